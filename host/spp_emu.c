@@ -0,0 +1,756 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP接続の模擬(ホスト側、spp_emu.h を参照)
+//     模擬は1つのタスク(Bluedroid の BTC タスクに相当)で行い、コールバックもこのタスクから呼ぶ
+//     esp_spp_* の要求はキューに入れて模擬タスクを起こし、結果はイベントで通知する
+//     スケジューラは1度に1つのタスクだけを実行するので、fd の読み書きと模擬タスクの間の排他は要らない
+//     セキュリティ(sec_mask)は扱わない(接続先はペアリング済みとみなす)
+//     クライアント接続(esp_spp_start_discovery/esp_spp_connect)は模擬しない(host_esp.c の weak のまま)
+
+#include <math.h>
+#include "esp_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_emu.h"
+
+#define TAG                 __func__
+
+#define EMU_WAIT_MAX_US     100000          // 何もなくても確認する周期
+#define EMU_REQ_MAX         8
+#define EMU_NAME_MAX        32
+
+// 乱数の系列(方向ごとの系列は + 方向)
+#define RNG_LOSS            0
+#define RNG_JITTER          2
+#define RNG_STALL           4
+#define RNG_DISC            5
+
+// esp_spp_* の要求
+#define REQ_INIT            0
+#define REQ_START_SRV       1
+#define REQ_STOP_SRV        2
+#define REQ_DISCONNECT      3
+#define REQ_PEER_CLOSE      4           // 接続先からの切断
+
+struct _emu_req {
+    uint8_t         type;
+    uint8_t         sec_id;
+    uint32_t        handle;
+    char            name[EMU_NAME_MAX];
+};
+
+// 開始したサーバ
+struct _emu_srv {
+    char            name[EMU_NAME_MAX];
+    uint32_t        listen_handle;
+    uint8_t         scn;
+};
+
+// パケット
+struct _emu_pkt {
+    uint64_t        write_us;               // 書き込まれた時刻
+    uint64_t        due_us;                 // 受信側に届く時刻(0:まだ送信していない)
+    uint16_t        len;
+    uint8_t         data[SPP_EMU_MTU];
+};
+
+// 方向ごと
+struct _emu_dir {
+    struct _emu_pkt         q[SPP_EMU_QUEUE];
+    uint32_t                head;
+    uint32_t                num;            // キューのパケット数(送信中を含む)
+    uint32_t                sent;           // 先頭から送信済み(due_us 設定済み)のパケット数
+    uint8_t                 rx[SPP_EMU_RX_BUF];     // 受信側のバッファ
+    uint32_t                rx_head;
+    uint32_t                rx_len;
+    bool                    blocked;        // 受信側のバッファに空きがなく届けられない
+    uint64_t                pos;            // 次に送信するパケットの先頭の位置(接続からの送信バイト数、乱数のキー)
+    uint64_t                link_free_us;   // 送信中のパケットが終わる時刻
+    uint64_t                last_due_us;    // 順序を保つため、前のパケットより先には届けない
+    struct _spp_emu_stat    stat;
+};
+
+// 接続の片側の fd(0:デバイス  1:接続先)
+struct _emu_end {
+    struct _spp_emu*        emu;
+    int                     side;
+    uint32_t                handle;         // この fd の接続
+    int                     fd;
+};
+
+struct _spp_emu {
+    struct _spp_emu_conf    conf;
+    TaskHandle_t            task;
+    bool                    quit;
+    bool                    done;
+    struct _emu_req         req[EMU_REQ_MAX];
+    uint32_t                req_head;
+    uint32_t                req_num;
+    struct _emu_srv         srv[SPP_EMU_SRV_MAX];
+    int                     srv_num;
+    uint32_t                handle_seq;
+    bool                    up;
+    uint32_t                handle;         // 接続中のハンドル(接続を受け付けた listen handle)
+    struct _emu_end         end[2][2];      // [接続の世代][side] 切断した接続の fd は次の次の接続まで残す
+    int                     gen;
+    int                     peer_fd;        // spp_emu_peer_accept() で渡す接続先側の fd
+    uint8_t                 peer_sig;       // 接続先側の待ちの通知先
+    uint64_t                start_us;
+    int                     disc_next;      // 次の disc_at_ms の添字
+    uint64_t                disc_rand_us;   // 次のランダムな切断(0:なし)
+    bool                    want_conn;      // 接続先が接続しようとしている
+    uint64_t                reconnect_us;   // 接続する時刻
+    bool                    stalled;
+    uint64_t                stall_at_us;    // 次の停止
+    uint64_t                stall_end_us;
+    struct _emu_dir         dir[2];         // 0:デバイス → 接続先  1:接続先 → デバイス
+    struct _spp_emu_count   count;
+};
+
+static esp_err_t emu_request_post(struct _spp_emu* emu, const struct _emu_req* req);
+
+static struct _spp_emu*     emu_active;     // esp_spp_* の対象
+static esp_spp_cb_t*        emu_cb;
+static const esp_bd_addr_t  emu_peer_bda = { 0x24, 0x0a, 0xc4, 0xee, 0x00, 0x01 };
+
+
+// ================================================================================================
+// 乱数(seed、系列、位置 から splitmix64 の混合で作る、呼ぶ順序によらない)
+// ================================================================================================
+static uint64_t rng_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_unit(const struct _spp_emu* emu, uint32_t stream, uint64_t pos, uint32_t n)
+{
+    uint64_t z = rng_mix(emu->conf.seed + (stream + 1) * 0x9e3779b97f4a7c15ULL);
+
+    z = rng_mix(z ^ pos);
+    z = rng_mix(z + n * 0x9e3779b97f4a7c15ULL);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// 平均 mean_us の指数分布(系列の n 番目)
+static uint64_t rng_exp(const struct _spp_emu* emu, uint32_t stream, uint64_t n, uint64_t mean_us)
+{
+    return (uint64_t)(-log(1.0 - rng_unit(emu, stream, n, 0)) * mean_us) + 1;
+}
+
+// ================================================================================================
+// 既定値(遅延もゆらぎもないリンク)
+// ================================================================================================
+void spp_emu_conf_default(struct _spp_emu_conf* conf)
+{
+    memset(conf, 0, sizeof(*conf));
+    conf->retx_us   = 1250;                 // 2スロット
+    conf->seed      = 1;
+}
+
+// ================================================================================================
+// イベントの通知(登録されたコールバックをこのタスクから呼ぶ)
+// ================================================================================================
+static void emu_post(esp_spp_cb_event_t event, esp_spp_cb_param_t* param)
+{
+    if (emu_cb != NULL) {
+        emu_cb(event, param);
+    }
+}
+
+// ================================================================================================
+// fd の読み書き(VFS と同じく、データなし/書き込めないときは0、切断後は-1)
+// ================================================================================================
+static bool emu_end_up(const struct _emu_end* end)
+{
+    return end->emu->up && end->handle == end->emu->handle;
+}
+
+static int emu_vfs_read(void* ctx, int fd, void* buf, size_t len)
+{
+    struct _emu_end*    end = ctx;
+    struct _spp_emu*    emu = end->emu;
+    struct _emu_dir*    dir = &emu->dir[1 - end->side];
+    size_t              n = 0;
+
+    if (!emu_end_up(end)) {
+        return -1;
+    }
+    while (n < len && dir->rx_len > 0) {
+        size_t chunk = SPP_EMU_RX_BUF - dir->rx_head;
+        if (chunk > dir->rx_len) {
+            chunk = dir->rx_len;
+        }
+        if (chunk > len - n) {
+            chunk = len - n;
+        }
+        memcpy((uint8_t*)buf + n, &dir->rx[dir->rx_head], chunk);
+        dir->rx_head    = (dir->rx_head + chunk) % SPP_EMU_RX_BUF;
+        dir->rx_len     -= chunk;
+        n               += chunk;
+    }
+    if (n > 0 && dir->blocked) {
+        // 空いたので届けられる(クレジットを返す)
+        host_wake(emu);
+    }
+    return n;
+}
+
+static int emu_vfs_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    struct _emu_end*    end = ctx;
+    struct _spp_emu*    emu = end->emu;
+    struct _emu_dir*    dir = &emu->dir[end->side];
+    size_t              n = 0;
+
+    if (!emu_end_up(end)) {
+        return -1;
+    }
+    while (n < len && dir->num < SPP_EMU_QUEUE) {
+        struct _emu_pkt*    pkt = &dir->q[(dir->head + dir->num) % SPP_EMU_QUEUE];
+        size_t              chunk = (len - n < SPP_EMU_MTU) ? len - n : SPP_EMU_MTU;
+
+        memcpy(pkt->data, (const uint8_t*)buf + n, chunk);
+        pkt->write_us   = host_now_us();
+        pkt->due_us     = 0;
+        pkt->len        = chunk;
+        dir->num++;
+        n += chunk;
+    }
+    if (n > 0) {
+        host_wake(emu);
+    }
+    return n;
+}
+
+static const struct _host_vfs_ops emu_vfs_ops = {
+    .read   = emu_vfs_read,
+    .write  = emu_vfs_write,
+};
+
+// ================================================================================================
+// 接続先が接続するサーバ
+// ================================================================================================
+static struct _emu_srv* emu_target(struct _spp_emu* emu)
+{
+    for (int i = 0; i < emu->srv_num; i++) {
+        if (emu->conf.server == NULL || strcmp(emu->srv[i].name, emu->conf.server) == 0) {
+            return &emu->srv[i];
+        }
+    }
+    return NULL;
+}
+
+// ================================================================================================
+// 接続(ESP_SPP_SRV_OPEN_EVT : handle は接続を受け付けた listen handle、以降の接続待ちは new_listen_handle)
+// ================================================================================================
+static void emu_connect(struct _spp_emu* emu, uint64_t now)
+{
+    struct _emu_srv*    srv = emu_target(emu);
+    esp_spp_cb_param_t  param;
+
+    if (srv == NULL) {
+        return;
+    }
+    // 前の前の接続の fd を解放する(切断後もしばらく読み書きされるので、番号をすぐには再利用させない)
+    emu->gen ^= 1;
+    for (int s = 0; s < 2; s++) {
+        struct _emu_end* end = &emu->end[emu->gen][s];
+        if (end->emu != NULL) {
+            host_vfs_close(end->fd);
+        }
+        end->emu    = emu;
+        end->side   = s;
+        end->handle = srv->listen_handle;
+        end->fd     = host_vfs_open(&emu_vfs_ops, end);
+        if (end->fd < 0) {
+            host_abort("spp_emu: no vfs fd");
+        }
+    }
+    for (int d = 0; d < 2; d++) {
+        struct _emu_dir* dir = &emu->dir[d];
+        dir->head           = 0;
+        dir->num            = 0;
+        dir->sent           = 0;
+        dir->rx_head        = 0;
+        dir->rx_len         = 0;
+        dir->blocked        = false;
+        dir->pos            = 0;
+        dir->link_free_us   = now;
+        dir->last_due_us    = now;
+    }
+    emu->up             = true;
+    emu->handle         = srv->listen_handle;
+    srv->listen_handle  = ++emu->handle_seq;
+    emu->disc_rand_us   = (emu->conf.disc_mean_ms > 0) ? now + rng_exp(emu, RNG_DISC, emu->count.opens, emu->conf.disc_mean_ms * 1000ULL) : 0;
+    emu->want_conn      = false;
+    emu->count.opens++;
+    emu->peer_fd        = emu->end[emu->gen][1].fd;
+    host_wake(&emu->peer_sig);
+    ESP_LOGD(TAG, "open : handle = %d  fd = %d  peer fd = %d", emu->handle, emu->end[emu->gen][0].fd, emu->peer_fd);
+
+    memset(&param, 0, sizeof(param));
+    param.srv_open.status               = ESP_SPP_SUCCESS;
+    param.srv_open.handle               = emu->handle;
+    param.srv_open.new_listen_handle    = srv->listen_handle;
+    param.srv_open.fd                   = emu->end[emu->gen][0].fd;
+    memcpy(param.srv_open.rem_bda, emu_peer_bda, sizeof(esp_bd_addr_t));
+    emu_post(ESP_SPP_SRV_OPEN_EVT, &param);
+}
+
+// ================================================================================================
+// 切断(ESP_SPP_CLOSE_EVT、送信中と受信側のバッファのデータは失われる)
+//     local : デバイスからの切断(esp_spp_disconnect)
+// ================================================================================================
+static void emu_close(struct _spp_emu* emu, uint64_t now, bool local)
+{
+    esp_spp_cb_param_t  param;
+
+    if (!emu->up) {
+        return;
+    }
+    emu->up = false;
+    for (int d = 0; d < 2; d++) {
+        emu->dir[d].stat.dropped += emu->dir[d].num;
+        emu->dir[d].num     = 0;
+        emu->dir[d].sent    = 0;
+        emu->dir[d].rx_len  = 0;
+    }
+    emu->count.closes++;
+    emu->count.local_closes += local;
+    emu->want_conn      = (emu->conf.reconnect_ms > 0 && !emu->quit);
+    emu->reconnect_us   = now + emu->conf.reconnect_ms * 1000ULL;
+    emu->peer_fd        = -1;
+    host_wake(&emu->peer_sig);
+    ESP_LOGD(TAG, "close : handle = %d  %s", emu->handle, local ? "local" : "remote");
+
+    memset(&param, 0, sizeof(param));
+    param.close.status      = ESP_SPP_SUCCESS;
+    param.close.handle      = emu->handle;
+    param.close.async       = !local;
+    emu_post(ESP_SPP_CLOSE_EVT, &param);
+}
+
+// ================================================================================================
+// 輻輳による停止の開始/終了(停止の時刻は接続の有無と通信量によらない)
+// ================================================================================================
+static void emu_stall(struct _spp_emu* emu, uint64_t now)
+{
+    esp_spp_cb_param_t  param;
+
+    if (emu->conf.stall_mean_ms == 0) {
+        return;
+    }
+    memset(&param, 0, sizeof(param));
+    param.cong.status   = ESP_SPP_SUCCESS;
+    param.cong.handle   = emu->handle;
+    if (!emu->stalled && now >= emu->stall_at_us) {
+        emu->stalled        = true;
+        emu->stall_end_us   = emu->stall_at_us + emu->conf.stall_ms * 1000ULL;
+        emu->count.stalls++;
+        param.cong.cong = true;
+    }
+    else if (emu->stalled && now >= emu->stall_end_us) {
+        emu->stalled        = false;
+        emu->stall_at_us    = emu->stall_end_us + rng_exp(emu, RNG_STALL, emu->count.stalls, emu->conf.stall_mean_ms * 1000ULL);
+        for (int d = 0; d < 2; d++) {
+            if (emu->dir[d].link_free_us < now) {
+                emu->dir[d].link_free_us = now;
+            }
+        }
+        param.cong.cong = false;
+    }
+    else {
+        return;
+    }
+    if (emu->up) {
+        emu_post(ESP_SPP_CONG_EVT, &param);
+    }
+}
+
+// ================================================================================================
+// 送信(リンクが空いていれば、キューの先頭から順に届く時刻を決める)
+//     損失とゆらぎはパケットの先頭の位置と再送回数で決まる
+// ================================================================================================
+static void emu_transmit(struct _spp_emu* emu, int d, uint64_t now)
+{
+    const struct _spp_emu_conf* conf = &emu->conf;
+    struct _emu_dir*            dir = &emu->dir[d];
+
+    while (!emu->stalled && dir->sent < dir->num && dir->link_free_us <= now) {
+        struct _emu_pkt*    pkt = &dir->q[(dir->head + dir->sent) % SPP_EMU_QUEUE];
+        uint64_t            start = (pkt->write_us > dir->link_free_us) ? pkt->write_us : dir->link_free_us;
+        uint64_t            air = (conf->rate_bps > 0) ? (uint64_t)pkt->len * 8 * 1000000 / conf->rate_bps : 0;
+        uint64_t            busy = air;
+        uint32_t            retrans = 0;
+        int64_t             delay = conf->latency_us;
+
+        // 失敗したら再送(リンクを占有したまま)
+        while (conf->loss > 0 && rng_unit(emu, RNG_LOSS + d, dir->pos, retrans) < conf->loss) {
+            busy += air + conf->retx_us;
+            retrans++;
+        }
+        if (conf->jitter_us > 0) {
+            delay += (int64_t)((rng_unit(emu, RNG_JITTER + d, dir->pos, 0) * 2.0 - 1.0) * conf->jitter_us);
+        }
+        dir->pos            += pkt->len;
+        dir->link_free_us   = start + busy;
+        pkt->due_us         = dir->link_free_us + ((delay > 0) ? delay : 0);
+        if (pkt->due_us < dir->last_due_us) {
+            pkt->due_us = dir->last_due_us;
+        }
+        dir->last_due_us    = pkt->due_us;
+        dir->sent++;
+        dir->stat.packets++;
+        dir->stat.retrans   += retrans;
+    }
+}
+
+// ================================================================================================
+// 受信側のバッファへ(届く時刻になったパケット、空きがなければクレジットが尽きた状態で待つ)
+// ================================================================================================
+static void emu_deliver(struct _spp_emu* emu, int d, uint64_t now)
+{
+    struct _emu_dir*    dir = &emu->dir[d];
+    bool                moved = false;
+
+    while (dir->sent > 0 && dir->q[dir->head].due_us <= now) {
+        struct _emu_pkt*    pkt = &dir->q[dir->head];
+        uint32_t            tail = (dir->rx_head + dir->rx_len) % SPP_EMU_RX_BUF;
+        uint32_t            first = SPP_EMU_RX_BUF - tail;
+
+        if (pkt->len > SPP_EMU_RX_BUF - dir->rx_len) {
+            if (!dir->blocked) {
+                dir->blocked = true;
+                dir->stat.blocked++;
+            }
+            break;
+        }
+        dir->blocked = false;
+        if (first >= pkt->len) {
+            memcpy(&dir->rx[tail], pkt->data, pkt->len);
+        }
+        else {
+            memcpy(&dir->rx[tail], pkt->data, first);
+            memcpy(dir->rx, &pkt->data[first], pkt->len - first);
+        }
+        dir->rx_len += pkt->len;
+        dir->stat.bytes += pkt->len;
+        if (now - pkt->write_us > dir->stat.max_delay_us) {
+            dir->stat.max_delay_us = now - pkt->write_us;
+        }
+        dir->head = (dir->head + 1) % SPP_EMU_QUEUE;
+        dir->num--;
+        dir->sent--;
+        moved = true;
+    }
+    if (moved) {
+        // 接続先側 : 受信データが届いた、または送信キューが空いた
+        host_wake(&emu->peer_sig);
+    }
+}
+
+// ================================================================================================
+// esp_spp_* の要求の処理
+// ================================================================================================
+static void emu_request(struct _spp_emu* emu, uint64_t now)
+{
+    while (emu->req_num > 0) {
+        struct _emu_req     req = emu->req[emu->req_head];
+        esp_spp_cb_param_t  param;
+
+        emu->req_head = (emu->req_head + 1) % EMU_REQ_MAX;
+        emu->req_num--;
+        memset(&param, 0, sizeof(param));
+        switch (req.type) {
+          case REQ_INIT :
+            param.init.status = ESP_SPP_SUCCESS;
+            emu_post(ESP_SPP_INIT_EVT, &param);
+            break;
+          case REQ_START_SRV :
+            if (emu->srv_num < SPP_EMU_SRV_MAX) {
+                struct _emu_srv* srv = &emu->srv[emu->srv_num++];
+                memcpy(srv->name, req.name, sizeof(srv->name));
+                srv->listen_handle  = ++emu->handle_seq;
+                srv->scn            = emu->srv_num;
+                param.start.status  = ESP_SPP_SUCCESS;
+                param.start.handle  = srv->listen_handle;
+                param.start.scn     = srv->scn;
+            }
+            else {
+                param.start.status  = ESP_SPP_NO_RESOURCE;
+            }
+            param.start.sec_id = req.sec_id;
+            emu_post(ESP_SPP_START_EVT, &param);
+            break;
+          case REQ_STOP_SRV :
+            emu_close(emu, now, true);
+            emu->srv_num = 0;
+            param.srv_stop.status = ESP_SPP_SUCCESS;
+            emu_post(ESP_SPP_SRV_STOP_EVT, &param);
+            break;
+          case REQ_DISCONNECT :
+            if (emu->up && req.handle == emu->handle) {
+                emu_close(emu, now, true);
+            }
+            break;
+          case REQ_PEER_CLOSE :
+            emu_close(emu, now, false);
+            break;
+        }
+    }
+}
+
+// ================================================================================================
+// 次に確認が必要な時刻
+// ================================================================================================
+static uint64_t emu_next(struct _spp_emu* emu, uint64_t now)
+{
+    uint64_t next = now + EMU_WAIT_MAX_US;
+
+#define EMU_NEXT(t)     do { if ((t) > now && (t) < next) next = (t); } while (0)
+    if (emu->conf.stall_mean_ms > 0) {
+        EMU_NEXT(emu->stalled ? emu->stall_end_us : emu->stall_at_us);
+    }
+    if (!emu->up) {
+        if (emu->want_conn) {
+            EMU_NEXT(emu->reconnect_us);
+        }
+        return next;
+    }
+    if (emu->disc_rand_us != 0) {
+        EMU_NEXT(emu->disc_rand_us);
+    }
+    if (emu->disc_next < SPP_EMU_DISC_MAX && emu->conf.disc_at_ms[emu->disc_next] != 0) {
+        EMU_NEXT(emu->start_us + emu->conf.disc_at_ms[emu->disc_next] * 1000ULL);
+    }
+    for (int d = 0; d < 2; d++) {
+        struct _emu_dir* dir = &emu->dir[d];
+        if (!emu->stalled && dir->sent < dir->num) {
+            EMU_NEXT(dir->link_free_us);
+        }
+        if (dir->sent > 0 && !dir->blocked) {
+            EMU_NEXT(dir->q[dir->head].due_us);
+        }
+    }
+#undef EMU_NEXT
+    return next;
+}
+
+// ================================================================================================
+// 模擬タスク
+// ================================================================================================
+static void emu_task(void* param)
+{
+    struct _spp_emu*    emu = param;
+    uint64_t            now = host_now_us();
+
+    emu->start_us   = now;
+    emu->want_conn  = true;
+    emu->reconnect_us = now;
+    if (emu->conf.stall_mean_ms > 0) {
+        emu->stall_at_us = now + rng_exp(emu, RNG_STALL, 0, emu->conf.stall_mean_ms * 1000ULL);
+    }
+
+    while (!emu->quit) {
+        now = host_now_us();
+        emu_request(emu, now);
+        // 切断していた間に過ぎた時刻の指定は飛ばす
+        while (!emu->up && emu->disc_next < SPP_EMU_DISC_MAX && emu->conf.disc_at_ms[emu->disc_next] != 0
+                && now >= emu->start_us + emu->conf.disc_at_ms[emu->disc_next] * 1000ULL) {
+            emu->disc_next++;
+        }
+        if (!emu->up) {
+            if (emu->want_conn && now >= emu->reconnect_us) {
+                emu_connect(emu, now);
+            }
+        }
+        else if (emu->disc_rand_us != 0 && now >= emu->disc_rand_us) {
+            // ランダムな切断
+            emu_close(emu, now, false);
+        }
+        else if (emu->disc_next < SPP_EMU_DISC_MAX && emu->conf.disc_at_ms[emu->disc_next] != 0
+                && now >= emu->start_us + emu->conf.disc_at_ms[emu->disc_next] * 1000ULL) {
+            // 時刻の指定による切断
+            emu->disc_next++;
+            emu_close(emu, now, false);
+        }
+        emu_stall(emu, now);
+        for (int d = 0; d < 2 && emu->up; d++) {
+            emu_transmit(emu, d, now);
+            emu_deliver(emu, d, now);
+        }
+        host_wait_us(emu, emu_next(emu, now));
+    }
+    emu_close(emu, host_now_us(), false);
+    emu->done = true;
+    host_wake(&emu->done);
+    vTaskDelete(NULL);
+}
+
+// ================================================================================================
+// 開始(spp_init() より前に呼ぶ、esp_spp_* はこの模擬に対して行う)
+// ================================================================================================
+struct _spp_emu* spp_emu_start(const struct _spp_emu_conf* conf)
+{
+    struct _spp_emu*    emu;
+
+    if (emu_active != NULL) {
+        return NULL;
+    }
+    if ((emu = calloc(1, sizeof(*emu))) == NULL) {
+        return NULL;
+    }
+    emu->conf       = *conf;
+    emu->peer_fd    = -1;
+    if (emu->conf.loss >= 1.0) {
+        emu->conf.loss = 0.99;
+    }
+    if (xTaskCreate(emu_task, "spp_emu", 4096, emu, SPP_EMU_PRIO, &emu->task) != pdPASS) {
+        free(emu);
+        return NULL;
+    }
+    emu_active = emu;
+    return emu;
+}
+
+// ================================================================================================
+// 終了(接続中なら ESP_SPP_CLOSE_EVT を通知してから終わる)
+// ================================================================================================
+void spp_emu_stop(struct _spp_emu* emu)
+{
+    emu->quit = true;
+    host_wake(emu);
+    while (!emu->done) {
+        host_wait_us(&emu->done, host_now_us() + EMU_WAIT_MAX_US);
+    }
+    for (int g = 0; g < 2; g++) {
+        for (int s = 0; s < 2; s++) {
+            if (emu->end[g][s].emu != NULL) {
+                host_vfs_close(emu->end[g][s].fd);
+            }
+        }
+    }
+    emu_active = NULL;
+    free(emu);
+}
+
+// ================================================================================================
+// 接続先側 : 次の接続を待ち、接続先側の fd を返す(-1:wait_ms 以内に接続されなかった)
+//     fd は close() せず、切断すると read()/write() が -1 になる
+// ================================================================================================
+int spp_emu_peer_accept(struct _spp_emu* emu, uint32_t wait_ms)
+{
+    uint64_t    until = host_now_us() + wait_ms * 1000ULL;
+    int         fd;
+
+    while (emu->peer_fd < 0) {
+        if (!host_wait_us(&emu->peer_sig, until) && host_now_us() >= until) {
+            return -1;
+        }
+    }
+    fd = emu->peer_fd;
+    emu->peer_fd = -1;
+    return fd;
+}
+
+// ================================================================================================
+// 接続先側 : データが届く、送信キューが空く、接続/切断のいずれかまたは until_us まで待つ
+// return   false: 時刻になった
+// ================================================================================================
+bool spp_emu_peer_wait(struct _spp_emu* emu, uint64_t until_us)
+{
+    return host_wait_us(&emu->peer_sig, until_us);
+}
+
+// ================================================================================================
+// 接続先からの切断
+// ================================================================================================
+void spp_emu_disconnect(struct _spp_emu* emu)
+{
+    struct _emu_req req = { .type = REQ_PEER_CLOSE };
+
+    emu_request_post(emu, &req);
+}
+
+// ================================================================================================
+// 統計
+// ================================================================================================
+void spp_emu_stat(struct _spp_emu* emu, struct _spp_emu_stat stat[2], struct _spp_emu_count* count)
+{
+    stat[0] = emu->dir[0].stat;
+    stat[1] = emu->dir[1].stat;
+    *count  = emu->count;
+}
+
+// ================================================================================================
+// esp_spp_*(要求をキューに入れて模擬タスクを起こす)
+// ================================================================================================
+static esp_err_t emu_request_post(struct _spp_emu* emu, const struct _emu_req* req)
+{
+    if (emu == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (emu->req_num >= EMU_REQ_MAX) {
+        return ESP_FAIL;
+    }
+    emu->req[(emu->req_head + emu->req_num) % EMU_REQ_MAX] = *req;
+    emu->req_num++;
+    host_wake(emu);
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_register_callback(esp_spp_cb_t* cb)
+{
+    emu_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_spp_init(esp_spp_mode_t mode)
+{
+    struct _emu_req req = { .type = REQ_INIT };
+
+    if (mode != ESP_SPP_MODE_VFS) {
+        // データは fd でだけ受け渡す
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return emu_request_post(emu_active, &req);
+}
+
+esp_err_t esp_spp_vfs_register(void)
+{
+    return (emu_active != NULL) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_spp_start_srv(esp_spp_sec_t sec, esp_spp_role_t role, uint8_t scn, const char* name)
+{
+    struct _emu_req req = { .type = REQ_START_SRV, .sec_id = (uint8_t)sec };
+
+    if (name == NULL || strlen(name) >= sizeof(req.name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(req.name, name);
+    return emu_request_post(emu_active, &req);
+}
+
+esp_err_t esp_spp_stop_srv(void)
+{
+    struct _emu_req req = { .type = REQ_STOP_SRV };
+
+    return emu_request_post(emu_active, &req);
+}
+
+esp_err_t esp_spp_disconnect(uint32_t handle)
+{
+    struct _emu_req req = { .type = REQ_DISCONNECT, .handle = handle };
+
+    return emu_request_post(emu_active, &req);
+}
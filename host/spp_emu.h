@@ -0,0 +1,72 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP接続の模擬(ホスト側、host/stubs の代用と一緒にリンクする)
+//     esp_spp_* を実装し(host_esp.c の weak を置き換える)、Bluedroid と同じく登録されたコールバックに
+//     esp_spp_cb_event_t / esp_spp_cb_param_t でイベントを通知する
+//     接続先(peer)は模擬の中にあり、conf.server の名前のサーバ(NULL:最初に開始したサーバ)に接続する
+//         デバイス側fd ─ [送信キュー → 帯域 → 再送 → 遅延/ゆらぎ → 受信バッファ] ─ 接続先fd (逆向きも同じ)
+//     両方のfdは host_vfs_open() で割り当て、VFS と同じくデータなしは0、切断後は-1を返す
+//     RFCOMM は失われたパケットを再送するので、損失は順序を保ったままの遅延として現れる
+//     送信キューがいっぱいになると書き込みが短くなる(VFSの短い write() と同じ)
+//     受信側のバッファに空きがなければ届けない(RFCOMM のクレジットによるフロー制御)
+//     輻輳による停止の間は両方向とも送信しない(ESP_SPP_CONG_EVT で通知する)
+//     切断はランダム(接続ごとの平均間隔)、開始からの時刻の指定、spp_emu_disconnect()(接続先から)、
+//     esp_spp_disconnect()(デバイスから)で起こり、reconnect_ms 後に次の listen handle に再接続する
+//     時刻は仮想時刻(host_now_us())で、乱数は seed とパケットの位置(方向ごとの送信バイト数と再送回数)
+//     または停止/切断の通し番号から作るので、同じ seed なら結果は毎回同じになる
+
+#define SPP_EMU_MTU             990         // 1パケットの最大長(RFCOMMの最大フレーム長)
+#define SPP_EMU_QUEUE           16          // 方向ごとの送信キューのパケット数
+#define SPP_EMU_RX_BUF          1000        // 受信側のバッファ(VFS の受信リングバッファと同じ大きさ)
+#define SPP_EMU_SRV_MAX         16          // 開始できるサーバの数
+#define SPP_EMU_DISC_MAX        8           // 指定できる切断時刻の数
+#define SPP_EMU_PRIO            19          // 模擬タスクの優先度(Bluedroid の BTC タスクと同じ)
+
+struct _spp_emu_conf {
+    uint32_t        latency_us;                     // 片方向の遅延
+    uint32_t        jitter_us;                      // 遅延のゆらぎ(±、一様分布)
+    uint32_t        rate_bps;                       // 帯域(0:制限なし)
+    double          loss;                           // パケットの送信が失敗する確率(0.0～1.0未満)
+    uint32_t        retx_us;                        // 再送1回あたりの遅延
+    uint32_t        stall_mean_ms;                  // 輻輳による停止の平均間隔(0:なし)
+    uint32_t        stall_ms;                       // 停止時間
+    uint32_t        disc_mean_ms;                   // ランダムな切断の平均間隔(0:なし)
+    uint32_t        disc_at_ms[SPP_EMU_DISC_MAX];   // 切断する時刻(開始からの経過時間の昇順、0で終わり)
+    uint32_t        reconnect_ms;                   // 切断から再接続までの時間(0:再接続しない)
+    const char*     server;                         // 接続先が接続するサーバ名(NULL:最初に開始したサーバ)
+    uint64_t        seed;
+};
+
+// 方向ごとの統計(0:デバイス → 接続先  1:接続先 → デバイス)
+struct _spp_emu_stat {
+    uint64_t        bytes;
+    uint32_t        packets;
+    uint32_t        retrans;
+    uint32_t        dropped;                        // 切断で失われたパケット
+    uint32_t        blocked;                        // 受信側のバッファに空きがなく届けられなかった回数
+    uint32_t        max_delay_us;                   // 書き込みから受信側に届くまでの最大
+};
+
+struct _spp_emu_count {
+    uint32_t        opens;                          // ESP_SPP_SRV_OPEN_EVT
+    uint32_t        closes;                         // ESP_SPP_CLOSE_EVT
+    uint32_t        stalls;                         // ESP_SPP_CONG_EVT(cong = true)
+    uint32_t        local_closes;                   // esp_spp_disconnect() による切断
+};
+
+struct _spp_emu;
+
+// extern宣言
+extern void spp_emu_conf_default(struct _spp_emu_conf* conf);
+extern struct _spp_emu* spp_emu_start(const struct _spp_emu_conf* conf);
+extern void spp_emu_stop(struct _spp_emu* emu);
+extern int spp_emu_peer_accept(struct _spp_emu* emu, uint32_t wait_ms);
+extern bool spp_emu_peer_wait(struct _spp_emu* emu, uint64_t until_us);
+extern void spp_emu_disconnect(struct _spp_emu* emu);
+extern void spp_emu_stat(struct _spp_emu* emu, struct _spp_emu_stat stat[2], struct _spp_emu_count* count);
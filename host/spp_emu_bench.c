@@ -0,0 +1,311 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 模擬したSPP接続(spp_emu.c)でのエコーバックの計測(ホスト側)
+//     デバイス側 : 実機と同じく spp_init() で初期化し、模擬が通知する ESP_SPP_*_EVT を esp_spp_cb() で処理する
+//                  (サーバの開始、接続ごとの spp_data_task と処理パイプライン、切断と再接続、バッファプールのフロー制御)
+//     接続先側   : SPP_SERVER_NAME のサーバ(エコーバック)に接続し、未確認のデータが window バイトになるまで
+//                  ブロックを送り続け、戻ってきたデータで往復時間を測る
+//                  1秒間戻ってこないデータは失われたとみなす、切断されたら再接続を待って続ける
+//     ホストの試験と同じく host/stubs の代用で src/*.c をリンクし、時刻は仮想時刻で進める
+//     (同じパラメータと seed なら結果は毎回同じになる)
+//     ビルド : make -C host build/spp_emu_bench
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "esp_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_test.h"
+#include "spp_init.h"
+#include "spp_user_hdr.h"
+#include "spp_task.h"
+#include "spp_metrics.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_hub.h"
+#include "spp_connlat.h"
+#include "spp_link.h"
+#include "spp_emu.h"
+
+#define BENCH_BLOCK_MAX     4096
+#define BENCH_RTT_MAX       65536           // 記録する往復時間の数
+#define BENCH_LOST_US       1000000         // 戻ってこないデータを失われたとみなすまでの時間
+#define BENCH_ACCEPT_MS     1000            // 接続を待つ単位
+
+// 接続先側の送信記録(往復時間の計測用)
+struct _bench_mark {
+    uint64_t        end;                    // このブロックの終わりの送信オフセット
+    uint64_t        us;
+};
+
+static struct _bench_mark   marks[BENCH_RTT_MAX];
+static uint32_t             mark_head, mark_num;
+static uint32_t             rtt[BENCH_RTT_MAX];
+static uint32_t             rtt_num;
+
+
+// ================================================================================================
+// 往復時間の集計
+// ================================================================================================
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void rtt_show(void)
+{
+    uint64_t sum = 0;
+
+    if (rtt_num == 0) {
+        printf("rtt : -\n");
+        return;
+    }
+    qsort(rtt, rtt_num, sizeof(rtt[0]), cmp_u32);
+    for (uint32_t i = 0; i < rtt_num; i++) {
+        sum += rtt[i];
+    }
+    printf("rtt (ms) : min %.1f  avg %.1f  p50 %.1f  p99 %.1f  max %.1f  (%u samples)\n",
+            rtt[0] / 1000.0, sum / rtt_num / 1000.0, rtt[rtt_num / 2] / 1000.0,
+            rtt[(uint64_t)rtt_num * 99 / 100] / 1000.0, rtt[rtt_num - 1] / 1000.0, rtt_num);
+}
+
+// ================================================================================================
+// 接続先側(1接続分)
+// return   切断された
+// ================================================================================================
+static bool peer_session(struct _spp_emu* emu, int fd, uint64_t end_us, uint32_t block, uint32_t window,
+        uint64_t* sent_total, uint64_t* echoed_total, uint64_t* lost_total)
+{
+    static uint8_t  tx[BENCH_BLOCK_MAX], rx[BENCH_BLOCK_MAX];
+    uint64_t        sent = 0, echoed = 0, progress_us = host_now_us();
+    bool            closed = false;
+
+    for (uint32_t i = 0; i < block; i++) {
+        tx[i] = (uint8_t)('0' + i % 64);
+    }
+    mark_head   = 0;
+    mark_num    = 0;
+    while (!closed && host_now_us() < end_us) {
+        bool    can_send = (sent - echoed + block <= window && mark_num < BENCH_RTT_MAX);
+        bool    moved = false;
+        int     n;
+
+        if (can_send) {
+            n = write(fd, tx, block);
+            if (n < 0) {
+                closed = true;
+                break;
+            }
+            if (n > 0) {
+                sent += n;
+                marks[(mark_head + mark_num++) % BENCH_RTT_MAX] = (struct _bench_mark){ sent, host_now_us() };
+                moved = true;
+            }
+        }
+        n = read(fd, rx, sizeof(rx));
+        if (n < 0) {
+            closed = true;
+            break;
+        }
+        if (n > 0) {
+            uint64_t now = host_now_us();
+            echoed      += n;
+            progress_us = now;
+            moved       = true;
+            while (mark_num > 0 && marks[mark_head].end <= echoed) {
+                if (rtt_num < BENCH_RTT_MAX) {
+                    rtt[rtt_num++] = now - marks[mark_head].us;
+                }
+                mark_head = (mark_head + 1) % BENCH_RTT_MAX;
+                mark_num--;
+            }
+        }
+        // 戻ってこないデータは失われた(短い書き込みで捨てられた)とみなして数え直す
+        if (sent > echoed && host_now_us() - progress_us >= BENCH_LOST_US) {
+            *lost_total     += sent - echoed;
+            *sent_total     += sent;
+            *echoed_total   += echoed;
+            sent = echoed = 0;
+            mark_num    = 0;
+            progress_us = host_now_us();
+            continue;
+        }
+        if (!moved) {
+            uint64_t until = (sent > echoed && progress_us + BENCH_LOST_US < end_us) ? progress_us + BENCH_LOST_US : end_us;
+            spp_emu_peer_wait(emu, until);
+        }
+    }
+    *sent_total     += sent;
+    *echoed_total   += echoed;
+    if (closed) {
+        // 切断で失われた(時間切れのときは送信中のデータ)
+        *lost_total += sent - echoed;
+    }
+    return closed;
+}
+
+// ================================================================================================
+// デバイス側の初期化(app_main() のうちエコーバックのサーバに要るもの)
+// ================================================================================================
+static esp_err_t dev_init(void)
+{
+    esp_err_t   err;
+
+    if ((err = spp_task_init()) != ESP_OK
+            || (err = spp_metrics_init()) != ESP_OK
+            || (err = spp_hub_init()) != ESP_OK
+            || (err = spp_pipe_init()) != ESP_OK
+            || (err = spp_connlat_init()) != ESP_OK
+            || (err = spp_link_init()) != ESP_OK
+            || (err = spp_conn_init()) != ESP_OK) {
+        return err;
+    }
+    if ((err = spp_init(ESP_SPP_MODE_VFS)) != ESP_OK) {
+        return err;
+    }
+    // CLIENT モードでは起動時にサーバを開始しないので、コンソールの 'S' と同じく開始する
+    spp_server_start_all();
+    return ESP_OK;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage : %s [options]\n", prog);
+    fprintf(stderr, "    -l ms       : one-way latency\n");
+    fprintf(stderr, "    -j ms       : jitter (+/-)\n");
+    fprintf(stderr, "    -b kbps     : bandwidth (0 : unlimited)\n");
+    fprintf(stderr, "    -p loss     : packet loss probability (retransmitted)\n");
+    fprintf(stderr, "    -r ms       : delay per retransmission\n");
+    fprintf(stderr, "    -c mean:ms  : congestion stalls (mean interval : duration)\n");
+    fprintf(stderr, "    -d ms       : mean interval of random disconnects\n");
+    fprintf(stderr, "    -D t1,t2,.. : disconnect at ms after start\n");
+    fprintf(stderr, "    -R ms       : reconnect delay (0 : no reconnect)\n");
+    fprintf(stderr, "    -S seed     : random seed\n");
+    fprintf(stderr, "    -t sec      : duration (virtual time)\n");
+    fprintf(stderr, "    -n byte     : block size\n");
+    fprintf(stderr, "    -w byte     : window (unacknowledged bytes)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    struct _spp_emu_conf    conf;
+    struct _spp_emu*        emu;
+    struct _spp_emu_stat    st[2];
+    struct _spp_emu_count   cnt;
+    struct _spp_conn_stat   conn;
+    const struct _spp_server_stat* srv = &spp_servers[0].stat;
+    uint32_t                sec = 10, block = 256, window = 4096;
+    uint64_t                sent = 0, echoed = 0, lost = 0, outage_us = 0, close_us = 0;
+    uint64_t                start, end, elapsed;
+    uint32_t                outages = 0;
+    esp_err_t               err;
+    int                     opt;
+
+    spp_emu_conf_default(&conf);
+    conf.server = SPP_SERVER_NAME;
+    while ((opt = getopt(argc, argv, "l:j:b:p:r:c:d:D:R:S:t:n:w:h")) != -1) {
+        switch (opt) {
+          case 'l' : conf.latency_us    = atof(optarg) * 1000;              break;
+          case 'j' : conf.jitter_us     = atof(optarg) * 1000;              break;
+          case 'b' : conf.rate_bps      = atof(optarg) * 1000;              break;
+          case 'p' : conf.loss          = atof(optarg);                     break;
+          case 'r' : conf.retx_us       = atof(optarg) * 1000;              break;
+          case 'd' : conf.disc_mean_ms  = atoi(optarg);                     break;
+          case 'R' : conf.reconnect_ms  = atoi(optarg);                     break;
+          case 'S' : conf.seed          = strtoull(optarg, NULL, 0);        break;
+          case 't' : sec                = atoi(optarg);                     break;
+          case 'n' : block              = atoi(optarg);                     break;
+          case 'w' : window             = atoi(optarg);                     break;
+          case 'c' :
+            if (sscanf(optarg, "%u:%u", &conf.stall_mean_ms, &conf.stall_ms) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+          case 'D' :
+            {
+                char* p = optarg;
+                for (int i = 0; i < SPP_EMU_DISC_MAX && *p != '\0'; i++) {
+                    conf.disc_at_ms[i] = strtoul(p, &p, 10);
+                    if (*p == ',') {
+                        p++;
+                    }
+                }
+            }
+            break;
+          default :
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (block == 0 || block > BENCH_BLOCK_MAX || window < block) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    emu = spp_emu_start(&conf);
+    if (emu == NULL) {
+        fprintf(stderr, "spp_emu_start failed\n");
+        return 1;
+    }
+    if ((err = dev_init()) != ESP_OK) {
+        fprintf(stderr, "device init failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    start   = host_now_us();
+    end     = start + sec * 1000000ULL;
+    while (host_now_us() < end) {
+        uint32_t    wait_ms = (end - host_now_us() + 999) / 1000;
+        int         fd = spp_emu_peer_accept(emu, (wait_ms < BENCH_ACCEPT_MS) ? wait_ms : BENCH_ACCEPT_MS);
+
+        if (fd < 0) {
+            continue;
+        }
+        // 切断から再接続までの時間
+        if (close_us != 0) {
+            outage_us += host_now_us() - close_us;
+            outages++;
+        }
+        if (peer_session(emu, fd, end, block, window, &sent, &echoed, &lost)) {
+            close_us = host_now_us();
+        }
+    }
+    elapsed = host_now_us() - start;
+    spp_emu_stat(emu, st, &cnt);
+    spp_conn_get_stat(&conn);
+
+    printf("seed %llu  latency %.1f ms  jitter %.1f ms  rate %u bps  loss %.3f  %u s (virtual)\n",
+            (unsigned long long)conf.seed, conf.latency_us / 1000.0, conf.jitter_us / 1000.0, conf.rate_bps,
+            conf.loss, sec);
+    printf("sent %llu byte  echoed %llu byte  lost %llu byte  goodput %.1f kbyte/s\n",
+            (unsigned long long)sent, (unsigned long long)echoed, (unsigned long long)lost,
+            echoed * 1000.0 / elapsed);
+    rtt_show();
+    printf("events : open %u  close %u (local %u)  congestion %u", cnt.opens, cnt.closes, cnt.local_closes, cnt.stalls);
+    if (outages > 0) {
+        printf("  reconnect %.1f ms avg", outage_us / outages / 1000.0);
+    }
+    printf("\n");
+    printf("device : accepted %u  closed %u  active %u  released %u  buffers free %d / %d\n",
+            srv->accepted, srv->closed, srv->active, conn.released, spp_buf_free_num(), SPP_BUF_NUM);
+    for (int d = 0; d < 2; d++) {
+        printf("link %s : %llu byte  %u packets  retrans %u  dropped %u  blocked %u  max delay %.1f ms\n",
+                (d == 0) ? "dev->peer" : "peer->dev", (unsigned long long)st[d].bytes, st[d].packets,
+                st[d].retrans, st[d].dropped, st[d].blocked, st[d].max_delay_us / 1000.0);
+    }
+    spp_emu_stop(emu);
+    return 0;
+}
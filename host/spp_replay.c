@@ -0,0 +1,346 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// キャプチャ(src/spp_cap.c)の再生(ホスト側)
+//     デバイスの 'Y' キーで書き出したキャプチャを読み込み、記録時のタイミング(-s で速度の倍率)
+//     または最速(-f)で、レコードを順に消費側に渡す
+//     入力はバイナリ(SPP経由)またはUARTのログ("CAP:" で始まる行以外は読み飛ばす)
+//     ホストの試験と同じく host/stubs の代用で src/*.c をリンクし、時刻は仮想時刻で進める
+//     (記録時のタイミングで再生しても実時間は待たず、結果は毎回同じになる)
+//     消費側
+//         stat : レコード種別、イベントごとの数と、fd ごとの送受信バイト数
+//         pipe : 受信データを fd ごとに src/spp_pipe.c の処理パイプライン(-p で chain を指定)に通す
+//                echo の送信先は捨てて数えるだけ、処理時間はこのスレッドのCPU時間で計る
+//     ビルド : make -C host build/spp_replay
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_cap.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_hub.h"
+
+#define REPLAY_FD_MAX       16
+
+// 消費側
+struct _replay_ops {
+    const char*     name;
+    void            (*record)(uint64_t ts_us, const struct _spp_cap_rec* rec, const uint8_t* data);
+    void            (*show)(void);
+};
+
+static uint8_t*     cap_data;
+static size_t       cap_len;
+
+// ================================================================================================
+// 消費側の処理時間(このスレッドのCPU時間、仮想時刻は進まないので使わない)
+// ================================================================================================
+static uint64_t cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ================================================================================================
+// キャプチャの読み込み(バイナリ または "CAP:" の16進の行)
+// ================================================================================================
+static bool load(const char* path)
+{
+    FILE*   fp = fopen(path, "rb");
+    char    line[256];
+    size_t  size = 0;
+
+    if (fp == NULL) {
+        perror(path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    cap_data = malloc(size + 1);
+    if (cap_data == NULL) {
+        fclose(fp);
+        return false;
+    }
+    if (size >= sizeof(SPP_CAP_MAGIC) - 1 && fread(cap_data, 1, size, fp) == size
+            && memcmp(cap_data, SPP_CAP_MAGIC, sizeof(SPP_CAP_MAGIC) - 1) == 0) {
+        cap_len = size;
+        fclose(fp);
+        return true;
+    }
+    // UARTのログ
+    fseek(fp, 0, SEEK_SET);
+    cap_len = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* p = strstr(line, "CAP:");
+        if (p == NULL) {
+            continue;
+        }
+        for (p += 4; isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1]); p += 2) {
+            char hex[3] = { p[0], p[1], '\0' };
+            cap_data[cap_len++] = strtol(hex, NULL, 16);
+        }
+    }
+    fclose(fp);
+    if (cap_len < sizeof(struct _spp_cap_file_hdr) || memcmp(cap_data, SPP_CAP_MAGIC, sizeof(SPP_CAP_MAGIC) - 1) != 0) {
+        fprintf(stderr, "%s : not a capture\n", path);
+        return false;
+    }
+    return true;
+}
+
+// ================================================================================================
+// stat : レコードの集計
+// ================================================================================================
+static uint32_t     stat_num[CAP_TX + 1];
+static uint32_t     stat_event[CAP_SPP + 1][256];
+static uint64_t     stat_bytes[REPLAY_FD_MAX][2];       // [fd][0:rx 1:tx]
+static uint64_t     stat_snapped;                       // 記録されなかったデータ長
+
+static void stat_record(uint64_t ts_us, const struct _spp_cap_rec* rec, const uint8_t* data)
+{
+    if (rec->type > CAP_TX) {
+        return;
+    }
+    stat_num[rec->type]++;
+    if (rec->type == CAP_GAP || rec->type == CAP_SPP) {
+        stat_event[rec->type][rec->code]++;
+    }
+    else if (rec->arg >= 0 && rec->arg < REPLAY_FD_MAX) {
+        stat_bytes[rec->arg][rec->type == CAP_TX] += rec->orig_len;
+    }
+    stat_snapped += rec->orig_len - rec->len;
+}
+
+static void stat_show(void)
+{
+    static const char* const type_name[] = { "", "GAP", "SPP", "RX", "TX" };
+
+    for (int t = CAP_GAP; t <= CAP_TX; t++) {
+        printf("%-4s : %u\n", type_name[t], stat_num[t]);
+        if (t == CAP_GAP || t == CAP_SPP) {
+            for (int e = 0; e < 256; e++) {
+                if (stat_event[t][e] > 0) {
+                    printf("    event %3d : %u\n", e, stat_event[t][e]);
+                }
+            }
+        }
+    }
+    for (int fd = 0; fd < REPLAY_FD_MAX; fd++) {
+        if (stat_bytes[fd][0] > 0 || stat_bytes[fd][1] > 0) {
+            printf("fd %2d : rx %llu byte  tx %llu byte\n", fd,
+                    (unsigned long long)stat_bytes[fd][0], (unsigned long long)stat_bytes[fd][1]);
+        }
+    }
+    printf("not captured : %llu byte (SPP_CAP_SNAP = %d)\n", (unsigned long long)stat_snapped, SPP_CAP_SNAP);
+}
+
+// ================================================================================================
+// pipe : 受信データを fd ごとの処理パイプラインに通す(spp_data_task と同じく共通バッファに入れて渡す)
+// ================================================================================================
+struct _replay_conn {
+    struct _spp_pipe*   pipe;
+    int                 fd;             // echo の送信先(捨てて数える)
+    uint64_t            rx;
+    uint64_t            tx;
+};
+
+static struct _replay_conn  replay_conn[REPLAY_FD_MAX];
+static int                  replay_chain = PIPE_CHAIN_NMEA;
+static uint32_t             replay_no_buf;                  // バッファが足りずに捨てたレコード数
+
+static int sink_read(void* ctx, int fd, void* buf, size_t len)
+{
+    return 0;
+}
+
+static int sink_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    struct _replay_conn* c = ctx;
+    c->tx += len;
+    return len;
+}
+
+static const struct _host_vfs_ops sink_ops = {
+    .read   = sink_read,
+    .write  = sink_write,
+};
+
+static void pipe_record(uint64_t ts_us, const struct _spp_cap_rec* rec, const uint8_t* data)
+{
+    struct _replay_conn*    c;
+    struct _spp_buf*        buf;
+
+    if (rec->type != CAP_RX || rec->len == 0 || rec->arg < 0 || rec->arg >= REPLAY_FD_MAX) {
+        return;
+    }
+    c = &replay_conn[rec->arg];
+    if (c->pipe == NULL) {
+        c->fd   = host_vfs_open(&sink_ops, c);
+        c->pipe = spp_pipe_create(c->fd, -1, replay_chain);
+        if (c->pipe == NULL) {
+            return;
+        }
+    }
+    buf = spp_buf_alloc(0);
+    if (buf == NULL) {
+        replay_no_buf++;
+        return;
+    }
+    memcpy(buf->data, data, rec->len);
+    buf->off    = 0;
+    buf->len    = rec->len;
+    c->rx       += rec->len;
+    spp_pipe_push(c->pipe, buf);
+}
+
+static void pipe_show(void)
+{
+    for (int fd = 0; fd < REPLAY_FD_MAX; fd++) {
+        struct _replay_conn* c = &replay_conn[fd];
+        if (c->pipe != NULL) {
+            printf("fd %2d : rx %llu byte  echo %llu byte\n", fd, (unsigned long long)c->rx, (unsigned long long)c->tx);
+            spp_pipe_destroy(c->pipe);
+            host_vfs_close(c->fd);
+            c->pipe = NULL;
+        }
+    }
+    if (replay_no_buf > 0) {
+        printf("no buffer : %u records\n", replay_no_buf);
+    }
+    spp_pipe_show();
+}
+
+static const struct _replay_ops replay_ops[] = {
+    { "stat",   stat_record,    stat_show   },
+    { "pipe",   pipe_record,    pipe_show   },
+};
+
+// ================================================================================================
+// 再生
+//     speed : 記録時の時間の倍率(0:最速)
+// ================================================================================================
+static int replay(const struct _replay_ops* ops, double speed)
+{
+    struct _spp_cap_file_hdr    hdr;
+    struct _spp_cap_rec         rec;
+    size_t                      pos = sizeof(hdr);
+    uint64_t                    ts = 0, wrap = 0;
+    uint32_t                    prev = 0, num = 0;
+    uint64_t                    start, busy = 0;
+
+    memcpy(&hdr, cap_data, sizeof(hdr));
+    start = host_now_us();
+    while (pos + sizeof(rec) <= cap_len) {
+        memcpy(&rec, &cap_data[pos], sizeof(rec));
+        if (pos + sizeof(rec) + rec.len > cap_len) {
+            fprintf(stderr, "truncated record at %zu\n", pos);
+            break;
+        }
+        // ts_us の一周を補正する
+        if (num > 0 && rec.ts_us < prev) {
+            wrap += (uint64_t)1 << 32;
+        }
+        prev    = rec.ts_us;
+        ts      = wrap + rec.ts_us;
+        if (speed > 0) {
+            host_sleep_until_us(start + (uint64_t)(ts * speed));
+        }
+        uint64_t t0 = cpu_us();
+        ops->record(ts, &rec, &cap_data[pos + sizeof(rec)]);
+        busy += cpu_us() - t0;
+        pos += sizeof(rec) + rec.len;
+        num++;
+    }
+    uint64_t elapsed = host_now_us() - start;
+
+    printf("records : %u / %u  lost on device : %u\n", num, hdr.num, hdr.lost);
+    printf("captured : %llu ms  replayed : %llu ms  consumer : %llu us\n",
+            (unsigned long long)(ts / 1000), (unsigned long long)(elapsed / 1000), (unsigned long long)busy);
+    ops->show();
+    return (num == hdr.num) ? 0 : 1;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr, "usage : %s [-f | -s speed] [-c stat|pipe] [-p echo|upper|nmea] capture\n", prog);
+    fprintf(stderr, "    -f : as fast as possible\n");
+    fprintf(stderr, "    -s : time scale (1.0 : original timing, virtual time)\n");
+    fprintf(stderr, "    -c : consumer\n");
+    fprintf(stderr, "    -p : pipeline chain for the pipe consumer\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const struct _replay_ops*   ops = &replay_ops[0];
+    double                      speed = 1.0;
+    int                         opt;
+
+    static const char* const    chain_name[PIPE_CHAIN_NUM] = { "echo", "upper", "nmea" };
+
+    while ((opt = getopt(argc, argv, "fs:c:p:")) != -1) {
+        switch (opt) {
+          case 'f' :
+            speed = 0;
+            break;
+          case 's' :
+            speed = atof(optarg);
+            break;
+          case 'c' :
+            ops = NULL;
+            for (size_t i = 0; i < sizeof(replay_ops) / sizeof(replay_ops[0]); i++) {
+                if (strcmp(optarg, replay_ops[i].name) == 0) {
+                    ops = &replay_ops[i];
+                }
+            }
+            if (ops == NULL) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+          case 'p' :
+            replay_chain = -1;
+            for (int i = 0; i < PIPE_CHAIN_NUM; i++) {
+                if (strcmp(optarg, chain_name[i]) == 0) {
+                    replay_chain = i;
+                }
+            }
+            if (replay_chain < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+          default :
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!load(argv[optind])) {
+        return 2;
+    }
+    if (spp_pipe_init() != ESP_OK || spp_hub_init() != ESP_OK) {
+        return 2;
+    }
+    return replay(ops, speed);
+}
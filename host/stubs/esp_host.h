@@ -0,0 +1,488 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ESP-IDF/FreeRTOS の代用(ホスト側)
+//     src/*.c をそのままホスト(Linux)でコンパイルして試験するための宣言
+//     host/stubs の各ヘッダ(freertos/task.h など)はこのファイルを読み込むだけ
+//     実装
+//         host_rtos.c : FreeRTOS(仮想時刻で動く決定的なスケジューラ)
+//         host_esp.c  : esp_timer/パーティション/NVS/ヒープ/ログ/UART/read()・write() の差し替え
+//         spp_emu.c   : esp_spp_* と SPPのfd(リンクの模擬)
+//     スケジューラは1度に1つのタスクだけを実行する(優先度の高い順、同じ優先度は到着順)
+//     すべてのタスクが待ちになったら時刻を次の期限まで進めるので、実行結果は実時間によらない
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// ------------------------------------------------------------------------------------------------
+// sdkconfig(sdkconfig.esp32dev のうち src が参照するもの)
+// ------------------------------------------------------------------------------------------------
+#define CONFIG_FREERTOS_HZ                          100
+#define CONFIG_BT_SSP_ENABLED                       1
+#define CONFIG_BT_BLUEDROID_PINNED_TO_CORE          0
+#define CONFIG_BTDM_CTRL_PINNED_TO_CORE             0
+#define CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION   1
+#define CONFIG_FREERTOS_ENABLE_STATIC_TASK_CLEAN_UP 1
+
+// ------------------------------------------------------------------------------------------------
+// esp_err
+// ------------------------------------------------------------------------------------------------
+typedef int esp_err_t;
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NO_MEM                  0x101
+#define ESP_ERR_INVALID_ARG             0x102
+#define ESP_ERR_INVALID_STATE           0x103
+#define ESP_ERR_INVALID_SIZE            0x104
+#define ESP_ERR_NOT_FOUND               0x105
+#define ESP_ERR_NOT_SUPPORTED           0x106
+#define ESP_ERR_TIMEOUT                 0x107
+#define ESP_ERR_INVALID_CRC             0x109
+#define ESP_ERR_NVS_NO_FREE_PAGES       0x110d
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_NVS_NEW_VERSION_FOUND   0x1110
+#define ESP_ERROR_CHECK(x)              do { esp_err_t err_rc_ = (x); if (err_rc_ != ESP_OK) { \
+                                            host_abort("ESP_ERROR_CHECK failed: %s at %s:%d", esp_err_to_name(err_rc_), __FILE__, __LINE__); } } while (0)
+#define BIT0                            0x00000001
+#define BIT1                            0x00000002
+#define BIT2                            0x00000004
+#define BIT3                            0x00000008
+#define BIT4                            0x00000010
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+extern const char* esp_err_to_name(esp_err_t code);
+extern void esp_restart(void);                                      // 呼んだタスクを止めて host_restarted を設定する
+extern uint32_t esp_get_free_heap_size(void);
+extern volatile bool host_restarted;
+
+// read()/write() の差し替え(host_esp.c、リンク時に --wrap=read,--wrap=write)
+//     登録した fd だけを ops で処理し、それ以外(通常のファイル)はそのまま read()/write() を呼ぶ
+//     SPPのfd と同じく、ops はデータなし/送信できないときは0、切断後は-1を返す
+struct _host_vfs_ops {
+    int     (*read)(void* ctx, int fd, void* buf, size_t len);
+    int     (*write)(void* ctx, int fd, const void* buf, size_t len);
+};
+extern int host_vfs_open(const struct _host_vfs_ops* ops, void* ctx);   // fd を割り当てる
+extern void host_vfs_close(int fd);
+
+// ------------------------------------------------------------------------------------------------
+// FreeRTOS
+// ------------------------------------------------------------------------------------------------
+typedef int                 BaseType_t;
+typedef unsigned int        UBaseType_t;
+typedef uint32_t            TickType_t;
+typedef uint8_t             StackType_t;
+typedef void*               TaskHandle_t;
+typedef void*               QueueHandle_t;
+typedef void*               SemaphoreHandle_t;
+typedef void*               EventGroupHandle_t;
+typedef uint32_t            EventBits_t;
+typedef void                (*TaskFunction_t)(void*);
+typedef struct { _Alignas(16) uint8_t opaque[256]; } StaticTask_t;     // host_rtos.c の TCB が入る大きさ
+typedef struct { int owner; uint32_t count; } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { -1, 0 }
+#define pdPASS                          1
+#define pdFAIL                          0
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define errQUEUE_FULL                   0
+#define portMAX_DELAY                   ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS              (1000 / CONFIG_FREERTOS_HZ)
+#define portTICK_RATE_MS                portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)               ((TickType_t)((uint64_t)(ms) * CONFIG_FREERTOS_HZ / 1000))
+#define portNUM_PROCESSORS              2
+#define tskNO_AFFINITY                  0x7fffffff
+#define configMAX_PRIORITIES            25
+#define configMAX_TASK_NAME_LEN         16
+#define portENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define portEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define portENTER_CRITICAL_ISR(mux)     host_critical_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux)      host_critical_exit(mux)
+#define taskENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define taskEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define portYIELD()                     host_yield()
+#define taskYIELD()                     host_yield()
+
+typedef enum { eRunning = 0, eReady, eBlocked, eSuspended, eDeleted, eInvalid } eTaskState;
+typedef struct {
+    TaskHandle_t    xHandle;
+    const char*     pcTaskName;
+    UBaseType_t     xTaskNumber;
+    eTaskState      eCurrentState;
+    UBaseType_t     uxCurrentPriority;
+    UBaseType_t     uxBasePriority;
+    uint32_t        ulRunTimeCounter;
+    StackType_t*    pxStackBase;
+    uint32_t        usStackHighWaterMark;
+    BaseType_t      xCoreID;
+} TaskStatus_t;
+
+extern BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char* name, uint32_t stack, void* param,
+                                          UBaseType_t prio, TaskHandle_t* handle, BaseType_t core);
+extern TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t func, const char* name, uint32_t stack, void* param,
+                                                  UBaseType_t prio, StackType_t* stack_buf, StaticTask_t* tcb, BaseType_t core);
+#define xTaskCreate(func, name, stack, param, prio, handle) \
+                                        xTaskCreatePinnedToCore(func, name, stack, param, prio, handle, tskNO_AFFINITY)
+#define xTaskCreateStatic(func, name, stack, param, prio, stack_buf, tcb) \
+                                        xTaskCreateStaticPinnedToCore(func, name, stack, param, prio, stack_buf, tcb, tskNO_AFFINITY)
+extern void vTaskDelete(TaskHandle_t task);
+extern void vTaskSuspend(TaskHandle_t task);
+extern void vTaskResume(TaskHandle_t task);
+extern void vTaskDelay(TickType_t ticks);
+extern void vTaskDelayUntil(TickType_t* prev, TickType_t ticks);
+extern TickType_t xTaskGetTickCount(void);
+extern TaskHandle_t xTaskGetCurrentTaskHandle(void);
+extern TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+extern UBaseType_t uxTaskGetNumberOfTasks(void);
+extern UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+extern UBaseType_t uxTaskGetSystemState(TaskStatus_t* stat, UBaseType_t num, uint32_t* total);
+extern eTaskState eTaskGetState(TaskHandle_t task);
+extern char* pcTaskGetTaskName(TaskHandle_t task);
+extern void vTaskList(char* buf);
+extern void vTaskPrioritySet(TaskHandle_t task, UBaseType_t prio);
+extern UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+extern BaseType_t xPortGetCoreID(void);
+extern uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+extern BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+extern QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+extern void vQueueDelete(QueueHandle_t q);
+extern BaseType_t xQueueGenericSend(QueueHandle_t q, const void* item, TickType_t ticks, bool front);
+#define xQueueSend(q, item, ticks)          xQueueGenericSend(q, item, ticks, false)
+#define xQueueSendToBack(q, item, ticks)    xQueueGenericSend(q, item, ticks, false)
+#define xQueueSendToFront(q, item, ticks)   xQueueGenericSend(q, item, ticks, true)
+#define xQueueSendFromISR(q, item, woken)   xQueueGenericSend(q, item, 0, false)
+extern BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks);
+extern BaseType_t xQueuePeek(QueueHandle_t q, void* item, TickType_t ticks);
+extern BaseType_t xQueueReset(QueueHandle_t q);
+extern UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+extern UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q);
+
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+extern SemaphoreHandle_t xSemaphoreCreateBinary(void);
+extern SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t init);
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+extern void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+extern EventGroupHandle_t xEventGroupCreate(void);
+extern EventBits_t xEventGroupSetBits(EventGroupHandle_t eg, EventBits_t bits);
+extern EventBits_t xEventGroupClearBits(EventGroupHandle_t eg, EventBits_t bits);
+extern EventBits_t xEventGroupGetBits(EventGroupHandle_t eg);
+extern EventBits_t xEventGroupWaitBits(EventGroupHandle_t eg, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks);
+
+// ホスト側だけの関数(host_rtos.c)
+extern void host_critical_enter(portMUX_TYPE* mux);
+extern void host_critical_exit(portMUX_TYPE* mux);
+extern void host_yield(void);
+extern uint64_t host_now_us(void);
+extern bool host_wait_us(const void* obj, uint64_t until_us);     // obj の通知または時刻まで待つ(false:時刻になった)
+extern void host_wake(const void* obj);                            // obj を待っているタスクをすべて起こす
+extern void host_sleep_until_us(uint64_t until_us);
+extern void host_busy(void);                                        // 待たない API の呼び出し(呼び続けると時刻が進む)
+extern int host_task_count(void);
+extern void host_abort(const char* fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// ------------------------------------------------------------------------------------------------
+// esp_log
+// ------------------------------------------------------------------------------------------------
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE } esp_log_level_t;
+#define ESP_LOGE(tag, ...)              host_log(ESP_LOG_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...)              host_log(ESP_LOG_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...)              host_log(ESP_LOG_INFO, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...)              host_log(ESP_LOG_DEBUG, tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...)              host_log(ESP_LOG_VERBOSE, tag, __VA_ARGS__)
+extern void host_log(esp_log_level_t level, const char* tag, const char* fmt, ...);
+extern void esp_log_level_set(const char* tag, esp_log_level_t level);
+extern void esp_log_buffer_hex(const char* tag, const void* buf, uint16_t len);
+extern void esp_log_buffer_char(const char* tag, const void* buf, uint16_t len);
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buf, len, level)    esp_log_buffer_hex(tag, buf, len)
+
+// ------------------------------------------------------------------------------------------------
+// esp_timer
+// ------------------------------------------------------------------------------------------------
+typedef struct _host_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+typedef struct {
+    esp_timer_cb_t          callback;
+    void*                   arg;
+    esp_timer_dispatch_t    dispatch_method;
+    const char*             name;
+    bool                    skip_unhandled_events;
+} esp_timer_create_args_t;
+extern int64_t esp_timer_get_time(void);
+extern esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle);
+extern esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+extern esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+extern esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+extern esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+// ------------------------------------------------------------------------------------------------
+// heap_caps
+// ------------------------------------------------------------------------------------------------
+#define MALLOC_CAP_8BIT                 (1 << 2)
+#define MALLOC_CAP_INTERNAL             (1 << 11)
+#define MALLOC_CAP_DEFAULT              (1 << 12)
+#define HOST_HEAP_SIZE                  (300 * 1024)        // 内部RAMのヒープの大きさ(仮)
+extern size_t heap_caps_get_free_size(uint32_t caps);
+extern size_t heap_caps_get_largest_free_block(uint32_t caps);
+extern size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+// ------------------------------------------------------------------------------------------------
+// esp_partition(ファイルに置く、host_partition_file() で指定)
+// ------------------------------------------------------------------------------------------------
+typedef enum { ESP_PARTITION_TYPE_APP = 0x00, ESP_PARTITION_TYPE_DATA = 0x01 } esp_partition_type_t;
+typedef enum {
+    ESP_PARTITION_SUBTYPE_APP_FACTORY   = 0x00,
+    ESP_PARTITION_SUBTYPE_APP_OTA_0     = 0x10,
+    ESP_PARTITION_SUBTYPE_APP_OTA_1     = 0x11,
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS   = 0x82,
+    ESP_PARTITION_SUBTYPE_ANY           = 0xff,
+} esp_partition_subtype_t;
+typedef struct {
+    esp_partition_type_t    type;
+    esp_partition_subtype_t subtype;
+    uint32_t                address;
+    uint32_t                size;
+    char                    label[17];
+    bool                    encrypted;
+} esp_partition_t;
+#define SPI_FLASH_SEC_SIZE              4096
+extern const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label);
+extern esp_err_t esp_partition_read(const esp_partition_t* part, size_t off, void* dst, size_t len);
+extern esp_err_t esp_partition_write(const esp_partition_t* part, size_t off, const void* src, size_t len);
+extern esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t off, size_t len);
+extern const esp_partition_t* host_partition_file(const char* label, esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                  const char* path, uint32_t size);
+
+// ------------------------------------------------------------------------------------------------
+// esp_ota_ops
+// ------------------------------------------------------------------------------------------------
+typedef uint32_t esp_ota_handle_t;
+extern const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start);
+extern const esp_partition_t* esp_ota_get_running_partition(void);
+extern const esp_partition_t* esp_ota_get_boot_partition(void);
+extern esp_err_t esp_ota_set_boot_partition(const esp_partition_t* part);
+
+// ------------------------------------------------------------------------------------------------
+// NVS(メモリ上、host_nvs_file() を呼ぶとファイルに保存する)
+// ------------------------------------------------------------------------------------------------
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+extern esp_err_t nvs_flash_init(void);
+extern esp_err_t nvs_flash_erase(void);
+extern esp_err_t nvs_open(const char* ns, nvs_open_mode_t mode, nvs_handle_t* handle);
+extern void nvs_close(nvs_handle_t handle);
+extern esp_err_t nvs_commit(nvs_handle_t handle);
+extern esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out, size_t* len);
+extern esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* val, size_t len);
+extern esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out);
+extern esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t val);
+extern esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
+extern void host_nvs_file(const char* path);
+
+// ------------------------------------------------------------------------------------------------
+// mbedtls/sha256
+// ------------------------------------------------------------------------------------------------
+typedef struct {
+    uint32_t    state[8];
+    uint64_t    total;
+    uint8_t     buf[64];
+} mbedtls_sha256_context;
+extern void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+extern void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+extern int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224);
+extern int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* data, size_t len);
+extern int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char out[32]);
+
+// ------------------------------------------------------------------------------------------------
+// SPIFFS(何もしない、マウント先は Makefile で SPP_FT_BASE_PATH にディレクトリを指定する)
+// ------------------------------------------------------------------------------------------------
+typedef struct {
+    const char*     base_path;
+    const char*     partition_label;
+    size_t          max_files;
+    bool            format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+extern esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t* conf);
+extern esp_err_t esp_spiffs_info(const char* label, size_t* total, size_t* used);
+
+// ------------------------------------------------------------------------------------------------
+// UART(driver/uart.h、host_uart_attach() でポートを pty などの fd につなぐ)
+// ------------------------------------------------------------------------------------------------
+typedef int uart_port_t;
+#define UART_NUM_0                      0
+#define UART_NUM_1                      1
+#define UART_NUM_2                      2
+typedef enum { UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR, UART_PARITY_ERR } uart_event_type_t;
+typedef struct { uart_event_type_t type; size_t size; bool timeout_flag; } uart_event_t;
+#define UART_DATA_8_BITS                3
+#define UART_PARITY_DISABLE             0
+#define UART_STOP_BITS_1                1
+#define UART_HW_FLOWCTRL_DISABLE        0
+#define UART_HW_FLOWCTRL_CTS_RTS        3
+#define UART_SCLK_APB                   0
+#define UART_PIN_NO_CHANGE              -1
+typedef struct {
+    int         baud_rate;
+    int         data_bits;
+    int         parity;
+    int         stop_bits;
+    int         flow_ctrl;
+    uint8_t     rx_flow_ctrl_thresh;
+    int         source_clk;
+} uart_config_t;
+extern esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int qlen, QueueHandle_t* q, int flags);
+extern esp_err_t uart_param_config(uart_port_t port, const uart_config_t* conf);
+extern esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+extern esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t* len);
+extern int uart_read_bytes(uart_port_t port, void* buf, uint32_t len, TickType_t ticks);
+extern int uart_write_bytes(uart_port_t port, const void* src, size_t len);
+extern esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud);
+extern esp_err_t uart_set_hw_flow_ctrl(uart_port_t port, int flow, uint8_t thresh);
+extern void host_uart_attach(uart_port_t port, int fd);
+#define OK                              0
+extern int uart_rx_one_char(uint8_t* ch);
+extern void host_console_input(const char* keys);                  // uart_rx_one_char() で読む文字を追加する
+
+// ------------------------------------------------------------------------------------------------
+// Bluetooth(コントローラ/Bluedroid/GAP)
+// ------------------------------------------------------------------------------------------------
+#define ESP_BD_ADDR_LEN                 6
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+typedef enum { ESP_BT_MODE_IDLE, ESP_BT_MODE_BLE, ESP_BT_MODE_CLASSIC_BT, ESP_BT_MODE_BTDM } esp_bt_mode_t;
+typedef struct { int dummy; } esp_bt_controller_config_t;
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() { 0 }
+extern esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode);
+extern esp_err_t esp_bt_controller_init(esp_bt_controller_config_t* conf);
+extern esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
+extern esp_err_t esp_bluedroid_init(void);
+extern esp_err_t esp_bluedroid_enable(void);
+extern esp_err_t esp_bt_dev_set_device_name(const char* name);
+
+typedef enum { ESP_BT_STATUS_SUCCESS = 0, ESP_BT_STATUS_FAIL } esp_bt_status_t;
+#define ESP_BT_GAP_MAX_BDNAME_LEN       248
+#define ESP_BT_GAP_EIR_DATA_LEN         240
+typedef enum { ESP_BT_GAP_DEV_PROP_BDNAME = 1, ESP_BT_GAP_DEV_PROP_COD, ESP_BT_GAP_DEV_PROP_RSSI, ESP_BT_GAP_DEV_PROP_EIR } esp_bt_gap_dev_prop_type_t;
+typedef struct { esp_bt_gap_dev_prop_type_t type; int len; void* val; } esp_bt_gap_dev_prop_t;
+typedef enum {
+    ESP_BT_GAP_DISC_RES_EVT = 0, ESP_BT_GAP_DISC_STATE_CHANGED_EVT, ESP_BT_GAP_RMT_SRVCS_EVT, ESP_BT_GAP_RMT_SRVC_REC_EVT,
+    ESP_BT_GAP_AUTH_CMPL_EVT, ESP_BT_GAP_PIN_REQ_EVT, ESP_BT_GAP_CFM_REQ_EVT, ESP_BT_GAP_KEY_NOTIF_EVT, ESP_BT_GAP_KEY_REQ_EVT,
+    ESP_BT_GAP_READ_RSSI_DELTA_EVT, ESP_BT_GAP_CONFIG_EIR_DATA_EVT, ESP_BT_GAP_SET_AFH_CHANNELS_EVT, ESP_BT_GAP_READ_REMOTE_NAME_EVT,
+    ESP_BT_GAP_MODE_CHG_EVT, ESP_BT_GAP_REMOVE_BOND_DEV_COMPLETE_EVT, ESP_BT_GAP_QOS_CMPL_EVT, ESP_BT_GAP_EVT_MAX
+} esp_bt_gap_cb_event_t;
+typedef enum { ESP_BT_GAP_DISCOVERY_STOPPED, ESP_BT_GAP_DISCOVERY_STARTED } esp_bt_gap_discovery_state_t;
+typedef uint8_t esp_bt_pin_code_t[16];
+typedef uint32_t esp_bt_uuid_t;
+typedef int esp_bt_pm_mode_t;
+typedef union {
+    struct { esp_bd_addr_t bda; int num_prop; esp_bt_gap_dev_prop_t* prop; } disc_res;
+    struct { esp_bt_gap_discovery_state_t state; } disc_st_chg;
+    struct { esp_bd_addr_t bda; esp_bt_status_t stat; int num_uuids; esp_bt_uuid_t* uuid_list; } rmt_srvcs;
+    struct { esp_bd_addr_t bda; esp_bt_status_t stat; } rmt_srvc_rec;
+    struct { esp_bd_addr_t bda; esp_bt_status_t stat; int8_t rssi_delta; } read_rssi_delta;
+    struct { esp_bt_status_t stat; uint8_t eir_type_num; uint8_t eir_type[8]; } config_eir_data;
+    struct { esp_bt_status_t stat; } set_afh_channels;
+    struct { esp_bt_status_t stat; uint8_t rmt_name[ESP_BT_GAP_MAX_BDNAME_LEN + 1]; } read_rmt_name;
+    struct { esp_bd_addr_t bda; esp_bt_status_t stat; uint8_t device_name[ESP_BT_GAP_MAX_BDNAME_LEN + 1]; } auth_cmpl;
+    struct { esp_bd_addr_t bda; bool min_16_digit; } pin_req;
+    struct { esp_bd_addr_t bda; uint32_t num_val; } cfm_req;
+    struct { esp_bd_addr_t bda; uint32_t passkey; } key_notif;
+    struct { esp_bd_addr_t bda; } key_req;
+    struct { esp_bd_addr_t bda; esp_bt_pm_mode_t mode; } mode_chg;
+    struct { esp_bt_status_t status; esp_bd_addr_t bda; } remove_bond_dev_cmpl;
+    struct { esp_bt_status_t stat; esp_bd_addr_t bda; uint32_t t_poll; } qos_cmpl;
+} esp_bt_gap_cb_param_t;
+typedef void (*esp_bt_gap_cb_t)(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t* param);
+typedef enum { ESP_BT_NON_CONNECTABLE, ESP_BT_CONNECTABLE } esp_bt_connection_mode_t;
+typedef enum { ESP_BT_NON_DISCOVERABLE, ESP_BT_LIMITED_DISCOVERABLE, ESP_BT_GENERAL_DISCOVERABLE } esp_bt_discovery_mode_t;
+typedef enum { ESP_BT_INQ_MODE_GENERAL_INQUIRY, ESP_BT_INQ_MODE_LIMITED_INQUIRY } esp_bt_inq_mode_t;
+typedef enum { ESP_BT_SP_IOCAP_MODE } esp_bt_sp_param_t;
+typedef uint8_t esp_bt_io_cap_t;
+#define ESP_BT_IO_CAP_OUT               0
+#define ESP_BT_IO_CAP_IO                1
+#define ESP_BT_IO_CAP_IN                2
+#define ESP_BT_IO_CAP_NONE              3
+typedef enum { ESP_BT_PIN_TYPE_VARIABLE, ESP_BT_PIN_TYPE_FIXED } esp_bt_pin_type_t;
+#define ESP_BT_EIR_TYPE_SHORT_LOCAL_NAME    0x08
+#define ESP_BT_EIR_TYPE_CMPL_LOCAL_NAME     0x09
+extern esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t cb);
+extern esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c, esp_bt_discovery_mode_t d);
+extern esp_err_t esp_bt_gap_start_discovery(esp_bt_inq_mode_t mode, uint8_t len, uint8_t num);
+extern esp_err_t esp_bt_gap_cancel_discovery(void);
+extern uint8_t* esp_bt_gap_resolve_eir_data(uint8_t* eir, uint8_t type, uint8_t* len);
+extern esp_err_t esp_bt_gap_pin_reply(esp_bd_addr_t bda, bool accept, uint8_t len, esp_bt_pin_code_t pin);
+extern esp_err_t esp_bt_gap_ssp_confirm_reply(esp_bd_addr_t bda, bool accept);
+extern esp_err_t esp_bt_gap_ssp_passkey_reply(esp_bd_addr_t bda, bool accept, uint32_t passkey);
+extern esp_err_t esp_bt_gap_set_security_param(esp_bt_sp_param_t type, void* value, uint8_t len);
+extern esp_err_t esp_bt_gap_set_pin(esp_bt_pin_type_t type, uint8_t len, esp_bt_pin_code_t pin);
+extern int esp_bt_gap_get_bond_device_num(void);
+extern esp_err_t esp_bt_gap_get_bond_device_list(int* num, esp_bd_addr_t* list);
+extern esp_err_t esp_bt_gap_remove_bond_device(esp_bd_addr_t bda);
+extern void host_bt_bond_add(const uint8_t* bda);                   // ペアリング済みデバイスの一覧に追加する
+extern bool host_bt_bonded(const uint8_t* bda);
+extern esp_err_t esp_bt_gap_read_rssi_delta(esp_bd_addr_t bda);
+extern esp_err_t esp_bt_gap_set_qos(esp_bd_addr_t bda, uint32_t t_poll);
+
+// ------------------------------------------------------------------------------------------------
+// SPP(spp_emu.c)
+// ------------------------------------------------------------------------------------------------
+typedef enum { ESP_SPP_SUCCESS = 0, ESP_SPP_FAILURE, ESP_SPP_BUSY, ESP_SPP_NO_DATA, ESP_SPP_NO_RESOURCE } esp_spp_status_t;
+typedef enum { ESP_SPP_MODE_CB = 0, ESP_SPP_MODE_VFS } esp_spp_mode_t;
+typedef uint16_t esp_spp_sec_t;
+#define ESP_SPP_SEC_NONE                0x0000
+#define ESP_SPP_SEC_AUTHORIZE           0x0001
+#define ESP_SPP_SEC_AUTHENTICATE        0x0012
+#define ESP_SPP_SEC_ENCRYPT             0x0024
+typedef enum { ESP_SPP_ROLE_MASTER = 0, ESP_SPP_ROLE_SLAVE = 1 } esp_spp_role_t;
+#define ESP_SPP_MAX_SCN                 31
+typedef enum {
+    ESP_SPP_INIT_EVT            = 0,
+    ESP_SPP_UNINIT_EVT          = 1,
+    ESP_SPP_DISCOVERY_COMP_EVT  = 8,
+    ESP_SPP_OPEN_EVT            = 26,
+    ESP_SPP_CLOSE_EVT           = 27,
+    ESP_SPP_START_EVT           = 28,
+    ESP_SPP_CL_INIT_EVT         = 29,
+    ESP_SPP_DATA_IND_EVT        = 30,
+    ESP_SPP_CONG_EVT            = 31,
+    ESP_SPP_WRITE_EVT           = 33,
+    ESP_SPP_SRV_OPEN_EVT        = 34,
+    ESP_SPP_SRV_STOP_EVT        = 35,
+} esp_spp_cb_event_t;
+typedef union {
+    struct { esp_spp_status_t status; } init;
+    struct { esp_spp_status_t status; } uninit;
+    struct { esp_spp_status_t status; uint8_t scn_num; uint8_t scn[ESP_SPP_MAX_SCN]; const char* service_name[ESP_SPP_MAX_SCN]; } disc_comp;
+    struct { esp_spp_status_t status; uint32_t handle; int fd; esp_bd_addr_t rem_bda; } open;
+    struct { esp_spp_status_t status; uint32_t handle; uint32_t new_listen_handle; int fd; esp_bd_addr_t rem_bda; } srv_open;
+    struct { esp_spp_status_t status; uint32_t port_status; uint32_t handle; bool async; } close;
+    struct { esp_spp_status_t status; uint32_t handle; uint8_t sec_id; uint8_t scn; bool use_co; } start;
+    struct { esp_spp_status_t status; uint8_t scn; } srv_stop;
+    struct { esp_spp_status_t status; uint32_t handle; uint8_t sec_id; bool use_co; } cl_init;
+    struct { esp_spp_status_t status; uint32_t handle; int len; bool cong; } write;
+    struct { esp_spp_status_t status; uint32_t handle; uint16_t len; uint8_t* data; } data_ind;
+    struct { esp_spp_status_t status; uint32_t handle; bool cong; } cong;
+} esp_spp_cb_param_t;
+typedef void (esp_spp_cb_t)(esp_spp_cb_event_t event, esp_spp_cb_param_t* param);
+extern esp_err_t esp_spp_register_callback(esp_spp_cb_t* cb);
+extern esp_err_t esp_spp_init(esp_spp_mode_t mode);
+extern esp_err_t esp_spp_vfs_register(void);
+extern esp_err_t esp_spp_start_srv(esp_spp_sec_t sec, esp_spp_role_t role, uint8_t scn, const char* name);
+extern esp_err_t esp_spp_stop_srv(void);
+extern esp_err_t esp_spp_start_discovery(esp_bd_addr_t bda);
+extern esp_err_t esp_spp_connect(esp_spp_sec_t sec, esp_spp_role_t role, uint8_t scn, esp_bd_addr_t bda);
+extern esp_err_t esp_spp_disconnect(uint32_t handle);
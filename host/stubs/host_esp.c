@@ -0,0 +1,980 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ESP-IDF の代用(ホスト側、esp_host.h を参照)
+//     esp_timer     : 優先度 22 の "esp_timer" タスクからコールバックを呼ぶ(仮想時刻)
+//     esp_partition : ファイルに置いたNORフラッシュ(書き込みはビットを落とすだけ、消去で 0xFF)
+//     NVS           : メモリ上(host_nvs_file() で指定したファイルに nvs_commit() で保存する)
+//     ヒープ        : HOST_HEAP_SIZE から malloc の使用量を引いた値
+//     read()/write(): host_vfs_open() で割り当てた fd だけを差し替える
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "esp_host.h"
+
+#define HOST_PART_MAX       8
+#define HOST_VFS_MAX        64
+#define HOST_NVS_MAX        64
+#define HOST_NVS_NS_MAX     16
+#define HOST_TIMER_PRIO     22
+#define HOST_UART_MAX       3
+#define HOST_BOND_MAX       32
+
+volatile bool               host_restarted = false;
+
+
+// ================================================================================================
+// esp_err/esp_system
+// ================================================================================================
+const char* esp_err_to_name(esp_err_t code)
+{
+    static char str[16];
+
+    switch (code) {
+      case ESP_OK :                     return "ESP_OK";
+      case ESP_FAIL :                   return "ESP_FAIL";
+      case ESP_ERR_NO_MEM :             return "ESP_ERR_NO_MEM";
+      case ESP_ERR_INVALID_ARG :        return "ESP_ERR_INVALID_ARG";
+      case ESP_ERR_INVALID_STATE :      return "ESP_ERR_INVALID_STATE";
+      case ESP_ERR_INVALID_SIZE :       return "ESP_ERR_INVALID_SIZE";
+      case ESP_ERR_NOT_FOUND :          return "ESP_ERR_NOT_FOUND";
+      case ESP_ERR_TIMEOUT :            return "ESP_ERR_TIMEOUT";
+      case ESP_ERR_INVALID_CRC :        return "ESP_ERR_INVALID_CRC";
+      case ESP_ERR_NVS_NOT_FOUND :      return "ESP_ERR_NVS_NOT_FOUND";
+      default :
+        snprintf(str, sizeof(str), "0x%x", code);
+        return str;
+    }
+}
+
+void esp_restart(void)
+{
+    host_log(ESP_LOG_WARN, "host", "esp_restart()");
+    host_restarted = true;
+    vTaskSuspend(NULL);
+}
+
+// ================================================================================================
+// ログ(HOST_LOG=0～5 で表示するレベル、既定は警告まで)
+// ================================================================================================
+static int host_log_level = -1;
+
+void host_log(esp_log_level_t level, const char* tag, const char* fmt, ...)
+{
+    static const char   level_ch[] = "NEWIDV";
+    va_list             ap;
+
+    if (host_log_level < 0) {
+        const char* env = getenv("HOST_LOG");
+        host_log_level = (env != NULL) ? atoi(env) : ESP_LOG_WARN;
+    }
+    if ((int)level > host_log_level) {
+        return;
+    }
+    printf("%c (%llu) %s: ", level_ch[level], (unsigned long long)(host_now_us() / 1000), tag);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+}
+
+void esp_log_buffer_hex(const char* tag, const void* buf, uint16_t len)
+{
+    if (host_log_level >= ESP_LOG_INFO) {
+        for (int i = 0; i < len; i++) {
+            printf("%02x%s", ((const uint8_t*)buf)[i], (i % 16 == 15 || i == len - 1) ? "\n" : " ");
+        }
+    }
+}
+
+void esp_log_buffer_char(const char* tag, const void* buf, uint16_t len)
+{
+    if (host_log_level >= ESP_LOG_INFO) {
+        printf("%.*s\n", len, (const char*)buf);
+    }
+}
+
+// ================================================================================================
+// ヒープ
+// ================================================================================================
+static size_t host_heap_min = HOST_HEAP_SIZE;
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    struct mallinfo2    mi = mallinfo2();
+    size_t              free_size = (mi.uordblks < HOST_HEAP_SIZE) ? HOST_HEAP_SIZE - mi.uordblks : 0;
+
+    if (free_size < host_heap_min) {
+        host_heap_min = free_size;
+    }
+    return free_size;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    heap_caps_get_free_size(caps);
+    return host_heap_min;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+// ================================================================================================
+// esp_timer
+// ================================================================================================
+struct _host_timer {
+    esp_timer_cb_t          callback;
+    void*                   arg;
+    uint64_t                due_us;         // 0:停止中
+    uint64_t                period_us;      // 0:1回だけ
+    struct _host_timer*     next;
+};
+static struct _host_timer*  host_timers = NULL;
+static TaskHandle_t         host_timer_task_handle = NULL;
+
+static void host_timer_task(void* param)
+{
+    for (;;) {
+        struct _host_timer* due = NULL;
+        for (struct _host_timer* t = host_timers; t != NULL; t = t->next) {
+            if (t->due_us != 0 && (due == NULL || t->due_us < due->due_us)) {
+                due = t;
+            }
+        }
+        if (due == NULL || due->due_us > host_now_us()) {
+            host_wait_us(&host_timers, (due != NULL) ? due->due_us : UINT64_MAX);
+            continue;
+        }
+        due->due_us = (due->period_us != 0) ? due->due_us + due->period_us : 0;
+        due->callback(due->arg);
+    }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    host_busy();
+    return (int64_t)host_now_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    struct _host_timer* t = calloc(1, sizeof(*t));
+
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (host_timer_task_handle == NULL) {
+        xTaskCreate(host_timer_task, "esp_timer", 4096, NULL, HOST_TIMER_PRIO, &host_timer_task_handle);
+    }
+    t->callback = args->callback;
+    t->arg      = args->arg;
+    t->next     = host_timers;
+    host_timers = t;
+    *handle     = t;
+    return ESP_OK;
+}
+
+static esp_err_t host_timer_start(esp_timer_handle_t timer, uint64_t us, bool periodic)
+{
+    if (timer->due_us != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due_us       = host_now_us() + ((us > 0) ? us : 1);
+    timer->period_us    = periodic ? us : 0;
+    host_wake(&host_timers);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return host_timer_start(timer, period_us, true);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return host_timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer->due_us == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    for (struct _host_timer** pp = &host_timers; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == timer) {
+            *pp = timer->next;
+            free(timer);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+// ================================================================================================
+// esp_partition(ファイル)
+// ================================================================================================
+struct _host_part {
+    esp_partition_t     part;
+    FILE*               fp;
+};
+static struct _host_part    host_parts[HOST_PART_MAX];
+static int                  host_part_num = 0;
+static const esp_partition_t* host_boot_part = NULL;
+
+const esp_partition_t* host_partition_file(const char* label, esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                           const char* path, uint32_t size)
+{
+    struct _host_part*  hp = NULL;
+    uint8_t             ff[SPI_FLASH_SEC_SIZE];
+    long                cur;
+
+    for (int i = 0; i < host_part_num; i++) {
+        if (strcmp(host_parts[i].part.label, label) == 0) {
+            hp = &host_parts[i];
+            fclose(hp->fp);
+            break;
+        }
+    }
+    if (hp == NULL) {
+        if (host_part_num >= HOST_PART_MAX) {
+            return NULL;
+        }
+        hp = &host_parts[host_part_num++];
+    }
+    memset(hp, 0, sizeof(*hp));
+    hp->part.type       = type;
+    hp->part.subtype    = subtype;
+    hp->part.address    = 0x110000 + (hp - host_parts) * 0x100000;
+    hp->part.size       = size;
+    strncpy(hp->part.label, label, sizeof(hp->part.label) - 1);
+    if ((hp->fp = fopen(path, "r+b")) == NULL && (hp->fp = fopen(path, "w+b")) == NULL) {
+        return NULL;
+    }
+    // 足りない部分は消去済み(0xFF)にする
+    memset(ff, 0xff, sizeof(ff));
+    fseek(hp->fp, 0, SEEK_END);
+    cur = ftell(hp->fp);
+    while (cur < size) {
+        size_t n = (size - cur < sizeof(ff)) ? size - cur : sizeof(ff);
+        fwrite(ff, 1, n, hp->fp);
+        cur += n;
+    }
+    fflush(hp->fp);
+    return &hp->part;
+}
+
+static struct _host_part* host_part(const esp_partition_t* part)
+{
+    for (int i = 0; i < host_part_num; i++) {
+        if (&host_parts[i].part == part) {
+            return &host_parts[i];
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+    for (int i = 0; i < host_part_num; i++) {
+        const esp_partition_t* p = &host_parts[i].part;
+        if (p->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype)
+         && (label == NULL || strcmp(p->label, label) == 0)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t off, void* dst, size_t len)
+{
+    struct _host_part*  hp = host_part(part);
+
+    if (hp == NULL || off + len > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_busy();
+    fseek(hp->fp, off, SEEK_SET);
+    return (fread(dst, 1, len, hp->fp) == len) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t off, const void* src, size_t len)
+{
+    struct _host_part*  hp = host_part(part);
+    uint8_t             cur[256];
+
+    if (hp == NULL || off + len > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_busy();
+    // NORフラッシュは 1 → 0 にしか書けない
+    for (size_t done = 0; done < len; ) {
+        size_t n = (len - done < sizeof(cur)) ? len - done : sizeof(cur);
+        fseek(hp->fp, off + done, SEEK_SET);
+        if (fread(cur, 1, n, hp->fp) != n) {
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < n; i++) {
+            cur[i] &= ((const uint8_t*)src)[done + i];
+        }
+        fseek(hp->fp, off + done, SEEK_SET);
+        fwrite(cur, 1, n, hp->fp);
+        done += n;
+    }
+    fflush(hp->fp);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t off, size_t len)
+{
+    struct _host_part*  hp = host_part(part);
+    uint8_t             ff[SPI_FLASH_SEC_SIZE];
+
+    if (hp == NULL || off + len > part->size || off % SPI_FLASH_SEC_SIZE != 0 || len % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host_busy();
+    memset(ff, 0xff, sizeof(ff));
+    fseek(hp->fp, off, SEEK_SET);
+    for (size_t done = 0; done < len; done += sizeof(ff)) {
+        fwrite(ff, 1, sizeof(ff), hp->fp);
+    }
+    fflush(hp->fp);
+    return ESP_OK;
+}
+
+// ================================================================================================
+// esp_ota_ops(実行中は factory、更新先は ota_0/ota_1 のうち実行中でない方)
+// ================================================================================================
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void)
+{
+    return (host_boot_part != NULL) ? host_boot_part : esp_ota_get_running_partition();
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start)
+{
+    const esp_partition_t*  running = esp_ota_get_running_partition();
+
+    for (int i = 0; i < host_part_num; i++) {
+        const esp_partition_t* p = &host_parts[i].part;
+        if (p->type == ESP_PARTITION_TYPE_APP && p->subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0 && p != running) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* part)
+{
+    if (host_part(part) == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    host_boot_part = part;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// NVS
+// ================================================================================================
+struct _host_nvs {
+    char        ns[16];
+    char        key[16];
+    size_t      len;
+    uint8_t*    data;
+};
+static struct _host_nvs     host_nvs[HOST_NVS_MAX];
+static char                 host_nvs_ns[HOST_NVS_NS_MAX][16];
+static const char*          host_nvs_path = NULL;
+
+static void host_nvs_save(void)
+{
+    FILE*   fp;
+
+    if (host_nvs_path == NULL || (fp = fopen(host_nvs_path, "wb")) == NULL) {
+        return;
+    }
+    for (int i = 0; i < HOST_NVS_MAX; i++) {
+        if (host_nvs[i].data != NULL) {
+            uint32_t len = host_nvs[i].len;
+            fwrite(host_nvs[i].ns, 1, sizeof(host_nvs[i].ns), fp);
+            fwrite(host_nvs[i].key, 1, sizeof(host_nvs[i].key), fp);
+            fwrite(&len, 1, sizeof(len), fp);
+            fwrite(host_nvs[i].data, 1, len, fp);
+        }
+    }
+    fclose(fp);
+}
+
+static struct _host_nvs* host_nvs_find(const char* ns, const char* key, bool create)
+{
+    struct _host_nvs*   empty = NULL;
+
+    for (int i = 0; i < HOST_NVS_MAX; i++) {
+        struct _host_nvs* e = &host_nvs[i];
+        if (e->data == NULL) {
+            if (empty == NULL) {
+                empty = e;
+            }
+        }
+        else if (strcmp(e->ns, ns) == 0 && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    if (create && empty != NULL) {
+        strncpy(empty->ns, ns, sizeof(empty->ns) - 1);
+        strncpy(empty->key, key, sizeof(empty->key) - 1);
+        return empty;
+    }
+    return NULL;
+}
+
+// ファイルから読み込み、以降の nvs_commit() で保存する(同じファイルで「再起動」できる)
+void host_nvs_file(const char* path)
+{
+    FILE*   fp;
+
+    for (int i = 0; i < HOST_NVS_MAX; i++) {
+        free(host_nvs[i].data);
+        memset(&host_nvs[i], 0, sizeof(host_nvs[i]));
+    }
+    host_nvs_path = path;
+    if ((fp = fopen(path, "rb")) == NULL) {
+        return;
+    }
+    for (int i = 0; i < HOST_NVS_MAX; i++) {
+        struct _host_nvs*   e = &host_nvs[i];
+        uint32_t            len;
+        if (fread(e->ns, 1, sizeof(e->ns), fp) != sizeof(e->ns) || fread(e->key, 1, sizeof(e->key), fp) != sizeof(e->key)
+         || fread(&len, 1, sizeof(len), fp) != sizeof(len)) {
+            memset(e, 0, sizeof(*e));
+            break;
+        }
+        e->len  = len;
+        e->data = malloc((len > 0) ? len : 1);
+        if (fread(e->data, 1, len, fp) != len) {
+            free(e->data);
+            memset(e, 0, sizeof(*e));
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    for (int i = 0; i < HOST_NVS_MAX; i++) {
+        free(host_nvs[i].data);
+        memset(&host_nvs[i], 0, sizeof(host_nvs[i]));
+    }
+    host_nvs_save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* ns, nvs_open_mode_t mode, nvs_handle_t* handle)
+{
+    for (int i = 0; i < HOST_NVS_NS_MAX; i++) {
+        if (host_nvs_ns[i][0] == '\0') {
+            strncpy(host_nvs_ns[i], ns, sizeof(host_nvs_ns[i]) - 1);
+        }
+        if (strcmp(host_nvs_ns[i], ns) == 0) {
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    host_nvs_save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out, size_t* len)
+{
+    struct _host_nvs*   e = host_nvs_find(host_nvs_ns[handle - 1], key, false);
+
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out != NULL) {
+        if (*len < e->len) {
+            *len = e->len;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out, e->data, e->len);
+    }
+    *len = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* val, size_t len)
+{
+    struct _host_nvs*   e = host_nvs_find(host_nvs_ns[handle - 1], key, true);
+    uint8_t*            data;
+
+    if (e == NULL || (data = malloc((len > 0) ? len : 1)) == NULL) {
+        return ESP_ERR_NVS_NO_FREE_PAGES;
+    }
+    memcpy(data, val, len);
+    free(e->data);
+    e->data = data;
+    e->len  = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out)
+{
+    size_t  len = sizeof(*out);
+
+    return nvs_get_blob(handle, key, out, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t val)
+{
+    return nvs_set_blob(handle, key, &val, sizeof(val));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    struct _host_nvs*   e = host_nvs_find(host_nvs_ns[handle - 1], key, false);
+
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(e->data);
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
+
+// ================================================================================================
+// SHA-256(mbedtls の代用)
+// ================================================================================================
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(mbedtls_sha256_context* ctx, const uint8_t* p)
+{
+    uint32_t    w[64];
+    uint32_t    s[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(s, ctx->state, sizeof(s));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        memmove(&s[1], &s[0], sizeof(s[0]) * 7);
+        s[4] += t1;
+        s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] += s[i];
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx)
+{
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int is224)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        ctx->buf[ctx->total % 64] = data[i];
+        if (++ctx->total % 64 == 0) {
+            sha256_block(ctx, ctx->buf);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char out[32])
+{
+    uint64_t    bits = ctx->total * 8;
+    uint8_t     pad = 0x80;
+    uint8_t     len[8];
+
+    mbedtls_sha256_update_ret(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->total % 64 != 56) {
+        mbedtls_sha256_update_ret(ctx, &pad, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+        len[i] = bits >> (56 - i * 8);
+    }
+    mbedtls_sha256_update_ret(ctx, len, 8);
+    for (int i = 0; i < 32; i++) {
+        out[i] = ctx->state[i / 4] >> (24 - (i % 4) * 8);
+    }
+    return 0;
+}
+
+// ================================================================================================
+// SPIFFS(マウント先はそのままホストのディレクトリ)
+// ================================================================================================
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t* conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char* label, size_t* total, size_t* used)
+{
+    *total  = 1024 * 1024;
+    *used   = 0;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// UART(ポートにつないだ fd、つながっていないポートは送信を捨てて受信なし)
+// ================================================================================================
+static int  host_uart_fd[HOST_UART_MAX] = { -1, -1, -1 };
+
+extern ssize_t __real_read(int fd, void* buf, size_t len);
+extern ssize_t __real_write(int fd, const void* buf, size_t len);
+
+void host_uart_attach(uart_port_t port, int fd)
+{
+    host_uart_fd[port] = fd;
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int qlen, QueueHandle_t* q, int flags)
+{
+    if (q != NULL) {
+        *q = xQueueCreate((qlen > 0) ? qlen : 1, sizeof(uart_event_t));
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t* conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_hw_flow_ctrl(uart_port_t port, int flow, uint8_t thresh)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t* len)
+{
+    int     n = 0;
+
+    *len = 0;
+    if (host_uart_fd[port] >= 0) {
+        // pty は書き込みから読めるようになるまで少し遅れる
+        struct pollfd pfd = { host_uart_fd[port], POLLIN, 0 };
+        poll(&pfd, 1, 1);
+        if (ioctl(host_uart_fd[port], FIONREAD, &n) == 0 && n > 0) {
+            *len = n;
+        }
+    }
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void* buf, uint32_t len, TickType_t ticks)
+{
+    TickType_t  start = xTaskGetTickCount();
+    ssize_t     n;
+
+    for (;;) {
+        n = (host_uart_fd[port] >= 0) ? __real_read(host_uart_fd[port], buf, len) : 0;
+        if (n > 0) {
+            return n;
+        }
+        if (ticks == 0 || xTaskGetTickCount() - start >= ticks) {
+            return 0;
+        }
+        vTaskDelay(1);
+    }
+}
+
+int uart_write_bytes(uart_port_t port, const void* src, size_t len)
+{
+    size_t  done = 0;
+
+    while (host_uart_fd[port] >= 0 && done < len) {
+        ssize_t n = __real_write(host_uart_fd[port], (const uint8_t*)src + done, len - done);
+        if (n > 0) {
+            done += n;
+        }
+        else if (n < 0 && errno != EAGAIN) {
+            break;
+        }
+        else {
+            // 送信できるまで待つ(相手が読むのを待つ)
+            struct pollfd pfd = { host_uart_fd[port], POLLOUT, 0 };
+            poll(&pfd, 1, 1);
+            vTaskDelay(1);
+        }
+    }
+    return len;
+}
+
+// コンソール(uart_rx_one_char)の入力
+static char                 host_console_buf[64];
+static int                  host_console_rd = 0;
+static int                  host_console_wr = 0;
+
+void host_console_input(const char* keys)
+{
+    for (; *keys != '\0'; keys++) {
+        host_console_buf[host_console_wr++ % sizeof(host_console_buf)] = *keys;
+    }
+}
+
+int uart_rx_one_char(uint8_t* ch)
+{
+    if (host_console_rd == host_console_wr) {
+        return -1;
+    }
+    *ch = host_console_buf[host_console_rd++ % sizeof(host_console_buf)];
+    return OK;
+}
+
+// ================================================================================================
+// Bluetooth(コントローラ/Bluedroid/GAP/SPP は何もしない、ペアリング済みデバイスの一覧だけ持つ)
+//     SPP は spp_emu.c を一緒にリンクすると置き換わる(ここは weak)
+// ================================================================================================
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode)                                 { return ESP_OK; }
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t* conf)                          { return ESP_OK; }
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode)                                      { return ESP_OK; }
+esp_err_t esp_bluedroid_init(void)                                                          { return ESP_OK; }
+esp_err_t esp_bluedroid_enable(void)                                                        { return ESP_OK; }
+esp_err_t esp_bt_dev_set_device_name(const char* name)                                      { return ESP_OK; }
+esp_err_t esp_bt_gap_register_callback(esp_bt_gap_cb_t cb)                                  { return ESP_OK; }
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c, esp_bt_discovery_mode_t d)   { return ESP_OK; }
+esp_err_t esp_bt_gap_start_discovery(esp_bt_inq_mode_t mode, uint8_t len, uint8_t num)      { return ESP_OK; }
+esp_err_t esp_bt_gap_cancel_discovery(void)                                                 { return ESP_OK; }
+uint8_t* esp_bt_gap_resolve_eir_data(uint8_t* eir, uint8_t type, uint8_t* len)              { *len = 0; return NULL; }
+esp_err_t esp_bt_gap_pin_reply(esp_bd_addr_t bda, bool accept, uint8_t len, esp_bt_pin_code_t pin) { return ESP_OK; }
+esp_err_t esp_bt_gap_ssp_confirm_reply(esp_bd_addr_t bda, bool accept)                      { return ESP_OK; }
+esp_err_t esp_bt_gap_ssp_passkey_reply(esp_bd_addr_t bda, bool accept, uint32_t passkey)    { return ESP_OK; }
+esp_err_t esp_bt_gap_set_security_param(esp_bt_sp_param_t type, void* value, uint8_t len)  { return ESP_OK; }
+esp_err_t esp_bt_gap_set_pin(esp_bt_pin_type_t type, uint8_t len, esp_bt_pin_code_t pin)   { return ESP_OK; }
+esp_err_t esp_bt_gap_read_rssi_delta(esp_bd_addr_t bda)                                     { return ESP_OK; }
+esp_err_t esp_bt_gap_set_qos(esp_bd_addr_t bda, uint32_t t_poll)                            { return ESP_OK; }
+
+// ペアリング済みデバイスの一覧(Bluedroidの保存の代用、host_bt_bond_add() で追加した順)
+static esp_bd_addr_t        host_bond[HOST_BOND_MAX];
+static int                  host_bond_num = 0;
+
+static int host_bond_find(const uint8_t* bda)
+{
+    for (int i = 0; i < host_bond_num; i++) {
+        if (memcmp(host_bond[i], bda, ESP_BD_ADDR_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void host_bt_bond_add(const uint8_t* bda)
+{
+    if (host_bond_find(bda) < 0 && host_bond_num < HOST_BOND_MAX) {
+        memcpy(host_bond[host_bond_num++], bda, ESP_BD_ADDR_LEN);
+    }
+}
+
+bool host_bt_bonded(const uint8_t* bda)
+{
+    return host_bond_find(bda) >= 0;
+}
+
+int esp_bt_gap_get_bond_device_num(void)
+{
+    return host_bond_num;
+}
+
+esp_err_t esp_bt_gap_get_bond_device_list(int* num, esp_bd_addr_t* list)
+{
+    if (*num > host_bond_num) {
+        *num = host_bond_num;
+    }
+    memcpy(list, host_bond, *num * sizeof(esp_bd_addr_t));
+    return ESP_OK;
+}
+
+esp_err_t esp_bt_gap_remove_bond_device(esp_bd_addr_t bda)
+{
+    int i = host_bond_find(bda);
+
+    if (i < 0) {
+        return ESP_FAIL;
+    }
+    memmove(&host_bond[i], &host_bond[i + 1], (host_bond_num - i - 1) * sizeof(esp_bd_addr_t));
+    host_bond_num--;
+    return ESP_OK;
+}
+
+#define WEAK    __attribute__((weak))
+WEAK esp_err_t esp_spp_register_callback(esp_spp_cb_t* cb)                                  { return ESP_OK; }
+WEAK esp_err_t esp_spp_init(esp_spp_mode_t mode)                                            { return ESP_OK; }
+WEAK esp_err_t esp_spp_vfs_register(void)                                                   { return ESP_OK; }
+WEAK esp_err_t esp_spp_start_srv(esp_spp_sec_t sec, esp_spp_role_t role, uint8_t scn, const char* name) { return ESP_OK; }
+WEAK esp_err_t esp_spp_stop_srv(void)                                                       { return ESP_OK; }
+WEAK esp_err_t esp_spp_start_discovery(esp_bd_addr_t bda)                                   { return ESP_OK; }
+WEAK esp_err_t esp_spp_connect(esp_spp_sec_t sec, esp_spp_role_t role, uint8_t scn, esp_bd_addr_t bda) { return ESP_OK; }
+WEAK esp_err_t esp_spp_disconnect(uint32_t handle)                                          { return ESP_OK; }
+
+// ================================================================================================
+// read()/write() の差し替え
+//     fd は /dev/null を開いて番号を確保する(通常のファイルの fd と重ならず、閉じた番号は再利用される)
+// ================================================================================================
+struct _host_vfs {
+    int                         fd;
+    const struct _host_vfs_ops* ops;
+    void*                       ctx;
+};
+static struct _host_vfs     host_vfs[HOST_VFS_MAX];
+
+int host_vfs_open(const struct _host_vfs_ops* ops, void* ctx)
+{
+    int     fd;
+
+    for (int i = 0; i < HOST_VFS_MAX; i++) {
+        if (host_vfs[i].ops == NULL) {
+            if ((fd = open("/dev/null", O_RDWR)) < 0) {
+                return -1;
+            }
+            host_vfs[i].fd  = fd;
+            host_vfs[i].ops = ops;
+            host_vfs[i].ctx = ctx;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+void host_vfs_close(int fd)
+{
+    for (int i = 0; i < HOST_VFS_MAX; i++) {
+        if (host_vfs[i].ops != NULL && host_vfs[i].fd == fd) {
+            host_vfs[i].ops = NULL;
+            close(fd);
+            return;
+        }
+    }
+}
+
+static struct _host_vfs* host_vfs_find(int fd)
+{
+    for (int i = 0; i < HOST_VFS_MAX; i++) {
+        if (host_vfs[i].ops != NULL && host_vfs[i].fd == fd) {
+            return &host_vfs[i];
+        }
+    }
+    return NULL;
+}
+
+ssize_t __wrap_read(int fd, void* buf, size_t len)
+{
+    struct _host_vfs*   v = host_vfs_find(fd);
+
+    if (v == NULL) {
+        return __real_read(fd, buf, len);
+    }
+    host_busy();
+    return v->ops->read(v->ctx, fd, buf, len);
+}
+
+ssize_t __wrap_write(int fd, const void* buf, size_t len)
+{
+    struct _host_vfs*   v = host_vfs_find(fd);
+
+    if (v == NULL) {
+        return __real_write(fd, buf, len);
+    }
+    host_busy();
+    return v->ops->write(v->ctx, fd, buf, len);
+}
@@ -0,0 +1,909 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// FreeRTOS の代用(ホスト側、esp_host.h を参照)
+//     タスクは pthread で動かすが、実行できるのは常に1つだけ(バトンを持つタスク)
+//         優先度の高いタスクが実行可能になったらすぐに切り替える(クリティカルセクション中は抜けたとき)
+//         同じ優先度は実行可能になった順、待ちは待ち始めた順に起こす
+//     時刻は仮想時刻で、実行可能なタスクがなくなったら次の期限まで進める(IDLE)
+//         待たずに API を HOST_BUSY_CALLS 回呼び続けたタスクは 1tick 分CPUを使ったとみなして次の tick まで待たせる
+//         (ポーリングで回り続けるタスクがあっても時刻が進み、低い優先度のタスクも動く)
+//     自分を削除したタスクの後始末(vPortCleanUpTCB)は IDLE で行い、他のタスクの削除はその場で行う
+//     main() も優先度 HOST_MAIN_PRIO のタスクとして扱う
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#include "esp_host.h"
+
+#define HOST_TICK_US        (1000000 / CONFIG_FREERTOS_HZ)
+#define HOST_BUSY_CALLS     256             // 待たずに続けて呼べる API の回数
+#define HOST_MAIN_PRIO      1               // main() の優先度
+#define HOST_THREAD_STACK   (256 * 1024)    // pthread のスタック(デバイスのスタックサイズとは別)
+#define HOST_TCB_MAGIC      0x54434221
+#define HOST_Q_MAGIC        0x51554521
+#define HOST_EG_MAGIC       0x45564721
+
+// タスクの状態
+#define T_READY             0
+#define T_BLOCKED           1
+#define T_SUSPENDED         2
+#define T_DELETED           3
+
+// スレッドの状態(スレッドのスタック上、TCBを解放した後も参照する)
+struct _host_thr {
+    volatile bool       kill;
+};
+
+// TCB
+struct _host_tcb {
+    uint32_t            magic;
+    char                name[configMAX_TASK_NAME_LEN];
+    UBaseType_t         prio;
+    UBaseType_t         number;
+    TaskFunction_t      func;
+    void*               param;
+    int                 state;
+    uint64_t            seq;                // 実行可能になった順/待ち始めた順
+    const void*         wait_obj;           // 待っている対象
+    uint64_t            wake_us;            // 待ちの期限(UINT64_MAX:なし)
+    bool                timed_out;
+    uint32_t            notify;             // タスク通知の値
+    int                 crit;               // クリティカルセクションのネスト
+    bool                yield_pending;      // クリティカルセクションを抜けたら切り替える
+    uint32_t            busy;               // 待たずに呼んだ API の回数
+    bool                is_static;
+    uint8_t*            stack;              // ヒープから確保したスタック(ヒープの使用量を合わせるため)
+    uint32_t            stack_size;
+    struct _host_thr*   thr;
+    struct _host_tcb*   next;
+    struct _host_tcb*   cleanup_next;
+};
+_Static_assert(sizeof(struct _host_tcb) <= sizeof(StaticTask_t), "StaticTask_t is too small");
+
+// キュー/セマフォ(セマフォは要素サイズ0のキュー)
+struct _host_queue {
+    uint32_t            magic;
+    UBaseType_t         len;
+    UBaseType_t         size;
+    UBaseType_t         count;
+    UBaseType_t         head;
+    uint8_t*            buf;
+};
+
+// イベントグループ
+struct _host_eg {
+    uint32_t            magic;
+    EventBits_t         bits;
+};
+
+static pthread_mutex_t      host_big = PTHREAD_MUTEX_INITIALIZER;   // バトン
+static pthread_cond_t       host_cond = PTHREAD_COND_INITIALIZER;
+static struct _host_tcb*    host_cur = NULL;                        // 実行中のタスク(IDLE中はNULL)
+static struct _host_tcb*    host_tasks = NULL;
+static struct _host_tcb*    host_cleanup = NULL;                    // 後始末待ち(自分を削除したタスク)
+static struct _host_tcb     host_main_tcb;
+static struct _host_thr     host_main_thr;
+static uint64_t             host_time_us = 0;
+static uint64_t             host_seq = 0;
+static UBaseType_t          host_task_number = 0;
+static const char           host_delay_obj = 0;                     // 時刻だけを待つときの対象
+
+extern void vPortCleanUpTCB(void* tcb) __attribute__((weak));
+
+static void host_schedule(void);
+
+
+// ================================================================================================
+// 初期化(main() の前、main() をタスクにする)
+// ================================================================================================
+__attribute__((constructor)) static void host_rtos_init(void)
+{
+    // ヒープの使用量を1つのアリーナで数える(heap_caps_get_free_size)
+    mallopt(M_ARENA_MAX, 1);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    host_main_tcb.magic     = HOST_TCB_MAGIC;
+    strcpy(host_main_tcb.name, "main");
+    host_main_tcb.prio      = HOST_MAIN_PRIO;
+    host_main_tcb.number    = ++host_task_number;
+    host_main_tcb.state     = T_READY;
+    host_main_tcb.wake_us   = UINT64_MAX;
+    host_main_tcb.is_static = true;
+    host_main_tcb.thr       = &host_main_thr;
+    host_tasks              = &host_main_tcb;
+    host_cur                = &host_main_tcb;
+    pthread_mutex_lock(&host_big);
+}
+
+// ================================================================================================
+// 異常終了(タスクの一覧を表示する)
+// ================================================================================================
+void host_abort(const char* fmt, ...)
+{
+    static const char*  state_str[] = { "ready", "blocked", "suspended", "deleted" };
+    va_list             ap;
+
+    fflush(stdout);
+    fprintf(stderr, "host: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "  (time %llu us)\n", (unsigned long long)host_time_us);
+    for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+        fprintf(stderr, "    %-16s prio %2u  %-9s wait %p  until %lld\n", t->name, t->prio, state_str[t->state],
+                t->wait_obj, (t->wake_us == UINT64_MAX) ? -1LL : (long long)t->wake_us);
+    }
+    abort();
+}
+
+// ================================================================================================
+// 仮想時刻
+// ================================================================================================
+uint64_t host_now_us(void)
+{
+    return host_time_us;
+}
+
+static uint64_t host_deadline(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return UINT64_MAX;
+    }
+    return (host_time_us / HOST_TICK_US + ticks) * HOST_TICK_US;
+}
+
+// ================================================================================================
+// タスクを実行可能にする
+// ================================================================================================
+static void host_make_ready(struct _host_tcb* t)
+{
+    t->state    = T_READY;
+    t->seq      = ++host_seq;
+    t->wait_obj = NULL;
+    t->wake_us  = UINT64_MAX;
+}
+
+static struct _host_tcb* host_pick(void)
+{
+    struct _host_tcb*   best = NULL;
+
+    for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+        if (t->state == T_READY && (best == NULL || t->prio > best->prio || (t->prio == best->prio && t->seq < best->seq))) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// ================================================================================================
+// IDLE(後始末と時刻を進める)
+// ================================================================================================
+static void host_free_tcb(struct _host_tcb* t)
+{
+    for (struct _host_tcb** pp = &host_tasks; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    if (vPortCleanUpTCB != NULL) {
+        vPortCleanUpTCB(t);
+    }
+    t->magic = 0;
+    if (!t->is_static) {
+        free(t->stack);
+        free(t);
+    }
+}
+
+static void host_idle(void)
+{
+    uint64_t    next = UINT64_MAX;
+
+    while (host_cleanup != NULL) {
+        struct _host_tcb* t = host_cleanup;
+        host_cleanup = t->cleanup_next;
+        host_free_tcb(t);
+    }
+    for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+        if (t->state == T_BLOCKED && t->wake_us < next) {
+            next = t->wake_us;
+        }
+    }
+    if (next == UINT64_MAX) {
+        host_abort("deadlock (all tasks are blocked without timeout)");
+    }
+    if (next > host_time_us) {
+        host_time_us = next;
+    }
+    // 期限になったタスクを待ち始めた順に起こす
+    for (;;) {
+        struct _host_tcb* w = NULL;
+        for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+            if (t->state == T_BLOCKED && t->wake_us <= host_time_us && (w == NULL || t->seq < w->seq)) {
+                w = t;
+            }
+        }
+        if (w == NULL) {
+            break;
+        }
+        host_make_ready(w);
+        w->timed_out = true;
+    }
+}
+
+// ================================================================================================
+// タスクの切り替え(実行中のタスクから呼ぶ、実行中のタスクの状態は設定済み)
+// ================================================================================================
+static void host_schedule(void)
+{
+    struct _host_tcb*   self = host_cur;
+    struct _host_thr*   thr = self->thr;
+    bool                exiting = (self->state == T_DELETED);
+    struct _host_tcb*   next;
+
+    host_cur = NULL;
+    while ((next = host_pick()) == NULL) {
+        host_idle();
+    }
+    host_cur    = next;
+    next->busy  = 0;
+    if (exiting) {
+        pthread_cond_broadcast(&host_cond);
+        pthread_mutex_unlock(&host_big);
+        pthread_exit(NULL);
+    }
+    if (next == self) {
+        return;
+    }
+    pthread_cond_broadcast(&host_cond);
+    for (;;) {
+        if (thr->kill) {
+            pthread_mutex_unlock(&host_big);
+            pthread_exit(NULL);
+        }
+        if (host_cur == self) {
+            return;
+        }
+        pthread_cond_wait(&host_cond, &host_big);
+    }
+}
+
+// 優先度の高いタスクが実行可能なら切り替える
+static void host_preempt(void)
+{
+    struct _host_tcb*   self = host_cur;
+    struct _host_tcb*   next;
+
+    if (self == NULL) {
+        return;
+    }
+    if (self->crit > 0) {
+        self->yield_pending = true;
+        return;
+    }
+    next = host_pick();
+    if (next != NULL && next != self && next->prio > self->prio) {
+        host_schedule();
+    }
+}
+
+// ================================================================================================
+// 待ち
+//     obj の通知(host_wake)または until_us まで待つ
+// return   false: 期限になった
+// ================================================================================================
+bool host_wait_us(const void* obj, uint64_t until_us)
+{
+    struct _host_tcb*   self = host_cur;
+
+    if (until_us <= host_time_us) {
+        return false;
+    }
+    if (self->crit > 0) {
+        host_abort("task '%s' blocks in a critical section", self->name);
+    }
+    self->state     = T_BLOCKED;
+    self->wait_obj  = obj;
+    self->wake_us   = until_us;
+    self->timed_out = false;
+    self->seq       = ++host_seq;
+    host_schedule();
+    return !self->timed_out;
+}
+
+void host_wake(const void* obj)
+{
+    bool    woken = false;
+
+    for (;;) {
+        struct _host_tcb* w = NULL;
+        for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+            if (t->state == T_BLOCKED && t->wait_obj == obj && (w == NULL || t->seq < w->seq)) {
+                w = t;
+            }
+        }
+        if (w == NULL) {
+            break;
+        }
+        host_make_ready(w);
+        woken = true;
+    }
+    if (woken) {
+        host_preempt();
+    }
+}
+
+void host_sleep_until_us(uint64_t until_us)
+{
+    host_wait_us(&host_delay_obj, until_us);
+}
+
+// 待たずに API を呼び続けたら 1tick 分CPUを使ったとみなす
+void host_busy(void)
+{
+    struct _host_tcb*   self = host_cur;
+
+    if (self != NULL && self->crit == 0 && ++self->busy >= HOST_BUSY_CALLS) {
+        self->busy = 0;
+        host_sleep_until_us((host_time_us / HOST_TICK_US + 1) * HOST_TICK_US);
+    }
+}
+
+void host_yield(void)
+{
+    struct _host_tcb*   self = host_cur;
+
+    host_make_ready(self);
+    host_schedule();
+}
+
+int host_task_count(void)
+{
+    int     n = 0;
+
+    for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+        if (t->state != T_DELETED) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// ================================================================================================
+// クリティカルセクション(実行中のタスクは1つなので、切り替えを止めるだけ)
+// ================================================================================================
+void host_critical_enter(portMUX_TYPE* mux)
+{
+    mux->count++;
+    if (host_cur != NULL) {
+        host_cur->crit++;
+    }
+}
+
+void host_critical_exit(portMUX_TYPE* mux)
+{
+    mux->count--;
+    if (host_cur != NULL && --host_cur->crit == 0 && host_cur->yield_pending) {
+        host_cur->yield_pending = false;
+        host_preempt();
+    }
+}
+
+// ================================================================================================
+// タスク
+// ================================================================================================
+static void* host_task_entry(void* arg)
+{
+    struct _host_tcb*   self = arg;
+    struct _host_thr    thr = { false };
+
+    pthread_mutex_lock(&host_big);
+    self->thr = &thr;
+    pthread_cond_broadcast(&host_cond);
+    while (host_cur != self) {
+        if (thr.kill) {
+            pthread_mutex_unlock(&host_big);
+            return NULL;
+        }
+        pthread_cond_wait(&host_cond, &host_big);
+    }
+    self->func(self->param);
+    host_abort("task '%s' returned", self->name);
+}
+
+static TaskHandle_t host_task_start(struct _host_tcb* t, TaskFunction_t func, const char* name, void* param, UBaseType_t prio)
+{
+    pthread_attr_t  attr;
+    pthread_t       th;
+
+    t->magic        = HOST_TCB_MAGIC;
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->prio         = (prio < configMAX_PRIORITIES) ? prio : configMAX_PRIORITIES - 1;
+    t->number       = ++host_task_number;
+    t->func         = func;
+    t->param        = param;
+    t->state        = T_SUSPENDED;
+    t->wake_us      = UINT64_MAX;
+    t->next         = host_tasks;
+    host_tasks      = t;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, HOST_THREAD_STACK);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&th, &attr, host_task_entry, t) != 0) {
+        host_abort("pthread_create failed");
+    }
+    pthread_attr_destroy(&attr);
+    while (t->thr == NULL) {
+        pthread_cond_wait(&host_cond, &host_big);
+    }
+    host_make_ready(t);
+    host_preempt();
+    return t;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char* name, uint32_t stack, void* param,
+                                   UBaseType_t prio, TaskHandle_t* handle, BaseType_t core)
+{
+    struct _host_tcb*   t = calloc(1, sizeof(*t));
+    uint8_t*            s = malloc(stack);
+    TaskHandle_t        h;
+
+    if (t == NULL || s == NULL) {
+        free(t);
+        free(s);
+        return pdFAIL;
+    }
+    memset(s, 0xa5, stack);
+    t->stack        = s;
+    t->stack_size   = stack;
+    h = host_task_start(t, func, name, param, prio);
+    if (handle != NULL) {
+        *handle = h;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t func, const char* name, uint32_t stack, void* param,
+                                           UBaseType_t prio, StackType_t* stack_buf, StaticTask_t* tcb, BaseType_t core)
+{
+    struct _host_tcb*   t = (struct _host_tcb*)tcb;
+
+    memset(t, 0, sizeof(*t));
+    t->is_static    = true;
+    t->stack_size   = stack;
+    // スタックを一部使ったことにする(スタック使用量の計測用)
+    memset(stack_buf, 0xa5, stack);
+    memset(stack_buf + stack - stack / 4, 0, stack / 4);
+    return host_task_start(t, func, name, param, prio);
+}
+
+static struct _host_tcb* host_tcb(TaskHandle_t task)
+{
+    struct _host_tcb*   t = (task != NULL) ? task : host_cur;
+
+    if (t == NULL || t->magic != HOST_TCB_MAGIC) {
+        host_abort("invalid task handle %p", task);
+    }
+    return t;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct _host_tcb*   t = host_tcb(task);
+
+    if (t == host_cur) {
+        // 後始末は IDLE で行う
+        t->state        = T_DELETED;
+        t->cleanup_next = host_cleanup;
+        host_cleanup    = t;
+        host_schedule();
+        return;
+    }
+    t->state = T_DELETED;
+    t->thr->kill = true;
+    pthread_cond_broadcast(&host_cond);
+    host_free_tcb(t);
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    struct _host_tcb*   t = host_tcb(task);
+
+    t->state    = T_SUSPENDED;
+    t->wait_obj = NULL;
+    t->wake_us  = UINT64_MAX;
+    if (t == host_cur) {
+        host_schedule();
+    }
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+    struct _host_tcb*   t = host_tcb(task);
+
+    if (t->state == T_SUSPENDED) {
+        host_make_ready(t);
+        host_preempt();
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0) {
+        host_yield();
+        return;
+    }
+    host_sleep_until_us(host_deadline(ticks));
+}
+
+void vTaskDelayUntil(TickType_t* prev, TickType_t ticks)
+{
+    *prev += ticks;
+    if ((int32_t)(*prev - xTaskGetTickCount()) > 0) {
+        host_sleep_until_us((uint64_t)*prev * HOST_TICK_US);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    host_busy();
+    return (TickType_t)(host_time_us / HOST_TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return host_cur;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu)
+{
+    return NULL;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    return host_task_count();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    struct _host_tcb*   t = host_tcb(task);
+
+    return t->stack_size - t->stack_size / 4;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+    static const eTaskState state[] = { eReady, eBlocked, eSuspended, eDeleted };
+    struct _host_tcb*       t = host_tcb(task);
+
+    return (t == host_cur) ? eRunning : state[t->state];
+}
+
+char* pcTaskGetTaskName(TaskHandle_t task)
+{
+    return host_tcb(task)->name;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* stat, UBaseType_t num, uint32_t* total)
+{
+    UBaseType_t n = 0;
+
+    for (struct _host_tcb* t = host_tasks; t != NULL && n < num; t = t->next) {
+        if (t->state == T_DELETED) {
+            continue;
+        }
+        memset(&stat[n], 0, sizeof(stat[n]));
+        stat[n].xHandle             = t;
+        stat[n].pcTaskName          = t->name;
+        stat[n].xTaskNumber         = t->number;
+        stat[n].eCurrentState       = eTaskGetState(t);
+        stat[n].uxCurrentPriority   = t->prio;
+        stat[n].uxBasePriority      = t->prio;
+        stat[n].usStackHighWaterMark = t->stack_size - t->stack_size / 4;
+        n++;
+    }
+    if (total != NULL) {
+        *total = 0;
+    }
+    return n;
+}
+
+void vTaskList(char* buf)
+{
+    static const char   state_ch[] = "RBSD";
+
+    buf[0] = '\0';
+    for (struct _host_tcb* t = host_tasks; t != NULL; t = t->next) {
+        buf += sprintf(buf, "%-16s%c\t%u\t%u\t%u\n", t->name, (t == host_cur) ? 'X' : state_ch[t->state], t->prio,
+                       t->stack_size - t->stack_size / 4, t->number);
+    }
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t prio)
+{
+    host_tcb(task)->prio = prio;
+    host_preempt();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return host_tcb(task)->prio;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+// ================================================================================================
+// タスク通知
+// ================================================================================================
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct _host_tcb*   self = host_cur;
+    uint64_t            until = host_deadline(ticks);
+    uint32_t            value;
+
+    host_busy();
+    while (self->notify == 0) {
+        if (!host_wait_us(&self->notify, until) && self->notify == 0) {
+            return 0;
+        }
+    }
+    value = self->notify;
+    self->notify = clear ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    struct _host_tcb*   t = host_tcb(task);
+
+    host_busy();
+    t->notify++;
+    host_wake(&t->notify);
+    return pdPASS;
+}
+
+// ================================================================================================
+// キュー
+// ================================================================================================
+static struct _host_queue* host_queue(QueueHandle_t q)
+{
+    struct _host_queue* hq = q;
+
+    if (hq == NULL || hq->magic != HOST_Q_MAGIC) {
+        host_abort("invalid queue %p", q);
+    }
+    return hq;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    struct _host_queue* q = calloc(1, sizeof(*q));
+
+    if (q == NULL) {
+        return NULL;
+    }
+    q->magic    = HOST_Q_MAGIC;
+    q->len      = len;
+    q->size     = item_size;
+    if (item_size > 0 && (q->buf = malloc(len * item_size)) == NULL) {
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    struct _host_queue* hq = host_queue(q);
+
+    hq->magic = 0;
+    free(hq->buf);
+    free(hq);
+}
+
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void* item, TickType_t ticks, bool front)
+{
+    struct _host_queue* hq = host_queue(q);
+    uint64_t            until = host_deadline(ticks);
+
+    host_busy();
+    while (hq->count >= hq->len) {
+        if (!host_wait_us(hq, until) && hq->count >= hq->len) {
+            return errQUEUE_FULL;
+        }
+    }
+    if (hq->size > 0) {
+        UBaseType_t pos;
+        if (front) {
+            hq->head = (hq->head + hq->len - 1) % hq->len;
+            pos = hq->head;
+        }
+        else {
+            pos = (hq->head + hq->count) % hq->len;
+        }
+        memcpy(&hq->buf[pos * hq->size], item, hq->size);
+    }
+    hq->count++;
+    host_wake(hq);
+    return pdPASS;
+}
+
+static BaseType_t host_queue_get(QueueHandle_t q, void* item, TickType_t ticks, bool remove)
+{
+    struct _host_queue* hq = host_queue(q);
+    uint64_t            until = host_deadline(ticks);
+
+    host_busy();
+    while (hq->count == 0) {
+        if (!host_wait_us(hq, until) && hq->count == 0) {
+            return pdFALSE;
+        }
+    }
+    if (hq->size > 0 && item != NULL) {
+        memcpy(item, &hq->buf[hq->head * hq->size], hq->size);
+    }
+    if (remove) {
+        hq->head = (hq->head + 1) % hq->len;
+        hq->count--;
+        host_wake(hq);
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks)
+{
+    return host_queue_get(q, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void* item, TickType_t ticks)
+{
+    return host_queue_get(q, item, ticks, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    struct _host_queue* hq = host_queue(q);
+
+    hq->count   = 0;
+    hq->head    = 0;
+    host_wake(hq);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    return host_queue(q)->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    struct _host_queue* hq = host_queue(q);
+
+    return hq->len - hq->count;
+}
+
+// ================================================================================================
+// セマフォ(要素サイズ0のキュー、count が取得できる数)
+// ================================================================================================
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t init)
+{
+    struct _host_queue* q = xQueueCreate(max, 0);
+
+    if (q != NULL) {
+        q->count = init;
+    }
+    return q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueGenericSend(sem, NULL, 0, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    vQueueDelete(sem);
+}
+
+// ================================================================================================
+// イベントグループ
+// ================================================================================================
+static struct _host_eg* host_eg(EventGroupHandle_t eg)
+{
+    struct _host_eg*    e = eg;
+
+    if (e == NULL || e->magic != HOST_EG_MAGIC) {
+        host_abort("invalid event group %p", eg);
+    }
+    return e;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct _host_eg*    e = calloc(1, sizeof(*e));
+
+    if (e != NULL) {
+        e->magic = HOST_EG_MAGIC;
+    }
+    return e;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t eg, EventBits_t bits)
+{
+    struct _host_eg*    e = host_eg(eg);
+
+    host_busy();
+    e->bits |= bits;
+    host_wake(e);
+    return e->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t eg, EventBits_t bits)
+{
+    struct _host_eg*    e = host_eg(eg);
+    EventBits_t         prev = e->bits;
+
+    e->bits &= ~bits;
+    return prev;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t eg)
+{
+    return host_eg(eg)->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t eg, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks)
+{
+    struct _host_eg*    e = host_eg(eg);
+    uint64_t            until = host_deadline(ticks);
+    EventBits_t         now;
+
+    host_busy();
+    for (;;) {
+        now = e->bits;
+        if (all ? (now & bits) == bits : (now & bits) != 0) {
+            break;
+        }
+        if (!host_wait_us(e, until)) {
+            return e->bits;
+        }
+    }
+    if (clear) {
+        e->bits &= ~bits;
+    }
+    return now;
+}
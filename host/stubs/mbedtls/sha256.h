@@ -0,0 +1,2 @@
+// ホスト側の代用(esp_host.h を参照)
+#include "../esp_host.h"
@@ -0,0 +1,3 @@
+// ホスト側の代用(esp_host.h を参照)
+#include "../esp_host.h"
+#include <unistd.h>
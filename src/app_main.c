@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
@@ -27,13 +28,32 @@
 #include "spp_test.h"
 #include "spp_init.h"
 #include "spp_user_hdr.h"
+#include "spp_outbox.h"
+#include "spp_ft.h"
+#include "spp_rpc.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_relay.h"
+#include "spp_hub.h"
+#include "spp_agg.h"
+#include "spp_bridge.h"
+#include "spp_metrics.h"
+#include "spp_mem.h"
+#include "spp_task.h"
+#include "spp_cpu.h"
+#include "spp_boot.h"
+#include "spp_connlat.h"
+#include "spp_link.h"
+#include "spp_scan.h"
+#include "spp_bond.h"
+#include "spp_disp.h"
+#include "spp_cap.h"
 #include "bt_utils.h"
 #include "uart_console.h"
 
 // LOG表示用TAG(関数名にしておく)
 #define TAG                 __func__
 
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
 // 接続先情報
 const char remote_device_name[] = REMOTE_DEVICE_NAME;   // デバイス名
 esp_bd_addr_t   host_bd_address;                        // BDアドレス
@@ -42,7 +62,6 @@ uint8_t         host_service_channel1;                  // サービスチャネ
 bool            found_scn1      = false;
 uint8_t         host_service_channel2;                  // サービスチャネル
 bool            found_scn2      = false;
-#endif  // SPP_CLIENT_MODE
 
 // ================================================================================================
 // USAGE
@@ -55,17 +74,45 @@ static void main_loop_usage(void)
     printf("    r : Reboot system\n");                      // リブート
     printf("    L : Show paired devices\n");                // ペアリング済みデバイスを表示
     printf("    C : Remove paired devices\n");              // ペアリング済みデバイスをすべて削除
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
+    printf("    x : Remove a paired device\n");             // ペアリング済みデバイスを1台削除
+    printf("    p : Pin/unpin a paired device\n");          // ペアリング済みデバイスの固定/解除
+    printf("    o : Put test data to outbox\n");            // outboxにテストデータを登録
+    printf("    O : Show outbox status\n");                 // outboxの状態表示
+    printf("    F : Show storage files\n");                 // ストレージのファイル一覧表示
+    printf("    S : Start SPP servers\n");                  // SPPサーバの開始
+    printf("    R : Toggle relay mode\n");                  // 中継モードの切り替え
+    printf("    h : Publish test data to hub\n");           // 配信ハブにテストデータを登録
+    printf("    H : Show hub status\n");                    // 配信ハブの状態表示
+    printf("    A : Show aggregator status\n");             // 集約の状態表示
+    printf("    I : Show pipeline status\n");               // 処理パイプラインの状態表示
+    printf("    j : Show UART bridge status\n");            // UARTブリッジの状態表示
+    printf("    m : Show metrics\n");                       // メトリクスの表示
+    printf("    M : Show memory usage\n");                  // メモリ使用量の表示
+    printf("    J : Configure UART bridge\n");              // UARTブリッジの設定
+    printf("    i : Set pipeline chain for a device\n");    // 接続先ごとの処理パイプラインの設定
+    printf("    U : Change aggregator output\n");           // 集約の出力先切り替え
     printf("    a : Enter the BD address Manually\n");      // BD addressの手動入力
     printf("    d : Start name discovery\n");               // Name Discoveryの開始
     printf("    D : Stop name discovery\n");                // Name Discoveryの停止
     printf("    e : Start service discovery(SPP)\n");       // サービス検出開始(SPP)
     printf("    f : Connect 1st channel\n");                // 接続(チャネル1)
     printf("    g : Connect 2nd channel\n");                // 接続(チャネル2)
-#endif  // SPP_CLIENT_MODE
+    printf("    l : Show connection latency\n");            // 接続所要時間の表示
+    printf("    B : Connection benchmark\n");               // 接続のベンチマーク
+    printf("    k : Show link status\n");                   // 接続先ごとの状態表示
+    printf("    K : Toggle QoS control\n");                 // QoS制御の切り替え
+    printf("    E : Show event dispatcher status\n");       // イベント配送の状態表示
+    printf("    y : Start/stop capture\n");                 // キャプチャの開始/停止
+    printf("    Y : Export capture\n");                     // キャプチャの書き出し
+    printf("    v : Show scan profile\n");                  // スキャンプロファイルの表示
+    printf("    V : Select scan profile\n");                // スキャンプロファイルの選択
 #ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
     printf("    t : Show task list\n");                     // タスクリストの表示
+    printf("    P : Show core load and stack usage\n");     // コアごとの使用率とスタック使用量の表示
+    printf("    c : Show CPU usage per task\n");            // タスクごとのCPU使用率表示
+    printf("    b : Show boot timeline\n");                 // 起動時間の表示
 #endif // CONFIG_FREERTOS_USE_TRACE_FACILITY
+    printf("    z : Show connections and servers\n");      // 接続とサーバごとの状態表示
     printf("    Z : close all channels\n");                 // すべてのチャネルを切断
     printf("=================================================================\n");
 }
@@ -77,18 +124,55 @@ void app_main(void)
 {
     esp_err_t err;
 
+    // 起動時間の計測開始
+    spp_boot_init();
     ESP_LOGI(TAG, "==== application start ====================");
     // NVS初期化
+    spp_boot_begin(BOOT_NVS_INIT);
     err = nvs_flash_init();
+    spp_boot_end(BOOT_NVS_INIT);
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        spp_boot_begin(BOOT_NVS_ERASE);
         ESP_ERROR_CHECK(nvs_flash_erase());
         err = nvs_flash_init();
+        spp_boot_end(BOOT_NVS_ERASE);
     }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "initialize nvs failed: %s", esp_err_to_name(err));
         abort();
     }
 
+    spp_boot_begin(BOOT_SERVICES);
+    // データタスク配置の初期化
+    spp_task_init();
+    // メトリクスの初期化(他のサービスより先に)
+    spp_metrics_init();
+    // outbox初期化(パーティションがなければ無効)
+    spp_outbox_init();
+    // ファイル転送用ストレージのマウント
+    spp_ft_init();
+    // RPCの組み込みメソッドの登録
+    spp_rpc_init();
+    // タスクごとのCPU使用率の計測開始
+    spp_cpu_init();
+    // 中継用バッファプールの初期化
+    spp_relay_init();
+    // 配信ハブの初期化
+    spp_hub_init();
+    // 集約のマージタスク生成
+    spp_agg_init();
+    // 受信データの処理パイプラインの初期化
+    spp_pipe_init();
+    // UARTブリッジ(UARTドライバのインストール)
+    spp_bridge_init();
+    // 接続所要時間の計測
+    spp_connlat_init();
+    // 接続先ごとのQoS制御
+    spp_link_init();
+    // 接続の終了の監視
+    spp_conn_init();
+    spp_boot_end(BOOT_SERVICES);
+
     // Bluetooth初期化
     err = spp_init(ESP_SPP_MODE_VFS);
     if (err != ESP_OK) {
@@ -106,18 +190,158 @@ void app_main(void)
             main_loop_usage();
             break;
           case 'q' :                                    // ループを抜ける
+            spp_bond_poll(true);
             term_flag = true;
             break;
           case 'r' :                                    // reboot
+            spp_bond_poll(true);
             esp_restart();
             break;
           case 'L' :                                    // ペアリング済みデバイスを表示
-            show_paired_devices();
+            spp_bond_show();
             break;
           case 'C' :                                    // ペアリング済みデバイスをすべて削除
-            remove_all_paired_devices();
+            spp_bond_remove_all();
+            break;
+          case 'x' :                                    // ペアリング済みデバイスを1台削除
+          case 'p' :                                    // ペアリング済みデバイスの固定/解除
+            {
+                esp_bd_addr_t   bond_addr;
+                char            bond_addr_buff[20];
+                printf("**** input paired BD address : ");
+                fflush(stdout);
+                uart_gets(bond_addr_buff, sizeof(bond_addr_buff));
+                if (!str_to_bdaddr(bond_addr_buff, bond_addr)) {
+                    printf("    !! INPUT ERROR !!\n");
+                }
+                else if (!spp_bond_is_bonded(bond_addr)) {
+                    printf("    not paired\n");
+                }
+                else if (in_key == 'x') {
+                    spp_bond_remove(bond_addr);
+                }
+                else {
+                    printf("**** pin (y/n) : ");
+                    fflush(stdout);
+                    uart_gets(bond_addr_buff, sizeof(bond_addr_buff));
+                    spp_bond_pin(bond_addr, bond_addr_buff[0] == 'y');
+                    spp_bond_show();
+                }
+            }
+            break;
+          case 'o' :                                    // outboxにテストデータを登録
+            {
+                static int  test_cnt = 0;
+                char        test_buff[32];
+                int         test_len = snprintf(test_buff, sizeof(test_buff), "outbox test %d\r\n", test_cnt++);
+                esp_err_t   ret = spp_outbox_put(test_buff, test_len);
+                if (ret != ESP_OK) {
+                    ESP_LOGE(TAG, "spp_outbox_put failed: %s", esp_err_to_name(ret));
+                }
+            }
+            break;
+          case 'O' :                                    // outboxの状態表示
+            spp_outbox_show();
+            break;
+          case 'F' :                                    // ストレージのファイル一覧表示
+            spp_ft_show_files();
+            break;
+          case 'S' :                                    // SPPサーバの開始
+            if (!spp_server_start_all()) {
+                printf("    servers already started\n");
+            }
+            break;
+          case 'R' :                                    // 中継モードの切り替え(以降の接続に適用)
+            spp_relay_enable = !spp_relay_enable;
+            spp_relay_show();
+            break;
+          case 'h' :                                    // 配信ハブにテストデータを登録
+            {
+                static int  hub_cnt = 0;
+                char        hub_buff[32];
+                int         hub_len = snprintf(hub_buff, sizeof(hub_buff), "hub test %d\r\n", hub_cnt++);
+                esp_err_t   ret = spp_hub_publish(hub_buff, hub_len);
+                if (ret != ESP_OK) {
+                    ESP_LOGE(TAG, "spp_hub_publish failed: %s", esp_err_to_name(ret));
+                }
+            }
+            break;
+          case 'H' :                                    // 配信ハブの状態表示
+            spp_hub_show();
+            break;
+          case 'A' :                                    // 集約の状態表示
+            spp_agg_show();
+            break;
+          case 'U' :                                    // 集約の出力先切り替え(UART → 接続順)
+            {
+                static int  agg_out_idx = -1;
+                int         fd;
+                while (++agg_out_idx < OPEN_HDR_NUM) {
+                    if (open_hdr_params[agg_out_idx].use) {
+                        break;
+                    }
+                }
+                if (agg_out_idx >= OPEN_HDR_NUM) {
+                    agg_out_idx = -1;
+                }
+                fd = spp_agg_set_output(agg_out_idx);
+                printf("    aggregator output : %s %d\n", (fd < 0) ? "UART" : "fd", fd);
+            }
+            break;
+          case 'I' :                                    // 処理パイプラインの状態表示
+            spp_pipe_show();
+            break;
+          case 'i' :                                    // 接続先ごとの処理パイプラインの設定
+            {
+                esp_bd_addr_t   pipe_addr;
+                char            pipe_buff[20];
+                printf("**** input BD address : ");
+                fflush(stdout);
+                uart_gets(pipe_buff, sizeof(pipe_buff));
+                if (!str_to_bdaddr(pipe_buff, pipe_addr)) {
+                    printf("    !! INPUT ERROR !!\n");
+                    break;
+                }
+                printf("**** input chain (0:echo 1:upper 2:nmea -1:default) : ");
+                fflush(stdout);
+                uart_gets(pipe_buff, sizeof(pipe_buff));
+                if (pipe_buff[0] == '\0' || spp_pipe_set_peer(pipe_addr, atoi(pipe_buff)) != ESP_OK) {
+                    printf("    !! INPUT ERROR !!\n");
+                    break;
+                }
+                spp_pipe_show();
+            }
+            break;
+          case 'm' :                                    // メトリクスの表示
+            spp_metrics_show();
+            break;
+          case 'M' :                                    // メモリ使用量の表示
+            spp_mem_show();
+            break;
+          case 'j' :                                    // UARTブリッジの状態表示
+            spp_bridge_show();
+            break;
+          case 'J' :                                    // UARTブリッジの設定
+            {
+                char    bridge_buff[12];
+                printf("**** input baud rate : ");
+                fflush(stdout);
+                uart_gets(bridge_buff, sizeof(bridge_buff));
+                uint32_t    baud = atoi(bridge_buff);
+                printf("**** RTS/CTS (y/n) : ");
+                fflush(stdout);
+                uart_gets(bridge_buff, sizeof(bridge_buff));
+                bool        flow = (bridge_buff[0] == 'y');
+                printf("**** input idle flush time (ms) : ");
+                fflush(stdout);
+                uart_gets(bridge_buff, sizeof(bridge_buff));
+                if (spp_bridge_config(baud, flow, atoi(bridge_buff)) != ESP_OK) {
+                    printf("    !! INPUT ERROR !!\n");
+                    break;
+                }
+                spp_bridge_show();
+            }
             break;
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
           case 'a' :                                    // BD addressの手動入力 *********************************
             printf("**** input target BD address : ");
             fflush(stdout);
@@ -152,6 +376,7 @@ void app_main(void)
                 受信可能応答数
                 0設定時は制限なし
             */
+            spp_connlat_mark(CONNLAT_INQ_START);
             esp_bt_gap_start_discovery(inq_mode, inq_len, inq_num_rsps);
             break;
           case 'D' :                                    // discovery停止 *********************************
@@ -159,6 +384,7 @@ void app_main(void)
             break;
           case 'e' :                                    // サービス検出 *********************************
             if (found_bd_addr) {
+                spp_connlat_mark(CONNLAT_SDP_START);
                 esp_spp_start_discovery(host_bd_address);
             } else { 
                 ESP_LOGE(TAG, "BD addr not found");
@@ -166,6 +392,7 @@ void app_main(void)
             break;
           case 'f' :                                    // 接続(チャネル1) *********************************
             if (found_scn1) {
+                spp_connlat_mark(CONNLAT_CONN_REQ);
                 esp_spp_connect(ESP_SPP_SEC_AUTHENTICATE, ESP_SPP_ROLE_MASTER, host_service_channel1, host_bd_address);
             } else {
                 ESP_LOGE(TAG, "service channel not found");
@@ -173,23 +400,99 @@ void app_main(void)
             break;
           case 'g' :                                    // 接続(チャネル2) *********************************
             if (found_scn2) {
+                spp_connlat_mark(CONNLAT_CONN_REQ);
                 esp_spp_connect(ESP_SPP_SEC_AUTHENTICATE, ESP_SPP_ROLE_MASTER, host_service_channel2, host_bd_address);
             } else {
                 ESP_LOGE(TAG, "service channel not found");
             }
             break;
-#endif  // SPP_CLIENT_MODE
+          case 'k' :                                    // 接続先ごとの状態表示
+            spp_link_show();
+            break;
+          case 'K' :                                    // QoS制御の切り替え
+            spp_link_qos_enable = !spp_link_qos_enable;
+            spp_link_show();
+            break;
+          case 'E' :                                    // イベント配送の状態表示
+            spp_disp_show();
+            break;
+          case 'v' :                                    // スキャンプロファイルの表示
+            spp_scan_show();
+            break;
+          case 'V' :                                    // スキャンプロファイルの選択
+            {
+                char    prof_buff[4];
+                printf("**** input profile (0:fast 1:balanced 2:low 3:auto) : ");
+                fflush(stdout);
+                uart_gets(prof_buff, sizeof(prof_buff));
+                int     prof = atoi(prof_buff);
+                if (prof_buff[0] >= '0' && prof <= SCAN_PROF_AUTO) {
+                    spp_scan_select(prof);
+                    spp_scan_show();
+                }
+                else {
+                    printf("    !! INPUT ERROR !!\n");
+                }
+            }
+            break;
+          case 'y' :                                    // キャプチャの開始/停止
+            if (spp_cap_running()) {
+                spp_cap_stop();
+            }
+            else {
+                spp_cap_start();
+            }
+            spp_cap_show();
+            break;
+          case 'Y' :                                    // キャプチャの書き出し(UART またはエコーバックの SPP接続)
+            {
+                char    cap_buff[8];
+                printf("**** input connection (empty:UART) : ");
+                fflush(stdout);
+                uart_gets(cap_buff, sizeof(cap_buff));
+                if (cap_buff[0] == '\0') {
+                    spp_cap_export(-1);
+                }
+                else {
+                    esp_err_t ret = spp_cap_export_request(atoi(cap_buff));
+                    if (ret != ESP_OK) {
+                        printf("    !! export not accepted : %s !!\n", esp_err_to_name(ret));
+                    }
+                }
+            }
+            break;
+          case 'l' :                                    // 接続所要時間の表示
+            spp_connlat_show();
+            break;
+          case 'B' :                                    // 接続のベンチマーク(SDP → 接続 → 切断 をくり返す)
+            {
+                char    count_buff[8];
+                printf("**** input repeat count : ");
+                fflush(stdout);
+                uart_gets(count_buff, sizeof(count_buff));
+                int     count = atoi(count_buff);
+                if (count > 0) {
+                    esp_err_t ret = spp_connlat_bench_start(count);
+                    if (ret != ESP_OK) {
+                        ESP_LOGE(TAG, "benchmark start failed: %s", esp_err_to_name(ret));
+                    }
+                }
+                else {
+                    printf("    !! INPUT ERROR !!\n");
+                }
+            }
+            break;
 #ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
           case 't' :                                    // タスクリストの表示
             {
                 // %HOMEPATH%\.platformio\packages\framework-espidf\examples\system\console\components\cmd_system\cmd_system.c から流用
 
-                const size_t bytes_per_task = 40;       // 1タスクあたりのメッセージ長
-                // メッセージ領域確保
-                char *task_list_buffer = malloc(uxTaskGetNumberOfTasks() * bytes_per_task);
-                if (task_list_buffer == NULL) {
-                    // 確保失敗
-                    ESP_LOGE(TAG, "failed to allocate buffer for vTaskList output");
+                #define BYTES_PER_TASK  40              // 1タスクあたりのメッセージ長
+                // メッセージ領域(毎回確保しないように静的に持つ)
+                static char task_list_buffer[SPP_TASK_STAT_MAX * BYTES_PER_TASK];
+                if (uxTaskGetNumberOfTasks() > SPP_TASK_STAT_MAX) {
+                    // 領域不足
+                    ESP_LOGE(TAG, "too many tasks for vTaskList output");
                 }
                 else {
                     // 確保成功
@@ -216,13 +519,24 @@ void app_main(void)
                         //      スタック空きサイズ
                         //      タスク番号
                         //      Core ID(-1はCore指定せず)
-
-                    // メッセージ領域解放
-                    free(task_list_buffer);
                 }
             }
             break;
+          case 'P' :                                    // コアごとの使用率とスタック使用量の表示
+            spp_task_show();
+            spp_task_show_stack();
+            break;
+          case 'c' :                                    // タスクごとのCPU使用率表示(直近1秒と10秒)
+            spp_cpu_show(1);
+            spp_cpu_show(10);
+            break;
 #endif // CONFIG_FREERTOS_USE_TRACE_FACILITY
+          case 'b' :                                    // 起動時間の表示
+            spp_boot_show();
+            break;
+          case 'z' :                                    // 接続とサーバごとの状態表示
+            spp_conn_show();
+            break;
           case 'Z' :                                    // すべてのチャネルを切断 *********************************
             spp_close_all_handle();
             break;
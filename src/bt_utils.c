@@ -26,46 +26,6 @@
 
 #define TAG                 __func__
 
-// ================================================================================================
-// ペアリング済みデバイスの表示
-// ================================================================================================
-void show_paired_devices(void)
-{
-    esp_bd_addr_t   dev_list[100];
-    int             paired_count = esp_bt_gap_get_bond_device_num(); //ペアリングしたデバイス数を取得
-    esp_err_t       result =  esp_bt_gap_get_bond_device_list(&paired_count, dev_list); //ペアリングしたデバイスのアドレス一覧を取得
-    if (result == ESP_OK) {
-        printf("    BT paired count : %d\n", paired_count);
-        for (int i = 0 ; i < paired_count; i++) {
-            printf("    [Device %d] : %s\n", i, bdaddr_to_str(dev_list[i], NULL));
-        }
-    }
-    else {
-        printf("    esp_bt_gap_get_bond_device_list failed\n");
-        return;
-    }
-}
-// ================================================================================================
-// ペアリング済み全デバイスのペアリング解除
-// ================================================================================================
-void remove_all_paired_devices(void)
-{
-    esp_bd_addr_t   dev_list[100];
-    int             paired_count = esp_bt_gap_get_bond_device_num(); //ペアリングしたデバイス数を取得
-    esp_err_t       result =  esp_bt_gap_get_bond_device_list(&paired_count, dev_list); //ペアリングしたデバイスのアドレス一覧を取得
-    if (result == ESP_OK) {
-        printf("    BT paired count : %d\n", paired_count);
-        for (int i = 0 ; i < paired_count; i++) {
-            printf("    clear [Device %d] : %s\n", i, bdaddr_to_str(dev_list[i], NULL));
-            esp_bt_gap_remove_bond_device(dev_list[i]);
-        }
-    }
-    else {
-        printf("    esp_bt_gap_get_bond_device_list failed\n");
-        return;
-    }
-}
-
 // ================================================================================================
 // BDアドレスを文字列に変換
 // ================================================================================================
@@ -7,7 +7,5 @@
 */
 
 // extern宣言
-extern void show_paired_devices(void);
-extern void remove_all_paired_devices(void);
 extern char* bdaddr_to_str(uint8_t* bd_addr, char* buff);
 extern bool str_to_bdaddr(char* buff, esp_bd_addr_t bd_addr);
@@ -23,6 +23,10 @@
 
 #include "spp_test.h"
 #include "spp_user_hdr.h"
+#include "spp_connlat.h"
+#include "spp_bond.h"
+#include "spp_link.h"
+#include "spp_metrics.h"
 #include "bt_utils.h"
 #include "uart_console.h"
 
@@ -47,6 +51,15 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
         ESP_LOGV(TAG, "    authentication : %s", (param->auth_cmpl.stat == ESP_BT_STATUS_SUCCESS) ? "success" : "fail");
         ESP_LOGV(TAG, "    status         : %d", param->auth_cmpl.stat);
         ESP_LOGV(TAG, "    device         : %s", param->auth_cmpl.device_name);
+        if (param->auth_cmpl.stat == ESP_BT_STATUS_SUCCESS) {
+            spp_connlat_mark(CONNLAT_AUTH_DONE);
+            spp_bond_added(param->auth_cmpl.bda);
+            spp_metrics_add(MET_AUTH_OK, 0, 1);
+        }
+        else {
+            spp_connlat_fail(CONNLAT_AUTH_DONE, param->auth_cmpl.stat);
+            spp_metrics_add(MET_AUTH_FAIL, 0, 1);
+        }
         break;
 
       case ESP_BT_GAP_PIN_REQ_EVT:           // Legacy Pairing Pin code request 
@@ -92,6 +105,7 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
       case ESP_BT_GAP_MODE_CHG_EVT:
         ESP_LOGV(TAG, "    BD_ADDR : %s", bdaddr_to_str(param->mode_chg.bda, NULL));
         ESP_LOGV(TAG, "    mode    : %d", param->mode_chg.mode);
+        spp_link_mode_chg(param->mode_chg.bda, param->mode_chg.mode);
         break;
 
       case ESP_BT_GAP_CONFIG_EIR_DATA_EVT :              // Config EIR(Extended Inquiry Response) data event
@@ -106,6 +120,9 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
       case ESP_BT_GAP_REMOVE_BOND_DEV_COMPLETE_EVT :     // ペアリング解除したとき
         ESP_LOGV(TAG, "    BD_ADDR : %s", bdaddr_to_str(param->remove_bond_dev_cmpl.bda, NULL));
         ESP_LOGV(TAG, "    status  : %d", param->remove_bond_dev_cmpl.status);
+        if (param->remove_bond_dev_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+            spp_bond_removed(param->remove_bond_dev_cmpl.bda);
+        }
         break;
 
       case ESP_BT_GAP_DISC_RES_EVT :                     //       Device discovery result event
@@ -135,23 +152,22 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
                 ESP_LOG_BUFFER_HEXDUMP(TAG, param->disc_res.prop[i].val, 240/* HCI_EXT_INQ_RESPONSE_LEN */, ESP_LOG_VERBOSE);
                 ;   // ↑の行をコメントアウトするとエラーになるので空行を入れておく
                 char bdname[ESP_BT_GAP_MAX_BDNAME_LEN + 1];
-                uint8_t bdname_len;
+                uint8_t bdname_len = 0;
                 bool eir_ret = get_name_from_eir(param->disc_res.prop[i].val, bdname, &bdname_len);
                 if (eir_ret) {
                     ESP_LOGV(TAG, "        %d    '%s'", bdname_len, bdname);
                 } else {
                     ESP_LOGV(TAG, "        **FAILED**");
                 }
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
                 if (strlen(remote_device_name) == bdname_len && strncmp(bdname, remote_device_name, bdname_len) == 0) {
                     memcpy(host_bd_address, param->disc_res.bda, ESP_BD_ADDR_LEN);
                     found_bd_addr   = true;
+                    spp_connlat_mark(CONNLAT_INQ_FOUND);
 #if 0   // 元のサンプルプログラムの処理は削除
                     esp_spp_start_discovery(host_bd_address);
                     esp_bt_gap_cancel_discovery();
 #endif
                 }
-#endif  // SPP_CLIENT_MODE
                 break;
               default :
                 break;
@@ -179,6 +195,7 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
         ESP_LOGV(TAG, "    BD_ADDR    : %s", bdaddr_to_str(param->read_rssi_delta.bda, NULL));
         ESP_LOGV(TAG, "    stat       : %d", param->read_rssi_delta.stat);
         ESP_LOGV(TAG, "    rssi_delta : %d", param->read_rssi_delta.rssi_delta);
+        spp_link_rssi(param->read_rssi_delta.bda, param->read_rssi_delta.stat, param->read_rssi_delta.rssi_delta);
         break;
 
       case ESP_BT_GAP_SET_AFH_CHANNELS_EVT :             //       Set AFH channels event
@@ -194,6 +211,7 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
         ESP_LOGV(TAG, "    BD_ADDR    : %s", bdaddr_to_str(param->qos_cmpl.bda, NULL));
         ESP_LOGV(TAG, "    stat       : %d", param->qos_cmpl.stat);
         ESP_LOGV(TAG, "    t_poll     : %d", param->qos_cmpl.t_poll);
+        spp_link_qos_cmpl(param->qos_cmpl.bda, param->qos_cmpl.stat, param->qos_cmpl.t_poll);
         break;
 
       default: 
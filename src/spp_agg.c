@@ -0,0 +1,422 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_agg.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define AGG_HDR_SIZE        (sizeof(struct _spp_agg_hdr))
+
+// キューに入れるレコード
+struct _agg_rec {
+    struct _spp_agg_hdr hdr;
+    TickType_t          arrival;        // 受信時刻
+    uint8_t             data[SPP_AGG_PAYLOAD_MAX];
+};
+
+// 接続ごとのキュー
+struct _agg_src {
+    bool                use;
+    int                 fd;
+    uint8_t             head;
+    uint8_t             num;
+    struct _agg_rec     q[SPP_AGG_QLEN];
+    uint32_t            received;
+    uint32_t            dropped;        // キューが一杯で捨てた
+    uint32_t            late;           // 遅着で捨てた
+};
+
+static struct _agg_src      agg_src[SPP_AGG_SRC_MAX];
+static uint8_t              agg_heap[SPP_AGG_SRC_MAX];  // キューにレコードがある接続(先頭の時刻が古い順のヒープ)
+static int                  agg_heap_num = 0;
+static uint32_t             agg_last_ts = 0;            // 最後に出力した時刻
+static bool                 agg_started = false;
+static uint32_t             agg_output = 0;             // 出力したレコード数
+static int                  agg_output_conn = -1;       // 出力先の接続(パラメータテーブルの添字、-1:UART)
+static uint32_t             agg_output_handle = 0;      // 出力先の接続のハンドル
+static int                  agg_output_fd = -1;
+static uint32_t             agg_output_lost = 0;        // 出力先の接続が切断されて出力できなかったレコード数
+static SemaphoreHandle_t    agg_mutex = NULL;
+static TaskHandle_t         agg_merge_handle = NULL;
+
+
+// ================================================================================================
+// ヒープ操作(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static inline uint32_t agg_key(int heap_idx)
+{
+    struct _agg_src* src = &agg_src[agg_heap[heap_idx]];
+    return src->q[src->head].hdr.ts_ms;
+}
+
+static void agg_heap_swap(int a, int b)
+{
+    uint8_t tmp = agg_heap[a];
+    agg_heap[a] = agg_heap[b];
+    agg_heap[b] = tmp;
+}
+
+static void agg_heap_up(int i)
+{
+    while (i > 0 && agg_key(i) < agg_key((i - 1) / 2)) {
+        agg_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void agg_heap_down(int i)
+{
+    while (1) {
+        int min = i;
+        int l   = i * 2 + 1;
+        int r   = i * 2 + 2;
+        if (l < agg_heap_num && agg_key(l) < agg_key(min)) {
+            min = l;
+        }
+        if (r < agg_heap_num && agg_key(r) < agg_key(min)) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+        agg_heap_swap(i, min);
+        i = min;
+    }
+}
+
+static void agg_heap_remove(int i)
+{
+    agg_heap_num--;
+    if (i < agg_heap_num) {
+        agg_heap[i] = agg_heap[agg_heap_num];
+        agg_heap_down(i);
+        agg_heap_up(i);
+    }
+}
+
+// ================================================================================================
+// レコードをキューに追加
+// ================================================================================================
+static void agg_push(int src_idx, const struct _spp_agg_hdr* hdr, const uint8_t* data)
+{
+    struct _agg_src*    src = &agg_src[src_idx];
+    struct _agg_rec*    rec;
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    src->received++;
+    if (agg_started && hdr->ts_ms < agg_last_ts) {
+        src->late++;
+    }
+    else if (src->num >= SPP_AGG_QLEN) {
+        src->dropped++;
+    }
+    else {
+        rec = &src->q[(src->head + src->num) % SPP_AGG_QLEN];
+        rec->hdr        = *hdr;
+        rec->arrival    = xTaskGetTickCount();
+        memcpy(rec->data, data, hdr->len);
+        src->num++;
+        if (src->num == 1) {
+            // 空だったキューをヒープに追加
+            agg_heap[agg_heap_num] = src_idx;
+            agg_heap_up(agg_heap_num++);
+        }
+    }
+    xSemaphoreGive(agg_mutex);
+    xTaskNotifyGive(agg_merge_handle);
+}
+
+// ================================================================================================
+// 出力先の接続が指定したときのままか(切断または切り替えで外れたら false)
+// ================================================================================================
+static bool agg_output_valid(int conn)
+{
+    bool    valid;
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    valid = (agg_output_conn == conn && open_hdr_params[conn].bd_handle == agg_output_handle);
+    xSemaphoreGive(agg_mutex);
+    return valid;
+}
+
+// ================================================================================================
+// 出力先の接続への送信(輻輳中は待って、書ききるまで繰り返す)
+// return   false: 出力先の接続が切断された
+// ================================================================================================
+static bool agg_send(int conn, int fd, const uint8_t* buf, int len)
+{
+    int sent = 0;
+
+    while (sent < len) {
+        int size_w = write(fd, &buf[sent], len - sent);
+        if (size_w < 0) {
+            return false;
+        }
+        if (size_w == 0) {
+            if (!agg_output_valid(conn) || (spp_conn_stopping(conn) && !spp_conn_draining(conn))) {
+                return false;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        spp_link_traffic(fd, size_w);
+        sent += size_w;
+    }
+    return true;
+}
+
+// ================================================================================================
+// レコード出力(出力先はレコードを取り出したときの指定)
+// ================================================================================================
+static void agg_emit(int src_idx, const struct _agg_rec* rec, int conn, int fd)
+{
+    if (conn >= 0) {
+        uint8_t frame[AGG_HDR_SIZE + SPP_AGG_PAYLOAD_MAX];
+        memcpy(frame, &rec->hdr, AGG_HDR_SIZE);
+        memcpy(&frame[AGG_HDR_SIZE], rec->data, rec->hdr.len);
+        if (!agg_send(conn, fd, frame, AGG_HDR_SIZE + rec->hdr.len)) {
+            xSemaphoreTake(agg_mutex, portMAX_DELAY);
+            agg_output_lost++;
+            xSemaphoreGive(agg_mutex);
+        }
+    }
+    else {
+        printf("AGG %10u src %d : %.*s\n", rec->hdr.ts_ms, agg_src[src_idx].fd, rec->hdr.len, (const char*)rec->data);
+    }
+}
+
+// ================================================================================================
+// マージタスク
+//     接続中の全接続のキューにレコードがあればヒープの先頭が最も古いので出力する
+//     そうでなければ先頭のレコードが SPP_AGG_WINDOW_MS 待ってから出力する
+// ================================================================================================
+static void agg_merge_task(void* param)
+{
+    struct _agg_rec rec;
+    int             src_idx;
+    int             out_conn;
+    int             out_fd;
+
+    while (1) {
+        bool    emit = false;
+
+        xSemaphoreTake(agg_mutex, portMAX_DELAY);
+        if (agg_heap_num > 0) {
+            // 接続中でキューが空の接続があれば、その接続からより古いレコードが届くかもしれない
+            // (切断済みの接続の残りのレコードは数えない)
+            int                 empty = 0;
+            struct _agg_src*    src = &agg_src[agg_heap[0]];
+            for (int i = 0; i < SPP_AGG_SRC_MAX; i++) {
+                if (agg_src[i].use && agg_src[i].num == 0) {
+                    empty++;
+                }
+            }
+            if (empty == 0 ||
+                xTaskGetTickCount() - src->q[src->head].arrival >= SPP_AGG_WINDOW_MS / portTICK_PERIOD_MS) {
+                src_idx     = agg_heap[0];
+                rec         = src->q[src->head];
+                src->head   = (src->head + 1) % SPP_AGG_QLEN;
+                src->num--;
+                if (src->num > 0) {
+                    agg_heap_down(0);
+                }
+                else {
+                    agg_heap_remove(0);
+                }
+                agg_last_ts = rec.hdr.ts_ms;
+                agg_started = true;
+                agg_output++;
+                out_conn    = agg_output_conn;
+                out_fd      = agg_output_fd;
+                emit        = true;
+            }
+        }
+        xSemaphoreGive(agg_mutex);
+
+        if (emit) {
+            agg_emit(src_idx, &rec, out_conn, out_fd);
+        }
+        else {
+            ulTaskNotifyTake(pdTRUE, 10 / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_agg_init(void)
+{
+    agg_mutex = xSemaphoreCreateMutex();
+    if (agg_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(agg_merge_task, "agg_merge_task", 3072, NULL, 5, &agg_merge_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 出力先の指定(パラメータテーブルの添字、-1:UART)
+//     接続のハンドルも記録し、その接続の停止要求(spp_agg_close)で UART に戻す
+// return   出力先の fd(-1:UART、接続中でない接続を指定したときも UART)
+// ================================================================================================
+int spp_agg_set_output(int conn)
+{
+    int         fd = -1;
+    uint32_t    handle = 0;
+
+    if (agg_mutex == NULL) {
+        return -1;
+    }
+    if (conn >= 0 && conn < OPEN_HDR_NUM && open_hdr_params[conn].use && !spp_conn_stopping(conn)) {
+        fd      = spp_conn_fd(conn);
+        handle  = open_hdr_params[conn].bd_handle;
+    }
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    agg_output_conn     = (fd >= 0) ? conn : -1;
+    agg_output_handle   = handle;
+    agg_output_fd       = fd;
+    xSemaphoreGive(agg_mutex);
+    return fd;
+}
+
+// ================================================================================================
+// クローズ通知(接続に停止要求を出したときに呼ぶ、出力先の接続なら UART に戻す)
+// ================================================================================================
+void spp_agg_close(int conn)
+{
+    if (agg_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    if (agg_output_conn == conn) {
+        agg_output_conn     = -1;
+        agg_output_handle   = 0;
+        agg_output_fd       = -1;
+    }
+    xSemaphoreGive(agg_mutex);
+}
+
+// ================================================================================================
+// 接続の登録の解除(強制終了されたときは監視タスクから呼ばれる)
+//     キューに残ったレコードは受信から SPP_AGG_WINDOW_MS 後に出力される
+// ================================================================================================
+static void agg_src_release(void* arg)
+{
+    struct _agg_src*    src = arg;
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    src->use = false;
+    xSemaphoreGive(agg_mutex);
+    xTaskNotifyGive(agg_merge_handle);
+}
+
+// ================================================================================================
+// 集約データタスク(SPP_AGG_SERVER_NAME の接続ごとに生成)
+// ================================================================================================
+void spp_agg_task(void* param)
+{
+    int                 conn = (int)(intptr_t)param;
+    int                 fd = spp_conn_fd(conn);
+    int                 src_idx = -1;
+    uint8_t             rx[(AGG_HDR_SIZE + SPP_AGG_PAYLOAD_MAX) * 2];
+    uint32_t            rx_len = 0;
+
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    for (int i = 0; i < SPP_AGG_SRC_MAX; i++) {
+        if (!agg_src[i].use && agg_src[i].num == 0) {
+            src_idx = i;
+            memset(&agg_src[i], 0, sizeof(agg_src[i]));
+            agg_src[i].use  = true;
+            agg_src[i].fd   = fd;
+            break;
+        }
+    }
+    xSemaphoreGive(agg_mutex);
+    if (src_idx < 0) {
+        ESP_LOGE(TAG, "source table full");
+        spp_conn_exit(conn);
+        return;
+    }
+    spp_conn_set_cleanup(conn, agg_src_release, &agg_src[src_idx]);
+
+    while (!spp_conn_stopping(conn)) {
+        struct _spp_agg_hdr hdr;
+        uint32_t            pos = 0;
+        int                 size_r = read(fd, &rx[rx_len], sizeof(rx) - rx_len);
+
+        if (size_r < 0) {
+            break;
+        }
+        if (size_r == 0) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            continue;
+        }
+        rx_len += size_r;
+        spp_link_traffic(fd, size_r);
+        while (rx_len - pos >= AGG_HDR_SIZE) {
+            memcpy(&hdr, &rx[pos], AGG_HDR_SIZE);
+            if (hdr.magic != SPP_AGG_MAGIC || hdr.type != SPP_AGG_TYPE || hdr.len > SPP_AGG_PAYLOAD_MAX) {
+                // レコードの先頭を探す
+                pos++;
+                continue;
+            }
+            if (rx_len - pos < AGG_HDR_SIZE + hdr.len) {
+                break;
+            }
+            agg_push(src_idx, &hdr, &rx[pos + AGG_HDR_SIZE]);
+            pos += AGG_HDR_SIZE + hdr.len;
+        }
+        memmove(rx, &rx[pos], rx_len - pos);
+        rx_len -= pos;
+    }
+
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    agg_src_release(&agg_src[src_idx]);
+    spp_conn_exit(conn);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_agg_show(void)
+{
+    if (agg_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(agg_mutex, portMAX_DELAY);
+    printf("    aggregator : output = %u  last ts = %u  output fd = %d  lost = %u\n", agg_output, agg_last_ts,
+            agg_output_fd, agg_output_lost);
+    for (int i = 0; i < SPP_AGG_SRC_MAX; i++) {
+        struct _agg_src* src = &agg_src[i];
+        if (src->use || src->num > 0) {
+            printf("    fd %2d  queued : %2d  received : %u  late : %u  dropped : %u\n",
+                    src->fd, src->num, src->received, src->late, src->dropped);
+        }
+    }
+    xSemaphoreGive(agg_mutex);
+}
@@ -0,0 +1,39 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 集約(SPP_AGG_SERVER_NAME の各接続から受信したレコードを時刻順に1本にまとめる)
+//     レコード形式(リトルエンディアン)
+//         0xA5 'T' len(1) rsv(1) ts_ms(4) + payload(len)
+//     接続ごとのキューに入れて、各キューの先頭をヒープで比較して時刻の古い順に出力する(k-way マージ)
+//     接続中の全接続のキューにレコードがあるか、受信してから SPP_AGG_WINDOW_MS 経過したら先頭を出力する(切断済みの接続の残りは数えない)
+//     出力済みの時刻より古いレコードは遅着(late)として捨てる
+//     出力先は UART(コンソール) または spp_agg_set_output() で指定した SPP 接続(切断されたら UART に戻る)
+//     接続への出力は輻輳中は待って書ききる(切断されて出力できなかったレコードは lost として数える)
+
+#define SPP_AGG_SRC_MAX         OPEN_HDR_NUM    // 接続数
+#define SPP_AGG_QLEN            16              // 接続ごとのキュー長
+#define SPP_AGG_PAYLOAD_MAX     32              // レコードの最大ペイロード長
+#define SPP_AGG_WINDOW_MS       200             // 並べ替えを待つ時間
+
+#define SPP_AGG_MAGIC           0xA5
+#define SPP_AGG_TYPE            'T'
+
+struct _spp_agg_hdr {
+    uint8_t         magic;
+    uint8_t         type;
+    uint8_t         len;
+    uint8_t         rsv;
+    uint32_t        ts_ms;
+};
+
+// extern宣言
+extern esp_err_t spp_agg_init(void);
+extern void spp_agg_task(void* param);
+extern int spp_agg_set_output(int conn);
+extern void spp_agg_close(int conn);
+extern void spp_agg_show(void);
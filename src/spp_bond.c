@@ -0,0 +1,507 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+
+#include "spp_bond.h"
+#include "bt_utils.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+static portMUX_TYPE         bond_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool                 bond_loaded = false;
+static struct _spp_bond     bond_tbl[SPP_BOND_MAX];
+static int8_t               bond_hash[SPP_BOND_HASH];       // 先頭のインデックス(-1:なし)
+static int8_t               bond_head = -1;                 // LRUリストの先頭(最近使った)
+static int8_t               bond_tail = -1;                 // LRUリストの末尾(最も長く使っていない)
+static int                  bond_count = 0;
+static uint32_t             bond_evicted = 0;               // LRUで解除した数
+static bool                 bond_lru_dirty = false;         // 使用順の変更を保存していない
+static TickType_t           bond_lru_dirty_tick;            // 最初に保存しなかった変更の時刻
+static uint32_t             bond_lru_saves = 0;             // 使用順の保存回数
+
+// LRUの順序と使用回数(NVSの "lru" に最近使った順に保存する)
+struct _bond_rec {
+    esp_bd_addr_t   bda;
+    uint8_t         rsv[2];
+    uint32_t        used;
+};
+
+
+// ================================================================================================
+// BDアドレスのハッシュ値(FNV-1a)
+// ================================================================================================
+static int bond_hash_of(const uint8_t* bda)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+        h = (h ^ bda[i]) * 16777619u;
+    }
+    return h & (SPP_BOND_HASH - 1);
+}
+
+// ================================================================================================
+// 検索(ロック取得済みで呼ぶこと)
+// return   インデックス(-1:なし)
+// ================================================================================================
+static int bond_find(const uint8_t* bda)
+{
+    for (int i = bond_hash[bond_hash_of(bda)]; i >= 0; i = bond_tbl[i].hnext) {
+        if (memcmp(bond_tbl[i].bda, bda, ESP_BD_ADDR_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// ================================================================================================
+// LRUリストの操作(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void bond_lru_unlink(int i)
+{
+    struct _spp_bond* b = &bond_tbl[i];
+    if (b->prev >= 0) {
+        bond_tbl[b->prev].next = b->next;
+    }
+    else {
+        bond_head = b->next;
+    }
+    if (b->next >= 0) {
+        bond_tbl[b->next].prev = b->prev;
+    }
+    else {
+        bond_tail = b->prev;
+    }
+    b->prev = b->next = -1;
+}
+
+static void bond_lru_push_front(int i)
+{
+    struct _spp_bond* b = &bond_tbl[i];
+    b->prev = -1;
+    b->next = bond_head;
+    if (bond_head >= 0) {
+        bond_tbl[bond_head].prev = i;
+    }
+    bond_head = i;
+    if (bond_tail < 0) {
+        bond_tail = i;
+    }
+}
+
+// ================================================================================================
+// 追加/削除(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static int bond_insert(const uint8_t* bda)
+{
+    for (int i = 0; i < SPP_BOND_MAX; i++) {
+        struct _spp_bond* b = &bond_tbl[i];
+        if (!b->use) {
+            int h = bond_hash_of(bda);
+            memset(b, 0, sizeof(*b));
+            b->use      = true;
+            memcpy(b->bda, bda, ESP_BD_ADDR_LEN);
+            b->hnext    = bond_hash[h];
+            bond_hash[h] = i;
+            bond_lru_push_front(i);
+            bond_count++;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void bond_delete(int i)
+{
+    int8_t* p = &bond_hash[bond_hash_of(bond_tbl[i].bda)];
+    while (*p >= 0 && *p != i) {
+        p = &bond_tbl[*p].hnext;
+    }
+    if (*p == i) {
+        *p = bond_tbl[i].hnext;
+    }
+    bond_lru_unlink(i);
+    bond_tbl[i].use = false;
+    bond_count--;
+}
+
+// ================================================================================================
+// 上限を超えていたら最も長く使っていないデバイスをミラーから外す(ロック取得済みで呼ぶこと)
+//     keep は対象外(追加したばかりのデバイス)
+// return   外したデバイスがあれば true(victim にBDアドレス)
+// ================================================================================================
+static bool bond_evict(int keep, esp_bd_addr_t victim)
+{
+    if (bond_count <= SPP_BOND_CAPACITY) {
+        return false;
+    }
+    for (int i = bond_tail; i >= 0; i = bond_tbl[i].prev) {
+        if (i != keep && !bond_tbl[i].pinned) {
+            memcpy(victim, bond_tbl[i].bda, ESP_BD_ADDR_LEN);
+            bond_delete(i);
+            bond_evicted++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ================================================================================================
+// 固定したデバイスの保存/読み出し
+// ================================================================================================
+static void bond_pins_save(void)
+{
+    esp_bd_addr_t   pins[SPP_BOND_MAX];
+    int             n = 0;
+    nvs_handle_t    handle;
+
+    portENTER_CRITICAL(&bond_mux);
+    for (int i = 0; i < SPP_BOND_MAX; i++) {
+        if (bond_tbl[i].use && bond_tbl[i].pinned) {
+            memcpy(pins[n++], bond_tbl[i].bda, ESP_BD_ADDR_LEN);
+        }
+    }
+    portEXIT_CRITICAL(&bond_mux);
+    if (nvs_open(SPP_BOND_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_blob(handle, "pins", pins, n * sizeof(esp_bd_addr_t));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+static void bond_pins_load(void)
+{
+    esp_bd_addr_t   pins[SPP_BOND_MAX];
+    size_t          len = sizeof(pins);
+    nvs_handle_t    handle;
+
+    if (nvs_open(SPP_BOND_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, "pins", pins, &len) == ESP_OK) {
+        portENTER_CRITICAL(&bond_mux);
+        for (int n = 0; n < len / sizeof(esp_bd_addr_t); n++) {
+            int i = bond_find(pins[n]);
+            if (i >= 0) {
+                bond_tbl[i].pinned = true;
+            }
+        }
+        portEXIT_CRITICAL(&bond_mux);
+    }
+    nvs_close(handle);
+}
+
+// ================================================================================================
+// LRUの順序と使用回数の保存/読み出し
+//     Bluedroidの一覧には使用順がないので、再起動後も同じ順で解除するために保存する
+//     保存していないデバイス(保存前にペアリングしたもの)は最も古い側に置く
+// ================================================================================================
+static void bond_lru_save(void)
+{
+    struct _bond_rec    rec[SPP_BOND_MAX];
+    int                 n = 0;
+    nvs_handle_t        handle;
+
+    memset(rec, 0, sizeof(rec));
+    portENTER_CRITICAL(&bond_mux);
+    for (int i = bond_head; i >= 0 && n < SPP_BOND_MAX; i = bond_tbl[i].next) {
+        memcpy(rec[n].bda, bond_tbl[i].bda, ESP_BD_ADDR_LEN);
+        rec[n++].used = bond_tbl[i].used;
+    }
+    bond_lru_dirty = false;
+    bond_lru_saves++;
+    portEXIT_CRITICAL(&bond_mux);
+    if (nvs_open(SPP_BOND_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_blob(handle, "lru", rec, n * sizeof(struct _bond_rec));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+static void bond_lru_load(void)
+{
+    struct _bond_rec    rec[SPP_BOND_MAX];
+    size_t              len = sizeof(rec);
+    nvs_handle_t        handle;
+
+    if (nvs_open(SPP_BOND_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, "lru", rec, &len) == ESP_OK) {
+        portENTER_CRITICAL(&bond_mux);
+        // 古い方から順に先頭に移すと保存した順になる
+        for (int n = len / sizeof(struct _bond_rec) - 1; n >= 0; n--) {
+            int i = bond_find(rec[n].bda);
+            if (i >= 0) {
+                bond_tbl[i].used = rec[n].used;
+                bond_lru_unlink(i);
+                bond_lru_push_front(i);
+            }
+        }
+        portEXIT_CRITICAL(&bond_mux);
+    }
+    nvs_close(handle);
+}
+
+// ================================================================================================
+// Bluedroidから一覧を読み込む(esp_bluedroid_enable の後に1回だけ呼ぶ)
+// ================================================================================================
+esp_err_t spp_bond_load(void)
+{
+    int             num = esp_bt_gap_get_bond_device_num();
+    esp_bd_addr_t*  list = NULL;
+    esp_bd_addr_t   victim;
+    esp_err_t       err = ESP_OK;
+
+    if (num > 0) {
+        list = malloc(num * sizeof(esp_bd_addr_t));
+        if (list == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        err = esp_bt_gap_get_bond_device_list(&num, list);
+        if (err != ESP_OK) {
+            free(list);
+            return err;
+        }
+    }
+
+    portENTER_CRITICAL(&bond_mux);
+    memset(bond_tbl, 0, sizeof(bond_tbl));
+    memset(bond_hash, -1, sizeof(bond_hash));
+    bond_head   = bond_tail = -1;
+    bond_count  = 0;
+    for (int n = 0; n < num && bond_count < SPP_BOND_MAX; n++) {
+        bond_insert(list[n]);
+    }
+    bond_loaded = true;
+    portEXIT_CRITICAL(&bond_mux);
+
+    // ミラーに入りきらない分は解除する
+    for (int n = SPP_BOND_MAX; n < num; n++) {
+        ESP_LOGW(TAG, "too many bonds, remove %s", bdaddr_to_str(list[n], NULL));
+        esp_bt_gap_remove_bond_device(list[n]);
+    }
+    free(list);
+
+    bond_pins_load();
+    bond_lru_load();
+    while (1) {
+        portENTER_CRITICAL(&bond_mux);
+        bool evicted = bond_evict(-1, victim);
+        portEXIT_CRITICAL(&bond_mux);
+        if (!evicted) {
+            break;
+        }
+        ESP_LOGI(TAG, "evict %s", bdaddr_to_str(victim, NULL));
+        esp_bt_gap_remove_bond_device(victim);
+    }
+    bond_lru_save();
+    ESP_LOGI(TAG, "%d bonded devices", bond_count);
+    return ESP_OK;
+}
+
+// ================================================================================================
+// ペアリング済みか
+// ================================================================================================
+bool spp_bond_is_bonded(esp_bd_addr_t bda)
+{
+    bool found;
+
+    portENTER_CRITICAL(&bond_mux);
+    found = bond_loaded && bond_find(bda) >= 0;
+    portEXIT_CRITICAL(&bond_mux);
+    return found;
+}
+
+// ================================================================================================
+// ペアリング済みデバイス数
+// ================================================================================================
+int spp_bond_num(void)
+{
+    return bond_count;
+}
+
+// ================================================================================================
+// ESP_BT_GAP_AUTH_CMPL_EVT(成功)
+//     上限を超えたら最も長く使っていないデバイスのペアリングを解除する
+// ================================================================================================
+void spp_bond_added(esp_bd_addr_t bda)
+{
+    esp_bd_addr_t   victim;
+    bool            evicted = false;
+    int             i;
+
+    portENTER_CRITICAL(&bond_mux);
+    if (!bond_loaded) {
+        portEXIT_CRITICAL(&bond_mux);
+        return;
+    }
+    i = bond_find(bda);
+    if (i < 0) {
+        i = bond_insert(bda);
+    }
+    else {
+        bond_lru_unlink(i);
+        bond_lru_push_front(i);
+    }
+    if (i >= 0) {
+        evicted = bond_evict(i, victim);
+    }
+    portEXIT_CRITICAL(&bond_mux);
+
+    if (i < 0) {
+        ESP_LOGW(TAG, "bond table full (all pinned) : %s", bdaddr_to_str(bda, NULL));
+    }
+    if (evicted) {
+        ESP_LOGI(TAG, "evict %s", bdaddr_to_str(victim, NULL));
+        esp_bt_gap_remove_bond_device(victim);
+    }
+    bond_lru_save();
+}
+
+// ================================================================================================
+// ESP_BT_GAP_REMOVE_BOND_DEV_COMPLETE_EVT
+// ================================================================================================
+void spp_bond_removed(esp_bd_addr_t bda)
+{
+    bool pinned = false;
+
+    portENTER_CRITICAL(&bond_mux);
+    int i = bond_loaded ? bond_find(bda) : -1;
+    if (i >= 0) {
+        pinned = bond_tbl[i].pinned;
+        bond_delete(i);
+    }
+    portEXIT_CRITICAL(&bond_mux);
+    if (pinned) {
+        bond_pins_save();
+    }
+    if (i >= 0) {
+        bond_lru_save();
+    }
+}
+
+// ================================================================================================
+// 接続時(最終使用の更新)
+//     NVSへの書き込みは接続ごとには行わず、spp_bond_poll() でまとめて保存する
+//     (追加/削除で解除する相手が変わるときはその場で保存する)
+// ================================================================================================
+void spp_bond_used(esp_bd_addr_t bda)
+{
+    portENTER_CRITICAL(&bond_mux);
+    int i = bond_loaded ? bond_find(bda) : -1;
+    if (i >= 0) {
+        bond_tbl[i].used++;
+        bond_lru_unlink(i);
+        bond_lru_push_front(i);
+        if (!bond_lru_dirty) {
+            bond_lru_dirty      = true;
+            bond_lru_dirty_tick = xTaskGetTickCount();
+        }
+    }
+    portEXIT_CRITICAL(&bond_mux);
+}
+
+// ================================================================================================
+// 保存していない使用順の変更を保存する(監視タスクから周期的に呼ぶ)
+//     最初の変更から SPP_BOND_FLUSH_MS 経っていれば保存する(force:すぐに保存する)
+// ================================================================================================
+void spp_bond_poll(bool force)
+{
+    bool save;
+
+    portENTER_CRITICAL(&bond_mux);
+    save = bond_lru_dirty &&
+           (force || xTaskGetTickCount() - bond_lru_dirty_tick >= SPP_BOND_FLUSH_MS / portTICK_PERIOD_MS);
+    portEXIT_CRITICAL(&bond_mux);
+    if (save) {
+        bond_lru_save();
+    }
+}
+
+// ================================================================================================
+// ペアリング解除(ミラーは ESP_BT_GAP_REMOVE_BOND_DEV_COMPLETE_EVT で更新する)
+// ================================================================================================
+esp_err_t spp_bond_remove(esp_bd_addr_t bda)
+{
+    if (!spp_bond_is_bonded(bda)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return esp_bt_gap_remove_bond_device(bda);
+}
+
+// ================================================================================================
+// 全デバイスのペアリング解除
+// ================================================================================================
+void spp_bond_remove_all(void)
+{
+    esp_bd_addr_t   list[SPP_BOND_MAX];
+    int             num = 0;
+
+    portENTER_CRITICAL(&bond_mux);
+    for (int i = bond_head; i >= 0; i = bond_tbl[i].next) {
+        memcpy(list[num++], bond_tbl[i].bda, ESP_BD_ADDR_LEN);
+    }
+    portEXIT_CRITICAL(&bond_mux);
+    printf("    BT paired count : %d\n", num);
+    for (int n = 0; n < num; n++) {
+        printf("    clear [Device %d] : %s\n", n, bdaddr_to_str(list[n], NULL));
+        esp_bt_gap_remove_bond_device(list[n]);
+    }
+}
+
+// ================================================================================================
+// 固定の設定/解除
+// ================================================================================================
+esp_err_t spp_bond_pin(esp_bd_addr_t bda, bool pin)
+{
+    portENTER_CRITICAL(&bond_mux);
+    int i = bond_loaded ? bond_find(bda) : -1;
+    if (i >= 0) {
+        bond_tbl[i].pinned = pin;
+    }
+    portEXIT_CRITICAL(&bond_mux);
+    if (i < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    bond_pins_save();
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 一覧表示(最近使った順)
+// ================================================================================================
+void spp_bond_show(void)
+{
+    struct _spp_bond    tbl[SPP_BOND_MAX];
+    int                 head;
+
+    portENTER_CRITICAL(&bond_mux);
+    memcpy(tbl, bond_tbl, sizeof(tbl));
+    head = bond_head;
+    portEXIT_CRITICAL(&bond_mux);
+
+    printf("    BT paired count : %d / %d  evicted %u  saved %u%s\n", bond_count, SPP_BOND_CAPACITY, bond_evicted,
+            bond_lru_saves, bond_lru_dirty ? " (pending)" : "");
+    int n = 0;
+    for (int i = head; i >= 0; i = tbl[i].next) {
+        printf("    [Device %d] : %s  %s  used %u\n", n++, bdaddr_to_str(tbl[i].bda, NULL),
+                tbl[i].pinned ? "pinned" : "      ", tbl[i].used);
+    }
+}
@@ -0,0 +1,48 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ペアリング済みデバイスの管理(RAM上のミラー)
+//     起動時に1回だけBluedroidから一覧を読み、以降はイベントで差分を反映する
+//         ESP_BT_GAP_AUTH_CMPL_EVT(成功)           → 追加
+//         ESP_BT_GAP_REMOVE_BOND_DEV_COMPLETE_EVT  → 削除
+//         ESP_SPP_OPEN_EVT / ESP_SPP_SRV_OPEN_EVT  → 最終使用の更新
+//     BDアドレスのハッシュ表で「ペアリング済みか」をO(1)で判定する
+//     SPP_BOND_CAPACITY を超えたら最も長く使っていないデバイスから1台ずつペアリングを解除する
+//     固定(pin)したデバイスは解除しない(固定はNVSに保存する)
+//     LRUの順序と使用回数もNVSに保存し、起動時に復元する
+//         接続による変更は SPP_BOND_FLUSH_MS ごとにまとめて書き込む(フラッシュの書き込み回数を抑える)
+//         追加/削除による変更はその場で書き込む
+
+#define SPP_BOND_MAX            16          // ミラーの大きさ
+#define SPP_BOND_CAPACITY       15          // Bluedroidに残すペアリング数の上限(次のペアリング用に1つ空けておく)
+#define SPP_BOND_HASH           32          // ハッシュ表の大きさ(2のべき乗)
+#define SPP_BOND_NVS_NAMESPACE  "spp_bond"
+#define SPP_BOND_FLUSH_MS       60000       // 接続による使用順の変更を保存するまでの時間
+
+struct _spp_bond {
+    bool            use;
+    bool            pinned;         // 固定(LRUで解除しない)
+    esp_bd_addr_t   bda;
+    int8_t          hnext;          // 同じハッシュ値の次(-1:なし)
+    int8_t          prev;           // LRUリスト(新しい側)
+    int8_t          next;           // LRUリスト(古い側)
+    uint32_t        used;           // 使用回数
+};
+
+// extern宣言
+extern esp_err_t spp_bond_load(void);
+extern bool spp_bond_is_bonded(esp_bd_addr_t bda);
+extern int spp_bond_num(void);
+extern void spp_bond_added(esp_bd_addr_t bda);
+extern void spp_bond_removed(esp_bd_addr_t bda);
+extern void spp_bond_used(esp_bd_addr_t bda);
+extern void spp_bond_poll(bool force);
+extern esp_err_t spp_bond_remove(esp_bd_addr_t bda);
+extern void spp_bond_remove_all(void);
+extern esp_err_t spp_bond_pin(esp_bd_addr_t bda, bool pin);
+extern void spp_bond_show(void);
@@ -0,0 +1,197 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "spp_boot.h"
+#include "spp_mem.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define BOOT_MAGIC          0x424F4F54      // "BOOT"
+#define BOOT_OPEN           0xFFFFFFFF      // 終了時刻未記録
+
+// 記録
+struct _boot_rec {
+    uint8_t         phase;
+    uint8_t         rsv[3];
+    uint32_t        begin_us;
+    uint32_t        end_us;
+};
+
+struct _boot_timeline {
+    uint32_t            magic;
+    uint32_t            num;
+    struct _boot_rec    rec[SPP_BOOT_REC_MAX];
+};
+
+static const char* const    boot_phase_name[BOOT_PHASE_NUM] = {
+    "app_main", "nvs init", "nvs erase", "services", "bt mem release", "ctrl init", "ctrl enable",
+    "bluedroid init", "bluedroid enable", "cb register", "spp init", "security", "device name",
+    "scan mode", "server start", "ready",
+};
+
+static RTC_NOINIT_ATTR struct _boot_timeline    boot_cur;       // 今回の起動(RTCメモリ)
+static struct _boot_timeline                    boot_prev;      // 前回の起動
+static portMUX_TYPE                             boot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+// ================================================================================================
+// 初期化(app_main の先頭で呼ぶ)
+//     RTCメモリに残っている前回の記録を退避してから今回の記録を始める
+// ================================================================================================
+void spp_boot_init(void)
+{
+    if (boot_cur.magic == BOOT_MAGIC && boot_cur.num <= SPP_BOOT_REC_MAX) {
+        boot_prev = boot_cur;
+    }
+    else {
+        boot_prev.magic = 0;
+        boot_prev.num   = 0;
+    }
+    boot_cur.magic  = BOOT_MAGIC;
+    boot_cur.num    = 0;
+    spp_boot_mark(BOOT_APP_START);
+}
+
+// ================================================================================================
+// 段階の開始
+// ================================================================================================
+void spp_boot_begin(uint8_t phase)
+{
+    uint32_t now;
+
+    // メモリの計測は時刻の記録の外で行う
+    spp_mem_phase_begin(phase);
+    now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&boot_mux);
+    if (boot_cur.num < SPP_BOOT_REC_MAX) {
+        struct _boot_rec* r = &boot_cur.rec[boot_cur.num++];
+        r->phase    = phase;
+        r->begin_us = now;
+        r->end_us   = BOOT_OPEN;
+    }
+    portEXIT_CRITICAL(&boot_mux);
+}
+
+// ================================================================================================
+// 段階の終了(同じ段階の未終了の記録のうち最も古いもの)
+// ================================================================================================
+void spp_boot_end(uint8_t phase)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&boot_mux);
+    for (int i = 0; i < boot_cur.num; i++) {
+        if (boot_cur.rec[i].phase == phase && boot_cur.rec[i].end_us == BOOT_OPEN) {
+            boot_cur.rec[i].end_us = now;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&boot_mux);
+    spp_mem_phase_end(phase);
+}
+
+// ================================================================================================
+// 段階の名前
+// ================================================================================================
+const char* spp_boot_phase_name(uint8_t phase)
+{
+    return (phase < BOOT_PHASE_NUM) ? boot_phase_name[phase] : "?";
+}
+
+// ================================================================================================
+// 時点の記録(開始と終了が同じ)
+// ================================================================================================
+void spp_boot_mark(uint8_t phase)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL(&boot_mux);
+    if (boot_cur.num < SPP_BOOT_REC_MAX) {
+        struct _boot_rec* r = &boot_cur.rec[boot_cur.num++];
+        r->phase    = phase;
+        r->begin_us = now;
+        r->end_us   = now;
+    }
+    portEXIT_CRITICAL(&boot_mux);
+}
+
+// ================================================================================================
+// 前回の起動の同じ段階(n 番目)の所要時間
+// return   -1: 記録なし
+// ================================================================================================
+static int32_t boot_prev_duration(uint8_t phase, int nth)
+{
+    for (int i = 0; i < boot_prev.num; i++) {
+        if (boot_prev.rec[i].phase == phase && nth-- == 0) {
+            if (boot_prev.rec[i].end_us == BOOT_OPEN) {
+                return -1;
+            }
+            return boot_prev.rec[i].end_us - boot_prev.rec[i].begin_us;
+        }
+    }
+    return -1;
+}
+
+// ================================================================================================
+// ウォーターフォール表示
+// ================================================================================================
+void spp_boot_show(void)
+{
+    struct _boot_timeline   tl;
+    uint32_t                last = 1;
+    int                     nth[BOOT_PHASE_NUM] = {0};
+
+    portENTER_CRITICAL(&boot_mux);
+    tl = boot_cur;
+    portEXIT_CRITICAL(&boot_mux);
+
+    for (int i = 0; i < tl.num; i++) {
+        if (tl.rec[i].end_us != BOOT_OPEN && tl.rec[i].end_us > last) {
+            last = tl.rec[i].end_us;
+        }
+    }
+    printf("    phase              start(ms)  time(ms)  prev(ms)  0 .. %u ms\n", last / 1000);
+    for (int i = 0; i < tl.num; i++) {
+        const struct _boot_rec* r = &tl.rec[i];
+        char                    bar[SPP_BOOT_BAR_WIDTH + 1];
+        uint32_t                end = (r->end_us == BOOT_OPEN) ? last : r->end_us;
+        int                     b = (uint64_t)r->begin_us * SPP_BOOT_BAR_WIDTH / last;
+        int                     e = (uint64_t)end * SPP_BOOT_BAR_WIDTH / last;
+        int32_t                 prev = (r->phase < BOOT_PHASE_NUM) ? boot_prev_duration(r->phase, nth[r->phase]++) : -1;
+
+        memset(bar, ' ', SPP_BOOT_BAR_WIDTH);
+        bar[SPP_BOOT_BAR_WIDTH] = '\0';
+        if (b >= SPP_BOOT_BAR_WIDTH) {
+            b = SPP_BOOT_BAR_WIDTH - 1;
+        }
+        for (int x = b; x <= e && x < SPP_BOOT_BAR_WIDTH; x++) {
+            bar[x] = (r->end_us == BOOT_OPEN) ? '.' : '#';
+        }
+        printf("    %-18s %7u.%u  %6u.%u  ", (r->phase < BOOT_PHASE_NUM) ? boot_phase_name[r->phase] : "?",
+                r->begin_us / 1000, (r->begin_us / 100) % 10, (end - r->begin_us) / 1000, ((end - r->begin_us) / 100) % 10);
+        if (prev >= 0) {
+            printf("%6d.%d", prev / 1000, (prev / 100) % 10);
+        }
+        else {
+            printf("%8s", "-");
+        }
+        printf("  |%s|\n", bar);
+    }
+}
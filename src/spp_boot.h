@@ -0,0 +1,42 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 起動時間の計測
+//     起動処理の各段階の開始/終了時刻(esp_timer)を記録してウォーターフォール表示する
+//     非同期の完了(ESP_SPP_INIT_EVT, ESP_SPP_START_EVT)は要求時に開始、イベント受信時に終了を記録する
+//     記録はRTCメモリ(RTC_NOINIT)に置くので、ソフトウェアリセット後は前回の起動と比較できる
+
+#define SPP_BOOT_REC_MAX        32          // 記録数
+#define SPP_BOOT_BAR_WIDTH      40          // ウォーターフォールの幅
+
+// 段階
+#define BOOT_APP_START          0           // app_main 開始
+#define BOOT_NVS_INIT           1           // nvs_flash_init
+#define BOOT_NVS_ERASE          2           // nvs_flash_erase + 再初期化
+#define BOOT_SERVICES           3           // アプリケーションの各機能の初期化
+#define BOOT_BT_MEM_RELEASE     4           // esp_bt_controller_mem_release
+#define BOOT_CTRL_INIT          5           // esp_bt_controller_init
+#define BOOT_CTRL_ENABLE        6           // esp_bt_controller_enable
+#define BOOT_BLUEDROID_INIT     7           // esp_bluedroid_init
+#define BOOT_BLUEDROID_ENABLE   8           // esp_bluedroid_enable
+#define BOOT_CB_REGISTER        9           // コールバック登録
+#define BOOT_SPP_INIT           10          // esp_spp_init → ESP_SPP_INIT_EVT
+#define BOOT_SECURITY           11          // セキュリティパラメータ/PIN
+#define BOOT_DEV_NAME           12          // esp_bt_dev_set_device_name
+#define BOOT_SCAN_MODE          13          // spp_scan_start(esp_bt_gap_set_scan_mode)
+#define BOOT_SRV_START          14          // esp_spp_start_srv → ESP_SPP_START_EVT(サーバごと)
+#define BOOT_READY              15          // 接続受付可能
+#define BOOT_PHASE_NUM          16
+
+// extern宣言
+extern void spp_boot_init(void);
+extern void spp_boot_begin(uint8_t phase);
+extern void spp_boot_end(uint8_t phase);
+extern void spp_boot_mark(uint8_t phase);
+extern void spp_boot_show(void);
+extern const char* spp_boot_phase_name(uint8_t phase);
@@ -0,0 +1,439 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_bridge.h"
+#include "spp_link.h"
+#include "spp_metrics.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// ブロック
+struct _bridge_blk {
+    uint16_t        len;
+    uint8_t         data[SPP_BRIDGE_BLK_SIZE] __attribute__((aligned(4)));
+};
+
+// 向きごとのブロック
+struct _bridge_dir {
+    struct _bridge_blk      blk[SPP_BRIDGE_BLK_NUM];
+    QueueHandle_t           free_q;         // 空いているブロック(インデックス)
+    QueueHandle_t           full_q;         // 書き出し待ちのブロック(インデックス)
+    struct _spp_bridge_stat stat;
+};
+
+static struct _bridge_dir   to_spp;                         // UART → SPP
+static struct _bridge_dir   to_uart;                        // SPP → UART
+static QueueHandle_t        uart_evt_q = NULL;
+static volatile int         bridge_fd = -1;                 // ブリッジ中の接続(-1:なし)
+static int                  bridge_rd = -1;                 // SPPから読み込み中のブロック(to_uart)
+static int                  bridge_wr = -1;                 // SPPに書き出し中のブロック(to_spp)
+static uint32_t             bridge_wr_pos;                  // bridge_wr の書き出し済みのバイト数
+static int64_t              bridge_start_us;
+static uint32_t             bridge_baud = SPP_BRIDGE_BAUD;
+static bool                 bridge_flow = SPP_BRIDGE_FLOW;
+static volatile uint32_t    bridge_idle_ms = SPP_BRIDGE_IDLE_MS;
+static uint32_t             uart_overflow;                  // 受信FIFO/リングバッファのあふれ
+static uint32_t             uart_errors;                    // フレーミング/パリティエラー
+
+
+// ================================================================================================
+// ブロックの初期化
+// ================================================================================================
+static esp_err_t bridge_dir_init(struct _bridge_dir* dir)
+{
+    dir->free_q = xQueueCreate(SPP_BRIDGE_BLK_NUM, sizeof(int));
+    dir->full_q = xQueueCreate(SPP_BRIDGE_BLK_NUM, sizeof(int));
+    if (dir->free_q == NULL || dir->full_q == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < SPP_BRIDGE_BLK_NUM; i++) {
+        xQueueSend(dir->free_q, &i, 0);
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 読み込んだブロックを書き出し側に渡す
+// ================================================================================================
+static void bridge_dir_post(struct _bridge_dir* dir, int idx, bool idle)
+{
+    if (idle) {
+        dir->stat.idle++;
+    }
+    else {
+        dir->stat.full++;
+    }
+    xQueueSend(dir->full_q, &idx, portMAX_DELAY);
+}
+
+// ================================================================================================
+// 書き出し済みのブロックを返却する
+// ================================================================================================
+static void bridge_dir_done(struct _bridge_dir* dir, int idx)
+{
+    dir->stat.bytes += dir->blk[idx].len;
+    dir->stat.blocks++;
+    dir->blk[idx].len = 0;
+    xQueueSend(dir->free_q, &idx, portMAX_DELAY);
+}
+
+// ================================================================================================
+// UART受信タスク(UART → ブロック)
+//     空きブロックがないとき、接続がないときは読まない(ドライバのリングバッファに溜まり、RTS で止まる)
+// ================================================================================================
+static void uart_rx_task(void* param)
+{
+    int         cur = -1;
+    TickType_t  last_rx = xTaskGetTickCount();
+
+    while (true) {
+        uart_event_t    evt;
+        TickType_t      wait = bridge_idle_ms / portTICK_PERIOD_MS;
+
+        if (xQueueReceive(uart_evt_q, &evt, (wait > 0) ? wait : 1) == pdTRUE) {
+            switch (evt.type) {
+              case UART_FIFO_OVF :
+              case UART_BUFFER_FULL :
+                uart_overflow++;
+                break;
+              case UART_FRAME_ERR :
+              case UART_PARITY_ERR :
+                uart_errors++;
+                break;
+              default :
+                break;
+            }
+        }
+        if (bridge_fd < 0) {
+            continue;
+        }
+
+        size_t avail = 0;
+        uart_get_buffered_data_len(SPP_BRIDGE_UART, &avail);
+        while (avail > 0) {
+            if (cur < 0) {
+                if (xQueueReceive(to_spp.free_q, &cur, 0) != pdTRUE) {
+                    // SPP側の書き出しが追いついていない
+                    to_spp.stat.stall++;
+                    if (xQueueReceive(to_spp.free_q, &cur, 100 / portTICK_PERIOD_MS) != pdTRUE) {
+                        cur = -1;
+                        break;
+                    }
+                }
+                to_spp.blk[cur].len = 0;
+            }
+            struct _bridge_blk* blk = &to_spp.blk[cur];
+            size_t              n = SPP_BRIDGE_BLK_SIZE - blk->len;
+            int                 size_r = uart_read_bytes(SPP_BRIDGE_UART, &blk->data[blk->len], (avail < n) ? avail : n, 0);
+            if (size_r <= 0) {
+                break;
+            }
+            blk->len    += size_r;
+            avail       -= size_r;
+            last_rx     = xTaskGetTickCount();
+            if (blk->len == SPP_BRIDGE_BLK_SIZE) {
+                bridge_dir_post(&to_spp, cur, false);
+                cur = -1;
+            }
+        }
+        // 受信が途切れたら途中のブロックも書き出す
+        if (cur >= 0 && to_spp.blk[cur].len > 0 && xTaskGetTickCount() - last_rx >= wait) {
+            bridge_dir_post(&to_spp, cur, true);
+            cur = -1;
+        }
+    }
+}
+
+// ================================================================================================
+// UART送信タスク(ブロック → UART)
+//     送信リングバッファがいっぱいのとき(CTS で止められているとき)は待つ
+// ================================================================================================
+static void uart_tx_task(void* param)
+{
+    int idx;
+
+    while (true) {
+        if (xQueueReceive(to_uart.full_q, &idx, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uart_write_bytes(SPP_BRIDGE_UART, (const char*)to_uart.blk[idx].data, to_uart.blk[idx].len);
+        bridge_dir_done(&to_uart, idx);
+    }
+}
+
+// ================================================================================================
+// 書き出し中のブロック(bridge_wr)を SPP に書き出す(リンク品質に応じて分割する)
+//     輻輳で書けなければブロックと書き出し済みの位置(bridge_wr_pos)を持ったまま戻り、次の周回で続きから書く
+// return   1: 書ききった  0: 輻輳中  -1: クローズされた
+// ================================================================================================
+static int bridge_spp_write(int fd, int conn)
+{
+    const struct _bridge_blk*   blk = &to_spp.blk[bridge_wr];
+
+    while (bridge_wr_pos < blk->len) {
+        uint32_t    n = spp_link_chunk_size(fd, blk->len - bridge_wr_pos);
+        int         size_w = write(fd, &blk->data[bridge_wr_pos], n);
+        if (size_w < 0) {
+            return -1;
+        }
+        if (size_w == 0) {
+            to_spp.stat.cong++;
+            return 0;
+        }
+        if (size_w < n) {
+            spp_metrics_add(MET_WRITE_SHORT, conn, 1);
+        }
+        spp_link_traffic(fd, size_w);
+        spp_metrics_add(MET_TX_BYTES, conn, size_w);
+        spp_link_pace(fd);
+        bridge_wr_pos += size_w;
+    }
+    return 1;
+}
+
+// ================================================================================================
+// ブリッジの終了(強制終了されたときは監視タスクから呼ばれる)
+//     送れなかったブロックは捨てる
+// ================================================================================================
+static void bridge_release(void* arg)
+{
+    int     idx;
+
+    bridge_fd = -1;
+    if (bridge_rd >= 0) {
+        to_uart.blk[bridge_rd].len = 0;
+        xQueueSend(to_uart.free_q, &bridge_rd, portMAX_DELAY);
+        bridge_rd = -1;
+    }
+    if (bridge_wr >= 0) {
+        // 書き出し途中のブロックは書けた分だけ数える
+        to_spp.stat.bytes       += bridge_wr_pos;
+        to_spp.stat.discarded   += to_spp.blk[bridge_wr].len - bridge_wr_pos;
+        to_spp.blk[bridge_wr].len = 0;
+        xQueueSend(to_spp.free_q, &bridge_wr, portMAX_DELAY);
+        bridge_wr       = -1;
+        bridge_wr_pos   = 0;
+    }
+    while (xQueueReceive(to_spp.full_q, &idx, 0) == pdTRUE) {
+        to_spp.stat.discarded += to_spp.blk[idx].len;
+        to_spp.blk[idx].len = 0;
+        xQueueSend(to_spp.free_q, &idx, portMAX_DELAY);
+    }
+}
+
+// ================================================================================================
+// UARTブリッジデータタスク(SPP_BRIDGE_SERVER_NAME の接続ごとに生成、同時に1接続のみ)
+//     UART → SPP のブロックの書き出しと、SPP → UART のブロックへの読み込みを行う
+// ================================================================================================
+void spp_bridge_task(void* param)
+{
+    int     conn = (int)(intptr_t)param;
+    int     fd = spp_conn_fd(conn);
+    int     idx;
+    bool    waiting = false;
+
+    if (uart_evt_q == NULL || bridge_fd >= 0) {
+        ESP_LOGW(TAG, "bridge not available : fd = %d", fd);
+        spp_conn_exit(conn);
+        return;
+    }
+    bridge_start_us = esp_timer_get_time();
+    bridge_fd       = fd;
+    spp_conn_set_cleanup(conn, bridge_release, NULL);
+    ESP_LOGI(TAG, "bridge start : fd = %d  %d baud  %s", fd, bridge_baud, bridge_flow ? "RTS/CTS" : "no flow control");
+
+    while (!spp_conn_stopping(conn)) {
+        bool    busy = false;
+        int     res = 1;
+
+        // UART → SPP(書ききったブロックだけ返却する、輻輳中は待ってから続きを書く)
+        while (bridge_wr >= 0 || xQueueReceive(to_spp.full_q, &bridge_wr, 0) == pdTRUE) {
+            res = bridge_spp_write(fd, conn);
+            if (res <= 0) {
+                break;
+            }
+            idx             = bridge_wr;
+            bridge_wr       = -1;
+            bridge_wr_pos   = 0;
+            bridge_dir_done(&to_spp, idx);
+            busy = true;
+        }
+        if (res < 0) {
+            // クローズされた(書き出し途中のブロックは bridge_release() で捨てる)
+            break;
+        }
+
+        // SPP → UART
+        if (bridge_rd < 0) {
+            if (xQueueReceive(to_uart.free_q, &bridge_rd, 0) == pdTRUE) {
+                waiting = false;
+            }
+            else {
+                // UART側の書き出しが追いついていない(SPPから読まずに待つ)
+                if (!waiting) {
+                    to_uart.stat.stall++;
+                    waiting = true;
+                }
+                bridge_rd = -1;
+            }
+        }
+        if (bridge_rd >= 0) {
+            struct _bridge_blk* blk = &to_uart.blk[bridge_rd];
+            int                 size_r = read(fd, &blk->data[blk->len], SPP_BRIDGE_BLK_SIZE - blk->len);
+            if (size_r < 0) {
+                // クローズされた
+                break;
+            }
+            spp_link_traffic(fd, size_r);
+            spp_metrics_add((size_r > 0) ? MET_RX_BYTES : MET_READ_ZERO, conn, (size_r > 0) ? size_r : 1);
+            blk->len += size_r;
+            if (blk->len == SPP_BRIDGE_BLK_SIZE || (size_r == 0 && blk->len > 0)) {
+                // いっぱいになったか、受信が途切れた
+                bridge_dir_post(&to_uart, bridge_rd, size_r == 0);
+                bridge_rd = -1;
+            }
+            busy |= (size_r > 0);
+        }
+
+        if (res == 0 && !busy) {
+            // 輻輳が解けるのを待つ(書き出し待ちのブロックがあるので xQueuePeek() では待てない)
+            vTaskDelay(SPP_BRIDGE_RETRY_MS / portTICK_PERIOD_MS);
+        }
+        else if (!busy) {
+            // UARTの受信を待つ(SPPの受信はポーリング)
+            xQueuePeek(to_spp.full_q, &idx, 10 / portTICK_PERIOD_MS);
+        }
+    }
+
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    bridge_release(NULL);
+    ESP_LOGI(TAG, "bridge end : fd = %d", fd);
+    spp_conn_exit(conn);
+}
+
+// ================================================================================================
+// 設定の変更(ボーレート、RTS/CTS、受信が途切れてから書き出すまでの時間)
+// ================================================================================================
+esp_err_t spp_bridge_config(uint32_t baud, bool flow, uint32_t idle_ms)
+{
+    esp_err_t   err = ESP_OK;
+
+    if (baud < 1200 || baud > 5000000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bridge_baud     = baud;
+    bridge_flow     = flow;
+    bridge_idle_ms  = idle_ms;
+    if (uart_evt_q != NULL) {
+        err = uart_set_baudrate(SPP_BRIDGE_UART, baud);
+        if (err == ESP_OK) {
+            err = uart_set_hw_flow_ctrl(SPP_BRIDGE_UART, flow ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+                                        SPP_BRIDGE_RTS_THRESH);
+        }
+    }
+    return err;
+}
+
+// ================================================================================================
+// 初期化(UARTドライバのインストールとタスクの生成)
+// ================================================================================================
+esp_err_t spp_bridge_init(void)
+{
+    uart_config_t   conf = {
+        .baud_rate              = bridge_baud,
+        .data_bits              = UART_DATA_8_BITS,
+        .parity                 = UART_PARITY_DISABLE,
+        .stop_bits              = UART_STOP_BITS_1,
+        .flow_ctrl              = bridge_flow ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh    = SPP_BRIDGE_RTS_THRESH,
+        .source_clk             = UART_SCLK_APB,
+    };
+    esp_err_t       err;
+
+    if (uart_evt_q != NULL) {
+        return ESP_OK;
+    }
+    err = uart_driver_install(SPP_BRIDGE_UART, SPP_BRIDGE_RX_RING, SPP_BRIDGE_TX_RING, SPP_BRIDGE_EVT_QLEN, &uart_evt_q, 0);
+    if (err == ESP_OK) {
+        err = uart_param_config(SPP_BRIDGE_UART, &conf);
+    }
+    if (err == ESP_OK) {
+        err = uart_set_pin(SPP_BRIDGE_UART, SPP_BRIDGE_TX_PIN, SPP_BRIDGE_RX_PIN, SPP_BRIDGE_RTS_PIN, SPP_BRIDGE_CTS_PIN);
+    }
+    if (err == ESP_OK) {
+        err = bridge_dir_init(&to_spp);
+    }
+    if (err == ESP_OK) {
+        err = bridge_dir_init(&to_uart);
+    }
+    if (err == ESP_OK
+            && (xTaskCreate(uart_rx_task, "bridge_rx", SPP_BRIDGE_TASK_STACK, NULL, SPP_BRIDGE_TASK_PRIO, NULL) != pdPASS
+             || xTaskCreate(uart_tx_task, "bridge_tx", SPP_BRIDGE_TASK_STACK, NULL, SPP_BRIDGE_TASK_PRIO, NULL) != pdPASS)) {
+        err = ESP_ERR_NO_MEM;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "bridge init failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+static void bridge_show_dir(const char* name, const struct _spp_bridge_stat* st, int64_t elapsed_us)
+{
+    printf("    %-11s %10" PRIu64 " byte  %6u blocks (full %u  idle %u)  stall %u  cong %u", name, st->bytes, st->blocks,
+            st->full, st->idle, st->stall, st->cong);
+    if (elapsed_us > 0) {
+        printf("  %" PRId64 " byte/s", (int64_t)st->bytes * 1000000 / elapsed_us);
+    }
+    printf("\n");
+}
+
+void spp_bridge_show(void)
+{
+    int64_t elapsed = (bridge_fd >= 0) ? esp_timer_get_time() - bridge_start_us : 0;
+
+    if (uart_evt_q == NULL) {
+        printf("    bridge not initialized\n");
+        return;
+    }
+    printf("    UART%d  %d baud  %s  idle %d ms  fd %d\n", SPP_BRIDGE_UART, bridge_baud,
+            bridge_flow ? "RTS/CTS" : "no flow control", bridge_idle_ms, bridge_fd);
+    bridge_show_dir("UART -> SPP", &to_spp.stat, elapsed);
+    bridge_show_dir("SPP -> UART", &to_uart.stat, elapsed);
+    printf("    overflow %u  uart errors %u  discarded %u byte\n", uart_overflow, uart_errors, to_spp.stat.discarded);
+}
+
+// ================================================================================================
+// 向きごとの統計の取得
+// ================================================================================================
+void spp_bridge_get_stat(struct _spp_bridge_stat* to_spp_stat, struct _spp_bridge_stat* to_uart_stat)
+{
+    *to_spp_stat    = to_spp.stat;
+    *to_uart_stat   = to_uart.stat;
+}
@@ -0,0 +1,53 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// UARTブリッジ(SPP_BRIDGE_SERVER_NAME の接続と UART をそのままつなぐ)
+//     UART側はドライバのリングバッファとイベントキューを使い、ブロック単位でまとめて読み書きする
+//     向きごとに SPP_BRIDGE_BLK_NUM 個のブロックを持ち(ダブルバッファ)、一方を読み込んでいる間にもう一方を書き出す
+//         UART → SPP : uart_rx_task がブロックに読み込み、接続のデータタスク(spp_bridge_task)が SPP に書き出す
+//         SPP → UART : spp_bridge_task がブロックに読み込み、uart_tx_task が UART に書き出す
+//     ブロックがいっぱいになるか、受信が SPP_BRIDGE_IDLE_MS 途切れたら書き出す
+//     空きブロックがないときは UART から読まないので、RTS/CTS を有効にすれば取りこぼさない
+//     接続がないときも UART から読まない(ドライバのリングバッファに溜まる)
+//     SPP が輻輳中はブロックを持ったまま SPP_BRIDGE_RETRY_MS ごとに続きを書き、書ききってから返却する
+
+#define SPP_BRIDGE_UART         UART_NUM_1
+#define SPP_BRIDGE_TX_PIN       4
+#define SPP_BRIDGE_RX_PIN       5
+#define SPP_BRIDGE_RTS_PIN      18
+#define SPP_BRIDGE_CTS_PIN      19
+#define SPP_BRIDGE_BAUD         115200      // ボーレートの既定値
+#define SPP_BRIDGE_FLOW         true        // RTS/CTS の既定値
+#define SPP_BRIDGE_IDLE_MS      5           // 受信が途切れてから書き出すまでの時間の既定値
+#define SPP_BRIDGE_RX_RING      8192        // ドライバの受信リングバッファ
+#define SPP_BRIDGE_TX_RING      8192        // ドライバの送信リングバッファ
+#define SPP_BRIDGE_EVT_QLEN     32          // ドライバのイベントキュー長
+#define SPP_BRIDGE_RTS_THRESH   100         // RTS を解除する受信FIFOのバイト数
+#define SPP_BRIDGE_BLK_SIZE     2048        // ブロック長
+#define SPP_BRIDGE_BLK_NUM      2           // 向きごとのブロック数
+#define SPP_BRIDGE_RETRY_MS     10          // 輻輳で書ききれなかったブロックの再送間隔
+#define SPP_BRIDGE_TASK_PRIO    12
+#define SPP_BRIDGE_TASK_STACK   3072
+
+// 向きごとの統計
+struct _spp_bridge_stat {
+    uint64_t        bytes;
+    uint32_t        blocks;         // 書き出したブロック数
+    uint32_t        full;           // いっぱいになって書き出した数
+    uint32_t        idle;           // 受信が途切れて書き出した数
+    uint32_t        stall;          // 空きブロックを待った回数
+    uint32_t        cong;           // 輻輳で書き出しを待った回数(UART → SPP)
+    uint32_t        discarded;      // 切断で送れなかったバイト数(UART → SPP)
+};
+
+// extern宣言
+extern esp_err_t spp_bridge_init(void);
+extern esp_err_t spp_bridge_config(uint32_t baud, bool flow, uint32_t idle_ms);
+extern void spp_bridge_task(void* param);
+extern void spp_bridge_show(void);
+extern void spp_bridge_get_stat(struct _spp_bridge_stat* to_spp_stat, struct _spp_bridge_stat* to_uart_stat);
@@ -0,0 +1,100 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "spp_buf.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+static struct _spp_buf  spp_buf_pool[SPP_BUF_NUM];
+static QueueHandle_t    spp_buf_free_q = NULL;          // 未使用バッファ
+static portMUX_TYPE     spp_buf_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_buf_init(void)
+{
+    if (spp_buf_free_q != NULL) {
+        return ESP_OK;
+    }
+    spp_buf_free_q = xQueueCreate(SPP_BUF_NUM, sizeof(struct _spp_buf*));
+    if (spp_buf_free_q == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < SPP_BUF_NUM; i++) {
+        struct _spp_buf* buf = &spp_buf_pool[i];
+        buf->refcnt = 0;
+        xQueueSend(spp_buf_free_q, &buf, 0);
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// バッファ取得(参照数1で返す)
+// param    wait: 空きがないときの待ち時間(tick)
+// return   NULL: 空きなし
+// ================================================================================================
+struct _spp_buf* spp_buf_alloc(TickType_t wait)
+{
+    struct _spp_buf*    buf;
+
+    if (spp_buf_free_q == NULL || xQueueReceive(spp_buf_free_q, &buf, wait) != pdTRUE) {
+        return NULL;
+    }
+    buf->refcnt = 1;
+    buf->off    = 0;
+    buf->len    = 0;
+    return buf;
+}
+
+// ================================================================================================
+// 参照追加
+// ================================================================================================
+void spp_buf_ref(struct _spp_buf* buf)
+{
+    portENTER_CRITICAL(&spp_buf_mux);
+    buf->refcnt++;
+    portEXIT_CRITICAL(&spp_buf_mux);
+}
+
+// ================================================================================================
+// 参照解除(参照がなくなったらプールに返却)
+// ================================================================================================
+void spp_buf_unref(struct _spp_buf* buf)
+{
+    uint32_t    refcnt;
+
+    if (buf == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&spp_buf_mux);
+    refcnt = --buf->refcnt;
+    portEXIT_CRITICAL(&spp_buf_mux);
+    if (refcnt == 0) {
+        xQueueSend(spp_buf_free_q, &buf, 0);
+    }
+}
+
+// ================================================================================================
+// 未使用バッファ数
+// ================================================================================================
+int spp_buf_free_num(void)
+{
+    return (spp_buf_free_q != NULL) ? (int)uxQueueMessagesWaiting(spp_buf_free_q) : 0;
+}
@@ -0,0 +1,28 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 共通バッファプール
+//     固定数のバッファを参照カウントで管理する
+//     受信したバッファはコピーせずにポインタ(所有権)をキューで渡し、最後に使った側が spp_buf_unref() で返却する
+
+#define SPP_BUF_NUM         24          // バッファ数(中継 + 配信ハブのリング + 処理パイプライン)
+#define SPP_BUF_SIZE        512         // バッファ長
+
+struct _spp_buf {
+    volatile uint32_t   refcnt;         // 参照数(0:未使用)
+    uint16_t            off;            // 有効データの先頭
+    uint16_t            len;            // 有効データ長
+    uint8_t             data[SPP_BUF_SIZE];
+};
+
+// extern宣言
+extern esp_err_t spp_buf_init(void);
+extern struct _spp_buf* spp_buf_alloc(TickType_t wait);
+extern void spp_buf_ref(struct _spp_buf* buf);
+extern void spp_buf_unref(struct _spp_buf* buf);
+extern int spp_buf_free_num(void);
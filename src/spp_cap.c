@@ -0,0 +1,344 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_cap.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define CAP_HEX_PER_LINE    32              // UARTへの書き出しの1行あたりのバイト数
+
+static portMUX_TYPE     cap_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t          cap_ring[SPP_CAP_RING_SIZE];
+static uint32_t         cap_head;           // 次に書き込む位置
+static uint32_t         cap_tail;           // 最も古いレコードの位置
+static uint32_t         cap_used;           // 使用中のバイト数
+static uint32_t         cap_num;            // リング内のレコード数
+static uint32_t         cap_lost;           // 上書きで失ったレコード数
+static volatile bool    cap_enable = false;
+static int64_t          cap_start_us;
+static int              cap_req_conn = -1;  // SPP接続への書き出し要求(データタスクが実行する、-1:なし)
+static bool             cap_exporting;      // データタスクが書き出し中
+static int              cap_last_export;    // 最後の書き出しのバイト数(-1:失敗)
+
+
+// ================================================================================================
+// リングへの書き込み/読み出し(リングの終端で折り返す)
+// ================================================================================================
+static void cap_ring_put(const void* data, uint32_t len)
+{
+    uint32_t    n = SPP_CAP_RING_SIZE - cap_head;
+
+    n = (n < len) ? n : len;
+    memcpy(&cap_ring[cap_head], data, n);
+    memcpy(cap_ring, (const uint8_t*)data + n, len - n);
+    cap_head    = (cap_head + len) % SPP_CAP_RING_SIZE;
+    cap_used    += len;
+}
+
+static void cap_ring_get(uint32_t off, void* data, uint32_t len)
+{
+    uint32_t    n = SPP_CAP_RING_SIZE - off;
+
+    n = (n < len) ? n : len;
+    memcpy(data, &cap_ring[off], n);
+    memcpy((uint8_t*)data + n, cap_ring, len - n);
+}
+
+// ================================================================================================
+// キャプチャ開始(リングを空にする)
+// ================================================================================================
+void spp_cap_start(void)
+{
+    portENTER_CRITICAL(&cap_mux);
+    cap_head        = 0;
+    cap_tail        = 0;
+    cap_used        = 0;
+    cap_num         = 0;
+    cap_lost        = 0;
+    cap_start_us    = esp_timer_get_time();
+    cap_enable      = true;
+    portEXIT_CRITICAL(&cap_mux);
+}
+
+// ================================================================================================
+// キャプチャ停止(リングの内容は残す)
+// ================================================================================================
+void spp_cap_stop(void)
+{
+    portENTER_CRITICAL(&cap_mux);
+    cap_enable = false;
+    portEXIT_CRITICAL(&cap_mux);
+}
+
+bool spp_cap_running(void)
+{
+    return cap_enable;
+}
+
+// ================================================================================================
+// レコードの記録(キャプチャ停止中は何もしない)
+//     データは SPP_CAP_SNAP まで記録する
+// ================================================================================================
+void spp_cap_record(uint8_t type, uint8_t code, int arg, const void* data, int len)
+{
+    struct _spp_cap_rec rec;
+    uint32_t            need;
+
+    if (!cap_enable) {
+        return;
+    }
+    if (data == NULL || len < 0) {
+        len = 0;
+    }
+    rec.type        = type;
+    rec.code        = code;
+    rec.len         = (len < SPP_CAP_SNAP) ? len : SPP_CAP_SNAP;
+    rec.orig_len    = (len < UINT16_MAX) ? len : UINT16_MAX;
+    rec.arg         = arg;
+    need            = sizeof(rec) + rec.len;
+
+    portENTER_CRITICAL(&cap_mux);
+    if (cap_enable) {
+        // 時刻は記録順に揃える
+        rec.ts_us = esp_timer_get_time() - cap_start_us;
+        // 空きが足りなければ古いレコードを捨てる
+        while (SPP_CAP_RING_SIZE - cap_used < need) {
+            struct _spp_cap_rec old;
+            cap_ring_get(cap_tail, &old, sizeof(old));
+            cap_tail    = (cap_tail + sizeof(old) + old.len) % SPP_CAP_RING_SIZE;
+            cap_used    -= sizeof(old) + old.len;
+            cap_num--;
+            cap_lost++;
+        }
+        cap_ring_put(&rec, sizeof(rec));
+        if (rec.len > 0) {
+            cap_ring_put(data, rec.len);
+        }
+        cap_num++;
+    }
+    portEXIT_CRITICAL(&cap_mux);
+}
+
+// ================================================================================================
+// 書き出し(1区間)
+//     SPPは輻輳中(write() が 0)なら待って、書ききるまで繰り返す
+// param    conn: 書き出し先の SPP 接続(-1:UART)
+// ================================================================================================
+static int cap_write(int conn, const uint8_t* data, uint32_t len)
+{
+    static uint32_t col = 0;
+    int             fd;
+
+    if (conn < 0) {
+        // UARTは16進の行で
+        for (uint32_t i = 0; i < len; i++) {
+            if (col == 0) {
+                printf("CAP:");
+            }
+            printf("%02x", data[i]);
+            if (++col == CAP_HEX_PER_LINE) {
+                printf("\n");
+                col = 0;
+            }
+        }
+        if (data == NULL && col > 0) {
+            // 最後の行
+            printf("\n");
+            col = 0;
+        }
+        return 0;
+    }
+    fd = spp_conn_fd(conn);
+    while (len > 0) {
+        int size_w = write(fd, data, len);
+        if (size_w < 0) {
+            return -1;
+        }
+        if (size_w == 0) {
+            if (spp_conn_stopping(conn) && !spp_conn_draining(conn)) {
+                return -1;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        spp_link_traffic(fd, size_w);
+        data    += size_w;
+        len     -= size_w;
+    }
+    return 0;
+}
+
+// ================================================================================================
+// キャプチャの書き出し
+//     書き出し中はキャプチャを止め、終わったら再開する(リングはコピーせずにそのまま書き出す)
+// param    conn: 書き出し先の SPP 接続(-1:UART)
+//                SPP 接続へはその接続のデータタスクから呼ぶこと(ほかに書き込むタスクがないように)
+// return   書き出したバイト数(-1:失敗)
+// ================================================================================================
+int spp_cap_export(int conn)
+{
+    struct _spp_cap_file_hdr    hdr;
+    bool                        running;
+    uint32_t                    off, len;
+    int                         err;
+
+    portENTER_CRITICAL(&cap_mux);
+    running     = cap_enable;
+    cap_enable  = false;
+    portEXIT_CRITICAL(&cap_mux);
+
+    memcpy(hdr.magic, SPP_CAP_MAGIC, sizeof(hdr.magic));
+    hdr.num     = cap_num;
+    hdr.lost    = cap_lost;
+    if (conn < 0) {
+        printf("==== capture begin ====\n");
+    }
+    err = cap_write(conn, (const uint8_t*)&hdr, sizeof(hdr));
+    off = cap_tail;
+    len = cap_used;
+    if (err == 0 && len > 0 && off + len > SPP_CAP_RING_SIZE) {
+        // 折り返している
+        err = cap_write(conn, &cap_ring[off], SPP_CAP_RING_SIZE - off);
+        len -= SPP_CAP_RING_SIZE - off;
+        off = 0;
+    }
+    if (err == 0) {
+        err = cap_write(conn, &cap_ring[off], len);
+    }
+    if (conn < 0) {
+        cap_write(conn, NULL, 0);
+        printf("==== capture end ====\n");
+    }
+
+    portENTER_CRITICAL(&cap_mux);
+    cap_enable = running;
+    portEXIT_CRITICAL(&cap_mux);
+    if (err != 0) {
+        ESP_LOGE(TAG, "export failed : conn = %d", conn);
+        return -1;
+    }
+    ESP_LOGI(TAG, "exported %d records : %d byte", hdr.num, sizeof(hdr) + cap_used);
+    return sizeof(hdr) + cap_used;
+}
+
+// ================================================================================================
+// SPP接続への書き出し要求
+//     エコーバック(spp_data_task)の接続だけ受け付け、その接続のデータタスクが次の受信の前に書き出す
+//     (書き出し中はエコーバックしないので、接続のデータと混ざらない)
+// ================================================================================================
+esp_err_t spp_cap_export_request(int conn)
+{
+    if (conn < 0 || conn >= OPEN_HDR_NUM || !open_hdr_params[conn].use || spp_conn_stopping(conn)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (open_hdr_params[conn].task_func != spp_data_task) {
+        // 自分で書き込むデータタスク(OTA、ファイル転送等)の接続には書き出さない
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    portENTER_CRITICAL(&cap_mux);
+    if (cap_req_conn >= 0 || cap_exporting) {
+        portEXIT_CRITICAL(&cap_mux);
+        return ESP_ERR_INVALID_STATE;
+    }
+    cap_req_conn    = conn;
+    portEXIT_CRITICAL(&cap_mux);
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 書き出し要求の確認(エコーバックのデータタスクから周期的に呼ぶ)
+// ================================================================================================
+void spp_cap_export_poll(int conn)
+{
+    bool    mine;
+    int     ret;
+
+    portENTER_CRITICAL(&cap_mux);
+    mine = (cap_req_conn == conn);
+    if (mine) {
+        cap_req_conn    = -1;
+        cap_exporting   = true;
+    }
+    portEXIT_CRITICAL(&cap_mux);
+    if (!mine) {
+        return;
+    }
+    ret = spp_cap_export(conn);
+    portENTER_CRITICAL(&cap_mux);
+    cap_last_export = ret;
+    cap_exporting   = false;
+    portEXIT_CRITICAL(&cap_mux);
+}
+
+// ================================================================================================
+// クローズ通知(接続に停止要求を出したときに呼ぶ、まだ書き出していない要求を取り消す)
+// ================================================================================================
+void spp_cap_close(int conn)
+{
+    portENTER_CRITICAL(&cap_mux);
+    if (cap_req_conn == conn) {
+        cap_req_conn = -1;
+    }
+    portEXIT_CRITICAL(&cap_mux);
+}
+
+// ================================================================================================
+// SPP接続への書き出しが終わっていなければ true(result に最後の書き出しのバイト数、-1:失敗)
+// ================================================================================================
+bool spp_cap_export_busy(int* result)
+{
+    bool    busy;
+
+    portENTER_CRITICAL(&cap_mux);
+    busy = (cap_req_conn >= 0 || cap_exporting);
+    if (result != NULL) {
+        *result = cap_last_export;
+    }
+    portEXIT_CRITICAL(&cap_mux);
+    return busy;
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_cap_show(void)
+{
+    uint32_t    num, lost, used;
+    int64_t     elapsed;
+
+    portENTER_CRITICAL(&cap_mux);
+    num     = cap_num;
+    lost    = cap_lost;
+    used    = cap_used;
+    portEXIT_CRITICAL(&cap_mux);
+    elapsed = esp_timer_get_time() - cap_start_us;
+    printf("    capture : %s\n", cap_enable ? "running" : "stopped");
+    printf("    records : %d  lost : %d  ring : %d / %d byte\n", num, lost, used, SPP_CAP_RING_SIZE);
+    if (cap_enable) {
+        printf("    elapsed : %" PRId64 " ms\n", elapsed / 1000);
+    }
+    printf("    export  : %s  last %d byte\n", spp_cap_export_busy(NULL) ? "busy" : "idle", cap_last_export);
+}
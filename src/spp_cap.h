@@ -0,0 +1,58 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 通信とイベントのキャプチャ
+//     GAP/SPPコールバックのイベントと SPP の送受信データを時刻付きのバイナリレコードで RAM のリングに記録する
+//     リングがいっぱいになったら古いレコードから上書きする
+//     書き出し形式(リトルエンディアン)
+//         ファイルヘッダ : magic(8) "SPPCAP01"  num(4) lost(4)
+//         レコード      : ts_us(4) type(1) code(1) len(2) orig_len(2) arg(2) + data(len)
+//     ts_us はキャプチャ開始からの経過時間(約71分で一周する、再生側で補正する)
+//     UART へは "CAP:" で始まる16進の行で、SPP へはバイナリのまま書き出す(host/spp_replay.c で再生できる)
+//     SPP へはエコーバックの接続にだけ、その接続のデータタスクが書き出す(ほかのデータと混ざらないように)
+//     輻輳中は待って書ききる(途中で切れたファイルにしない)
+
+#define SPP_CAP_RING_SIZE       16384       // リングの大きさ(byte)
+#define SPP_CAP_SNAP            64          // 1レコードに記録するデータ長の上限
+
+#define SPP_CAP_MAGIC           "SPPCAP01"
+
+// レコード種別
+#define CAP_GAP                 1           // code : esp_bt_gap_cb_event_t  data : esp_bt_gap_cb_param_t
+#define CAP_SPP                 2           // code : esp_spp_cb_event_t     data : esp_spp_cb_param_t
+#define CAP_RX                  3           // arg : fd  data : 受信データ
+#define CAP_TX                  4           // arg : fd  data : 送信データ
+
+// パラメータの data が指す先(プロパティ、サービス名等)は記録しない
+
+struct _spp_cap_file_hdr {
+    char            magic[8];
+    uint32_t        num;            // レコード数
+    uint32_t        lost;           // 上書きで失ったレコード数
+};
+
+struct _spp_cap_rec {
+    uint32_t        ts_us;
+    uint8_t         type;           // CAP_xxx
+    uint8_t         code;
+    uint16_t        len;            // 記録したデータ長
+    uint16_t        orig_len;       // 元のデータ長
+    int16_t         arg;
+};
+
+// extern宣言
+extern void spp_cap_start(void);
+extern void spp_cap_stop(void);
+extern bool spp_cap_running(void);
+extern void spp_cap_record(uint8_t type, uint8_t code, int arg, const void* data, int len);
+extern int spp_cap_export(int conn);
+extern esp_err_t spp_cap_export_request(int conn);
+extern void spp_cap_export_poll(int conn);
+extern void spp_cap_close(int conn);
+extern bool spp_cap_export_busy(int* result);
+extern void spp_cap_show(void);
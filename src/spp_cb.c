@@ -23,6 +23,11 @@
 
 #include "spp_test.h"
 #include "spp_user_hdr.h"
+#include "spp_boot.h"
+#include "spp_connlat.h"
+#include "spp_scan.h"
+#include "spp_bond.h"
+#include "spp_metrics.h"
 #include "bt_utils.h"
 #include "uart_console.h"
 
@@ -39,27 +44,15 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
     switch (event) {
     case ESP_SPP_INIT_EVT:                                  // 初期化完了
         ESP_LOGV(TAG, "    status : %d", param->init.status);
+        spp_boot_end(BOOT_SPP_INIT);
         if (param->init.status == ESP_SPP_SUCCESS) {
             // VFS(virtual File System)の登録
             esp_spp_vfs_register();
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
-#else  // SPP_CLIENT_MODE
-            // SPPサーバのスタート
-            esp_spp_start_srv(ESP_SPP_SEC_AUTHENTICATE, ESP_SPP_ROLE_SLAVE, 0, SPP_SERVER_NAME);
-            /*
-                第1パラメータ
-                    ESP_SPP_SEC_NONE
-                    ESP_SPP_SEC_AUTHORIZE
-                    ESP_SPP_SEC_AUTHENTICATE 
-                第2パラメータ
-                    ESP_SPP_ROLE_MASTER         initiatorのとき
-                    ESP_SPP_ROLE_SLAVE          Accepterのとき
-                第3パラメータ
-                    取得するチャネル
-                    0: 任意のチャネル
-                第4パラメータ
-                    サーバ名
-            */
+#ifndef SPP_CLIENT_MODE         // SPP サーバモード
+            // SPPサーバのスタート(CLIENT モード時はコンソールから開始)
+            spp_server_start_all();
+#else   // SPP_CLIENT_MODE
+            spp_boot_mark(BOOT_READY);
 #endif  // SPP_CLIENT_MODE
         }
         break;
@@ -73,8 +66,8 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
             ESP_LOGV(TAG, "      [%d]scn          : %d", i, param->disc_comp.scn[i]);
             ESP_LOGV(TAG, "      [%d]service_name : %s", i, param->disc_comp.service_name[i]);
         }
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
         if (param->disc_comp.status == ESP_SPP_SUCCESS) {
+            spp_connlat_mark(CONNLAT_SDP_DONE);
             if (param->disc_comp.scn_num >= 1) {
                 found_scn1            = true;
                 host_service_channel1  =  param->disc_comp.scn[0];
@@ -84,19 +77,24 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
                 host_service_channel2 =  param->disc_comp.scn[1];
             }
         }
-#endif  // SPP_CLIENT_MODE
+        else {
+            spp_connlat_fail(CONNLAT_SDP_DONE, param->disc_comp.status);
+        }
         break;
     case ESP_SPP_OPEN_EVT:
         ESP_LOGV(TAG, "    BD_ADDR : %s", bdaddr_to_str(param->open.rem_bda, NULL));
         ESP_LOGV(TAG, "    status  : %d", param->open.status);
         ESP_LOGV(TAG, "    handle  : %d", param->open.handle);
         ESP_LOGV(TAG, "    fd      : %d", param->open.fd);
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
         if (param->open.status == ESP_SPP_SUCCESS) {
             // オープンユーザハンドラ
-            spp_open_handler(param->open.handle, param->open.fd, param->open.rem_bda);
+            spp_open_handler(param->open.handle, param->open.fd, param->open.rem_bda, NULL);
+            spp_bond_used(param->open.rem_bda);
+            spp_connlat_opened(param->open.handle);
+        }
+        else {
+            spp_connlat_fail(CONNLAT_OPEN, param->open.status);
         }
-#endif  // SPP_CLIENT_MODE
         break;
     case ESP_SPP_CLOSE_EVT:                                 // クローズ時
         ESP_LOGV(TAG, "    status       : %d", param->close.status);
@@ -107,6 +105,8 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
             // クローズユーザハンドラ
             spp_close_handler(param->close.handle);
         }
+        spp_connlat_closed(param->close.handle);
+        spp_scan_disconnected();
         break;
     case ESP_SPP_START_EVT:
         ESP_LOGV(TAG, "    status : %d", param->start.status);
@@ -114,12 +114,25 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         ESP_LOGV(TAG, "    sec_id : %d", param->start.sec_id);
         ESP_LOGV(TAG, "    scn    : %d", param->start.scn);
         ESP_LOGV(TAG, "    use_co : %s", param->start.use_co ? "true" : "false");
+        spp_boot_end(BOOT_SRV_START);
+        spp_server_started(param->start.status == ESP_SPP_SUCCESS, param->start.handle, param->start.scn);
+        // 次のサーバのスタート
+        if (!spp_server_start_next()) {
+            // すべてのサーバを開始した
+            spp_boot_mark(BOOT_READY);
+        }
         break;
     case ESP_SPP_CL_INIT_EVT:
         ESP_LOGV(TAG, "    status : %d", param->cl_init.status);
         ESP_LOGV(TAG, "    handle : %d", param->cl_init.handle);
         ESP_LOGV(TAG, "    sec_id : %d", param->cl_init.sec_id);
         ESP_LOGV(TAG, "    use_co : %s", param->cl_init.use_co ? "true" : "false");
+        if (param->cl_init.status == ESP_SPP_SUCCESS) {
+            spp_connlat_mark(CONNLAT_CL_INIT);
+        }
+        else {
+            spp_connlat_fail(CONNLAT_CL_INIT, param->cl_init.status);
+        }
         break;
     case ESP_SPP_SRV_OPEN_EVT:                              // オープン時
         ESP_LOGV(TAG, "    BD_ADDR           : %s", bdaddr_to_str(param->srv_open.rem_bda, NULL));
@@ -127,13 +140,13 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         ESP_LOGV(TAG, "    handle            : %d", param->srv_open.handle);
         ESP_LOGV(TAG, "    new_listen_handle : %d", param->srv_open.new_listen_handle);
         ESP_LOGV(TAG, "    fd                : %d", param->srv_open.fd);
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
-#else   // SPP_CLIENT_MODE
         if (param->srv_open.status == ESP_SPP_SUCCESS) {
             // オープンユーザハンドラ
-            spp_open_handler(param->srv_open.handle, param->srv_open.fd, param->srv_open.rem_bda);
+            spp_open_handler(param->srv_open.handle, param->srv_open.fd, param->srv_open.rem_bda,
+                             spp_server_accept(param->srv_open.handle, param->srv_open.new_listen_handle));
+            spp_scan_accepted();
+            spp_bond_used(param->srv_open.rem_bda);
         }
-#endif  // SPP_CLIENT_MODE
         break;
       case ESP_SPP_DATA_IND_EVT :           // callbackモード時のみ
         ESP_LOGV(TAG, "    status : %d", param->data_ind.status);
@@ -142,6 +155,9 @@ void esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         esp_log_buffer_hex(TAG,          param->data_ind.data,param->data_ind.len);
         break;
       case ESP_SPP_CONG_EVT :               // callbackモード時のみ     // cong → congestion → 輻輳/集中
+        if (param->cong.cong) {
+            spp_metrics_add(MET_SPP_CONG, 0, 1);
+        }
         ESP_LOGV(TAG, "    status : %d", param->cong.status);
         ESP_LOGV(TAG, "    handle : %d", param->cong.handle);
         ESP_LOGV(TAG, "    cong   : %s", param->cong.cong ? "true" : "false");
@@ -0,0 +1,364 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "spp_test.h"
+#include "spp_connlat.h"
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// ベンチマーク用イベント
+#define CONNLAT_EV_SDP      BIT0
+#define CONNLAT_EV_OPEN     BIT1
+#define CONNLAT_EV_FAIL     BIT2
+#define CONNLAT_EV_CLOSE    BIT3
+
+// 段階
+struct _connlat_phase {
+    const char*     name;
+    uint8_t         from;
+    uint8_t         to;
+};
+
+static const struct _connlat_phase connlat_phase[] = {
+    { "inquiry",    CONNLAT_INQ_START,  CONNLAT_INQ_FOUND },
+    { "sdp",        CONNLAT_SDP_START,  CONNLAT_SDP_DONE  },
+    { "auth",       CONNLAT_CONN_REQ,   CONNLAT_AUTH_DONE },
+    { "rfcomm",     CONNLAT_CL_INIT,    CONNLAT_OPEN      },    // 認証があれば認証完了から
+    { "connect",    CONNLAT_CONN_REQ,   CONNLAT_OPEN      },
+    { "total",      0xff,               CONNLAT_OPEN      },    // 最初に記録した時点から
+};
+#define CONNLAT_PHASE_NUM   (sizeof(connlat_phase) / sizeof(connlat_phase[0]))
+
+// 試行
+struct _connlat_attempt {
+    bool            active;
+    int8_t          fail_mark;                  // 失敗した時点(-1:成功/未完了)
+    int16_t         fail_status;
+    uint32_t        handle;
+    int64_t         t[CONNLAT_MARK_NUM];        // 時刻(us、0:未記録)
+};
+
+// 段階ごとの集計
+struct _connlat_stat {
+    uint32_t        count;
+    uint32_t        min_ms;
+    uint32_t        max_ms;
+    uint64_t        sum_ms;
+    uint32_t        hist[SPP_CONNLAT_HIST_NUM];
+};
+
+static struct _connlat_attempt  connlat_cur;
+static struct _connlat_attempt  connlat_log[SPP_CONNLAT_LOG_NUM];
+static uint32_t                 connlat_log_count = 0;
+static uint32_t                 connlat_fail_count = 0;
+static struct _connlat_stat     connlat_stat[CONNLAT_PHASE_NUM];
+static portMUX_TYPE             connlat_mux = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t       connlat_ev = NULL;
+static TaskHandle_t             connlat_bench_handle = NULL;
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_connlat_init(void)
+{
+    connlat_ev = xEventGroupCreate();
+    return (connlat_ev != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// ================================================================================================
+// 段階の所要時間(ms)
+// return   -1: 記録なし
+// ================================================================================================
+static int32_t connlat_duration(const struct _connlat_attempt* a, int phase)
+{
+    const struct _connlat_phase*    p = &connlat_phase[phase];
+    int64_t                         from = 0;
+
+    if (a->t[p->to] == 0) {
+        return -1;
+    }
+    if (p->from == 0xff) {
+        // 最初に記録した時点
+        for (int m = 0; m < CONNLAT_MARK_NUM; m++) {
+            if (a->t[m] != 0 && (from == 0 || a->t[m] < from)) {
+                from = a->t[m];
+            }
+        }
+    }
+    else {
+        from = a->t[p->from];
+        if (p->to == CONNLAT_OPEN && p->from == CONNLAT_CL_INIT && a->t[CONNLAT_AUTH_DONE] > from) {
+            from = a->t[CONNLAT_AUTH_DONE];
+        }
+    }
+    if (from == 0 || a->t[p->to] < from) {
+        return -1;
+    }
+    return (a->t[p->to] - from) / 1000;
+}
+
+// ================================================================================================
+// 試行の終了(集計して記録に移す、ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void connlat_finish(void)
+{
+    struct _connlat_attempt* a = &connlat_cur;
+
+    if (!a->active) {
+        return;
+    }
+    for (int i = 0; i < CONNLAT_PHASE_NUM; i++) {
+        int32_t ms = connlat_duration(a, i);
+        if (ms >= 0) {
+            struct _connlat_stat*   s = &connlat_stat[i];
+            int                     b = 0;
+            if (s->count == 0 || ms < s->min_ms) {
+                s->min_ms = ms;
+            }
+            if (ms > s->max_ms) {
+                s->max_ms = ms;
+            }
+            s->count++;
+            s->sum_ms += ms;
+            while (b < SPP_CONNLAT_HIST_NUM - 1 && ms >= (SPP_CONNLAT_HIST_MIN_MS << b)) {
+                b++;
+            }
+            s->hist[b]++;
+        }
+    }
+    if (a->fail_mark >= 0) {
+        connlat_fail_count++;
+    }
+    connlat_log[connlat_log_count % SPP_CONNLAT_LOG_NUM] = *a;
+    connlat_log_count++;
+    a->active = false;
+}
+
+// ================================================================================================
+// 時点の記録
+//     試行の開始になる時点(inquiry/SDP/接続要求)で、その時点が記録済みなら新しい試行を始める
+// ================================================================================================
+void spp_connlat_mark(int mark)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&connlat_mux);
+    if (mark == CONNLAT_INQ_START || mark == CONNLAT_SDP_START || mark == CONNLAT_CONN_REQ) {
+        if (connlat_cur.active && connlat_cur.t[mark] != 0) {
+            // 前の試行は未完了のまま終了
+            connlat_finish();
+        }
+        if (!connlat_cur.active) {
+            memset(&connlat_cur, 0, sizeof(connlat_cur));
+            connlat_cur.active      = true;
+            connlat_cur.fail_mark   = -1;
+        }
+    }
+    if (connlat_cur.active && connlat_cur.t[mark] == 0) {
+        connlat_cur.t[mark] = now;
+    }
+    portEXIT_CRITICAL(&connlat_mux);
+    if (mark == CONNLAT_SDP_DONE && connlat_ev != NULL) {
+        xEventGroupSetBits(connlat_ev, CONNLAT_EV_SDP);
+    }
+}
+
+// ================================================================================================
+// 失敗の記録(試行を終了する)
+// ================================================================================================
+void spp_connlat_fail(int mark, int status)
+{
+    portENTER_CRITICAL(&connlat_mux);
+    if (connlat_cur.active) {
+        connlat_cur.fail_mark   = mark;
+        connlat_cur.fail_status = status;
+        connlat_finish();
+    }
+    portEXIT_CRITICAL(&connlat_mux);
+    if (connlat_ev != NULL) {
+        xEventGroupSetBits(connlat_ev, CONNLAT_EV_FAIL);
+    }
+}
+
+// ================================================================================================
+// 接続完了(ESP_SPP_OPEN_EVT、試行を終了する)
+// ================================================================================================
+void spp_connlat_opened(uint32_t handle)
+{
+    spp_connlat_mark(CONNLAT_OPEN);
+    portENTER_CRITICAL(&connlat_mux);
+    connlat_cur.handle = handle;
+    connlat_finish();
+    portEXIT_CRITICAL(&connlat_mux);
+    if (connlat_ev != NULL) {
+        xEventGroupSetBits(connlat_ev, CONNLAT_EV_OPEN);
+    }
+}
+
+// ================================================================================================
+// 切断(ベンチマーク用)
+// ================================================================================================
+void spp_connlat_closed(uint32_t handle)
+{
+    if (connlat_ev != NULL) {
+        xEventGroupSetBits(connlat_ev, CONNLAT_EV_CLOSE);
+    }
+}
+
+// ================================================================================================
+// ベンチマークタスク(SDP → 接続 → 切断 をくり返す)
+// ================================================================================================
+static void connlat_bench_task(void* param)
+{
+    int         count = (int)(intptr_t)param;
+    int         ok = 0;
+    EventBits_t bits;
+    uint32_t    heap_start = esp_get_free_heap_size();
+    int         buf_start = spp_buf_free_num();
+
+    for (int n = 0; n < count; n++) {
+        uint32_t handle;
+
+        // SDP
+        xEventGroupClearBits(connlat_ev, CONNLAT_EV_SDP | CONNLAT_EV_OPEN | CONNLAT_EV_FAIL | CONNLAT_EV_CLOSE);
+        spp_connlat_mark(CONNLAT_SDP_START);
+        esp_spp_start_discovery(host_bd_address);
+        bits = xEventGroupWaitBits(connlat_ev, CONNLAT_EV_SDP | CONNLAT_EV_FAIL, pdTRUE, pdFALSE,
+                                   SPP_CONNLAT_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (!(bits & CONNLAT_EV_SDP) || !found_scn1) {
+            ESP_LOGW(TAG, "[%d] sdp failed", n);
+            spp_connlat_fail(CONNLAT_SDP_DONE, -1);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        // 接続
+        spp_connlat_mark(CONNLAT_CONN_REQ);
+        esp_spp_connect(ESP_SPP_SEC_AUTHENTICATE, ESP_SPP_ROLE_MASTER, host_service_channel1, host_bd_address);
+        bits = xEventGroupWaitBits(connlat_ev, CONNLAT_EV_OPEN | CONNLAT_EV_FAIL, pdTRUE, pdFALSE,
+                                   SPP_CONNLAT_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (!(bits & CONNLAT_EV_OPEN)) {
+            ESP_LOGW(TAG, "[%d] connect failed", n);
+            if (bits == 0) {
+                spp_connlat_fail(CONNLAT_OPEN, -1);
+            }
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        ok++;
+
+        // 切断
+        vTaskDelay(SPP_CONNLAT_HOLD_MS / portTICK_PERIOD_MS);
+        portENTER_CRITICAL(&connlat_mux);
+        handle = connlat_log[(connlat_log_count - 1) % SPP_CONNLAT_LOG_NUM].handle;
+        portEXIT_CRITICAL(&connlat_mux);
+        spp_close_handle(handle);
+        xEventGroupWaitBits(connlat_ev, CONNLAT_EV_CLOSE, pdTRUE, pdFALSE, SPP_CONNLAT_TIMEOUT_MS / portTICK_PERIOD_MS);
+        vTaskDelay(SPP_CONNLAT_HOLD_MS / portTICK_PERIOD_MS);
+    }
+
+    // 接続/切断をくり返しても資源が減っていないこと
+    vTaskDelay((SPP_CONN_STOP_MS + SPP_CONN_WATCH_MS) / portTICK_PERIOD_MS);
+    ESP_LOGI(TAG, "benchmark end : %d / %d connected", ok, count);
+    ESP_LOGI(TAG, "free heap : %u -> %u (%d)  free buffers : %d -> %d", heap_start, esp_get_free_heap_size(),
+            (int)(esp_get_free_heap_size() - heap_start), buf_start, spp_buf_free_num());
+    spp_conn_show();
+    spp_connlat_show();
+    connlat_bench_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+// ================================================================================================
+// ベンチマーク開始
+// ================================================================================================
+esp_err_t spp_connlat_bench_start(int count)
+{
+    if (connlat_ev == NULL || connlat_bench_handle != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!found_bd_addr) {
+        ESP_LOGE(TAG, "BD addr not found");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(connlat_bench_task, "connlat_bench", 3072, (void*)(intptr_t)count, 4, &connlat_bench_handle) != pdPASS) {
+        connlat_bench_handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 集計結果の表示
+// ================================================================================================
+void spp_connlat_show(void)
+{
+    struct _connlat_stat    stat[CONNLAT_PHASE_NUM];
+    struct _connlat_attempt last;
+    uint32_t                log_count, fail_count;
+
+    portENTER_CRITICAL(&connlat_mux);
+    memcpy(stat, connlat_stat, sizeof(stat));
+    log_count   = connlat_log_count;
+    fail_count  = connlat_fail_count;
+    if (log_count > 0) {
+        last = connlat_log[(log_count - 1) % SPP_CONNLAT_LOG_NUM];
+    }
+    portEXIT_CRITICAL(&connlat_mux);
+
+    printf("    attempts : %u  failed : %u\n", log_count, fail_count);
+    printf("    phase      count    min    avg    max  |");
+    for (int b = 0; b < SPP_CONNLAT_HIST_NUM; b++) {
+        if (b < SPP_CONNLAT_HIST_NUM - 1) {
+            printf(" <%-4d", SPP_CONNLAT_HIST_MIN_MS << b);
+        }
+        else {
+            printf(" >=%-4d", SPP_CONNLAT_HIST_MIN_MS << (b - 1));
+        }
+    }
+    printf("\n");
+    for (int i = 0; i < CONNLAT_PHASE_NUM; i++) {
+        const struct _connlat_stat* s = &stat[i];
+        printf("    %-8s %6u %6u %6u %6u  |", connlat_phase[i].name, s->count, s->min_ms,
+                (s->count > 0) ? (uint32_t)(s->sum_ms / s->count) : 0, s->max_ms);
+        for (int b = 0; b < SPP_CONNLAT_HIST_NUM; b++) {
+            printf(" %5u", s->hist[b]);
+        }
+        printf("\n");
+    }
+    if (log_count > 0) {
+        printf("    last attempt :");
+        for (int i = 0; i < CONNLAT_PHASE_NUM; i++) {
+            int32_t ms = connlat_duration(&last, i);
+            if (ms >= 0) {
+                printf(" %s %d ms", connlat_phase[i].name, ms);
+            }
+        }
+        if (last.fail_mark >= 0) {
+            printf("  (failed at %d status %d)", last.fail_mark, last.fail_status);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,44 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 接続(クライアント)の所要時間の計測
+//     接続の試行ごとに各イベントの時刻を記録し、段階ごとの所要時間をヒストグラムに集計する
+//     段階
+//         inquiry : esp_bt_gap_start_discovery      → 接続先のDISC_RES
+//         sdp     : esp_spp_start_discovery         → ESP_SPP_DISCOVERY_COMP_EVT
+//         auth    : esp_spp_connect                 → ESP_BT_GAP_AUTH_CMPL_EVT(認証が行われたときのみ)
+//         rfcomm  : ESP_SPP_CL_INIT_EVT または認証完了 → ESP_SPP_OPEN_EVT
+//         connect : esp_spp_connect                 → ESP_SPP_OPEN_EVT
+//         total   : 試行開始                         → ESP_SPP_OPEN_EVT
+//     ベンチマークは SDP → 接続 → 切断 を指定回数くり返す(キー操作なし)
+
+#define SPP_CONNLAT_HIST_NUM    10          // ヒストグラムの区間数(16ms未満、32ms未満 ... 4096ms以上)
+#define SPP_CONNLAT_HIST_MIN_MS 16
+#define SPP_CONNLAT_LOG_NUM     16          // 保持する試行数
+#define SPP_CONNLAT_TIMEOUT_MS  15000       // ベンチマークの各段階の待ち時間
+#define SPP_CONNLAT_HOLD_MS     500         // ベンチマークで接続を保持する時間
+
+// 記録する時点
+#define CONNLAT_INQ_START       0
+#define CONNLAT_INQ_FOUND       1
+#define CONNLAT_SDP_START       2
+#define CONNLAT_SDP_DONE        3
+#define CONNLAT_CONN_REQ        4
+#define CONNLAT_CL_INIT         5
+#define CONNLAT_AUTH_DONE       6
+#define CONNLAT_OPEN            7
+#define CONNLAT_MARK_NUM        8
+
+// extern宣言
+extern esp_err_t spp_connlat_init(void);
+extern void spp_connlat_mark(int mark);
+extern void spp_connlat_fail(int mark, int status);
+extern void spp_connlat_opened(uint32_t handle);
+extern void spp_connlat_closed(uint32_t handle);
+extern esp_err_t spp_connlat_bench_start(int count);
+extern void spp_connlat_show(void);
@@ -0,0 +1,331 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "spp_task.h"
+#include "spp_rpc.h"
+#include "spp_cpu.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// サンプル(タスクごと)
+struct _cpu_entry {
+    uint16_t        task_no;
+    uint16_t        permille;
+};
+
+// サンプル
+struct _cpu_sample {
+    uint32_t            time_ms;
+    uint16_t            num;
+    uint16_t            other;          // 上位に入らなかったタスクの合計
+    struct _cpu_entry   e[SPP_CPU_TOP];
+};
+
+// タスク名(タスク番号で引く)
+struct _cpu_name {
+    uint16_t        task_no;
+    uint8_t         flags;
+    bool            alive;              // 直近のサンプルに存在した
+    char            name[configMAX_TASK_NAME_LEN];
+};
+
+// 集計結果
+struct _cpu_sum {
+    uint16_t        task_no;
+    uint32_t        sum;
+};
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// Bluetoothスタックのタスク名(前方一致)
+static const char* const    cpu_bt_names[] = { "BTC", "BTU", "hciT", "btController", "btm", "bt" };
+#endif
+
+static struct _cpu_sample   cpu_ring[SPP_CPU_RING];
+static uint32_t             cpu_count = 0;                  // 格納したサンプル数
+static struct _cpu_name     cpu_names[SPP_CPU_NAME_MAX];
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static TaskStatus_t         cpu_stat[SPP_TASK_STAT_MAX];
+static struct _cpu_entry    cpu_work[SPP_TASK_STAT_MAX];
+static uint32_t             cpu_prev_run[SPP_TASK_STAT_MAX];
+static uint16_t             cpu_prev_no[SPP_TASK_STAT_MAX];
+static int                  cpu_prev_num = 0;
+static uint32_t             cpu_prev_total = 0;
+#endif
+static struct _cpu_sum      cpu_sum[SPP_CPU_NAME_MAX + 1];  // 集計用(表示/RPCで共用するのでロック中に使う)
+static SemaphoreHandle_t    cpu_mutex = NULL;
+
+
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// ================================================================================================
+// タスク名の登録(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void cpu_name_update(const TaskStatus_t* st)
+{
+    struct _cpu_name*   slot = NULL;
+
+    for (int i = 0; i < SPP_CPU_NAME_MAX; i++) {
+        if (cpu_names[i].name[0] != '\0' && cpu_names[i].task_no == st->xTaskNumber) {
+            cpu_names[i].alive = true;
+            return;
+        }
+        if (slot == NULL && (cpu_names[i].name[0] == '\0' || !cpu_names[i].alive)) {
+            slot = &cpu_names[i];
+        }
+    }
+    if (slot == NULL) {
+        return;
+    }
+    slot->task_no   = st->xTaskNumber;
+    slot->alive     = true;
+    slot->flags     = 0;
+    snprintf(slot->name, sizeof(slot->name), "%s", st->pcTaskName);
+    for (int i = 0; i < sizeof(cpu_bt_names) / sizeof(cpu_bt_names[0]); i++) {
+        if (strncmp(slot->name, cpu_bt_names[i], strlen(cpu_bt_names[i])) == 0) {
+            slot->flags |= SPP_CPU_FLAG_BT;
+            break;
+        }
+    }
+}
+#endif // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+static const struct _cpu_name* cpu_name_find(uint16_t task_no)
+{
+    for (int i = 0; i < SPP_CPU_NAME_MAX; i++) {
+        if (cpu_names[i].name[0] != '\0' && cpu_names[i].task_no == task_no) {
+            return &cpu_names[i];
+        }
+    }
+    return NULL;
+}
+
+// ================================================================================================
+// 1回分の計測
+// ================================================================================================
+static void cpu_sample(void)
+{
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint32_t            total;
+    UBaseType_t         num = uxTaskGetSystemState(cpu_stat, SPP_TASK_STAT_MAX, &total);
+    uint32_t            span;
+    int                 work_num = 0;
+    struct _cpu_sample* s;
+
+    if (num == 0) {
+        return;
+    }
+    span = (total - cpu_prev_total) * portNUM_PROCESSORS;
+
+    xSemaphoreTake(cpu_mutex, portMAX_DELAY);
+    for (int i = 0; i < SPP_CPU_NAME_MAX; i++) {
+        cpu_names[i].alive = false;
+    }
+    for (int i = 0; i < num; i++) {
+        uint32_t prev = 0;
+        cpu_name_update(&cpu_stat[i]);
+        for (int j = 0; j < cpu_prev_num; j++) {
+            if (cpu_prev_no[j] == cpu_stat[i].xTaskNumber) {
+                prev = cpu_prev_run[j];
+                break;
+            }
+        }
+        if (cpu_prev_total != 0 && span != 0) {
+            cpu_work[work_num].task_no  = cpu_stat[i].xTaskNumber;
+            cpu_work[work_num].permille = (uint64_t)(cpu_stat[i].ulRunTimeCounter - prev) * 1000 / span;
+            work_num++;
+        }
+    }
+    if (work_num > 0) {
+        // 上位 SPP_CPU_TOP 個を選んで格納する
+        s = &cpu_ring[cpu_count % SPP_CPU_RING];
+        s->time_ms  = esp_timer_get_time() / 1000;
+        s->num      = 0;
+        s->other    = 0;
+        for (int n = 0; n < work_num; n++) {
+            int max = n;
+            for (int i = n + 1; i < work_num; i++) {
+                if (cpu_work[i].permille > cpu_work[max].permille) {
+                    max = i;
+                }
+            }
+            struct _cpu_entry tmp = cpu_work[n];
+            cpu_work[n]     = cpu_work[max];
+            cpu_work[max]   = tmp;
+            if (n < SPP_CPU_TOP) {
+                s->e[s->num++] = cpu_work[n];
+            }
+            else {
+                s->other += cpu_work[n].permille;
+            }
+        }
+        cpu_count++;
+    }
+    xSemaphoreGive(cpu_mutex);
+
+    for (int i = 0; i < num; i++) {
+        cpu_prev_no[i]  = cpu_stat[i].xTaskNumber;
+        cpu_prev_run[i] = cpu_stat[i].ulRunTimeCounter;
+    }
+    cpu_prev_num    = num;
+    cpu_prev_total  = total;
+#endif // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+}
+
+// ================================================================================================
+// 計測タスク
+// ================================================================================================
+static void cpu_sampler_task(void* param)
+{
+    TickType_t  last = xTaskGetTickCount();
+
+    while (1) {
+        vTaskDelayUntil(&last, SPP_CPU_SAMPLE_MS / portTICK_PERIOD_MS);
+        cpu_sample();
+    }
+}
+
+// ================================================================================================
+// 直近 window サンプルの平均(ロック取得済みで呼ぶこと)
+//     結果は cpu_sum[] に使用率の高い順に格納する(最後の要素は上位外の合計、task_no = 0xffff)
+// return   cpu_sum[] の要素数
+// ================================================================================================
+static int cpu_window(int window)
+{
+    int         num = 0;
+    uint32_t    other = 0;
+
+    if (window > cpu_count) {
+        window = cpu_count;
+    }
+    if (window > SPP_CPU_RING) {
+        window = SPP_CPU_RING;
+    }
+    if (window <= 0) {
+        return 0;
+    }
+    for (int w = 0; w < window; w++) {
+        const struct _cpu_sample* s = &cpu_ring[(cpu_count - 1 - w) % SPP_CPU_RING];
+        for (int i = 0; i < s->num; i++) {
+            int j;
+            for (j = 0; j < num; j++) {
+                if (cpu_sum[j].task_no == s->e[i].task_no) {
+                    break;
+                }
+            }
+            if (j == num) {
+                if (num >= SPP_CPU_NAME_MAX) {
+                    other += s->e[i].permille;
+                    continue;
+                }
+                cpu_sum[num].task_no    = s->e[i].task_no;
+                cpu_sum[num].sum        = 0;
+                num++;
+            }
+            cpu_sum[j].sum += s->e[i].permille;
+        }
+        other += s->other;
+    }
+    // 使用率の高い順に並べる(挿入ソート)
+    for (int i = 1; i < num; i++) {
+        struct _cpu_sum tmp = cpu_sum[i];
+        int             j = i;
+        while (j > 0 && cpu_sum[j - 1].sum < tmp.sum) {
+            cpu_sum[j] = cpu_sum[j - 1];
+            j--;
+        }
+        cpu_sum[j] = tmp;
+    }
+    for (int i = 0; i < num; i++) {
+        cpu_sum[i].sum /= window;
+    }
+    cpu_sum[num].task_no    = 0xffff;
+    cpu_sum[num].sum        = other / window;
+    return num + 1;
+}
+
+// ================================================================================================
+// RPC : 使用率の取得
+// ================================================================================================
+static uint8_t cpu_rpc_handler(const struct _spp_rpc_req* req, uint8_t* rsp, uint16_t* rsp_len)
+{
+    int         window = (req->len >= 1 && req->data[0] != 0) ? req->data[0] : 1;
+    uint16_t    len = 0;
+    int         num;
+
+    xSemaphoreTake(cpu_mutex, portMAX_DELAY);
+    num = cpu_window(window);
+    for (int i = 0; i < num && len + 4 + SPP_CPU_RPC_NAME_LEN <= SPP_RPC_MAX_PAYLOAD; i++) {
+        const struct _cpu_name* nm = cpu_name_find(cpu_sum[i].task_no);
+        uint16_t                permille = cpu_sum[i].sum;
+        memcpy(&rsp[len], &permille, sizeof(permille));
+        rsp[len + 2] = (nm != NULL) ? nm->flags : 0;
+        rsp[len + 3] = 0;
+        memset(&rsp[len + 4], 0, SPP_CPU_RPC_NAME_LEN);
+        strncpy((char*)&rsp[len + 4], (cpu_sum[i].task_no == 0xffff) ? "(other)" : (nm != NULL) ? nm->name : "?",
+                SPP_CPU_RPC_NAME_LEN);
+        len += 4 + SPP_CPU_RPC_NAME_LEN;
+    }
+    xSemaphoreGive(cpu_mutex);
+    *rsp_len = len;
+    return RPC_ST_OK;
+}
+
+// ================================================================================================
+// 初期化(計測タスクの生成とRPCメソッドの登録)
+// ================================================================================================
+esp_err_t spp_cpu_init(void)
+{
+    cpu_mutex = xSemaphoreCreateMutex();
+    if (cpu_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(cpu_sampler_task, "cpu_sampler", 2048, NULL, 2, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return spp_rpc_register(SPP_RPC_M_CPU, cpu_rpc_handler);
+}
+
+// ================================================================================================
+// 表示(直近 window サンプルの平均)
+// ================================================================================================
+void spp_cpu_show(int window)
+{
+    int         num;
+    uint32_t    bt = 0;
+
+    if (cpu_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(cpu_mutex, portMAX_DELAY);
+    num = cpu_window(window);
+    printf("    CPU usage (last %d s, %% of %d cores)\n", (window * SPP_CPU_SAMPLE_MS) / 1000, portNUM_PROCESSORS);
+    for (int i = 0; i < num; i++) {
+        const struct _cpu_name* nm = cpu_name_find(cpu_sum[i].task_no);
+        bool                    is_bt = (nm != NULL && (nm->flags & SPP_CPU_FLAG_BT));
+        if (cpu_sum[i].sum == 0) {
+            continue;
+        }
+        if (is_bt) {
+            bt += cpu_sum[i].sum;
+        }
+        printf("    %c %-16s %3u.%u\n", is_bt ? '*' : ' ', (cpu_sum[i].task_no == 0xffff) ? "(other)" : (nm != NULL) ? nm->name : "?",
+                cpu_sum[i].sum / 10, cpu_sum[i].sum % 10);
+    }
+    printf("    * bluetooth total  %3u.%u\n", bt / 10, bt % 10);
+    xSemaphoreGive(cpu_mutex);
+}
@@ -0,0 +1,29 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// タスクごとのCPU使用率の計測
+//     SPP_CPU_SAMPLE_MS ごとに uxTaskGetSystemState() の実行時間を取得し、前回との差分から使用率を求めて
+//     上位 SPP_CPU_TOP 個をリング(SPP_CPU_RING サンプル)に格納する(バイナリ、名前はタスク番号で別に持つ)
+//     表示時はリングから直近のサンプル数(ウィンドウ)分を平均する
+//     使用率は全コア合計(2コアなら200%)に対する千分率
+//     Bluetoothスタックのタスクには印('*')を付ける
+
+#define SPP_CPU_SAMPLE_MS       1000        // 計測間隔
+#define SPP_CPU_RING            60          // 保持するサンプル数
+#define SPP_CPU_TOP             16          // 1サンプルに格納するタスク数
+#define SPP_CPU_NAME_MAX        SPP_TASK_STAT_MAX
+
+// RPCメソッド(payload : ウィンドウのサンプル数(1)  応答 : 1タスクあたり permille(2) flags(1) rsv(1) name(12))
+#define SPP_RPC_M_CPU           0x0003
+#define SPP_CPU_RPC_NAME_LEN    12
+
+#define SPP_CPU_FLAG_BT         0x01        // Bluetoothスタックのタスク
+
+// extern宣言
+extern esp_err_t spp_cpu_init(void);
+extern void spp_cpu_show(int window);
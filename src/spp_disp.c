@@ -0,0 +1,350 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "spp_disp.h"
+#include "spp_cap.h"
+#include "spp_metrics.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+static struct _spp_disp_evt disp_pool[SPP_DISP_QUEUE_LEN];
+static QueueHandle_t        disp_free_q = NULL;             // 空いているイベント(インデックス)
+static QueueHandle_t        disp_evt_q  = NULL;             // 配送待ちのイベント(インデックス)
+static esp_bt_gap_cb_t      disp_gap_handler[SPP_DISP_HANDLER_MAX];
+static esp_spp_cb_t*        disp_spp_handler[SPP_DISP_HANDLER_MAX];
+static struct _spp_disp_stat disp_stat;
+static portMUX_TYPE         disp_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+// ================================================================================================
+// パラメータが指す先のコピー用領域の確保
+// return   確保した領域(NULL:空きなし)
+// ================================================================================================
+static void* disp_ext_alloc(struct _spp_disp_evt* evt, size_t size)
+{
+    size_t  off = (evt->ext_len + 3) & ~3;
+    if (off + size > SPP_DISP_EXT_SIZE) {
+        return NULL;
+    }
+    evt->ext_len = off + size;
+    return &evt->ext[off];
+}
+
+static void* disp_ext_copy(struct _spp_disp_evt* evt, const void* src, size_t size)
+{
+    void* dst = (src != NULL) ? disp_ext_alloc(evt, size) : NULL;
+    if (dst != NULL) {
+        memcpy(dst, src, size);
+    }
+    return dst;
+}
+
+// ================================================================================================
+// GAPパラメータの複製(ポインタの指す先も ext にコピーする)
+// return   すべてコピーできたら true
+// ================================================================================================
+static bool disp_copy_gap(struct _spp_disp_evt* evt, esp_bt_gap_cb_event_t event, const esp_bt_gap_cb_param_t* param)
+{
+    esp_bt_gap_cb_param_t*  p = &evt->param.gap;
+    bool                    ok = true;
+
+    memcpy(p, param, sizeof(*p));
+    switch (event) {
+      case ESP_BT_GAP_DISC_RES_EVT :
+        {
+            // 入りきらないプロパティは落とす
+            esp_bt_gap_dev_prop_t* prop = disp_ext_alloc(evt, param->disc_res.num_prop * sizeof(esp_bt_gap_dev_prop_t));
+            int num = 0;
+            for (int i = 0; prop != NULL && i < param->disc_res.num_prop; i++) {
+                prop[num] = param->disc_res.prop[i];
+                prop[num].val = disp_ext_copy(evt, param->disc_res.prop[i].val, param->disc_res.prop[i].len);
+                if (prop[num].val != NULL) {
+                    num++;
+                }
+            }
+            p->disc_res.prop        = prop;
+            p->disc_res.num_prop    = num;
+            ok = (num == param->disc_res.num_prop);
+        }
+        break;
+      case ESP_BT_GAP_RMT_SRVCS_EVT :
+        p->rmt_srvcs.uuid_list = disp_ext_copy(evt, param->rmt_srvcs.uuid_list, param->rmt_srvcs.num_uuids * sizeof(esp_bt_uuid_t));
+        if (p->rmt_srvcs.uuid_list == NULL) {
+            ok = (param->rmt_srvcs.uuid_list == NULL);
+            p->rmt_srvcs.num_uuids = 0;
+        }
+        break;
+      default :
+        break;
+    }
+    return ok;
+}
+
+// ================================================================================================
+// SPPパラメータの複製(ポインタの指す先も ext にコピーする)
+// return   すべてコピーできたら true
+// ================================================================================================
+static bool disp_copy_spp(struct _spp_disp_evt* evt, esp_spp_cb_event_t event, const esp_spp_cb_param_t* param)
+{
+    esp_spp_cb_param_t*     p = &evt->param.spp;
+    bool                    ok = true;
+
+    memcpy(p, param, sizeof(*p));
+    switch (event) {
+      case ESP_SPP_DISCOVERY_COMP_EVT :
+        for (int i = 0; i < param->disc_comp.scn_num && i < ESP_SPP_MAX_SCN; i++) {
+            const char* name = param->disc_comp.service_name[i];
+            p->disc_comp.service_name[i] = (name != NULL) ? disp_ext_copy(evt, name, strlen(name) + 1) : NULL;
+            if (name != NULL && p->disc_comp.service_name[i] == NULL) {
+                p->disc_comp.service_name[i] = "";
+                ok = false;
+            }
+        }
+        break;
+      case ESP_SPP_DATA_IND_EVT :
+        p->data_ind.data = disp_ext_copy(evt, param->data_ind.data, param->data_ind.len);
+        if (p->data_ind.data == NULL && param->data_ind.len > 0) {
+            p->data_ind.len = 0;
+            ok = false;
+        }
+        break;
+      default :
+        break;
+    }
+    return ok;
+}
+
+// ================================================================================================
+// キューへの登録(コールバックから呼ぶ)
+// return   登録できなかったら NULL
+// ================================================================================================
+static struct _spp_disp_evt* disp_get(bool droppable)
+{
+    int idx;
+
+    if (xQueueReceive(disp_free_q, &idx, 0) != pdTRUE) {
+        if (droppable) {
+            portENTER_CRITICAL(&disp_mux);
+            disp_stat.dropped++;
+            portEXIT_CRITICAL(&disp_mux);
+            return NULL;
+        }
+        portENTER_CRITICAL(&disp_mux);
+        disp_stat.stalled++;
+        portEXIT_CRITICAL(&disp_mux);
+        xQueueReceive(disp_free_q, &idx, portMAX_DELAY);
+    }
+    disp_pool[idx].ext_len = 0;
+    return &disp_pool[idx];
+}
+
+static void disp_post(struct _spp_disp_evt* evt, bool complete, int64_t start_us)
+{
+    int         idx = evt - disp_pool;
+    uint32_t    us;
+
+    // 深さはキューに入れる前に増やす(入れた時点で配送タスクに切り替わると先に減らされる)
+    portENTER_CRITICAL(&disp_mux);
+    disp_stat.depth++;
+    if (disp_stat.depth > disp_stat.depth_max) {
+        disp_stat.depth_max = disp_stat.depth;
+    }
+    portEXIT_CRITICAL(&disp_mux);
+
+    evt->post_us = esp_timer_get_time();
+    if (xQueueSend(disp_evt_q, &idx, portMAX_DELAY) != pdPASS) {
+        portENTER_CRITICAL(&disp_mux);
+        disp_stat.depth--;
+        disp_stat.dropped++;
+        portEXIT_CRITICAL(&disp_mux);
+        xQueueSend(disp_free_q, &idx, 0);
+        return;
+    }
+    us = esp_timer_get_time() - start_us;
+
+    portENTER_CRITICAL(&disp_mux);
+    disp_stat.posted++;
+    disp_stat.truncated += complete ? 0 : 1;
+    if (us > disp_stat.post_us_max) {
+        disp_stat.post_us_max = us;
+    }
+    portEXIT_CRITICAL(&disp_mux);
+}
+
+// ================================================================================================
+// Bluedroidに登録するコールバック
+// ================================================================================================
+void spp_disp_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
+{
+    int64_t                 start_us = esp_timer_get_time();
+    struct _spp_disp_evt*   evt;
+
+    spp_cap_record(CAP_GAP, event, -1, param, sizeof(*param));
+    evt = disp_get(event == ESP_BT_GAP_DISC_RES_EVT);
+    if (evt != NULL) {
+        evt->src    = DISP_SRC_GAP;
+        evt->event  = event;
+        disp_post(evt, disp_copy_gap(evt, event, param), start_us);
+    }
+}
+
+void spp_disp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
+{
+    int64_t                 start_us = esp_timer_get_time();
+    struct _spp_disp_evt*   evt;
+
+    spp_cap_record(CAP_SPP, event, -1, param, sizeof(*param));
+    evt = disp_get(false);
+    if (evt != NULL) {
+        evt->src    = DISP_SRC_SPP;
+        evt->event  = event;
+        disp_post(evt, disp_copy_spp(evt, event, param), start_us);
+    }
+}
+
+// ================================================================================================
+// 1イベントの配送
+// ================================================================================================
+static void disp_dispatch(struct _spp_disp_evt* evt)
+{
+    uint32_t lat_us = esp_timer_get_time() - evt->post_us;
+    spp_metrics_observe(MET_DISP_LATENCY, 0, lat_us);
+
+    portENTER_CRITICAL(&disp_mux);
+    disp_stat.depth--;
+    disp_stat.lat_us_sum += lat_us;
+    if (disp_stat.dispatched++ == 0 || lat_us < disp_stat.lat_us_min) {
+        disp_stat.lat_us_min = lat_us;
+    }
+    if (lat_us > disp_stat.lat_us_max) {
+        disp_stat.lat_us_max = lat_us;
+    }
+    portEXIT_CRITICAL(&disp_mux);
+
+    for (int i = 0; i < SPP_DISP_HANDLER_MAX; i++) {
+        if (evt->src == DISP_SRC_GAP && disp_gap_handler[i] != NULL) {
+            disp_gap_handler[i](evt->event, &evt->param.gap);
+        }
+        else if (evt->src == DISP_SRC_SPP && disp_spp_handler[i] != NULL) {
+            disp_spp_handler[i](evt->event, &evt->param.spp);
+        }
+    }
+}
+
+// ================================================================================================
+// 配送タスク
+//     1つ目のイベントを待ち、その時点で溜まっているイベントを SPP_DISP_BATCH_MAX 個までまとめて処理する
+// ================================================================================================
+static void disp_task(void* param)
+{
+    int         idx;
+
+    while (1) {
+        uint32_t    n = 0;
+        xQueueReceive(disp_evt_q, &idx, portMAX_DELAY);
+        do {
+            disp_dispatch(&disp_pool[idx]);
+            xQueueSend(disp_free_q, &idx, portMAX_DELAY);
+            n++;
+        } while (n < SPP_DISP_BATCH_MAX && xQueueReceive(disp_evt_q, &idx, 0) == pdTRUE);
+
+        portENTER_CRITICAL(&disp_mux);
+        disp_stat.batches++;
+        if (n > disp_stat.batch_max) {
+            disp_stat.batch_max = n;
+        }
+        portEXIT_CRITICAL(&disp_mux);
+    }
+}
+
+// ================================================================================================
+// 初期化(Bluedroidへのコールバック登録の前に呼ぶ)
+// ================================================================================================
+esp_err_t spp_disp_init(void)
+{
+    if (disp_free_q != NULL) {
+        return ESP_OK;
+    }
+    disp_free_q = xQueueCreate(SPP_DISP_QUEUE_LEN, sizeof(int));
+    disp_evt_q  = xQueueCreate(SPP_DISP_QUEUE_LEN, sizeof(int));
+    if (disp_free_q == NULL || disp_evt_q == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < SPP_DISP_QUEUE_LEN; i++) {
+        xQueueSend(disp_free_q, &i, 0);
+    }
+    if (xTaskCreate(disp_task, "disp_task", SPP_DISP_TASK_STACK, NULL, SPP_DISP_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// ハンドラの登録
+// ================================================================================================
+esp_err_t spp_disp_register_gap(esp_bt_gap_cb_t handler)
+{
+    for (int i = 0; i < SPP_DISP_HANDLER_MAX; i++) {
+        if (disp_gap_handler[i] == NULL) {
+            disp_gap_handler[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t spp_disp_register_spp(esp_spp_cb_t* handler)
+{
+    for (int i = 0; i < SPP_DISP_HANDLER_MAX; i++) {
+        if (disp_spp_handler[i] == NULL) {
+            disp_spp_handler[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+// ================================================================================================
+// 統計の取得
+// ================================================================================================
+void spp_disp_get_stat(struct _spp_disp_stat* stat)
+{
+    portENTER_CRITICAL(&disp_mux);
+    *stat = disp_stat;
+    portEXIT_CRITICAL(&disp_mux);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_disp_show(void)
+{
+    struct _spp_disp_stat   st;
+
+    spp_disp_get_stat(&st);
+
+    printf("    posted %u  dropped %u  stalled %u  truncated %u\n", st.posted, st.dropped, st.stalled, st.truncated);
+    printf("    depth %u (max %u / %d)  batches %u (max %u events)\n",
+            st.depth, st.depth_max, SPP_DISP_QUEUE_LEN, st.batches, st.batch_max);
+    printf("    callback max %u us  dispatch latency min/avg/max %u / %u / %u us\n", st.post_us_max,
+            st.lat_us_min, (st.dispatched > 0) ? (uint32_t)(st.lat_us_sum / st.dispatched) : 0, st.lat_us_max);
+}
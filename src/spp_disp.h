@@ -0,0 +1,62 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// GAP/SPPイベントの配送
+//     Bluedroidのコールバック(BTCタスク)ではイベントを事前に確保した領域にコピーしてキューに入れるだけにする
+//     配送タスクがキューに溜まったイベントをまとめて取り出し、登録されたハンドラを順に呼ぶ
+//     パラメータが指す先(inquiry結果のプロパティ、SDPのサービス名等)もコピーする
+//     空きがないときは inquiry結果(ESP_BT_GAP_DISC_RES_EVT)だけ捨て、それ以外は空くまで待つ
+
+#define SPP_DISP_QUEUE_LEN      16          // キューに入れられるイベント数
+#define SPP_DISP_EXT_SIZE       560         // パラメータが指す先のコピー用領域(1イベントあたり)
+#define SPP_DISP_BATCH_MAX      8           // 1回にまとめて処理するイベント数
+#define SPP_DISP_HANDLER_MAX    4           // 登録できるハンドラ数(GAP/SPPそれぞれ)
+#define SPP_DISP_TASK_PRIO      10
+#define SPP_DISP_TASK_STACK     4096
+
+// イベントの発生元
+#define DISP_SRC_GAP            0
+#define DISP_SRC_SPP            1
+
+struct _spp_disp_evt {
+    uint8_t                 src;            // DISP_SRC_xxx
+    int                     event;
+    int64_t                 post_us;        // キューに入れた時刻
+    union {
+        esp_bt_gap_cb_param_t   gap;
+        esp_spp_cb_param_t      spp;
+    } param;
+    uint16_t                ext_len;
+    uint8_t                 ext[SPP_DISP_EXT_SIZE] __attribute__((aligned(4)));
+};
+
+// 統計
+struct _spp_disp_stat {
+    uint32_t        posted;         // キューに入れた数
+    uint32_t        dropped;        // 空きがなくて捨てた数
+    uint32_t        stalled;        // 空きを待った数
+    uint32_t        truncated;      // パラメータが指す先をコピーしきれなかった数
+    uint32_t        depth;          // キューに入っている数
+    uint32_t        depth_max;
+    uint32_t        dispatched;     // ハンドラを呼んだ数
+    uint32_t        batches;        // まとめて処理した回数
+    uint32_t        batch_max;
+    uint32_t        post_us_max;    // コールバックでかかった時間の最大
+    uint64_t        lat_us_sum;     // キューに入れてからハンドラを呼ぶまで
+    uint32_t        lat_us_min;
+    uint32_t        lat_us_max;
+};
+
+// extern宣言
+extern esp_err_t spp_disp_init(void);
+extern esp_err_t spp_disp_register_gap(esp_bt_gap_cb_t handler);
+extern esp_err_t spp_disp_register_spp(esp_spp_cb_t* handler);
+extern void spp_disp_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param);
+extern void spp_disp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param);
+extern void spp_disp_get_stat(struct _spp_disp_stat* stat);
+extern void spp_disp_show(void);
@@ -0,0 +1,382 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_spiffs.h"
+
+#include "sys/unistd.h"
+
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+#include "spp_user_hdr.h"
+#include "spp_ft.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define FT_HDR_SIZE         (sizeof(struct _spp_ft_hdr))
+
+// 転送状態(接続ごと)
+struct _ft_ctx {
+    int             fd;                                 // SPP
+    int             conn;                               // パラメータテーブルの添字
+    int             file;                               // 転送中のファイル(-1:なし)
+    uint32_t        size;                               // ファイルサイズ
+    uint32_t        acked;                              // 受信確認済みオフセット
+    uint32_t        next;                               // 次に送信するオフセット
+    uint32_t        window;                             // 未確認のまま送信できるバイト数
+    TickType_t      progress_tick;                      // 最後にACKが進んだ時刻
+    int64_t         start_us;                           // 転送開始時刻
+    uint32_t        start_off;                          // 転送開始オフセット
+    uint32_t        retrans;                            // 再送回数
+    bool            closed;                             // write() がクローズを返した
+    bool            resend;                             // FT_NAK で再送するチャンクあり
+    uint32_t        resend_off;
+    uint32_t        tx_len;                             // 送信バッファのフレーム長
+    uint32_t        tx_sent;                            // 送信バッファの送信済み長
+    uint32_t        rx_len;
+    uint8_t         rx[FT_HDR_SIZE + SPP_FT_PATH_MAX];  // 要求受信バッファ
+    uint8_t         tx[FT_HDR_SIZE + SPP_FT_CHUNK_SIZE];// 送信バッファ(ファイルから直接読み込む)
+};
+
+static bool ft_mounted = false;
+
+
+// ================================================================================================
+// 初期化(ストレージのマウント)
+// ================================================================================================
+esp_err_t spp_ft_init(void)
+{
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path              = SPP_FT_BASE_PATH,
+        .partition_label        = SPP_FT_PARTITION_LABEL,
+        .max_files              = 4,
+        .format_if_mount_failed = true,
+    };
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "mount '%s' failed: %s", SPP_FT_PARTITION_LABEL, esp_err_to_name(err));
+        return err;
+    }
+    ft_mounted = true;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// ストレージのファイル一覧表示
+// ================================================================================================
+void spp_ft_show_files(void)
+{
+    DIR*            dir;
+    struct dirent*  ent;
+    char            path[SPP_FT_PATH_MAX + sizeof(SPP_FT_BASE_PATH) + 1];
+    struct stat     st;
+    size_t          total = 0, used = 0;
+
+    if (!ft_mounted) {
+        printf("    storage not mounted\n");
+        return;
+    }
+    esp_spiffs_info(SPP_FT_PARTITION_LABEL, &total, &used);
+    printf("    storage : %u / %u byte used\n", (unsigned)used, (unsigned)total);
+    dir = opendir(SPP_FT_BASE_PATH);
+    if (dir == NULL) {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (snprintf(path, sizeof(path), "%s/%s", SPP_FT_BASE_PATH, ent->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (stat(path, &st) == 0) {
+            printf("    %8ld  %s\n", (long)st.st_size, ent->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+// ================================================================================================
+// 送信バッファに残っているフレームの続きを送信
+//     フレームの途中で別のフレームを送ると接続先でフレーム境界がずれるので、書ききるまで次のフレームは送らない
+// return   true: 送信バッファが空になった
+// ================================================================================================
+static bool ft_flush_tx(struct _ft_ctx* ctx)
+{
+    while (ctx->tx_sent < ctx->tx_len) {
+        int size_w = write(ctx->fd, &ctx->tx[ctx->tx_sent], ctx->tx_len - ctx->tx_sent);
+        if (size_w <= 0) {
+            // 輻輳中(0)またはクローズされた(-1)
+            ctx->closed = (size_w < 0);
+            return false;
+        }
+        spp_link_traffic(ctx->fd, size_w);
+        ctx->tx_sent += size_w;
+    }
+    ctx->tx_len     = 0;
+    ctx->tx_sent    = 0;
+    return true;
+}
+
+// ================================================================================================
+// フレーム送信(ヘッダのみ)
+//     送信中のデータフレームを書ききってから送る
+// ================================================================================================
+static void ft_send_hdr(struct _ft_ctx* ctx, uint8_t type, uint8_t param, uint32_t arg)
+{
+    struct _spp_ft_hdr  hdr = { .type = type, .param = param, .len = 0, .arg = arg };
+
+    while (!ft_flush_tx(ctx)) {
+        if (ctx->closed || spp_conn_stopping(ctx->conn)) {
+            return;
+        }
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    memcpy(ctx->tx, &hdr, FT_HDR_SIZE);
+    ctx->tx_len = FT_HDR_SIZE;
+    ft_flush_tx(ctx);
+}
+
+// ================================================================================================
+// データチャンク送信
+//     ファイルから送信バッファのヘッダの後ろに直接読み込み、1回のwrite()で送信する
+//     書ききれなかった残りは ft_flush_tx() で続きを送る
+// return   送信を開始したデータ長(0:前のフレームが送信中 -1:失敗)
+// ================================================================================================
+static int ft_send_chunk(struct _ft_ctx* ctx, uint32_t offset)
+{
+    struct _spp_ft_hdr  hdr;
+    uint32_t            n = ctx->size - offset;
+    int                 size_r;
+
+    if (!ft_flush_tx(ctx)) {
+        return ctx->closed ? -1 : 0;
+    }
+    // リンク品質が悪いときは小さく分割する
+    uint32_t chunk = spp_link_chunk_size(ctx->fd, SPP_FT_CHUNK_SIZE);
+    if (n > chunk) {
+        n = chunk;
+    }
+    if (lseek(ctx->file, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    size_r = read(ctx->file, &ctx->tx[FT_HDR_SIZE], n);
+    if (size_r <= 0) {
+        return -1;
+    }
+    hdr.type    = FT_DATA;
+    hdr.param   = 0;
+    hdr.len     = size_r;
+    hdr.arg     = offset;
+    memcpy(ctx->tx, &hdr, FT_HDR_SIZE);
+    ctx->tx_len = FT_HDR_SIZE + size_r;
+    if (ft_flush_tx(ctx)) {
+        spp_link_pace(ctx->fd);
+    }
+    return ctx->closed ? -1 : size_r;
+}
+
+// ================================================================================================
+// 転送終了
+// ================================================================================================
+static void ft_close_file(struct _ft_ctx* ctx)
+{
+    if (ctx->file >= 0) {
+        close(ctx->file);
+        ctx->file = -1;
+    }
+}
+
+// ================================================================================================
+// FT_OPEN
+// ================================================================================================
+static void ft_open(struct _ft_ctx* ctx, const struct _spp_ft_hdr* hdr, const char* name)
+{
+    char        path[SPP_FT_PATH_MAX + sizeof(SPP_FT_BASE_PATH) + 1];
+    struct stat st;
+    uint32_t    window = (hdr->param != 0) ? hdr->param : SPP_FT_WINDOW_DEFAULT;
+
+    ft_close_file(ctx);
+    if (strstr(name, "..") != NULL || window > SPP_FT_WINDOW_MAX) {
+        ft_send_hdr(ctx, FT_RSP_OPEN, FT_ST_BAD_REQ, 0);
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s", SPP_FT_BASE_PATH, name);
+    if (stat(path, &st) != 0 || (ctx->file = open(path, O_RDONLY)) < 0) {
+        ESP_LOGW(TAG, "file not found : %s", path);
+        ft_send_hdr(ctx, FT_RSP_OPEN, FT_ST_NOT_FOUND, 0);
+        return;
+    }
+    ctx->size           = st.st_size;
+    ctx->acked          = (hdr->arg < ctx->size) ? hdr->arg : ctx->size;        // 続きからの転送
+    ctx->next           = ctx->acked;
+    ctx->window         = window * SPP_FT_CHUNK_SIZE;
+    ctx->progress_tick  = xTaskGetTickCount();
+    ctx->start_us       = esp_timer_get_time();
+    ctx->start_off      = ctx->acked;
+    ctx->retrans        = 0;
+    ctx->resend         = false;
+    ESP_LOGI(TAG, "send %s : %d byte from %d  window = %d", path, ctx->size, ctx->acked, window);
+    ft_send_hdr(ctx, FT_RSP_OPEN, FT_ST_OK, ctx->size);
+}
+
+// ================================================================================================
+// 受信した要求の処理
+// ================================================================================================
+static void ft_process_rx(struct _ft_ctx* ctx)
+{
+    struct _spp_ft_hdr  hdr;
+    uint32_t            pos = 0;
+
+    while (ctx->rx_len - pos >= FT_HDR_SIZE) {
+        memcpy(&hdr, &ctx->rx[pos], FT_HDR_SIZE);
+        if (hdr.len >= SPP_FT_PATH_MAX) {
+            // フレーム境界がわからなくなったので受信済みデータは捨てる
+            ft_send_hdr(ctx, FT_RSP_OPEN, FT_ST_BAD_REQ, 0);
+            pos = ctx->rx_len;
+            break;
+        }
+        if (ctx->rx_len - pos < FT_HDR_SIZE + hdr.len) {
+            // ペイロード受信待ち
+            break;
+        }
+        switch (hdr.type) {
+          case FT_OPEN :
+            {
+                char    name[SPP_FT_PATH_MAX];
+                memcpy(name, &ctx->rx[pos + FT_HDR_SIZE], hdr.len);
+                name[hdr.len] = '\0';
+                ft_open(ctx, &hdr, name);
+            }
+            break;
+          case FT_ACK :
+            if (ctx->file >= 0 && hdr.arg > ctx->acked && hdr.arg <= ctx->size) {
+                ctx->acked          = hdr.arg;
+                ctx->progress_tick  = xTaskGetTickCount();
+                if (ctx->next < ctx->acked) {
+                    ctx->next = ctx->acked;
+                }
+                if (ctx->acked == ctx->size) {
+                    int64_t     elapsed = esp_timer_get_time() - ctx->start_us;
+                    uint32_t    bytes   = ctx->size - ctx->start_off;
+                    ESP_LOGI(TAG, "transfer complete : %d byte  %lld ms  %lld byte/s  retrans = %d",
+                            bytes, elapsed / 1000, (elapsed > 0) ? (int64_t)bytes * 1000000 / elapsed : 0, ctx->retrans);
+                }
+            }
+            break;
+          case FT_NAK :
+            // 抜けたチャンクだけ再送(送信中のフレームがあれば書ききってから、複数あれば前のほうを優先)
+            if (ctx->file >= 0 && hdr.arg >= ctx->acked && hdr.arg < ctx->next
+             && (!ctx->resend || hdr.arg < ctx->resend_off)) {
+                ctx->resend     = true;
+                ctx->resend_off = hdr.arg;
+                ctx->retrans++;
+            }
+            break;
+          case FT_CLOSE :
+            ft_close_file(ctx);
+            break;
+          default :
+            break;
+        }
+        pos += FT_HDR_SIZE + hdr.len;
+    }
+    // 未処理分を先頭に詰める
+    memmove(ctx->rx, &ctx->rx[pos], ctx->rx_len - pos);
+    ctx->rx_len -= pos;
+}
+
+// ================================================================================================
+// コンテキストの返却(強制終了されたときは監視タスクから呼ばれる)
+// ================================================================================================
+static void ft_free_ctx(void* arg)
+{
+    struct _ft_ctx* ctx = arg;
+
+    ft_close_file(ctx);
+    free(ctx);
+}
+
+// ================================================================================================
+// ファイル転送データタスク(SPP_FT_SERVER_NAME の接続ごとに生成)
+// ================================================================================================
+void spp_ft_task(void* param)
+{
+    int             conn = (int)(intptr_t)param;
+    struct _ft_ctx* ctx = malloc(sizeof(struct _ft_ctx));
+
+    if (ctx == NULL) {
+        ESP_LOGE(TAG, "failed to allocate context");
+        spp_conn_exit(conn);
+        return;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->fd     = spp_conn_fd(conn);
+    ctx->conn   = conn;
+    ctx->file   = -1;
+    spp_conn_set_cleanup(conn, ft_free_ctx, ctx);
+
+    while (!spp_conn_stopping(conn)) {
+        bool    sent = false;
+        int     size_r = read(ctx->fd, &ctx->rx[ctx->rx_len], sizeof(ctx->rx) - ctx->rx_len);
+        if (size_r < 0 || ctx->closed) {
+            // クローズされた
+            break;
+        }
+        ctx->rx_len += size_r;
+        ft_process_rx(ctx);
+
+        // 途中まで書けたフレームの続き
+        if (ctx->tx_len > 0 && ft_flush_tx(ctx)) {
+            sent = true;
+        }
+        if (ctx->file >= 0) {
+            if (ctx->resend && ctx->resend_off < ctx->acked) {
+                // 再送前にACKされた
+                ctx->resend = false;
+            }
+            if (ctx->resend && ft_send_chunk(ctx, ctx->resend_off) != 0) {
+                ctx->resend = false;
+                sent        = true;
+            }
+            // ウィンドウが空いている分だけ送信
+            while (ctx->next < ctx->size && ctx->next - ctx->acked < ctx->window) {
+                int n = ft_send_chunk(ctx, ctx->next);
+                if (n <= 0) {
+                    break;
+                }
+                ctx->next   += n;
+                sent        = true;
+            }
+            // ACKが進まなければ未確認位置から送り直す
+            if (ctx->acked < ctx->next && xTaskGetTickCount() - ctx->progress_tick > SPP_FT_TIMEOUT_MS / portTICK_PERIOD_MS) {
+                ESP_LOGW(TAG, "ack timeout, resend from %d", ctx->acked);
+                ctx->next           = ctx->acked;
+                ctx->progress_tick  = xTaskGetTickCount();
+                ctx->retrans++;
+            }
+        }
+        if (size_r == 0 && !sent) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    ft_free_ctx(ctx);
+    spp_conn_exit(conn);
+}
@@ -0,0 +1,56 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP経由のファイル転送(デバイス → 接続先)
+//     フレーム形式(リトルエンディアン、要求/応答/データ共通)
+//         type(1) param(1) len(2) arg(4) + payload(len)
+//     手順
+//         1. FT_OPEN  (param : ウィンドウ数(0:既定値)  arg : 開始オフセット  payload : ファイル名)
+//              → FT_RSP_OPEN (param : ステータス  arg : ファイルサイズ)
+//         2. デバイスは FT_DATA (arg : オフセット) をウィンドウ数まで応答を待たずに送信する
+//         3. 接続先は FT_ACK (arg : 受信済みオフセット) でウィンドウを進める
+//            抜けがあれば FT_NAK (arg : 抜けたチャンクのオフセット) でそのチャンクだけ再送させる
+//         4. 全データを受信したら FT_CLOSE
+//     ウィンドウ数を1にすると stop-and-wait と同じ動作になる(比較用)
+
+#ifndef SPP_FT_BASE_PATH
+#define SPP_FT_BASE_PATH        "/spiffs"       // マウント先(ホストでの試験ではディレクトリを指定する)
+#endif
+#define SPP_FT_PARTITION_LABEL  "storage"       // パーティション名(partitions.csv)
+#define SPP_FT_CHUNK_SIZE       982             // 1フレームのデータ長(ヘッダ込みでRFCOMMの最大フレーム長(990)に収まるように)
+#define SPP_FT_WINDOW_DEFAULT   8               // ウィンドウ数の既定値
+#define SPP_FT_WINDOW_MAX       32
+#define SPP_FT_TIMEOUT_MS       3000            // ACKが進まないときに未確認位置から送り直すまでの時間
+#define SPP_FT_PATH_MAX         64
+
+// 要求
+#define FT_OPEN                 0x01
+#define FT_ACK                  0x02
+#define FT_NAK                  0x03
+#define FT_CLOSE                0x04
+
+// 応答/データ
+#define FT_RSP_OPEN             0x81
+#define FT_DATA                 0x82
+
+// 応答ステータス
+#define FT_ST_OK                0
+#define FT_ST_NOT_FOUND         1
+#define FT_ST_BAD_REQ           2
+
+struct _spp_ft_hdr {
+    uint8_t         type;
+    uint8_t         param;
+    uint16_t        len;
+    uint32_t        arg;
+};
+
+// extern宣言
+extern esp_err_t spp_ft_init(void);
+extern void spp_ft_task(void* param);
+extern void spp_ft_show_files(void);
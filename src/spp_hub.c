@@ -0,0 +1,282 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_hub.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// 購読者(接続ごと)
+struct _hub_sub {
+    bool            use;
+    int             fd;
+    TaskHandle_t    task;
+    uint32_t        cursor;             // 次に送信するシーケンス番号
+    uint32_t        sent;               // 送信したバッファ数
+    uint32_t        skipped;            // 読み飛ばしたバッファ数
+    struct _spp_buf* tx;                // 送信中のバッファ
+};
+
+int                         spp_hub_lag_policy = HUB_LAG_SKIP;
+static struct _spp_buf*     hub_ring[SPP_HUB_RING];
+static uint32_t             hub_head = 0;       // 次に登録するシーケンス番号
+static uint32_t             hub_tail = 0;       // リングに残っている最も古いシーケンス番号
+static uint32_t             hub_published = 0;  // 登録したバイト数
+static uint32_t             hub_dropped = 0;    // バッファ不足で登録できなかった回数
+static struct _hub_sub      hub_sub[SPP_HUB_SUB_MAX];
+static SemaphoreHandle_t    hub_mutex = NULL;
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_hub_init(void)
+{
+    esp_err_t   err = spp_buf_init();
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    hub_mutex = xSemaphoreCreateMutex();
+    return (hub_mutex != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// ================================================================================================
+// 全購読者が送信を始めたバッファの参照を外す(ロック取得済みで呼ぶこと)
+//     購読者がいなければリングは空になる(新しい購読者は接続後に登録されたデータから送信する)
+// ================================================================================================
+static void hub_ring_trim(void)
+{
+    uint32_t    oldest = hub_head;
+
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        if (hub_sub[i].use && hub_head - hub_sub[i].cursor > hub_head - oldest) {
+            oldest = hub_sub[i].cursor;
+        }
+    }
+    while (hub_head - hub_tail > hub_head - oldest) {
+        spp_buf_unref(hub_ring[hub_tail % SPP_HUB_RING]);
+        hub_ring[hub_tail % SPP_HUB_RING] = NULL;
+        hub_tail++;
+    }
+}
+
+// ================================================================================================
+// リングにバッファを置く(バッファの参照を1つ引き取る)
+//     リングが一杯なら最も古いバッファは参照を外す(送信中の接続が参照していればその接続が返却する)
+// ================================================================================================
+static void hub_ring_put(struct _spp_buf* buf)
+{
+    xSemaphoreTake(hub_mutex, portMAX_DELAY);
+    if (hub_head - hub_tail >= SPP_HUB_RING) {
+        spp_buf_unref(hub_ring[hub_tail % SPP_HUB_RING]);
+        hub_ring[hub_tail % SPP_HUB_RING] = NULL;
+        hub_tail++;
+    }
+    hub_ring[hub_head % SPP_HUB_RING] = buf;
+    hub_head++;
+    hub_published += buf->len;
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        if (hub_sub[i].use) {
+            xTaskNotifyGive(hub_sub[i].task);
+        }
+    }
+    hub_ring_trim();
+    xSemaphoreGive(hub_mutex);
+}
+
+// ================================================================================================
+// データ登録(全接続に配信)
+// ================================================================================================
+esp_err_t spp_hub_publish(const void* data, size_t len)
+{
+    const uint8_t*  p = data;
+
+    if (hub_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (len > 0) {
+        struct _spp_buf*    buf = spp_buf_alloc(0);
+        size_t              n = (len > SPP_BUF_SIZE) ? SPP_BUF_SIZE : len;
+
+        if (buf == NULL) {
+            xSemaphoreTake(hub_mutex, portMAX_DELAY);
+            hub_dropped++;
+            xSemaphoreGive(hub_mutex);
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(buf->data, p, n);
+        buf->len = n;
+        hub_ring_put(buf);
+
+        p   += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// バッファの登録(コピーせずに全接続に配信する)
+//     buf の参照を1つ引き取る。登録後はバッファの内容を変更しないこと
+// ================================================================================================
+esp_err_t spp_hub_publish_buf(struct _spp_buf* buf)
+{
+    if (hub_mutex == NULL) {
+        spp_buf_unref(buf);
+        return ESP_ERR_INVALID_STATE;
+    }
+    hub_ring_put(buf);
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 購読の解除(送信中のバッファを返却し、購読者の位置で止めていたリングを進める)
+// ================================================================================================
+static void hub_sub_release(void* arg)
+{
+    struct _hub_sub*    sub = arg;
+
+    xSemaphoreTake(hub_mutex, portMAX_DELAY);
+    spp_buf_unref(sub->tx);
+    sub->tx     = NULL;
+    sub->use    = false;
+    hub_ring_trim();
+    xSemaphoreGive(hub_mutex);
+}
+
+// ================================================================================================
+// 配信データタスク(SPP_HUB_SERVER_NAME の接続ごとに生成)
+//     強制終了されたときは監視タスクが購読を解除する
+// ================================================================================================
+void spp_hub_task(void* param)
+{
+    int                 conn = (int)(intptr_t)param;
+    int                 fd = spp_conn_fd(conn);
+    struct _hub_sub*    sub = NULL;
+    uint8_t             discard[32];
+
+    xSemaphoreTake(hub_mutex, portMAX_DELAY);
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        if (!hub_sub[i].use) {
+            sub = &hub_sub[i];
+            sub->use        = true;
+            sub->fd         = fd;
+            sub->task       = xTaskGetCurrentTaskHandle();
+            sub->cursor     = hub_head;             // 接続後に登録されたデータから送信する
+            sub->sent       = 0;
+            sub->skipped    = 0;
+            sub->tx         = NULL;
+            break;
+        }
+    }
+    xSemaphoreGive(hub_mutex);
+    if (sub == NULL) {
+        ESP_LOGE(TAG, "subscriber table full");
+        spp_conn_exit(conn);
+        return;
+    }
+    spp_conn_set_cleanup(conn, hub_sub_release, sub);
+
+    while (!spp_conn_stopping(conn)) {
+        struct _spp_buf*    buf = NULL;
+        bool                lagged = false;
+
+        // 受信データは使わない(クローズの検出のみ)
+        if (read(fd, discard, sizeof(discard)) < 0) {
+            break;
+        }
+
+        xSemaphoreTake(hub_mutex, portMAX_DELAY);
+        if (hub_head - sub->cursor > hub_head - hub_tail) {
+            // リングから追い出された
+            lagged = true;
+            if (spp_hub_lag_policy == HUB_LAG_SKIP) {
+                sub->skipped    += hub_tail - sub->cursor;
+                sub->cursor     = hub_tail;
+            }
+        }
+        if (sub->cursor != hub_head && !(lagged && spp_hub_lag_policy == HUB_LAG_DISCONNECT)) {
+            buf = hub_ring[sub->cursor % SPP_HUB_RING];
+            spp_buf_ref(buf);
+            sub->tx = buf;
+            sub->cursor++;
+            hub_ring_trim();
+        }
+        xSemaphoreGive(hub_mutex);
+
+        if (lagged && spp_hub_lag_policy == HUB_LAG_DISCONNECT) {
+            // データタスクを終了する(spp_conn_exit で切断される)
+            ESP_LOGW(TAG, "fd %d lagged behind, disconnect", fd);
+            break;
+        }
+        if (buf != NULL) {
+            // 送信中はリングが進んでもバッファは返却されない(輻輳中は書けるまで待って続きを送る)
+            int size_w = 0;
+            while (size_w < buf->len) {
+                int w = write(fd, &buf->data[buf->off + size_w], buf->len - size_w);
+                if (w < 0 || (w == 0 && spp_conn_stopping(conn))) {
+                    break;
+                }
+                if (w == 0) {
+                    vTaskDelay(10 / portTICK_PERIOD_MS);
+                    continue;
+                }
+                spp_link_traffic(fd, w);
+                size_w += w;
+            }
+            sub->tx = NULL;
+            spp_buf_unref(buf);
+            sub->sent++;
+        }
+        else {
+            ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS);
+        }
+    }
+
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    hub_sub_release(sub);
+    ESP_LOGI(TAG, "hub end : fd = %d  sent = %d  skipped = %d", fd, sub->sent, sub->skipped);
+    spp_conn_exit(conn);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_hub_show(void)
+{
+    if (hub_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(hub_mutex, portMAX_DELAY);
+    printf("    hub : seq = %u  held = %u  published = %u byte  dropped = %u  lag policy = %s\n", hub_head, hub_head - hub_tail,
+            hub_published, hub_dropped, (spp_hub_lag_policy == HUB_LAG_SKIP) ? "skip" : "disconnect");
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        struct _hub_sub* sub = &hub_sub[i];
+        if (sub->use) {
+            printf("    fd %2d  behind : %u  sent : %u  skipped : %u\n", sub->fd, hub_head - sub->cursor, sub->sent, sub->skipped);
+        }
+    }
+    xSemaphoreGive(hub_mutex);
+}
@@ -0,0 +1,31 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 配信ハブ(1つのデータを SPP_HUB_SERVER_NAME の全接続に配信する)
+//     spp_hub_publish() で登録したデータは共通バッファプールのバッファに1回だけ格納し、
+//     リング(SPP_HUB_RING 個)に参照を置く。各接続は自分の位置(cursor)から順に送信する
+//     接続数が増えてもバッファの使用量は変わらない。全接続が送信を始めたバッファはリングから外す(接続がなければ保持しない)
+//     同時に接続できる端末の数はコントローラの ACL 接続数(CONFIG_BTDM_CTRL_BR_EDR_MAX_ACL_CONN、最大7)で制限される
+//     送信が遅れてリングから追い出された接続は spp_hub_lag_policy に従って
+//         HUB_LAG_SKIP       : 残っている最も古いデータまで読み飛ばす
+//         HUB_LAG_DISCONNECT : 切断する
+
+#define SPP_HUB_RING            8           // 保持するバッファ数
+#define SPP_HUB_SUB_MAX         OPEN_HDR_NUM
+
+// 遅れた接続の扱い
+#define HUB_LAG_SKIP            0
+#define HUB_LAG_DISCONNECT      1
+
+// extern宣言
+extern int spp_hub_lag_policy;
+extern esp_err_t spp_hub_init(void);
+extern esp_err_t spp_hub_publish(const void* data, size_t len);
+extern esp_err_t spp_hub_publish_buf(struct _spp_buf* buf);
+extern void spp_hub_task(void* param);
+extern void spp_hub_show(void);
@@ -25,6 +25,10 @@
 #include "gap_cb.h"
 #include "spp_cb.h"
 #include "spp_user_hdr.h"
+#include "spp_boot.h"
+#include "spp_scan.h"
+#include "spp_bond.h"
+#include "spp_disp.h"
 #include "bt_utils.h"
 #include "uart_console.h"
 
@@ -39,7 +43,9 @@ esp_err_t spp_init(esp_spp_mode_t mode)
     esp_err_t err;
 
     // Bluetooth Low energyモードのメモリ解放
+    spp_boot_begin(BOOT_BT_MEM_RELEASE);
     err = esp_bt_controller_mem_release(ESP_BT_MODE_BLE);
+    spp_boot_end(BOOT_BT_MEM_RELEASE);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "controller memory release failed: %s", esp_err_to_name(err));
         return err;
@@ -47,54 +53,74 @@ esp_err_t spp_init(esp_spp_mode_t mode)
 
     // コントローラ初期化
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+    spp_boot_begin(BOOT_CTRL_INIT);
     err = esp_bt_controller_init(&bt_cfg);
+    spp_boot_end(BOOT_CTRL_INIT);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "initialize controller failed: %s", esp_err_to_name(err));
         return err;
     }
 
     // コントローラの有効化
+    spp_boot_begin(BOOT_CTRL_ENABLE);
     err = esp_bt_controller_enable(ESP_BT_MODE_CLASSIC_BT);
+    spp_boot_end(BOOT_CTRL_ENABLE);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "enable controller failed: %s", esp_err_to_name(err));
         return err;
     }
 
     // プロトコルスタックの初期化
+    spp_boot_begin(BOOT_BLUEDROID_INIT);
     err = esp_bluedroid_init();
+    spp_boot_end(BOOT_BLUEDROID_INIT);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "initialize bluedroid failed: %s", esp_err_to_name(err));
         return err;
     }
 
     // プロトコルスタックの有効化
+    spp_boot_begin(BOOT_BLUEDROID_ENABLE);
     err = esp_bluedroid_enable();
+    spp_boot_end(BOOT_BLUEDROID_ENABLE);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "enable bluedroid failed: %s", esp_err_to_name(err));
         return err;
     }
 
     // GAP コールバックの登録
-    err = esp_bt_gap_register_callback(esp_bt_gap_cb);
+    // (コールバックはイベントをキューに入れるだけで、処理は配送タスクで行う)
+    spp_boot_begin(BOOT_CB_REGISTER);
+    err = spp_disp_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "event dispatcher init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    spp_disp_register_gap(esp_bt_gap_cb);
+    err = esp_bt_gap_register_callback(spp_disp_gap_cb);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "gap register failed: %s\n", esp_err_to_name(err));
         return err;
     }
 
     // SPPコールバックの登録
-    err = esp_spp_register_callback(esp_spp_cb);
+    spp_disp_register_spp(esp_spp_cb);
+    err = esp_spp_register_callback(spp_disp_spp_cb);
+    spp_boot_end(BOOT_CB_REGISTER);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "spp register failed: %s", esp_err_to_name(err));
         return err;
     }
 
-    // SPP初期化
+    // SPP初期化(完了は ESP_SPP_INIT_EVT)
+    spp_boot_begin(BOOT_SPP_INIT);
     err = esp_spp_init(mode);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "spp init failed: %s", esp_err_to_name(err));
         return err;
     }
 
+    spp_boot_begin(BOOT_SECURITY);
 #if CONFIG_BT_SSP_ENABLED       // セキュア有効時の設定
     // ペアリング時の動作＝YSE/NO選択
     esp_bt_io_cap_t iocap = ESP_BT_IO_CAP_IO;
@@ -112,15 +138,27 @@ esp_err_t spp_init(esp_spp_mode_t mode)
     // ESP_BT_PIN_TYPE_VARIABLE指定時は第2第3パラメータは未参照
     // ESP_BT_PIN_TYPE_FIXED指定時は第2パラメータにPINコードの桁数、第3パラメータにPINコードを指定する
     esp_bt_gap_set_pin(ESP_BT_PIN_TYPE_VARIABLE, 0, 0);
+    spp_boot_end(BOOT_SECURITY);
 
     // デバイス名の設定
+    spp_boot_begin(BOOT_DEV_NAME);
     err = esp_bt_dev_set_device_name(BT_DEVICE_NAME);
+    spp_boot_end(BOOT_DEV_NAME);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "set device name failed: %s", esp_err_to_name(err));
         return err;
     }
+    // ペアリング済みデバイスの読み込み
+    err = spp_bond_load();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "load bonded devices failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
     // スキャンモードの設定
-    err = esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+    spp_boot_begin(BOOT_SCAN_MODE);
+    err = spp_scan_start();
+    spp_boot_end(BOOT_SCAN_MODE);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "set scan mode failed: %s", esp_err_to_name(err));
         return err;
@@ -0,0 +1,385 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "spp_user_hdr.h"
+#include "spp_link.h"
+#include "bt_utils.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+bool                        spp_link_qos_enable = true;
+static struct _spp_link     link_tbl[SPP_LINK_MAX];
+static portMUX_TYPE         link_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint16_t       link_chunk[LINK_Q_NUM] = { LINK_CHUNK_GOOD, LINK_CHUNK_FAIR, LINK_CHUNK_POOR };
+static const uint16_t       link_pace[LINK_Q_NUM]  = { LINK_PACE_GOOD,  LINK_PACE_FAIR,  LINK_PACE_POOR  };
+
+
+// ================================================================================================
+// ポーリング間隔の制御(1周期分)
+// param    bytes      : 今周期の転送量
+//          elapsed_ms : 周期
+// return   要求するポーリング間隔
+// ================================================================================================
+uint32_t spp_link_policy_step(struct _spp_link_policy* p, uint32_t bytes, uint32_t elapsed_ms)
+{
+    uint32_t    inst = (elapsed_ms > 0) ? bytes * 1000 / elapsed_ms : 0;
+
+    p->rate = (p->rate * 3 + inst) / 4;
+    if (bytes >= SPP_LINK_BURST_BYTES) {
+        // 転送が始まったらすぐに戻す
+        p->state    = LINK_ST_ACTIVE;
+        p->quiet_ms = 0;
+    }
+    else if (p->state == LINK_ST_ACTIVE) {
+        if (p->rate < SPP_LINK_IDLE_RATE) {
+            p->quiet_ms += elapsed_ms;
+            if (p->quiet_ms >= SPP_LINK_IDLE_MS) {
+                p->state = LINK_ST_IDLE;
+            }
+        }
+        else {
+            p->quiet_ms = 0;
+        }
+    }
+    return (p->state == LINK_ST_ACTIVE) ? SPP_LINK_POLL_ACTIVE : SPP_LINK_POLL_IDLE;
+}
+
+// ================================================================================================
+// リンク品質の判定(RSSI 1回分)
+//     平滑化(1/4)した RSSI delta を閾値と比べる。品質が上がる方向はヒステリシス分余計に必要
+// return   品質(LINK_Q_xxx)
+// ================================================================================================
+uint8_t spp_link_quality_step(struct _spp_link_quality* q, int8_t rssi_delta)
+{
+    int     avg;
+
+    if (!q->valid) {
+        q->avg_x16  = rssi_delta * 16;
+        q->valid    = true;
+    }
+    else {
+        q->avg_x16 += (rssi_delta * 16 - q->avg_x16) / 4;
+    }
+    avg = q->avg_x16 / 16;
+
+    switch (q->level) {
+      case LINK_Q_GOOD :
+        if (avg < LINK_Q_POOR_DB) {
+            q->level = LINK_Q_POOR;
+        }
+        else if (avg < LINK_Q_FAIR_DB) {
+            q->level = LINK_Q_FAIR;
+        }
+        break;
+      case LINK_Q_FAIR :
+        if (avg < LINK_Q_POOR_DB) {
+            q->level = LINK_Q_POOR;
+        }
+        else if (avg >= LINK_Q_FAIR_DB + SPP_LINK_RSSI_HYST) {
+            q->level = LINK_Q_GOOD;
+        }
+        break;
+      default :
+        if (avg >= LINK_Q_FAIR_DB + SPP_LINK_RSSI_HYST) {
+            q->level = LINK_Q_GOOD;
+        }
+        else if (avg >= LINK_Q_POOR_DB + SPP_LINK_RSSI_HYST) {
+            q->level = LINK_Q_FAIR;
+        }
+        break;
+    }
+    return q->level;
+}
+
+// ================================================================================================
+// BDアドレスで接続先を検索(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static struct _spp_link* link_find(const uint8_t* bda)
+{
+    for (int i = 0; i < SPP_LINK_MAX; i++) {
+        if (link_tbl[i].use && memcmp(link_tbl[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) {
+            return &link_tbl[i];
+        }
+    }
+    return NULL;
+}
+
+// ================================================================================================
+// 転送量の通知(データタスクから呼ぶ)
+// ================================================================================================
+void spp_link_traffic(int fd, int bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (open_hdr_params[i].use && open_hdr_params[i].fd == fd) {
+            portENTER_CRITICAL(&link_mux);
+            struct _spp_link* link = link_find(open_hdr_params[i].bda);
+            if (link != NULL) {
+                link->bytes += bytes;
+            }
+            portEXIT_CRITICAL(&link_mux);
+            return;
+        }
+    }
+}
+
+// ================================================================================================
+// fd の接続先の品質(接続先が見つからなければ LINK_Q_GOOD)
+// ================================================================================================
+static uint8_t link_quality_of(int fd)
+{
+    uint8_t level = LINK_Q_GOOD;
+
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (open_hdr_params[i].use && open_hdr_params[i].fd == fd) {
+            portENTER_CRITICAL(&link_mux);
+            struct _spp_link* link = link_find(open_hdr_params[i].bda);
+            if (link != NULL) {
+                level = link->quality.level;
+            }
+            portEXIT_CRITICAL(&link_mux);
+            break;
+        }
+    }
+    return level;
+}
+
+// ================================================================================================
+// 送信の分割サイズ(リンク品質に応じて max 以下にする)
+// ================================================================================================
+int spp_link_chunk_size(int fd, int max)
+{
+    int chunk = link_chunk[link_quality_of(fd)];
+    return (chunk < max) ? chunk : max;
+}
+
+// ================================================================================================
+// 送信間隔の調整(リンク品質が悪いときは送信後に待つ)
+// ================================================================================================
+void spp_link_pace(int fd)
+{
+    uint16_t ms = link_pace[link_quality_of(fd)];
+    if (ms > 0) {
+        vTaskDelay((ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+    }
+}
+
+// ================================================================================================
+// ESP_BT_GAP_READ_RSSI_DELTA_EVT
+// ================================================================================================
+void spp_link_rssi(esp_bd_addr_t bda, int stat, int8_t rssi_delta)
+{
+    portENTER_CRITICAL(&link_mux);
+    struct _spp_link* link = link_find(bda);
+    if (link != NULL) {
+        if (stat == ESP_BT_STATUS_SUCCESS) {
+            link->rssi_hist[link->rssi_count % SPP_LINK_RSSI_HIST] = rssi_delta;
+            link->rssi_count++;
+            spp_link_quality_step(&link->quality, rssi_delta);
+        }
+        else {
+            link->rssi_fail++;
+        }
+    }
+    portEXIT_CRITICAL(&link_mux);
+}
+
+// ================================================================================================
+// ESP_BT_GAP_QOS_CMPL_EVT
+// ================================================================================================
+void spp_link_qos_cmpl(esp_bd_addr_t bda, int stat, uint32_t t_poll)
+{
+    portENTER_CRITICAL(&link_mux);
+    struct _spp_link* link = link_find(bda);
+    if (link != NULL) {
+        if (stat == ESP_BT_STATUS_SUCCESS) {
+            link->t_poll = t_poll;
+        }
+        else {
+            // 次の周期で要求し直す
+            link->t_poll_req = 0;
+        }
+    }
+    portEXIT_CRITICAL(&link_mux);
+}
+
+// ================================================================================================
+// ESP_BT_GAP_MODE_CHG_EVT
+// ================================================================================================
+void spp_link_mode_chg(esp_bd_addr_t bda, uint8_t mode)
+{
+    portENTER_CRITICAL(&link_mux);
+    struct _spp_link* link = link_find(bda);
+    if (link != NULL) {
+        link->mode = mode;
+    }
+    portEXIT_CRITICAL(&link_mux);
+}
+
+// ================================================================================================
+// 接続中の接続先とテーブルを合わせる
+//     新しい接続先は転送中として登録し、接続がなくなった接続先は削除する
+// ================================================================================================
+static void link_sync(void)
+{
+    bool    alive[SPP_LINK_MAX] = {0};
+
+    portENTER_CRITICAL(&link_mux);
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (!open_hdr_params[i].use) {
+            continue;
+        }
+        struct _spp_link* link = link_find(open_hdr_params[i].bda);
+        if (link == NULL) {
+            for (int j = 0; j < SPP_LINK_MAX; j++) {
+                if (!link_tbl[j].use) {
+                    link = &link_tbl[j];
+                    memset(link, 0, sizeof(*link));
+                    memcpy(link->bda, open_hdr_params[i].bda, sizeof(esp_bd_addr_t));
+                    link->use           = true;
+                    link->policy.state  = LINK_ST_ACTIVE;
+                    break;
+                }
+            }
+        }
+        if (link != NULL) {
+            alive[link - link_tbl] = true;
+        }
+    }
+    for (int j = 0; j < SPP_LINK_MAX; j++) {
+        if (link_tbl[j].use && !alive[j]) {
+            link_tbl[j].use = false;
+        }
+    }
+    portEXIT_CRITICAL(&link_mux);
+}
+
+// ================================================================================================
+// 制御タスク
+// ================================================================================================
+static void link_task(void* param)
+{
+    TickType_t  last = xTaskGetTickCount();
+    uint32_t    rssi_ms = 0;
+    int         rssi_next = 0;
+
+    while (1) {
+        vTaskDelayUntil(&last, SPP_LINK_TICK_MS / portTICK_PERIOD_MS);
+        link_sync();
+
+        // RSSIの読み出し(接続先を1つずつ順に、接続先ごとに SPP_LINK_RSSI_MS 間隔になるように)
+        int link_num = 0;
+        for (int i = 0; i < SPP_LINK_MAX; i++) {
+            link_num += link_tbl[i].use ? 1 : 0;
+        }
+        rssi_ms += SPP_LINK_TICK_MS;
+        if (link_num > 0 && rssi_ms >= SPP_LINK_RSSI_MS / link_num) {
+            esp_bd_addr_t   bda;
+            bool            found = false;
+            rssi_ms = 0;
+            portENTER_CRITICAL(&link_mux);
+            for (int n = 0; n < SPP_LINK_MAX && !found; n++) {
+                rssi_next = (rssi_next + 1) % SPP_LINK_MAX;
+                if (link_tbl[rssi_next].use) {
+                    memcpy(bda, link_tbl[rssi_next].bda, sizeof(bda));
+                    found = true;
+                }
+            }
+            portEXIT_CRITICAL(&link_mux);
+            if (found) {
+                esp_bt_gap_read_rssi_delta(bda);
+            }
+        }
+
+        for (int i = 0; i < SPP_LINK_MAX; i++) {
+            esp_bd_addr_t   bda;
+            uint32_t        t_poll;
+            bool            request = false;
+
+            portENTER_CRITICAL(&link_mux);
+            struct _spp_link* link = &link_tbl[i];
+            if (link->use) {
+                uint32_t bytes = link->bytes;
+                link->bytes = 0;
+                link->total += bytes;
+                t_poll = spp_link_policy_step(&link->policy, bytes, SPP_LINK_TICK_MS);
+                if (spp_link_qos_enable && t_poll != link->t_poll_req) {
+                    link->t_poll_req = t_poll;
+                    link->switches++;
+                    memcpy(bda, link->bda, sizeof(bda));
+                    request = true;
+                }
+            }
+            portEXIT_CRITICAL(&link_mux);
+
+            if (request) {
+                ESP_LOGD(TAG, "%s : t_poll %d", bdaddr_to_str(bda, NULL), t_poll);
+                esp_bt_gap_set_qos(bda, t_poll);
+            }
+        }
+    }
+}
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_link_init(void)
+{
+    if (xTaskCreate(link_task, "link_task", 2560, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_link_show(void)
+{
+    struct _spp_link    tbl[SPP_LINK_MAX];
+
+    portENTER_CRITICAL(&link_mux);
+    memcpy(tbl, link_tbl, sizeof(tbl));
+    portEXIT_CRITICAL(&link_mux);
+
+    static const char* const q_name[LINK_Q_NUM] = { "good", "fair", "poor" };
+
+    printf("    QoS control : %s\n", spp_link_qos_enable ? "on" : "off");
+    for (int i = 0; i < SPP_LINK_MAX; i++) {
+        struct _spp_link* link = &tbl[i];
+        if (link->use) {
+            printf("    %s  %-6s  rate %6u byte/s  t_poll %4u (req %4u)  mode %d  switches %u  total %u\n",
+                    bdaddr_to_str(link->bda, NULL), (link->policy.state == LINK_ST_ACTIVE) ? "active" : "idle",
+                    link->policy.rate, link->t_poll, link->t_poll_req, link->mode, link->switches, link->total);
+            printf("        quality %s  rssi avg %d  chunk %u  pace %u ms  fail %u  history :",
+                    q_name[link->quality.level], link->quality.avg_x16 / 16,
+                    link_chunk[link->quality.level], link_pace[link->quality.level], link->rssi_fail);
+            // 古い順に表示
+            uint32_t n = (link->rssi_count < SPP_LINK_RSSI_HIST) ? link->rssi_count : SPP_LINK_RSSI_HIST;
+            for (uint32_t k = link->rssi_count - n; k < link->rssi_count; k++) {
+                printf(" %d", link->rssi_hist[k % SPP_LINK_RSSI_HIST]);
+            }
+            printf("\n");
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 接続先(ACLリンク)ごとの状態管理
+//     データタスクは送受信のたびに spp_link_traffic() で転送量を通知する
+//     制御タスクが SPP_LINK_TICK_MS ごとに転送量を集計し、ポーリング間隔(QoS)を切り替える
+//         転送中 : SPP_LINK_POLL_ACTIVE(応答を速く)
+//         休止中 : SPP_LINK_POLL_IDLE(消費電力を少なく)
+//     SPP_LINK_BURST_BYTES 以上の転送があれば休止中でもすぐに転送中に戻す
+//     転送量が SPP_LINK_IDLE_RATE 未満の状態が SPP_LINK_IDLE_MS 続いたら休止中にする
+//     (IDF 4.3 ではスニフモードを要求するAPIがないので、休止中はポーリング間隔を長くするだけ)
+//
+//     リンク品質
+//     SPP_LINK_RSSI_MS ごとに接続先を1つずつ esp_bt_gap_read_rssi_delta() で読み、平滑化して品質を判定する
+//     品質に応じて送信の分割サイズと送信間隔を変える(spp_link_chunk_size(), spp_link_pace())
+//     RSSI delta は受信電力の適正範囲からの差(dB、0:範囲内  負:弱い)
+
+#define SPP_LINK_MAX            OPEN_HDR_NUM
+#define SPP_LINK_TICK_MS        100         // 制御周期
+#define SPP_LINK_POLL_ACTIVE    8           // 転送中のポーリング間隔(スロット : 625us)
+#define SPP_LINK_POLL_IDLE      160         // 休止中のポーリング間隔
+#define SPP_LINK_BURST_BYTES    64          // 1周期でこれ以上転送したら転送中にする
+#define SPP_LINK_IDLE_RATE      256         // これ未満(byte/s)なら休止候補
+#define SPP_LINK_IDLE_MS        2000        // 休止候補がこの時間続いたら休止中にする
+
+#define SPP_LINK_RSSI_MS        1000        // RSSIを読む間隔(接続先ごと)
+#define SPP_LINK_RSSI_HIST      16          // 保持するRSSIの履歴数
+#define SPP_LINK_RSSI_HYST      3           // 品質の判定のヒステリシス(dB)
+
+// 制御状態
+#define LINK_ST_IDLE            0
+#define LINK_ST_ACTIVE          1
+
+// リンク品質
+#define LINK_Q_GOOD             0           // RSSI delta >= -5dB
+#define LINK_Q_FAIR             1           // RSSI delta >= -15dB
+#define LINK_Q_POOR             2
+#define LINK_Q_NUM              3
+
+#define LINK_Q_FAIR_DB          -5          // これ未満で FAIR
+#define LINK_Q_POOR_DB          -15         // これ未満で POOR
+
+// 品質ごとの送信の分割サイズ(byte)と送信間隔(ms)
+#define LINK_CHUNK_GOOD         990
+#define LINK_CHUNK_FAIR         512
+#define LINK_CHUNK_POOR         128
+#define LINK_PACE_GOOD          0
+#define LINK_PACE_FAIR          5
+#define LINK_PACE_POOR          20
+
+// ポーリング間隔の制御状態(FreeRTOSに依存しない)
+struct _spp_link_policy {
+    uint8_t         state;
+    uint32_t        rate;           // 転送量(byte/s、平滑化)
+    uint32_t        quiet_ms;       // 休止候補になってからの時間
+};
+
+// リンク品質の判定状態(FreeRTOSに依存しない)
+struct _spp_link_quality {
+    uint8_t         level;          // LINK_Q_xxx
+    bool            valid;          // 平滑値あり
+    int16_t         avg_x16;        // RSSI delta の平滑値(×16)
+};
+
+// 接続先
+struct _spp_link {
+    bool                    use;
+    esp_bd_addr_t           bda;
+    uint32_t                bytes;          // 今周期の転送量
+    uint32_t                total;          // 累計転送量
+    struct _spp_link_policy policy;
+    uint32_t                t_poll_req;     // 要求したポーリング間隔(0:未要求)
+    uint32_t                t_poll;         // 確定したポーリング間隔(ESP_BT_GAP_QOS_CMPL_EVT)
+    uint8_t                 mode;           // 電力モード(ESP_BT_GAP_MODE_CHG_EVT)
+    uint32_t                switches;       // ポーリング間隔の切り替え回数
+    struct _spp_link_quality quality;
+    int8_t                  rssi_hist[SPP_LINK_RSSI_HIST];  // RSSI delta の履歴
+    uint32_t                rssi_count;     // RSSIを読んだ回数
+    uint32_t                rssi_fail;      // 読めなかった回数
+};
+
+// extern宣言
+extern bool spp_link_qos_enable;
+extern esp_err_t spp_link_init(void);
+extern uint32_t spp_link_policy_step(struct _spp_link_policy* p, uint32_t bytes, uint32_t elapsed_ms);
+extern uint8_t spp_link_quality_step(struct _spp_link_quality* q, int8_t rssi_delta);
+extern void spp_link_traffic(int fd, int bytes);
+extern int spp_link_chunk_size(int fd, int max);
+extern void spp_link_pace(int fd);
+extern void spp_link_rssi(esp_bd_addr_t bda, int stat, int8_t rssi_delta);
+extern void spp_link_qos_cmpl(esp_bd_addr_t bda, int stat, uint32_t t_poll);
+extern void spp_link_mode_chg(esp_bd_addr_t bda, uint8_t mode);
+extern void spp_link_show(void);
@@ -0,0 +1,299 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "spp_user_hdr.h"
+#include "spp_boot.h"
+#include "spp_mem.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// 起動の段階ごと
+struct _mem_phase {
+    struct _spp_mem_snap    begin;
+    int32_t                 used;           // 使用量(段階が複数回あるときは合計)
+    struct _spp_mem_snap    end;            // 最後に終了したときの空き
+    uint8_t                 num;            // 終了した回数
+};
+
+// 接続の計測状態
+#define MEM_CONN_NONE       0
+#define MEM_CONN_OPENING    1               // 接続ハンドラ ～ データタスク生成
+#define MEM_CONN_SETTLING   2               // データタスク生成 ～ SPP_MEM_SETTLE_MS
+#define MEM_CONN_OPEN       3
+#define MEM_CONN_CLOSING    4               // 解放 ～ SPP_MEM_SETTLE_MS
+
+// 接続ごと(パラメータテーブルと同じ添字)
+struct _mem_conn {
+    uint8_t                 state;          // MEM_CONN_xxx
+    bool                    overlap;        // 計測中に他の接続のイベントがあった
+    TickType_t              tick;           // 状態が変わった時刻
+    struct _spp_mem_snap    task_begin;
+    struct _spp_mem_snap    task_end;
+    uint32_t                close_free;     // 解放時の空き(直前の計測値)
+    int32_t                 bt;
+    int32_t                 task;
+    int32_t                 worker;
+};
+
+// 接続/切断のサイクル(すべての接続が解放されたときの空き)
+struct _mem_idle {
+    uint32_t                num;
+    struct _spp_mem_snap    first;
+    struct _spp_mem_snap    last;
+};
+
+static portMUX_TYPE         mem_mux = portMUX_INITIALIZER_UNLOCKED;
+static struct _mem_phase    mem_phase[BOOT_PHASE_NUM];
+static struct _mem_conn     mem_conn[OPEN_HDR_NUM];
+static struct _spp_mem_snap mem_last;           // 直前の接続イベントが落ち着いたときの空き
+static struct {
+    uint32_t                num;
+    int64_t                 bt, task, worker, freed;
+} mem_sum;                                      // 計測できた接続の合計
+static struct _mem_idle     mem_idle;
+
+
+// ================================================================================================
+// 空きと最大の連続領域
+// ================================================================================================
+void spp_mem_take(struct _spp_mem_snap* snap)
+{
+    snap->free      = heap_caps_get_free_size(SPP_MEM_CAPS);
+    snap->largest   = heap_caps_get_largest_free_block(SPP_MEM_CAPS);
+}
+
+// ================================================================================================
+// 起動の段階の開始/終了(spp_boot_begin/end から呼ぶ)
+// ================================================================================================
+void spp_mem_phase_begin(uint8_t phase)
+{
+    struct _spp_mem_snap now;
+
+    if (phase >= BOOT_PHASE_NUM) {
+        return;
+    }
+    spp_mem_take(&now);
+    portENTER_CRITICAL(&mem_mux);
+    mem_phase[phase].begin = now;
+    portEXIT_CRITICAL(&mem_mux);
+}
+
+void spp_mem_phase_end(uint8_t phase)
+{
+    struct _spp_mem_snap now;
+
+    if (phase >= BOOT_PHASE_NUM) {
+        return;
+    }
+    spp_mem_take(&now);
+    portENTER_CRITICAL(&mem_mux);
+    mem_phase[phase].used   += (int32_t)(mem_phase[phase].begin.free - now.free);
+    mem_phase[phase].end    = now;
+    mem_phase[phase].num++;
+    mem_last                = now;
+    portEXIT_CRITICAL(&mem_mux);
+}
+
+// ================================================================================================
+// 計測中の他の接続を平均から外す(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void mem_mark_overlap(int idx)
+{
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (i != idx && mem_conn[i].state != MEM_CONN_NONE && mem_conn[i].state != MEM_CONN_OPEN) {
+            mem_conn[i].overlap = true;
+        }
+    }
+}
+
+// ================================================================================================
+// 接続ハンドラ(パラメータテーブル確保後)
+// ================================================================================================
+void spp_mem_conn_open(int idx)
+{
+    struct _spp_mem_snap now;
+
+    spp_mem_take(&now);
+    portENTER_CRITICAL(&mem_mux);
+    memset(&mem_conn[idx], 0, sizeof(mem_conn[idx]));
+    mem_conn[idx].state = MEM_CONN_OPENING;
+    mem_conn[idx].tick  = xTaskGetTickCount();
+    mem_conn[idx].bt    = (int32_t)(mem_last.free - now.free);
+    mem_mark_overlap(idx);
+    portEXIT_CRITICAL(&mem_mux);
+}
+
+// ================================================================================================
+// データタスクの生成の前後
+// ================================================================================================
+void spp_mem_conn_task(int idx, bool end)
+{
+    struct _spp_mem_snap now;
+
+    spp_mem_take(&now);
+    portENTER_CRITICAL(&mem_mux);
+    if (!end) {
+        mem_conn[idx].task_begin = now;
+    }
+    else {
+        mem_conn[idx].task_end  = now;
+        mem_conn[idx].task      = (int32_t)(mem_conn[idx].task_begin.free - now.free);
+        mem_conn[idx].state     = MEM_CONN_SETTLING;
+        mem_conn[idx].tick      = xTaskGetTickCount();
+    }
+    portEXIT_CRITICAL(&mem_mux);
+}
+
+// ================================================================================================
+// パラメータテーブルの解放(conn_mux 取得中に呼ばれるので、ここでは計測しない)
+// ================================================================================================
+void spp_mem_conn_close(int idx)
+{
+    portENTER_CRITICAL(&mem_mux);
+    if (mem_conn[idx].state != MEM_CONN_OPEN) {
+        // データタスクの確保が落ち着く前に切断された
+        mem_conn[idx].overlap = true;
+    }
+    mem_conn[idx].state         = MEM_CONN_CLOSING;
+    mem_conn[idx].tick          = xTaskGetTickCount();
+    mem_conn[idx].close_free    = mem_last.free;
+    mem_mark_overlap(idx);
+    portEXIT_CRITICAL(&mem_mux);
+}
+
+// ================================================================================================
+// 接続/切断の1サイクル(すべての接続が解放された)
+// ================================================================================================
+static void mem_idle_sample(const struct _spp_mem_snap* now)
+{
+    uint32_t    drift;
+
+    if (mem_idle.num++ == 0) {
+        mem_idle.first = *now;
+    }
+    mem_idle.last = *now;
+    if (mem_idle.num >= SPP_MEM_LEAK_CYCLES && mem_idle.first.free > now->free) {
+        drift = (mem_idle.first.free - now->free) / (mem_idle.num - 1);
+        if (drift > SPP_MEM_LEAK_BYTES) {
+            ESP_LOGW(TAG, "possible leak : %u byte/cycle over %u cycles (free %u -> %u)",
+                    drift, mem_idle.num, mem_idle.first.free, now->free);
+        }
+    }
+}
+
+// ================================================================================================
+// 接続/解放が落ち着いたかの確認(接続の監視タスクから定期的に呼ぶ)
+// ================================================================================================
+void spp_mem_poll(void)
+{
+    TickType_t              settle = SPP_MEM_SETTLE_MS / portTICK_PERIOD_MS;
+    struct _spp_mem_snap    now;
+    bool                    taken = false;
+    bool                    idle;
+
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        struct _mem_conn* c = &mem_conn[idx];
+
+        if ((c->state != MEM_CONN_SETTLING && c->state != MEM_CONN_CLOSING) || xTaskGetTickCount() - c->tick < settle) {
+            continue;
+        }
+        if (!taken) {
+            spp_mem_take(&now);
+            taken = true;
+        }
+        portENTER_CRITICAL(&mem_mux);
+        if (c->state == MEM_CONN_SETTLING) {
+            c->worker   = (int32_t)(c->task_end.free - now.free);
+            c->state    = MEM_CONN_OPEN;
+        }
+        else if (c->state == MEM_CONN_CLOSING) {
+            if (!c->overlap) {
+                mem_sum.num++;
+                mem_sum.bt      += c->bt;
+                mem_sum.task    += c->task;
+                mem_sum.worker  += c->worker;
+                mem_sum.freed   += (int32_t)(now.free - c->close_free);
+            }
+            c->state = MEM_CONN_NONE;
+        }
+        mem_last = now;
+        portEXIT_CRITICAL(&mem_mux);
+    }
+    if (!taken) {
+        return;
+    }
+
+    // すべての接続が解放されていれば1サイクル
+    idle = true;
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        if (open_hdr_params[idx].use || mem_conn[idx].state != MEM_CONN_NONE) {
+            idle = false;
+        }
+    }
+    if (idle) {
+        mem_idle_sample(&now);
+    }
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_mem_show(void)
+{
+    static const char* const    state_name[] = { "-", "opening", "settling", "open", "closing" };
+    struct _spp_mem_snap        now;
+
+    spp_mem_take(&now);
+    printf("    internal RAM : free %u  largest %u (%u%% fragmented)  min free %u\n", now.free, now.largest,
+            (now.free > 0) ? 100 - (uint32_t)((uint64_t)now.largest * 100 / now.free) : 0,
+            (unsigned)heap_caps_get_minimum_free_size(SPP_MEM_CAPS));
+
+    printf("    phase              used(byte)  free after  largest after\n");
+    for (int i = 0; i < BOOT_PHASE_NUM; i++) {
+        if (mem_phase[i].num > 0) {
+            printf("    %-18s %10d  %10u  %13u\n", spp_boot_phase_name(i), mem_phase[i].used,
+                    mem_phase[i].end.free, mem_phase[i].end.largest);
+        }
+    }
+
+    printf("    connection        bt    task  worker\n");
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        struct _mem_conn c = mem_conn[idx];
+        if (c.state != MEM_CONN_NONE) {
+            printf("    [%d] %-8s %6d  %6d  %6d%s\n", idx, state_name[c.state], c.bt, c.task, c.worker,
+                    c.overlap ? "  (overlapped)" : "");
+        }
+    }
+    if (mem_sum.num > 0) {
+        int32_t bt = mem_sum.bt / mem_sum.num, task = mem_sum.task / mem_sum.num, worker = mem_sum.worker / mem_sum.num;
+        printf("    average of %u : bt %d  task %d  worker %d  total %d  freed %d\n", mem_sum.num, bt, task, worker,
+                bt + task + worker, (int32_t)(mem_sum.freed / mem_sum.num));
+    }
+
+    if (mem_idle.num > 0) {
+        printf("    idle cycles %u : free %u -> %u  largest %u -> %u", mem_idle.num, mem_idle.first.free,
+                mem_idle.last.free, mem_idle.first.largest, mem_idle.last.largest);
+        if (mem_idle.num > 1) {
+            printf("  (%d byte/cycle)", ((int32_t)mem_idle.last.free - (int32_t)mem_idle.first.free) / (int32_t)(mem_idle.num - 1));
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,38 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// メモリの使用量の計測(内部RAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+//     起動の段階ごと(spp_boot_begin/end)に空きと最大の連続領域を記録し、段階ごとの使用量を出す
+//     接続ごとの使用量
+//         bt     : 前回の接続イベントから接続ハンドラまでに減った分(RFCOMM/L2CAPのバッファ、VFS)
+//         task   : データタスクの生成で減った分(スタックとTCB、静的割り当てのプールから取れれば0)
+//         worker : データタスクの開始から SPP_MEM_SETTLE_MS の間に減った分(データタスクが確保した領域)
+//         freed  : 解放から SPP_MEM_SETTLE_MS 後までに戻った分
+//     計測中に他の接続のイベントがあった接続は平均に含めない
+//     すべての接続が解放されたとき(idle)の空きを接続/切断の1サイクルとして記録し、
+//     SPP_MEM_LEAK_CYCLES サイクル以上で1サイクルあたり SPP_MEM_LEAK_BYTES より多く減り続けていたらリークとして警告する
+
+#define SPP_MEM_CAPS            (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define SPP_MEM_SETTLE_MS       500         // 接続/解放後に確保/返却が落ち着くまでの時間
+#define SPP_MEM_LEAK_CYCLES     4           // リーク判定に必要なサイクル数
+#define SPP_MEM_LEAK_BYTES      32          // リークとみなす1サイクルあたりの減少量
+
+struct _spp_mem_snap {
+    uint32_t        free;
+    uint32_t        largest;        // 最大の連続領域
+};
+
+// extern宣言
+extern void spp_mem_take(struct _spp_mem_snap* snap);
+extern void spp_mem_phase_begin(uint8_t phase);
+extern void spp_mem_phase_end(uint8_t phase);
+extern void spp_mem_conn_open(int idx);
+extern void spp_mem_conn_task(int idx, bool end);
+extern void spp_mem_conn_close(int idx);
+extern void spp_mem_poll(void);
+extern void spp_mem_show(void);
@@ -0,0 +1,409 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_metrics.h"
+#include "spp_link.h"
+#include "bt_utils.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define MET_HIST_WORDS      (SPP_METRICS_BUCKETS + 2)       // count, sum, bucket...
+#define MET_SNAP_VER        2                   // 2: 全体の長さを追加
+
+// メトリクスの定義
+struct _met_def {
+    const char*     name;
+    uint8_t         type;           // MET_COUNTER/GAUGE/HIST
+    uint8_t         label;          // MET_LABEL_xxx
+    uint8_t         shift;          // ヒストグラムの単位(値 >> shift で bucket を決める)
+};
+
+// MET_xxx の順
+static const struct _met_def met_defs[MET_NUM] = {
+    // name                 type            label               shift
+    { "rx_bytes",           MET_COUNTER,    MET_LABEL_CONN,     0 },
+    { "tx_bytes",           MET_COUNTER,    MET_LABEL_CONN,     0 },
+    { "read_zero",          MET_COUNTER,    MET_LABEL_CONN,     0 },
+    { "write_short",        MET_COUNTER,    MET_LABEL_CONN,     0 },
+    { "read_size",          MET_HIST,       MET_LABEL_CONN,     0 },
+    { "conn_open",          MET_COUNTER,    MET_LABEL_SVC,      0 },
+    { "conn_close",         MET_COUNTER,    MET_LABEL_SVC,      0 },
+    { "conn_reject",        MET_COUNTER,    MET_LABEL_SVC,      0 },
+    { "conn_active",        MET_GAUGE,      MET_LABEL_SVC,      0 },
+    { "conn_time_ms",       MET_HIST,       MET_LABEL_SVC,      7 },    // 128ms 単位
+    { "spp_cong",           MET_COUNTER,    MET_LABEL_NONE,     0 },
+    { "auth_ok",            MET_COUNTER,    MET_LABEL_NONE,     0 },
+    { "auth_fail",          MET_COUNTER,    MET_LABEL_NONE,     0 },
+    { "disp_latency_us",    MET_HIST,       MET_LABEL_NONE,     4 },    // 16us 単位
+};
+
+static uint32_t     met_val[SPP_METRICS_VAL_MAX];       // 値(メトリクス、系列の順)
+static uint16_t     met_off[MET_NUM];                   // メトリクスごとの先頭
+static bool         met_ready = false;
+
+
+// ================================================================================================
+// 系列数と1系列の大きさ
+// ================================================================================================
+static int met_series(const struct _met_def* def)
+{
+    switch (def->label) {
+      case MET_LABEL_CONN :
+        return OPEN_HDR_NUM;
+      case MET_LABEL_SVC :
+        return SPP_METRICS_SVC_MAX;
+      default :
+        return 1;
+    }
+}
+
+static int met_words(const struct _met_def* def)
+{
+    return (def->type == MET_HIST) ? MET_HIST_WORDS : 1;
+}
+
+// ================================================================================================
+// 初期化(値の配置を決める、更新はこの後から有効)
+// ================================================================================================
+esp_err_t spp_metrics_init(void)
+{
+    int off = 0;
+
+    for (int id = 0; id < MET_NUM; id++) {
+        met_off[id] = off;
+        off += met_series(&met_defs[id]) * met_words(&met_defs[id]);
+    }
+    if (off > SPP_METRICS_VAL_MAX) {
+        ESP_LOGE(TAG, "SPP_METRICS_VAL_MAX too small : %d needed", off);
+        return ESP_ERR_NO_MEM;
+    }
+    if (spp_server_num >= SPP_METRICS_SVC_MAX) {
+        ESP_LOGW(TAG, "SPP_METRICS_SVC_MAX too small : client connections are not counted");
+    }
+    met_ready = true;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 系列の値の位置(範囲外は NULL)
+// ================================================================================================
+static uint32_t* met_slot(int id, int label)
+{
+    if (!met_ready || id < 0 || id >= MET_NUM || label < 0 || label >= met_series(&met_defs[id])) {
+        return NULL;
+    }
+    return &met_val[met_off[id] + label * met_words(&met_defs[id])];
+}
+
+// ================================================================================================
+// 更新(カウンタの加算、ゲージの増減/設定、ヒストグラムへの記録)
+// ================================================================================================
+void spp_metrics_add(int id, int label, int32_t n)
+{
+    uint32_t* p = met_slot(id, label);
+    if (p != NULL) {
+        __atomic_fetch_add(p, (uint32_t)n, __ATOMIC_RELAXED);
+    }
+}
+
+void spp_metrics_set(int id, int label, uint32_t value)
+{
+    uint32_t* p = met_slot(id, label);
+    if (p != NULL) {
+        __atomic_store_n(p, value, __ATOMIC_RELAXED);
+    }
+}
+
+void spp_metrics_observe(int id, int label, uint32_t value)
+{
+    uint32_t*   p = met_slot(id, label);
+    uint32_t    v;
+    int         bucket;
+
+    if (p == NULL || met_defs[id].type != MET_HIST) {
+        return;
+    }
+    v       = value >> met_defs[id].shift;
+    bucket  = (v == 0) ? 0 : 32 - __builtin_clz(v);
+    if (bucket >= SPP_METRICS_BUCKETS) {
+        bucket = SPP_METRICS_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&p[0], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p[1], value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p[2 + bucket], 1, __ATOMIC_RELAXED);
+}
+
+// ================================================================================================
+// 接続のラベルの値を0に戻す(接続時)
+// ================================================================================================
+void spp_metrics_conn_reset(int conn)
+{
+    for (int id = 0; id < MET_NUM; id++) {
+        uint32_t* p;
+        if (met_defs[id].label != MET_LABEL_CONN || (p = met_slot(id, conn)) == NULL) {
+            continue;
+        }
+        for (int i = 0; i < met_words(&met_defs[id]); i++) {
+            __atomic_store_n(&p[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// ================================================================================================
+// バイナリの書き込み(はみ出した分は書かずに長さだけ数える)
+// ================================================================================================
+struct _met_wr {
+    uint8_t*        buf;
+    int             size;
+    int             pos;
+};
+
+static void met_put(struct _met_wr* wr, const void* data, int len)
+{
+    if (wr->pos + len <= wr->size) {
+        memcpy(&wr->buf[wr->pos], data, len);
+    }
+    wr->pos += len;
+}
+
+static void met_put8(struct _met_wr* wr, uint8_t v)
+{
+    met_put(wr, &v, 1);
+}
+
+static void met_put32(struct _met_wr* wr, uint32_t v)
+{
+    met_put(wr, &v, 4);
+}
+
+// 全体の長さを len_off の位置(met_put32(0) で空けておく)に書き込んで終わる
+// return   長さ(-1:buf が小さい)
+static int met_end(struct _met_wr* wr, int len_off)
+{
+    uint32_t    len = wr->pos;
+
+    if (wr->pos > wr->size) {
+        return -1;
+    }
+    memcpy(&wr->buf[len_off], &len, 4);
+    return wr->pos;
+}
+
+// ================================================================================================
+// スナップショット(形式は spp_metrics.h)
+// return   長さ(-1:buf が小さい)
+// ================================================================================================
+int spp_metrics_snapshot(uint8_t* buf, int size)
+{
+    struct _met_wr  wr = { buf, size, 0 };
+    int             len_off;
+
+    met_put(&wr, "MT", 2);
+    met_put8(&wr, MET_SNAP_VER);
+    met_put8(&wr, MET_NUM);
+    len_off = wr.pos;
+    met_put32(&wr, 0);
+    met_put32(&wr, esp_timer_get_time() / 1000);
+    met_put32(&wr, esp_get_free_heap_size());
+    // 接続テーブル(接続のラベルと接続先の対応)
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        const struct _open_hdr_params* p = &open_hdr_params[idx];
+        met_put8(&wr, p->use);
+        met_put8(&wr, (p->server >= 0) ? p->server : spp_server_num);
+        met_put(&wr, p->bda, sizeof(esp_bd_addr_t));
+        met_put32(&wr, p->bd_handle);
+    }
+    for (int id = 0; id < MET_NUM; id++) {
+        const struct _met_def*  def = &met_defs[id];
+        int                     series = met_series(def);
+
+        met_put8(&wr, id);
+        met_put8(&wr, def->type);
+        met_put8(&wr, def->label);
+        met_put8(&wr, series);
+        for (int s = 0; s < series; s++) {
+            const uint32_t* p = met_slot(id, s);
+            if (def->type != MET_HIST) {
+                met_put32(&wr, __atomic_load_n(p, __ATOMIC_RELAXED));
+                continue;
+            }
+            uint16_t    bitmap = 0;
+            uint32_t    bucket[SPP_METRICS_BUCKETS];
+            for (int b = 0; b < SPP_METRICS_BUCKETS; b++) {
+                bucket[b] = __atomic_load_n(&p[2 + b], __ATOMIC_RELAXED);
+                if (bucket[b] != 0) {
+                    bitmap |= 1 << b;
+                }
+            }
+            met_put32(&wr, __atomic_load_n(&p[0], __ATOMIC_RELAXED));
+            met_put32(&wr, __atomic_load_n(&p[1], __ATOMIC_RELAXED));
+            met_put(&wr, &bitmap, 2);
+            for (int b = 0; b < SPP_METRICS_BUCKETS; b++) {
+                if (bucket[b] != 0) {
+                    met_put32(&wr, bucket[b]);
+                }
+            }
+        }
+    }
+    return met_end(&wr, len_off);
+}
+
+// ================================================================================================
+// 定義(形式は spp_metrics.h)
+// return   長さ(-1:buf が小さい)
+// ================================================================================================
+int spp_metrics_describe(uint8_t* buf, int size)
+{
+    struct _met_wr  wr = { buf, size, 0 };
+
+    met_put32(&wr, 0);
+    met_put8(&wr, MET_NUM);
+    for (int id = 0; id < MET_NUM; id++) {
+        int len = strlen(met_defs[id].name);
+        met_put8(&wr, id);
+        met_put8(&wr, met_defs[id].type);
+        met_put8(&wr, met_defs[id].label);
+        met_put8(&wr, met_defs[id].shift);
+        met_put8(&wr, len);
+        met_put(&wr, met_defs[id].name, len);
+    }
+    return met_end(&wr, 0);
+}
+
+// ================================================================================================
+// 応答の送信(輻輳で途中までしか書けなければ残りを書ききる)
+// return   false: クローズされた(切断中で送りきれない場合も含む)
+// ================================================================================================
+static bool metrics_send(int conn, int fd, const uint8_t* buf, int len)
+{
+    int sent = 0;
+
+    while (sent < len) {
+        int size_w = write(fd, &buf[sent], len - sent);
+        if (size_w < 0) {
+            return false;
+        }
+        if (size_w == 0) {
+            if (spp_conn_stopping(conn) && !spp_conn_draining(conn)) {
+                return false;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        spp_link_traffic(fd, size_w);
+        sent += size_w;
+    }
+    return true;
+}
+
+// ================================================================================================
+// メトリクスデータタスク(SPP_METRICS_SERVER_NAME の接続ごとに生成)
+//     要求('S'/'D')を受信するたびに応答を返す(応答は書ききってから次の要求を処理する)
+// ================================================================================================
+void spp_metrics_task(void* param)
+{
+    int         conn = (int)(intptr_t)param;
+    int         fd = spp_conn_fd(conn);
+    uint8_t     req[16];
+    uint8_t*    buf = malloc(SPP_METRICS_SNAP_MAX);
+    bool        closed = false;
+
+    if (buf == NULL) {
+        ESP_LOGE(TAG, "failed to allocate buffer");
+        spp_conn_exit(conn);
+        return;
+    }
+    spp_conn_set_cleanup(conn, free, buf);
+    while (!closed && !spp_conn_stopping(conn)) {
+        int size_r = read(fd, req, sizeof(req));
+        if (size_r < 0) {
+            // クローズされた
+            break;
+        }
+        if (size_r == 0) {
+            vTaskDelay(50 / portTICK_PERIOD_MS);
+            continue;
+        }
+        spp_link_traffic(fd, size_r);
+        for (int i = 0; i < size_r && !closed; i++) {
+            int len = -1;
+            if (req[i] == 'S') {
+                len = spp_metrics_snapshot(buf, SPP_METRICS_SNAP_MAX);
+            }
+            else if (req[i] == 'D') {
+                len = spp_metrics_describe(buf, SPP_METRICS_SNAP_MAX);
+            }
+            if (len > 0) {
+                closed = !metrics_send(conn, fd, buf, len);
+            }
+        }
+    }
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    free(buf);
+    spp_conn_exit(conn);
+}
+
+// ================================================================================================
+// 状態表示(0でない系列のみ)
+// ================================================================================================
+void spp_metrics_show(void)
+{
+    if (!met_ready) {
+        printf("    metrics not initialized\n");
+        return;
+    }
+    for (int id = 0; id < MET_NUM; id++) {
+        const struct _met_def*  def = &met_defs[id];
+
+        for (int s = 0; s < met_series(def); s++) {
+            const uint32_t* p = met_slot(id, s);
+            char            label[24] = "";
+
+            if (__atomic_load_n(&p[0], __ATOMIC_RELAXED) == 0) {
+                continue;
+            }
+            if (def->label == MET_LABEL_CONN) {
+                snprintf(label, sizeof(label), "{conn=%d}", s);
+            }
+            else if (def->label == MET_LABEL_SVC) {
+                snprintf(label, sizeof(label), "{svc=%s}", (s < spp_server_num) ? spp_servers[s].name : "client");
+            }
+            if (def->type != MET_HIST) {
+                printf("    %s%s %u\n", def->name, label, p[0]);
+                continue;
+            }
+            // ヒストグラムは回数、平均、最大の bucket の上限
+            int top = 0;
+            for (int b = 0; b < SPP_METRICS_BUCKETS; b++) {
+                if (p[2 + b] != 0) {
+                    top = b;
+                }
+            }
+            printf("    %s%s count %u  avg %u  max < %u\n", def->name, label, p[0], p[1] / p[0],
+                    (top < SPP_METRICS_BUCKETS - 1) ? (1u << top) << def->shift : UINT32_MAX);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// メトリクス(カウンタ/ゲージ/ヒストグラム)
+//     メトリクスは spp_metrics.c の met_defs[] で定義し、値は固定長の配列に置く(実行中にヒープを使わない)
+//     更新はロックを取らずにアトミック命令(__atomic_fetch_add)で行うので、コールバックやデータタスクから呼んでよい
+//     ラベル
+//         MET_LABEL_NONE : なし(系列1つ)
+//         MET_LABEL_CONN : 接続(パラメータテーブルの添字、接続時に0に戻す)
+//         MET_LABEL_SVC  : サービス(spp_servers[] の添字、クライアント接続は spp_server_num)
+//     ヒストグラムは (値 >> shift) の2を底とする対数で SPP_METRICS_BUCKETS 個に分ける
+//         bucket 0 : 0   bucket n : 2^(n-1) ～ 2^n - 1   最後の bucket : それ以上
+//     SPP_METRICS_SERVER_NAME に接続して要求を送るとバイナリで返す(リトルエンディアン)
+//         'S' : スナップショット
+//             magic(2) "MT"  ver(1)  metric_num(1)  len(4)  uptime_ms(4)  heap_free(4)
+//             接続テーブル OPEN_HDR_NUM 個 : use(1) svc(1) bda(6) handle(4)
+//             メトリクスごと : id(1) type(1) label(1) series(1) + 系列ごとの値
+//                 カウンタ/ゲージ : value(4)
+//                 ヒストグラム    : count(4) sum(4) bitmap(2) + 0でない bucket の値(4)
+//         'D' : 定義 len(4)  metric_num(1) + メトリクスごと : id(1) type(1) label(1) shift(1) name_len(1) name
+//         len はヘッダを含む応答全体の長さ(輻輳で分割されても応答は書ききってから次を送る)
+
+#define SPP_METRICS_BUCKETS     16          // ヒストグラムの bucket 数
+#define SPP_METRICS_SVC_MAX     10          // サービスのラベル数(サーバ数 + クライアント接続)
+#define SPP_METRICS_VAL_MAX     1024        // 値の配列の大きさ(32bit)
+#define SPP_METRICS_SNAP_MAX    2048        // スナップショットの最大長
+
+// 種類
+#define MET_COUNTER             0
+#define MET_GAUGE               1
+#define MET_HIST                2
+
+// ラベル
+#define MET_LABEL_NONE          0
+#define MET_LABEL_CONN          1
+#define MET_LABEL_SVC           2
+
+// メトリクス(met_defs[] の順)
+#define MET_RX_BYTES            0           // 受信バイト数(接続)
+#define MET_TX_BYTES            1           // 送信バイト数(接続)
+#define MET_READ_ZERO           2           // 受信データなしの read() の回数(接続)
+#define MET_WRITE_SHORT         3           // 要求より短い write() の回数(接続)
+#define MET_READ_SIZE           4           // read() 1回の受信バイト数(接続、ヒストグラム)
+#define MET_CONN_OPEN           5           // 接続数(サービス)
+#define MET_CONN_CLOSE          6           // 解放した接続数(サービス)
+#define MET_CONN_REJECT         7           // 同時接続数の上限で切断した数(サービス)
+#define MET_CONN_ACTIVE         8           // 接続中の数(サービス、ゲージ)
+#define MET_CONN_TIME           9           // 接続時間 ms(サービス、ヒストグラム)
+#define MET_SPP_CONG            10          // 輻輳の通知の回数
+#define MET_AUTH_OK             11          // 認証の成功
+#define MET_AUTH_FAIL           12          // 認証の失敗
+#define MET_DISP_LATENCY        13          // イベント配送の遅延 us(ヒストグラム)
+#define MET_NUM                 14
+
+// extern宣言
+extern esp_err_t spp_metrics_init(void);
+extern void spp_metrics_add(int id, int label, int32_t n);
+extern void spp_metrics_set(int id, int label, uint32_t value);
+extern void spp_metrics_observe(int id, int label, uint32_t value);
+extern void spp_metrics_conn_reset(int conn);
+extern int spp_metrics_snapshot(uint8_t* buf, int size);
+extern int spp_metrics_describe(uint8_t* buf, int size);
+extern void spp_metrics_task(void* param);
+extern void spp_metrics_show(void);
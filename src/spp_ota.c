@@ -0,0 +1,609 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_ota.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define OTA_SECTOR_SIZE     4096
+
+// NVSに保存する転送状態(再開用)
+struct _ota_session {
+    uint32_t        part_addr;          // 書き込み先パーティション
+    uint32_t        size;               // イメージサイズ
+    uint8_t         sha256[32];         // イメージのハッシュ
+    uint32_t        confirmed;          // 書き込み済みオフセット
+};
+
+// 受信タスク側の状態
+struct _ota_ctx {
+    int             fd;
+    int             conn;               // パラメータテーブルの添字
+    bool            begun;              // OTA_BEGIN 受付済み
+    uint32_t        expected;           // 次に受信するオフセット
+    int             active;             // 受信中のバッファ(-1:なし)
+    uint32_t        fill;               // 受信中のバッファの格納済み長
+    uint32_t        buf_off;            // 受信中のバッファの先頭オフセット
+    uint32_t        acked;              // ACK送信済みオフセット
+    uint32_t        saved;              // NVS保存済みオフセット
+};
+
+// 書き込み要求
+struct _ota_job {
+    int             idx;                // バッファ番号
+    uint32_t        gen;                // セッションの世代
+    uint32_t        offset;
+    uint32_t        len;
+};
+
+static portMUX_TYPE             ota_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool                     ota_busy = false;               // OTA実行中
+static QueueHandle_t            ota_free_q = NULL;              // 空きバッファ番号
+static QueueHandle_t            ota_job_q = NULL;               // 書き込み要求
+static TaskHandle_t             ota_writer = NULL;
+static uint32_t                 ota_gen = 0;                    // セッションの世代(強制終了で進めて残った書き込み要求を無効にする)
+static bool                     ota_writing = false;            // 書き込みタスクがバッファを使用中
+static uint8_t*                 ota_buf[2];
+static const esp_partition_t*   ota_part;
+static struct _ota_session      ota_sess;
+static volatile uint32_t        ota_confirmed;                  // 書き込み済みオフセット(書き込みタスクが更新)
+static volatile esp_err_t       ota_err;                        // 書き込みエラー
+static struct _ota_ctx          ota_ctx;                        // 受信タスク側の状態(強制終了したときに参照する)
+
+
+// ================================================================================================
+// 書き込みタスク
+//     受信タスクが次のバッファに受信している間に、セクタ消去と書き込みを行う
+//     世代が古い要求(強制終了したセッションの残り)は書き込まず、バッファも返却しない
+// ================================================================================================
+static void ota_writer_task(void* param)
+{
+    struct _ota_job job;
+    uint8_t*        buf;
+    bool            current;
+    esp_err_t       err;
+
+    while (1) {
+        xQueueReceive(ota_job_q, &job, portMAX_DELAY);
+        err = ESP_OK;
+        portENTER_CRITICAL(&ota_mux);
+        current     = (job.gen == ota_gen);
+        ota_writing = current;
+        buf         = ota_buf[job.idx];
+        portEXIT_CRITICAL(&ota_mux);
+        if (!current) {
+            continue;
+        }
+        if (ota_err == ESP_OK) {
+            if ((job.offset % OTA_SECTOR_SIZE) == 0) {
+                err = esp_partition_erase_range(ota_part, job.offset, OTA_SECTOR_SIZE);
+            }
+            if (err == ESP_OK) {
+                err = esp_partition_write(ota_part, job.offset, buf, job.len);
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "flash write failed at 0x%x : %s", job.offset, esp_err_to_name(err));
+            }
+        }
+        portENTER_CRITICAL(&ota_mux);
+        current     = (job.gen == ota_gen);
+        ota_writing = false;
+        if (current && ota_err == ESP_OK) {
+            if (err != ESP_OK) {
+                ota_err = err;
+            }
+            else {
+                ota_confirmed = job.offset + job.len;
+            }
+        }
+        portEXIT_CRITICAL(&ota_mux);
+        // バッファを返却(書き込み中に強制終了されたセッションのバッファは返却しない)
+        if (current) {
+            xQueueSend(ota_free_q, &job.idx, portMAX_DELAY);
+        }
+    }
+}
+
+// ================================================================================================
+// 転送状態の保存/読み出し/削除
+// ================================================================================================
+static void ota_session_save(const struct _ota_session* sess)
+{
+    nvs_handle_t    handle;
+    if (nvs_open(SPP_OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_blob(handle, "sess", sess, sizeof(*sess));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+static bool ota_session_load(struct _ota_session* sess)
+{
+    nvs_handle_t    handle;
+    size_t          len = sizeof(*sess);
+    esp_err_t       err;
+
+    if (nvs_open(SPP_OTA_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    err = nvs_get_blob(handle, "sess", sess, &len);
+    nvs_close(handle);
+    return (err == ESP_OK && len == sizeof(*sess));
+}
+
+static void ota_session_clear(void)
+{
+    nvs_handle_t    handle;
+    if (nvs_open(SPP_OTA_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, "sess");
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+// ================================================================================================
+// 応答送信
+// ================================================================================================
+static void ota_send_rsp(int fd, uint8_t type, uint8_t status, uint32_t offset)
+{
+    struct _spp_ota_rsp rsp;
+
+    rsp.type    = type;
+    rsp.status  = status;
+    rsp.rsv     = 0;
+    rsp.offset  = offset;
+    write(fd, &rsp, sizeof(rsp));
+}
+
+// ================================================================================================
+// 書き込みが進んでいればACKを送信(必要なら再開位置を保存)
+// ================================================================================================
+static void ota_flush_ack(struct _ota_ctx* ctx)
+{
+    uint32_t    confirmed = ota_confirmed;
+
+    if (!ctx->begun || confirmed == ctx->acked) {
+        return;
+    }
+    ctx->acked = confirmed;
+    ota_send_rsp(ctx->fd, OTA_RSP_ACK, OTA_ST_OK, confirmed);
+    if (confirmed - ctx->saved >= SPP_OTA_SAVE_INTERVAL) {
+        ota_sess.confirmed = confirmed;
+        ota_session_save(&ota_sess);
+        ctx->saved = confirmed;
+    }
+}
+
+// ================================================================================================
+// 指定長を受信するまで読む(受信待ちの間にACKを送信する)
+// return   false: クローズされた
+// ================================================================================================
+static bool ota_read_full(struct _ota_ctx* ctx, void* buf, uint32_t len)
+{
+    uint32_t    got = 0;
+
+    while (got < len) {
+        int size_r = read(ctx->fd, (uint8_t*)buf + got, len - got);
+        if (size_r < 0 || spp_conn_stopping(ctx->conn)) {
+            return false;
+        }
+        if (size_r == 0) {
+            ota_flush_ack(ctx);
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            continue;
+        }
+        spp_link_traffic(ctx->fd, size_r);
+        got += size_r;
+    }
+    return true;
+}
+
+// ================================================================================================
+// 不要なペイロードの読み捨て
+// ================================================================================================
+static bool ota_discard(struct _ota_ctx* ctx, uint32_t len)
+{
+    uint8_t     tmp[64];
+
+    while (len > 0) {
+        uint32_t n = (len > sizeof(tmp)) ? sizeof(tmp) : len;
+        if (!ota_read_full(ctx, tmp, n)) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+// ================================================================================================
+// 受信中のバッファを書き込みタスクに渡す
+// ================================================================================================
+static void ota_submit(struct _ota_ctx* ctx)
+{
+    struct _ota_job job;
+
+    if (ctx->active < 0) {
+        return;
+    }
+    if (ctx->fill > 0) {
+        job.idx     = ctx->active;
+        job.offset  = ctx->buf_off;
+        job.len     = ctx->fill;
+        job.gen     = ota_gen;
+        xQueueSend(ota_job_q, &job, portMAX_DELAY);
+    }
+    else {
+        xQueueSend(ota_free_q, &ctx->active, portMAX_DELAY);
+    }
+    ctx->active = -1;
+    ctx->fill   = 0;
+}
+
+// ================================================================================================
+// 書き込み完了待ち(受信中のバッファも書き込む)
+// ================================================================================================
+static void ota_drain(struct _ota_ctx* ctx)
+{
+    ota_submit(ctx);
+    while (uxQueueMessagesWaiting(ota_free_q) < 2) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+}
+
+// ================================================================================================
+// OTA_BEGIN
+// ================================================================================================
+static void ota_begin(struct _ota_ctx* ctx, const uint8_t* payload)
+{
+    struct _ota_session saved;
+    uint32_t            size;
+    uint32_t            resume = 0;
+
+    ota_drain(ctx);
+    ctx->begun = false;
+
+    memcpy(&size, payload, sizeof(size));
+    ota_part = esp_ota_get_next_update_partition(NULL);
+    if (ota_part == NULL) {
+        ESP_LOGE(TAG, "no OTA partition");
+        ota_send_rsp(ctx->fd, OTA_RSP_BEGIN, OTA_ST_IMAGE, 0);
+        return;
+    }
+    if (size == 0 || size > ota_part->size) {
+        ESP_LOGE(TAG, "invalid image size %d", size);
+        ota_send_rsp(ctx->fd, OTA_RSP_BEGIN, OTA_ST_BAD_REQ, 0);
+        return;
+    }
+
+    if (ota_session_load(&saved) && saved.part_addr == ota_part->address
+     && saved.size == size && memcmp(saved.sha256, &payload[sizeof(size)], sizeof(saved.sha256)) == 0) {
+        // 同じイメージの転送途中 → 続きから
+        resume = saved.confirmed & ~(OTA_SECTOR_SIZE - 1);
+        ota_sess = saved;
+    }
+    else {
+        ota_sess.part_addr  = ota_part->address;
+        ota_sess.size       = size;
+        memcpy(ota_sess.sha256, &payload[sizeof(size)], sizeof(ota_sess.sha256));
+        ota_sess.confirmed  = 0;
+        ota_session_save(&ota_sess);
+    }
+    ota_err         = ESP_OK;
+    ota_confirmed   = resume;
+    ctx->expected   = resume;
+    ctx->acked      = resume;
+    ctx->saved      = resume;
+    ctx->begun      = true;
+    ESP_LOGI(TAG, "OTA begin : partition '%s'  size = %d  resume = %d", ota_part->label, size, resume);
+    ota_send_rsp(ctx->fd, OTA_RSP_BEGIN, OTA_ST_OK, resume);
+}
+
+// ================================================================================================
+// OTA_DATA(ペイロードを直接書き込みバッファに受信する)
+// ================================================================================================
+static bool ota_data(struct _ota_ctx* ctx, uint32_t len)
+{
+    while (len > 0) {
+        if (ctx->active < 0) {
+            // 空きバッファを取得(2面とも書き込み中ならここで待つ)
+            xQueueReceive(ota_free_q, &ctx->active, portMAX_DELAY);
+            ctx->fill       = 0;
+            ctx->buf_off    = ctx->expected;
+        }
+        uint32_t n = SPP_OTA_BUF_SIZE - ctx->fill;
+        if (n > len) {
+            n = len;
+        }
+        if (!ota_read_full(ctx, &ota_buf[ctx->active][ctx->fill], n)) {
+            return false;
+        }
+        ctx->fill       += n;
+        ctx->expected   += n;
+        len             -= n;
+        if (ctx->fill == SPP_OTA_BUF_SIZE) {
+            ota_submit(ctx);
+        }
+    }
+    return true;
+}
+
+// ================================================================================================
+// 書き込んだイメージのハッシュ確認
+// ================================================================================================
+static bool ota_verify(void)
+{
+    mbedtls_sha256_context  sha;
+    uint8_t                 digest[32];
+    uint8_t*                work = ota_buf[0];      // 書き込み完了後なので作業用に使う
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    for (uint32_t off = 0; off < ota_sess.size; off += SPP_OTA_BUF_SIZE) {
+        uint32_t n = ota_sess.size - off;
+        if (n > SPP_OTA_BUF_SIZE) {
+            n = SPP_OTA_BUF_SIZE;
+        }
+        esp_partition_read(ota_part, off, work, n);
+        mbedtls_sha256_update_ret(&sha, work, n);
+    }
+    mbedtls_sha256_finish_ret(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    return memcmp(digest, ota_sess.sha256, sizeof(digest)) == 0;
+}
+
+// ================================================================================================
+// OTA_END
+// return   true: 切り替え成功
+// ================================================================================================
+static bool ota_end(struct _ota_ctx* ctx)
+{
+    esp_err_t   err;
+
+    ota_drain(ctx);
+    if (!ctx->begun || ota_err != ESP_OK || ota_confirmed != ota_sess.size) {
+        ESP_LOGE(TAG, "OTA incomplete : %d / %d", ota_confirmed, ota_sess.size);
+        ota_send_rsp(ctx->fd, OTA_RSP_END, (ota_err != ESP_OK) ? OTA_ST_FLASH : OTA_ST_OFFSET, ota_confirmed);
+        return false;
+    }
+    ctx->begun = false;
+    ota_session_clear();
+    if (!ota_verify()) {
+        ESP_LOGE(TAG, "OTA hash mismatch");
+        ota_send_rsp(ctx->fd, OTA_RSP_END, OTA_ST_HASH, ota_confirmed);
+        return false;
+    }
+    err = esp_ota_set_boot_partition(ota_part);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        ota_send_rsp(ctx->fd, OTA_RSP_END, OTA_ST_IMAGE, ota_confirmed);
+        return false;
+    }
+    ESP_LOGI(TAG, "OTA complete : next boot partition '%s'", ota_part->label);
+    ota_send_rsp(ctx->fd, OTA_RSP_END, OTA_ST_OK, ota_confirmed);
+    return true;
+}
+
+// ================================================================================================
+// 共通資源の確保(初回のみ)
+// ================================================================================================
+static bool ota_resource_init(void)
+{
+    if (ota_writer != NULL) {
+        return true;
+    }
+    ota_free_q  = xQueueCreate(2, sizeof(int));
+    ota_job_q   = xQueueCreate(2, sizeof(struct _ota_job));
+    if (ota_free_q == NULL || ota_job_q == NULL) {
+        return false;
+    }
+    if (xTaskCreate(ota_writer_task, "ota_writer", 3072, NULL, 6, &ota_writer) != pdPASS) {
+        ota_writer = NULL;
+        return false;
+    }
+    return true;
+}
+
+// ================================================================================================
+// 中断時の再開位置の保存
+// ================================================================================================
+static void ota_suspend(struct _ota_ctx* ctx)
+{
+    if (ctx->begun && ota_err == ESP_OK) {
+        ota_sess.confirmed = ota_confirmed;
+        ota_session_save(&ota_sess);
+        ESP_LOGI(TAG, "OTA suspended at %d", ota_confirmed);
+    }
+}
+
+// ================================================================================================
+// バッファの解放と実行中の解除
+// ================================================================================================
+static void ota_release(void)
+{
+    free(ota_buf[0]);
+    free(ota_buf[1]);
+    ota_buf[0] = NULL;
+    ota_buf[1] = NULL;
+    portENTER_CRITICAL(&ota_mux);
+    ota_busy = false;
+    portEXIT_CRITICAL(&ota_mux);
+}
+
+// ================================================================================================
+// 強制終了されたときの資源の返却(監視タスクから呼ばれる)
+//     世代を進めてキューに残った書き込み要求を捨て、書き込みタスクが書き込み中のバッファを
+//     手放すのを待ってから解放する
+//     期限までに書き込みが終わらなければ、書き込みタスクがまだ参照しているのでバッファは解放しない
+// ================================================================================================
+static void ota_cleanup(void* arg)
+{
+    struct _ota_ctx*    ctx = arg;
+    bool                writing = true;
+
+    portENTER_CRITICAL(&ota_mux);
+    ota_gen++;
+    portEXIT_CRITICAL(&ota_mux);
+    xQueueReset(ota_job_q);
+    for (int i = 0; i < SPP_OTA_KILL_WAIT_MS / 10; i++) {
+        portENTER_CRITICAL(&ota_mux);
+        writing = ota_writing;
+        portEXIT_CRITICAL(&ota_mux);
+        if (!writing) {
+            break;
+        }
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    ota_suspend(ctx);
+    if (writing) {
+        ESP_LOGW(TAG, "flash write still running, OTA buffers are not freed");
+        ota_buf[0] = NULL;
+        ota_buf[1] = NULL;
+    }
+    ota_release();
+}
+
+// ================================================================================================
+// OTAデータタスク(SPP_OTA_SERVER_NAME の接続ごとに生成)
+// ================================================================================================
+void spp_ota_task(void* param)
+{
+    int                     conn = (int)(intptr_t)param;
+    struct _ota_ctx*        ctx = &ota_ctx;
+    struct _spp_ota_req_hdr hdr;
+    uint8_t                 begin_payload[sizeof(uint32_t) + 32];
+    bool                    nak_sent = false;
+    bool                    reboot = false;
+    bool                    claimed;
+
+    // 同時に実行できるのは1接続のみ
+    portENTER_CRITICAL(&ota_mux);
+    claimed = !ota_busy;
+    ota_busy = true;
+    portEXIT_CRITICAL(&ota_mux);
+    if (!claimed) {
+        ESP_LOGW(TAG, "OTA already running");
+        ota_send_rsp(spp_conn_fd(conn), OTA_RSP_NAK, OTA_ST_BUSY, 0);
+        spp_conn_exit(conn);
+        return;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->fd     = spp_conn_fd(conn);
+    ctx->conn   = conn;
+    ctx->active = -1;
+
+    ota_buf[0] = malloc(SPP_OTA_BUF_SIZE);
+    ota_buf[1] = malloc(SPP_OTA_BUF_SIZE);
+    if (!ota_resource_init() || ota_buf[0] == NULL || ota_buf[1] == NULL) {
+        ESP_LOGE(TAG, "failed to allocate OTA resources");
+        goto exit;
+    }
+    xQueueReset(ota_free_q);
+    for (int i = 0; i < 2; i++) {
+        xQueueSend(ota_free_q, &i, 0);
+    }
+    spp_conn_set_cleanup(conn, ota_cleanup, ctx);
+
+    while (ota_read_full(ctx, &hdr, sizeof(hdr))) {
+        bool    ok = true;
+
+        if (hdr.len > SPP_OTA_MAX_PAYLOAD) {
+            // フレーム境界がずれたので継続不可
+            ota_send_rsp(ctx->fd, OTA_RSP_NAK, OTA_ST_BAD_REQ, ctx->expected);
+            break;
+        }
+        switch (hdr.type) {
+          case OTA_BEGIN :
+            if (hdr.len != sizeof(begin_payload)) {
+                ok = ota_discard(ctx, hdr.len);
+                ota_send_rsp(ctx->fd, OTA_RSP_BEGIN, OTA_ST_BAD_REQ, 0);
+                break;
+            }
+            ok = ota_read_full(ctx, begin_payload, sizeof(begin_payload));
+            if (ok) {
+                ota_begin(ctx, begin_payload);
+                nak_sent = false;
+            }
+            break;
+          case OTA_DATA :
+            if (!ctx->begun || hdr.offset != ctx->expected || hdr.offset + hdr.len > ota_sess.size) {
+                // 送り直しが必要(連続して届くフレームには1回だけ応答する)
+                ok = ota_discard(ctx, hdr.len);
+                if (!nak_sent) {
+                    ota_send_rsp(ctx->fd, OTA_RSP_NAK, ctx->begun ? OTA_ST_OFFSET : OTA_ST_BAD_REQ, ctx->expected);
+                    nak_sent = true;
+                }
+                break;
+            }
+            nak_sent = false;
+            ok = ota_data(ctx, hdr.len);
+            break;
+          case OTA_END :
+            ok = ota_discard(ctx, hdr.len);
+            if (ok && ota_end(ctx) && (hdr.flags & OTA_FLAG_REBOOT)) {
+                reboot = true;
+            }
+            break;
+          case OTA_ABORT :
+            ok = ota_discard(ctx, hdr.len);
+            ota_drain(ctx);
+            ctx->begun = false;
+            ota_session_clear();
+            ESP_LOGI(TAG, "OTA aborted");
+            break;
+          default :
+            ok = ota_discard(ctx, hdr.len);
+            ota_send_rsp(ctx->fd, OTA_RSP_NAK, OTA_ST_BAD_REQ, ctx->expected);
+            break;
+        }
+        if (!ok || reboot) {
+            break;
+        }
+        if (ota_err != ESP_OK) {
+            ota_send_rsp(ctx->fd, OTA_RSP_NAK, OTA_ST_FLASH, ota_confirmed);
+            break;
+        }
+        ota_flush_ack(ctx);
+    }
+
+    // 書き込み中のデータを書き終えてから再開位置を保存
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    ota_drain(ctx);
+    ota_suspend(ctx);
+
+exit:
+    ota_release();
+
+    if (reboot) {
+        // 応答が届くのを待ってから再起動
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        esp_restart();
+    }
+    spp_conn_exit(conn);
+}
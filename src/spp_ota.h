@@ -0,0 +1,66 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP経由のOTAアップデート
+//     フレーム形式(リトルエンディアン)
+//         要求 : type(1) flags(1) len(2) offset(4) + payload(len)
+//         応答 : type(1) status(1) rsv(2) offset(4)
+//     手順
+//         1. OTA_BEGIN (payload : image_size(4) sha256(32))
+//              → 応答の offset から送信を開始する(同じイメージの転送途中なら続きから)
+//         2. OTA_DATA を応答を待たずに連続して送信する
+//              → 書き込み完了ごとに OTA_RSP_ACK(書き込み済みオフセット)が返る
+//              → OTA_RSP_NAK が返ったら応答の offset から送り直す
+//         3. OTA_END (flags の OTA_FLAG_REBOOT で切り替え後に再起動)
+//              → ハッシュ確認後にブートパーティションを切り替えて OTA_RSP_END を返す
+
+#define SPP_OTA_BUF_SIZE        4096            // 書き込みバッファ長(フラッシュのセクタサイズ) × 2面
+#define SPP_OTA_MAX_PAYLOAD     4096            // 1フレームの最大ペイロード長
+#define SPP_OTA_SAVE_INTERVAL   (64 * 1024)     // 再開位置をNVSに保存する間隔
+#define SPP_OTA_NVS_NAMESPACE   "spp_ota"
+#define SPP_OTA_KILL_WAIT_MS    1000            // 強制終了後に書き込み中のバッファの返却を待つ期限
+
+// 要求
+#define OTA_BEGIN               0x01
+#define OTA_DATA                0x02
+#define OTA_END                 0x03
+#define OTA_ABORT               0x04
+
+#define OTA_FLAG_REBOOT         0x01            // OTA_END : 切り替え後に再起動
+
+// 応答
+#define OTA_RSP_BEGIN           0x81
+#define OTA_RSP_ACK             0x82
+#define OTA_RSP_END             0x83
+#define OTA_RSP_NAK             0x84
+
+// 応答ステータス
+#define OTA_ST_OK               0
+#define OTA_ST_BUSY             1               // 他の接続でOTA実行中
+#define OTA_ST_BAD_REQ          2               // 不正な要求
+#define OTA_ST_OFFSET           3               // オフセット不一致
+#define OTA_ST_FLASH            4               // フラッシュ書き込みエラー
+#define OTA_ST_HASH             5               // ハッシュ不一致
+#define OTA_ST_IMAGE            6               // イメージ不正(ブート切り替え失敗)
+
+struct _spp_ota_req_hdr {
+    uint8_t         type;
+    uint8_t         flags;
+    uint16_t        len;
+    uint32_t        offset;
+};
+
+struct _spp_ota_rsp {
+    uint8_t         type;
+    uint8_t         status;
+    uint16_t        rsv;
+    uint32_t        offset;
+};
+
+// extern宣言
+extern void spp_ota_task(void* param);
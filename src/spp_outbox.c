@@ -0,0 +1,719 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_outbox.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define REC_HDR_SIZE        (sizeof(struct _outbox_rec_hdr))
+
+// フラッシュアクセス
+static const struct _outbox_flash_ops*  ob_ops = NULL;
+static struct _outbox_flash_ops         ob_part_ops;            // esp_partition用
+
+static SemaphoreHandle_t    ob_mutex    = NULL;
+static TaskHandle_t         ob_task     = NULL;
+
+// リングログの状態
+static uint32_t     ob_nsec;                                    // セクタ数
+static uint32_t     ob_sec_data[OUTBOX_MAX_SECTORS];            // 各セクタの最終データレコードのシーケンス番号(0:なし)
+static uint32_t     ob_head_sec;                                // 書き込み位置(セクタ)
+static uint32_t     ob_head_off;                                // 書き込み位置(セクタ内オフセット)
+static uint32_t     ob_seq;                                     // 最後に割り当てたシーケンス番号
+static uint32_t     ob_acked;                                   // 受信確認済みシーケンス番号
+
+// 書き込みバッチ
+static uint8_t      ob_batch[OUTBOX_BATCH_SIZE];
+static uint32_t     ob_batch_len;
+static uint32_t     ob_batch_data_seq;                          // バッチ内の最終データレコードのシーケンス番号
+static int          ob_batch_ack_off = -1;                      // バッチ末尾のACKレコード位置(上書きして書き込み回数を減らす)
+
+// 送信カーソル(送信タスク専用)
+static uint8_t      ob_io[OUTBOX_IO_SIZE];
+static int          ob_link_fd  = -1;
+static uint32_t     ob_cur_sec;
+static uint32_t     ob_cur_off;
+static uint32_t     ob_sent;
+static uint32_t     ob_link_gen;                                // リンク接続ごとに更新
+static uint32_t     ob_tx_gen;                                  // 送信途中の区間(ob_io上)のリンク
+static uint32_t     ob_tx_pos;
+static uint32_t     ob_tx_end;
+
+// ACKフレームの受信状態(受信タスク専用)
+static int          ob_rx_state;                                // 0:データ 1:0xA5の次 2～5:seq受信中
+static uint32_t     ob_rx_seq;
+static uint32_t     ob_rx_errors;
+
+// 統計
+static uint32_t     ob_flash_writes;
+static uint32_t     ob_erases;
+static uint32_t     ob_dropped;
+
+
+// ================================================================================================
+// esp_partition によるフラッシュアクセス
+// ================================================================================================
+static esp_err_t outbox_part_read(void* ctx, uint32_t addr, void* buf, size_t len)
+{
+    return esp_partition_read((const esp_partition_t*)ctx, addr, buf, len);
+}
+
+static esp_err_t outbox_part_write(void* ctx, uint32_t addr, const void* buf, size_t len)
+{
+    return esp_partition_write((const esp_partition_t*)ctx, addr, buf, len);
+}
+
+static esp_err_t outbox_part_erase(void* ctx, uint32_t addr, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t*)ctx, addr, len);
+}
+
+// ================================================================================================
+// レコード長(4byte境界に揃える)
+// ================================================================================================
+static uint32_t outbox_rec_size(uint32_t len)
+{
+    return (REC_HDR_SIZE + len + 3) & ~3;
+}
+
+// ================================================================================================
+// ペイロードのチェックサム
+// ================================================================================================
+static uint8_t outbox_sum(const uint8_t* data, uint32_t len)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// ================================================================================================
+// セクタ内のレコードを走査
+//     used     : 有効なレコードの終端オフセット
+//     last_seq : 最終レコードのシーケンス番号
+//     last_data: 最終データレコードのシーケンス番号
+//     ack      : ACKレコードの最大値
+// ================================================================================================
+static void outbox_scan_sector(uint32_t sec, uint32_t* used, uint32_t* last_seq, uint32_t* last_data, uint32_t* ack)
+{
+    struct _outbox_rec_hdr  hdr;
+    uint32_t                off = 0;
+
+    *last_seq  = 0;
+    *last_data = 0;
+    while (off + REC_HDR_SIZE <= OUTBOX_SECTOR_SIZE) {
+        if (ob_ops->read(ob_ops->ctx, sec * OUTBOX_SECTOR_SIZE + off, &hdr, REC_HDR_SIZE) != ESP_OK) {
+            break;
+        }
+        if (hdr.magic != OUTBOX_REC_MAGIC || hdr.len > OUTBOX_MAX_PAYLOAD) {
+            // 未書き込み領域(0xFF)または破損
+            break;
+        }
+        uint32_t size = outbox_rec_size(hdr.len);
+        if (off + size > OUTBOX_SECTOR_SIZE) {
+            break;
+        }
+        if (ob_ops->read(ob_ops->ctx, sec * OUTBOX_SECTOR_SIZE + off + REC_HDR_SIZE, ob_io, hdr.len) != ESP_OK) {
+            break;
+        }
+        if (outbox_sum(ob_io, hdr.len) != hdr.sum) {
+            // 書きかけのレコード
+            break;
+        }
+        *last_seq = hdr.seq;
+        if (hdr.type == OUTBOX_REC_DATA) {
+            *last_data = hdr.seq;
+        }
+        else if (hdr.type == OUTBOX_REC_ACK && hdr.len >= sizeof(uint32_t)) {
+            uint32_t    val;
+            memcpy(&val, ob_io, sizeof(val));
+            if (val > *ack) {
+                *ack = val;
+            }
+        }
+        off += size;
+    }
+    *used = off;
+}
+
+// ================================================================================================
+// レコードをバッチに追加(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void outbox_batch_add(uint8_t type, const void* data, uint32_t len)
+{
+    struct _outbox_rec_hdr  hdr;
+    uint32_t                size = outbox_rec_size(len);
+
+    hdr.magic   = OUTBOX_REC_MAGIC;
+    hdr.type    = type;
+    hdr.sum     = outbox_sum(data, len);
+    hdr.len     = (uint16_t)len;
+    hdr.rsv     = 0;
+    hdr.seq     = ++ob_seq;
+
+    memcpy(&ob_batch[ob_batch_len], &hdr, REC_HDR_SIZE);
+    memcpy(&ob_batch[ob_batch_len + REC_HDR_SIZE], data, len);
+    memset(&ob_batch[ob_batch_len + REC_HDR_SIZE + len], 0, size - REC_HDR_SIZE - len);
+
+    ob_batch_ack_off = (type == OUTBOX_REC_ACK) ? (int)ob_batch_len : -1;
+    if (type == OUTBOX_REC_DATA) {
+        ob_batch_data_seq = hdr.seq;
+    }
+    ob_batch_len += size;
+}
+
+// ================================================================================================
+// バッチをフラッシュに書き込む(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static esp_err_t outbox_flush_locked(void)
+{
+    esp_err_t   err;
+
+    if (ob_batch_len == 0) {
+        return ESP_OK;
+    }
+    err = ob_ops->write(ob_ops->ctx, ob_head_sec * OUTBOX_SECTOR_SIZE + ob_head_off, ob_batch, ob_batch_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "flash write failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ob_flash_writes++;
+    if (ob_batch_data_seq != 0) {
+        ob_sec_data[ob_head_sec] = ob_batch_data_seq;
+    }
+    ob_head_off         += ob_batch_len;
+    ob_batch_len        = 0;
+    ob_batch_data_seq   = 0;
+    ob_batch_ack_off    = -1;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 書き込み位置を次のセクタに進める(ロック取得済み、バッチ書き込み済みで呼ぶこと)
+// ================================================================================================
+static void outbox_next_sector(void)
+{
+    uint32_t    next = (ob_head_sec + 1) % ob_nsec;
+
+    if (ob_sec_data[next] > ob_acked) {
+        // 未確認データを上書きする
+        ESP_LOGW(TAG, "outbox full, sector %d dropped", next);
+        ob_dropped++;
+    }
+    if (ob_link_fd >= 0 && ob_cur_sec == next) {
+        // 送信中のセクタが消えるので次の(最も古い)セクタから送り直す
+        ob_cur_sec = (next + 1) % ob_nsec;
+        ob_cur_off = 0;
+    }
+    ob_ops->erase(ob_ops->ctx, next * OUTBOX_SECTOR_SIZE, OUTBOX_SECTOR_SIZE);
+    ob_erases++;
+    ob_sec_data[next]   = 0;
+    ob_head_sec         = next;
+    ob_head_off         = 0;
+
+    // ACK位置を記録したセクタを上書きしても失われないよう、セクタ先頭に記録しなおす
+    if (ob_acked != 0) {
+        outbox_batch_add(OUTBOX_REC_ACK, &ob_acked, sizeof(ob_acked));
+    }
+}
+
+// ================================================================================================
+// レコード追加(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static esp_err_t outbox_append_locked(uint8_t type, const void* data, uint32_t len)
+{
+    esp_err_t   err;
+    uint32_t    size = outbox_rec_size(len);
+
+    if (ob_head_off + ob_batch_len + size > OUTBOX_SECTOR_SIZE) {
+        // セクタに収まらないので次のセクタへ
+        err = outbox_flush_locked();
+        if (err != ESP_OK) {
+            return err;
+        }
+        outbox_next_sector();
+    }
+    if (ob_batch_len + size > OUTBOX_BATCH_SIZE) {
+        // バッチが一杯
+        err = outbox_flush_locked();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    outbox_batch_add(type, data, len);
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 起動時の状態復元
+// ================================================================================================
+static void outbox_recover(void)
+{
+    uint32_t    max_seq  = 0;
+    uint32_t    head_used = 0;
+    uint32_t    ack = 0;
+
+    ob_head_sec = 0;
+    for (uint32_t sec = 0; sec < ob_nsec; sec++) {
+        uint32_t    used, last_seq, last_data;
+        outbox_scan_sector(sec, &used, &last_seq, &last_data, &ack);
+        ob_sec_data[sec] = last_data;
+        if (last_seq > max_seq) {
+            max_seq     = last_seq;
+            ob_head_sec = sec;
+            head_used   = used;
+        }
+    }
+    ob_seq      = max_seq;
+    ob_acked    = ack;
+    ob_batch_len = 0;
+
+    if (max_seq == 0) {
+        // 空(初回起動)
+        ob_ops->erase(ob_ops->ctx, 0, OUTBOX_SECTOR_SIZE);
+        ob_erases++;
+        ob_head_off = 0;
+    }
+    else {
+        ob_head_off = head_used;
+        if (head_used + REC_HDR_SIZE <= OUTBOX_SECTOR_SIZE) {
+            // 書きかけのレコードが残っていたらそのセクタには追記できない
+            uint8_t     tmp[REC_HDR_SIZE];
+            bool        blank = true;
+            ob_ops->read(ob_ops->ctx, ob_head_sec * OUTBOX_SECTOR_SIZE + head_used, tmp, sizeof(tmp));
+            for (int i = 0; i < sizeof(tmp); i++) {
+                if (tmp[i] != 0xff) {
+                    blank = false;
+                }
+            }
+            if (!blank) {
+                outbox_next_sector();
+            }
+        }
+    }
+    ESP_LOGI(TAG, "outbox recovered : seq = %d  acked = %d  head = %d:%d", ob_seq, ob_acked, ob_head_sec, ob_head_off);
+}
+
+// ================================================================================================
+// 送信途中の区間の続きを送る(送信タスクから呼ぶ)
+// return   0: 送信完了  >0: 残りバイト数(輻輳中)  <0: 書き込みエラー
+// ================================================================================================
+static int outbox_send_span(int fd)
+{
+    int len = ob_tx_end - ob_tx_pos;
+    int size_w = write(fd, &ob_io[ob_tx_pos], len);
+
+    spp_link_traffic(fd, size_w);
+    if (size_w < 0) {
+        // 未確認分は次回接続時に再送される
+        ESP_LOGW(TAG, "write : fd = %d data_len = %d / %d", fd, size_w, len);
+        ob_tx_pos = ob_tx_end = 0;
+        return -1;
+    }
+    ob_tx_pos += size_w;
+    return len - size_w;
+}
+
+// ================================================================================================
+// 未確認データの送信(送信タスクから呼ぶ)
+//     フラッシュからまとめて読み出し、連続するデータレコードは1回のwrite()で送信する
+//     書ききれなかった場合は残りを保持し、次回はその続きから送る(レコードの途中で別のデータを送らない)
+// return   true: 輻輳で送信を中断した
+// ================================================================================================
+static bool outbox_send_pending(void)
+{
+    while (1) {
+        int         fd;
+        uint32_t    end;
+        uint32_t    n;
+        uint32_t    pos = 0;
+        int         span_start = -1;
+        uint32_t    span_end = 0;
+        uint32_t    span_seq = 0;
+
+        xSemaphoreTake(ob_mutex, portMAX_DELAY);
+        fd = ob_link_fd;
+        if (fd < 0) {
+            xSemaphoreGive(ob_mutex);
+            break;
+        }
+        if (ob_tx_pos < ob_tx_end) {
+            if (ob_tx_gen == ob_link_gen) {
+                // 前回の残り
+                xSemaphoreGive(ob_mutex);
+                int remain = outbox_send_span(fd);
+                if (remain > 0) {
+                    return true;
+                }
+                if (remain < 0) {
+                    break;
+                }
+                continue;
+            }
+            // 接続しなおしたので捨てる(link_upで確認済みの次から送り直す)
+            ob_tx_pos = ob_tx_end = 0;
+        }
+        outbox_flush_locked();
+        if (ob_cur_sec != ob_head_sec && (ob_sec_data[ob_cur_sec] <= ob_sent || ob_cur_off >= OUTBOX_SECTOR_SIZE)) {
+            // 送信済みのセクタは読まずに飛ばす
+            ob_cur_sec = (ob_cur_sec + 1) % ob_nsec;
+            ob_cur_off = 0;
+            xSemaphoreGive(ob_mutex);
+            continue;
+        }
+        end = (ob_cur_sec == ob_head_sec) ? ob_head_off : OUTBOX_SECTOR_SIZE;
+        if (ob_cur_off >= end) {
+            // すべて送信済み
+            xSemaphoreGive(ob_mutex);
+            break;
+        }
+        n = end - ob_cur_off;
+        if (n > OUTBOX_IO_SIZE) {
+            n = OUTBOX_IO_SIZE;
+        }
+        ob_ops->read(ob_ops->ctx, ob_cur_sec * OUTBOX_SECTOR_SIZE + ob_cur_off, ob_io, n);
+
+        while (pos + REC_HDR_SIZE <= n) {
+            struct _outbox_rec_hdr  hdr;
+            memcpy(&hdr, &ob_io[pos], REC_HDR_SIZE);
+            if (hdr.magic != OUTBOX_REC_MAGIC) {
+                // セクタ内の有効レコード終端
+                if (pos == 0) {
+                    ob_cur_off = OUTBOX_SECTOR_SIZE;
+                }
+                break;
+            }
+            uint32_t size = outbox_rec_size(hdr.len);
+            if (pos + size > n) {
+                if (pos == 0) {
+                    // 破損レコード
+                    ob_cur_off = OUTBOX_SECTOR_SIZE;
+                }
+                break;
+            }
+            if (hdr.type == OUTBOX_REC_DATA && hdr.seq > ob_sent) {
+                if (span_start < 0) {
+                    span_start = pos;
+                }
+                span_end = pos + size;
+                span_seq = hdr.seq;
+            }
+            else if (span_start >= 0) {
+                // 連続区間の終わり
+                break;
+            }
+            pos += size;
+        }
+        if (ob_cur_off < OUTBOX_SECTOR_SIZE) {
+            ob_cur_off += pos;
+        }
+        if (span_start >= 0) {
+            // 送信前に更新しておく(write()中にACKが返ってきても受け付けられるように)
+            ob_sent     = span_seq;
+            ob_tx_gen   = ob_link_gen;
+            ob_tx_pos   = span_start;
+            ob_tx_end   = span_end;
+        }
+        xSemaphoreGive(ob_mutex);
+
+        if (span_start >= 0) {
+            int remain = outbox_send_span(fd);
+            if (remain > 0) {
+                return true;
+            }
+            if (remain < 0) {
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+// ================================================================================================
+// 送信タスク
+//     一定周期でバッチを書き込み、リンクがあれば未確認データを送信する
+// ================================================================================================
+static void outbox_task(void* param)
+{
+    bool    blocked = false;
+
+    while (1) {
+        // 輻輳で送りきれなかった場合は短い間隔で続きを送る
+        ulTaskNotifyTake(pdTRUE, (blocked ? OUTBOX_RETRY_MS : OUTBOX_FLUSH_MS) / portTICK_PERIOD_MS);
+
+        xSemaphoreTake(ob_mutex, portMAX_DELAY);
+        outbox_flush_locked();
+        xSemaphoreGive(ob_mutex);
+
+        blocked = outbox_send_pending();
+    }
+}
+
+// ================================================================================================
+// 初期化(フラッシュアクセス関数指定)
+// ================================================================================================
+esp_err_t spp_outbox_init_ops(const struct _outbox_flash_ops* ops)
+{
+    if (ops == NULL || ops->size < OUTBOX_SECTOR_SIZE * 2) {
+        ESP_LOGE(TAG, "invalid outbox area");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ob_mutex == NULL) {
+        ob_mutex = xSemaphoreCreateMutex();
+        if (ob_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    ob_ops  = ops;
+    ob_nsec = ops->size / OUTBOX_SECTOR_SIZE;
+    if (ob_nsec > OUTBOX_MAX_SECTORS) {
+        ob_nsec = OUTBOX_MAX_SECTORS;
+    }
+    outbox_recover();
+    ob_sent     = ob_acked;
+    ob_tx_pos   = ob_tx_end = 0;
+    xSemaphoreGive(ob_mutex);
+
+    if (ob_task == NULL) {
+        BaseType_t ret = xTaskCreate(outbox_task, "outbox_task", 3072, NULL, 4, &ob_task);
+        if (ret != pdPASS) {
+            ESP_LOGE(TAG, "outbox task create error %d", ret);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 初期化(パーティション使用)
+// ================================================================================================
+esp_err_t spp_outbox_init(void)
+{
+    const esp_partition_t*  part;
+
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, OUTBOX_PARTITION_LABEL);
+    if (part == NULL) {
+        ESP_LOGW(TAG, "partition '%s' not found, outbox disabled", OUTBOX_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    ob_part_ops.read    = outbox_part_read;
+    ob_part_ops.write   = outbox_part_write;
+    ob_part_ops.erase   = outbox_part_erase;
+    ob_part_ops.size    = part->size;
+    ob_part_ops.ctx     = (void*)part;
+    return spp_outbox_init_ops(&ob_part_ops);
+}
+
+// ================================================================================================
+// データ登録
+// ================================================================================================
+esp_err_t spp_outbox_put(const void* data, size_t len)
+{
+    esp_err_t   err;
+
+    if (ob_ops == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (len == 0 || len > OUTBOX_MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    err = outbox_append_locked(OUTBOX_REC_DATA, data, len);
+    xSemaphoreGive(ob_mutex);
+    return err;
+}
+
+// ================================================================================================
+// バッチの即時書き込み
+// ================================================================================================
+esp_err_t spp_outbox_flush(void)
+{
+    esp_err_t   err;
+
+    if (ob_ops == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    err = outbox_flush_locked();
+    xSemaphoreGive(ob_mutex);
+    return err;
+}
+
+// ================================================================================================
+// 受信確認(seqまで受信済み)
+// ================================================================================================
+void spp_outbox_ack(uint32_t seq)
+{
+    if (ob_ops == NULL) {
+        return;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    if (seq > ob_acked && seq <= ob_sent) {
+        ob_acked = seq;
+        if (ob_batch_ack_off >= 0) {
+            // 未書き込みのACKレコードを上書き
+            uint8_t*    payload = &ob_batch[ob_batch_ack_off + REC_HDR_SIZE];
+            memcpy(payload, &ob_acked, sizeof(ob_acked));
+            ob_batch[ob_batch_ack_off + offsetof(struct _outbox_rec_hdr, sum)] = outbox_sum(payload, sizeof(ob_acked));
+        }
+        else {
+            outbox_append_locked(OUTBOX_REC_ACK, &ob_acked, sizeof(ob_acked));
+        }
+    }
+    xSemaphoreGive(ob_mutex);
+}
+
+// ================================================================================================
+// 受信データからACKフレームを取り除く
+//     受信側からのデータは 0xA5 をエスケープとするストリームとして解析する(spp_outbox.h 参照)
+//     ACKフレームはread()の区切りと無関係に分割/連結されていてよい
+//     ACKフレームを取り除き、0xA5 0xA5 を 0xA5 に戻して data を前に詰める
+// return   残ったデータ長(0:すべてACKフレームだった)
+// ================================================================================================
+int spp_outbox_rx(int fd, uint8_t* data, int len)
+{
+    int     out = 0;
+
+    if (ob_ops == NULL || fd != ob_link_fd) {
+        return len;
+    }
+    for (int i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        if (ob_rx_state == 0) {
+            if (c == OUTBOX_ACK_MAGIC0) {
+                ob_rx_state = 1;
+            }
+            else {
+                data[out++] = c;
+            }
+        }
+        else if (ob_rx_state == 1) {
+            if (c == OUTBOX_ACK_MAGIC1) {
+                ob_rx_state = 2;
+                ob_rx_seq   = 0;
+            }
+            else {
+                if (c != OUTBOX_ACK_MAGIC0) {
+                    // 不正なエスケープ(0xA5は捨てて次のバイトはデータとする)
+                    ob_rx_errors++;
+                }
+                data[out++] = c;
+                ob_rx_state = 0;
+            }
+        }
+        else {
+            ob_rx_seq |= (uint32_t)c << ((ob_rx_state - 2) * 8);
+            if (++ob_rx_state == OUTBOX_ACK_LEN) {
+                ob_rx_state = 0;
+                spp_outbox_ack(ob_rx_seq);
+            }
+        }
+    }
+    return out;
+}
+
+// ================================================================================================
+// リンク接続(未確認データの再送開始)
+// ================================================================================================
+void spp_outbox_link_up(int fd)
+{
+    if (ob_ops == NULL) {
+        return;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    if (ob_link_fd < 0) {
+        ob_link_fd  = fd;
+        // 最も古いセクタから確認済みの次を送り直す
+        ob_cur_sec  = (ob_head_sec + 1) % ob_nsec;
+        ob_cur_off  = 0;
+        ob_sent     = ob_acked;
+        ob_link_gen++;
+        ob_rx_state = 0;
+        ESP_LOGI(TAG, "outbox link up : fd = %d  resend from seq %d", fd, ob_acked + 1);
+    }
+    xSemaphoreGive(ob_mutex);
+    xTaskNotifyGive(ob_task);
+}
+
+// ================================================================================================
+// リンク切断
+// ================================================================================================
+void spp_outbox_link_down(int fd)
+{
+    if (ob_ops == NULL) {
+        return;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    if (ob_link_fd == fd) {
+        ob_link_fd  = -1;
+        ob_sent     = ob_acked;         // 未確認分は次回接続時に再送
+        ESP_LOGI(TAG, "outbox link down : fd = %d", fd);
+    }
+    xSemaphoreGive(ob_mutex);
+}
+
+// ================================================================================================
+// 統計情報の取得
+// ================================================================================================
+void spp_outbox_get_stat(struct _outbox_stat* stat)
+{
+    memset(stat, 0, sizeof(*stat));
+    if (ob_ops == NULL) {
+        return;
+    }
+    xSemaphoreTake(ob_mutex, portMAX_DELAY);
+    stat->head_seq      = ob_seq;
+    stat->acked_seq     = ob_acked;
+    stat->sent_seq      = ob_sent;
+    stat->pending       = ob_batch_len;
+    stat->flash_writes  = ob_flash_writes;
+    stat->erases        = ob_erases;
+    stat->dropped       = ob_dropped;
+    stat->rx_errors     = ob_rx_errors;
+    xSemaphoreGive(ob_mutex);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_outbox_show(void)
+{
+    struct _outbox_stat stat;
+
+    if (ob_ops == NULL) {
+        printf("    outbox disabled\n");
+        return;
+    }
+    spp_outbox_get_stat(&stat);
+    printf("    outbox  seq : %u  sent : %u  acked : %u  pending : %u byte\n",
+            stat.head_seq, stat.sent_seq, stat.acked_seq, stat.pending);
+    printf("            head : %u:%u / %u sectors  writes : %u  erases : %u  dropped : %u  rx errors : %u\n",
+            ob_head_sec, ob_head_off, ob_nsec, stat.flash_writes, stat.erases, stat.dropped, stat.rx_errors);
+}
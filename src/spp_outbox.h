@@ -0,0 +1,79 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 送信待ちデータ保存領域(outbox)
+//     専用パーティションを追記型のリングログとして使用する
+//     レコードはフラッシュ上の形式のままSPPに送信する(受信側はヘッダでレコードを切り出す)
+//     受信側は ACKフレーム(OUTBOX_ACK_MAGIC0, OUTBOX_ACK_MAGIC1, seq(LE 4byte)) で受信済みシーケンス番号を返す
+//     受信側から送るデータは OUTBOX_ACK_MAGIC0 をエスケープとして扱う
+//         0xA5 'K' seq(LE 4byte) : ACKフレーム(データの途中に挟んでよい)
+//         0xA5 0xA5              : データの 0xA5
+//         0xA5 その他            : 不正(0xA5を捨てる)
+
+#define OUTBOX_PARTITION_LABEL  "outbox"        // パーティション名(partitions.csv)
+#define OUTBOX_SECTOR_SIZE      4096            // 消去単位
+#define OUTBOX_MAX_SECTORS      64              // 扱える最大セクタ数(パーティションサイズ上限 256KB)
+#define OUTBOX_BATCH_SIZE       512             // 書き込みバッチバッファ長
+#define OUTBOX_IO_SIZE          512             // 再送時の一括読み出し長
+#define OUTBOX_FLUSH_MS         1000            // バッチの定期書き込み間隔
+#define OUTBOX_RETRY_MS         20              // 輻輳で書ききれなかった場合の再送間隔
+
+#define OUTBOX_REC_MAGIC        0x424F          // レコードヘッダのマジック("OB")
+#define OUTBOX_REC_DATA         0x01            // データレコード
+#define OUTBOX_REC_ACK          0x02            // ACK位置記録レコード(受信側は読み捨てる)
+
+#define OUTBOX_ACK_MAGIC0       0xA5            // 受信側から返されるACKフレーム
+#define OUTBOX_ACK_MAGIC1       'K'
+#define OUTBOX_ACK_LEN          6
+
+// レコードヘッダ(フラッシュ上/送信データ共通 リトルエンディアン)
+struct _outbox_rec_hdr {
+    uint16_t        magic;
+    uint8_t         type;
+    uint8_t         sum;            // ペイロードのチェックサム(電源断時の書きかけ検出用)
+    uint16_t        len;            // ペイロード長
+    uint16_t        rsv;
+    uint32_t        seq;            // シーケンス番号(全レコード共通で単調増加)
+};
+
+#define OUTBOX_MAX_PAYLOAD      (OUTBOX_BATCH_SIZE - sizeof(struct _outbox_rec_hdr))
+
+// フラッシュアクセス関数テーブル
+//     デフォルトは esp_partition_*() を使用する
+//     ホスト(Linux)で動作確認する場合はファイルを読み書きする関数を設定して spp_outbox_init_ops() を呼ぶ
+struct _outbox_flash_ops {
+    esp_err_t       (*read)(void* ctx, uint32_t addr, void* buf, size_t len);
+    esp_err_t       (*write)(void* ctx, uint32_t addr, const void* buf, size_t len);
+    esp_err_t       (*erase)(void* ctx, uint32_t addr, size_t len);
+    uint32_t        size;           // 領域サイズ(OUTBOX_SECTOR_SIZE の倍数)
+    void*           ctx;
+};
+
+// 統計情報
+struct _outbox_stat {
+    uint32_t        head_seq;       // 最後に登録したシーケンス番号
+    uint32_t        acked_seq;      // 受信確認済みシーケンス番号
+    uint32_t        sent_seq;       // 送信済みシーケンス番号
+    uint32_t        pending;        // バッチバッファ上の未書き込みバイト数
+    uint32_t        flash_writes;   // フラッシュ書き込み回数
+    uint32_t        erases;         // セクタ消去回数
+    uint32_t        dropped;        // 未送信のまま上書きされたセクタ数
+    uint32_t        rx_errors;      // 不正なエスケープの受信数
+};
+
+// extern宣言
+extern esp_err_t spp_outbox_init(void);
+extern esp_err_t spp_outbox_init_ops(const struct _outbox_flash_ops* ops);
+extern esp_err_t spp_outbox_put(const void* data, size_t len);
+extern esp_err_t spp_outbox_flush(void);
+extern void spp_outbox_ack(uint32_t seq);
+extern int spp_outbox_rx(int fd, uint8_t* data, int len);
+extern void spp_outbox_link_up(int fd);
+extern void spp_outbox_link_down(int fd);
+extern void spp_outbox_get_stat(struct _outbox_stat* stat);
+extern void spp_outbox_show(void);
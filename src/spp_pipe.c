@@ -0,0 +1,486 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_outbox.h"
+#include "spp_hub.h"
+#include "spp_link.h"
+#include "spp_cap.h"
+#include "spp_metrics.h"
+#include "bt_utils.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// 接続先ごとの chain の設定
+struct _pipe_peer {
+    bool            use;
+    esp_bd_addr_t   bda;
+    int             chain;
+};
+
+static portMUX_TYPE         pipe_mux = portMUX_INITIALIZER_UNLOCKED;
+static struct _pipe_peer    pipe_peer[SPP_PIPE_PEER_MAX];
+static struct _spp_pipe*    pipe_live[OPEN_HDR_NUM];            // 実行中のパイプライン(表示用)
+static struct _spp_pipe_stat pipe_total[PIPE_STAGE_NUM];        // 終了した接続の段ごとの合計
+
+
+// ================================================================================================
+// PIPE_OUTBOX : outboxのACKフレームを取り除く
+//     先頭の段なのでバッファは専有している(その場で詰めてよい)
+// ================================================================================================
+static void stage_outbox(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    v.len = spp_outbox_rx(pipe->fd, &v.buf->data[v.off], v.len);
+    if (v.len == 0) {
+        // outboxのACKフレームのみ(後段には渡さない)
+        ESP_LOGV(TAG, "outbox ack : fd = %d", pipe->fd);
+        spp_buf_unref(v.buf);
+        return;
+    }
+    spp_pipe_emit(pipe, v);
+}
+
+// ================================================================================================
+// PIPE_LOG : 受信データのログ表示
+// ================================================================================================
+static void stage_log(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    ESP_LOGI(TAG, "read : fd = %d data_len = %d", pipe->fd, v.len);
+    esp_log_buffer_hex(TAG, &v.buf->data[v.off], v.len);
+    spp_pipe_emit(pipe, v);
+}
+
+// ================================================================================================
+// PIPE_LINE : 行(LF区切り)に分ける
+//     バッファ内の行はそのバッファの view として渡し、バッファをまたぐ行だけを別のバッファにつなぐ
+//     SPP_BUF_SIZE を超える行は SPP_BUF_SIZE ごとに区切って渡す
+// ================================================================================================
+struct _line_state {
+    struct _spp_buf*    part;       // 前回の受信の残り(行の途中)
+};
+
+static void line_append(struct _spp_pipe* pipe, struct _line_state* st, const uint8_t* data, uint16_t len)
+{
+    while (len > 0) {
+        if (st->part == NULL) {
+            st->part = spp_buf_alloc(0);
+            if (st->part == NULL) {
+                pipe->stat[pipe->cur].dropped++;
+                return;
+            }
+        }
+        uint16_t n = SPP_BUF_SIZE - st->part->len;
+        n = (n < len) ? n : len;
+        memcpy(&st->part->data[st->part->len], data, n);
+        st->part->len   += n;
+        data            += n;
+        len             -= n;
+        if (st->part->len == SPP_BUF_SIZE) {
+            struct _spp_pipe_view lv = { st->part, 0, st->part->len };
+            st->part = NULL;
+            spp_pipe_emit(pipe, lv);
+        }
+    }
+}
+
+static void stage_line(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    struct _line_state* st = state;
+    uint16_t            start = v.off;
+    uint16_t            end = v.off + v.len;
+
+    for (uint16_t i = v.off; i < end; i++) {
+        if (v.buf->data[i] != '\n') {
+            continue;
+        }
+        if (st->part != NULL) {
+            // 前回の残りとつなぐ
+            line_append(pipe, st, &v.buf->data[start], i + 1 - start);
+            if (st->part != NULL) {
+                struct _spp_pipe_view lv = { st->part, 0, st->part->len };
+                st->part = NULL;
+                spp_pipe_emit(pipe, lv);
+            }
+        }
+        else if (i + 1 == end) {
+            // バッファの最後の行は参照をそのまま渡す
+            v.off   = start;
+            v.len   = end - start;
+            spp_pipe_emit(pipe, v);
+            return;
+        }
+        else {
+            struct _spp_pipe_view lv = { v.buf, start, i + 1 - start };
+            spp_buf_ref(v.buf);
+            spp_pipe_emit(pipe, lv);
+        }
+        start = i + 1;
+    }
+    if (start < end) {
+        line_append(pipe, st, &v.buf->data[start], end - start);
+    }
+    spp_buf_unref(v.buf);
+}
+
+static void stage_line_cleanup(void* state)
+{
+    struct _line_state* st = state;
+    spp_buf_unref(st->part);
+    st->part = NULL;
+}
+
+// ================================================================================================
+// PIPE_CKSUM : NMEA形式のチェックサムの確認
+//     "$" と "*" の間の排他的論理和が "*" の後の16進2桁と一致する行だけを渡す
+// ================================================================================================
+static void stage_cksum(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    const uint8_t*  p = &v.buf->data[v.off];
+    int             len = v.len;
+    int             star = -1;
+    uint8_t         sum = 0;
+
+    while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r')) {
+        len--;
+    }
+    if (len >= 4 && p[len - 3] == '*' && isxdigit(p[len - 2]) && isxdigit(p[len - 1])) {
+        star = len - 3;
+        for (int i = (p[0] == '$') ? 1 : 0; i < star; i++) {
+            sum ^= p[i];
+        }
+    }
+    if (star < 0 || sum != (uint8_t)strtol((const char[]){ p[len - 2], p[len - 1], '\0' }, NULL, 16)) {
+        spp_pipe_drop(pipe, v);
+        return;
+    }
+    spp_pipe_emit(pipe, v);
+}
+
+// ================================================================================================
+// PIPE_UPPER : 英小文字を大文字にする(その場で書き換える)
+// ================================================================================================
+static void stage_upper(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    uint8_t* p = &v.buf->data[v.off];
+    for (int i = 0; i < v.len; i++) {
+        p[i] = toupper(p[i]);
+    }
+    spp_pipe_emit(pipe, v);
+}
+
+// ================================================================================================
+// PIPE_ECHO : 送信元に返す(終端)
+// ================================================================================================
+static void stage_echo(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    int size_w = write(pipe->fd, &v.buf->data[v.off], v.len);
+    spp_link_traffic(pipe->fd, size_w);
+    spp_cap_record(CAP_TX, 0, pipe->fd, &v.buf->data[v.off], size_w);
+    if (size_w > 0) {
+        spp_metrics_add(MET_TX_BYTES, pipe->conn, size_w);
+    }
+    if (size_w < v.len) {
+        spp_metrics_add(MET_WRITE_SHORT, pipe->conn, 1);
+    }
+    ESP_LOGI(TAG, "write : fd = %d data_len = %d", pipe->fd, size_w);
+    if (size_w > 0) {
+        pipe->stat[pipe->cur].bytes_out += size_w;
+    }
+    spp_buf_unref(v.buf);
+}
+
+// ================================================================================================
+// PIPE_HUB : 配信ハブに渡す(終端)
+//     バッファを他の view と共有していなければコピーせずに渡す
+// ================================================================================================
+static void stage_hub(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v)
+{
+    pipe->stat[pipe->cur].bytes_out += v.len;
+    if (v.buf->refcnt == 1) {
+        v.buf->off = v.off;
+        v.buf->len = v.len;
+        spp_hub_publish_buf(v.buf);
+    }
+    else {
+        spp_hub_publish(&v.buf->data[v.off], v.len);
+        spp_buf_unref(v.buf);
+    }
+}
+
+// 段の一覧(PIPE_xxx の順)
+static const struct _spp_pipe_stage pipe_stages[PIPE_STAGE_NUM] = {
+    // name         process         cleanup
+    { "outbox",     stage_outbox,   NULL                },
+    { "log",        stage_log,      NULL                },
+    { "line",       stage_line,     stage_line_cleanup  },
+    { "cksum",      stage_cksum,    NULL                },
+    { "upper",      stage_upper,    NULL                },
+    { "echo",       stage_echo,     NULL                },
+    { "hub",        stage_hub,      NULL                },
+};
+
+// chain の一覧(PIPE_CHAIN_xxx の順)
+static const struct {
+    const char*     name;
+    uint8_t         stage[SPP_PIPE_STAGE_MAX];
+} pipe_chains[PIPE_CHAIN_NUM] = {
+    { "echo",   { PIPE_OUTBOX, PIPE_LOG, PIPE_ECHO, PIPE_END } },
+    { "upper",  { PIPE_OUTBOX, PIPE_LINE, PIPE_UPPER, PIPE_ECHO, PIPE_END } },
+    { "nmea",   { PIPE_LINE, PIPE_CKSUM, PIPE_HUB, PIPE_END } },
+};
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_pipe_init(void)
+{
+    return spp_buf_init();
+}
+
+// ================================================================================================
+// 接続先の chain(設定がなければ既定値)
+// ================================================================================================
+int spp_pipe_chain_for(esp_bd_addr_t bda, int chain)
+{
+    portENTER_CRITICAL(&pipe_mux);
+    for (int i = 0; i < SPP_PIPE_PEER_MAX; i++) {
+        if (pipe_peer[i].use && memcmp(pipe_peer[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) {
+            chain = pipe_peer[i].chain;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pipe_mux);
+    return chain;
+}
+
+// ================================================================================================
+// 接続先ごとの chain の設定(chain < 0 で設定を削除、次の接続から有効)
+// ================================================================================================
+esp_err_t spp_pipe_set_peer(esp_bd_addr_t bda, int chain)
+{
+    esp_err_t   err = ESP_ERR_NO_MEM;
+    int         free_idx = -1;
+
+    if (chain >= PIPE_CHAIN_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&pipe_mux);
+    for (int i = 0; i < SPP_PIPE_PEER_MAX; i++) {
+        if (pipe_peer[i].use && memcmp(pipe_peer[i].bda, bda, sizeof(esp_bd_addr_t)) == 0) {
+            free_idx = i;
+            break;
+        }
+        if (!pipe_peer[i].use && free_idx < 0) {
+            free_idx = i;
+        }
+    }
+    if (free_idx >= 0) {
+        pipe_peer[free_idx].use     = (chain >= 0);
+        pipe_peer[free_idx].chain   = chain;
+        memcpy(pipe_peer[free_idx].bda, bda, sizeof(esp_bd_addr_t));
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&pipe_mux);
+    return err;
+}
+
+// ================================================================================================
+// パイプラインの生成(データタスクの開始時)
+// param    conn    : パラメータテーブルの添字(-1:接続なし)
+// ================================================================================================
+struct _spp_pipe* spp_pipe_create(int fd, int conn, int chain)
+{
+    struct _spp_pipe* pipe;
+
+    if (chain < 0 || chain >= PIPE_CHAIN_NUM) {
+        chain = PIPE_CHAIN_ECHO;
+    }
+    pipe = malloc(sizeof(struct _spp_pipe));
+    if (pipe == NULL) {
+        return NULL;
+    }
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->fd    = fd;
+    pipe->conn  = conn;
+    pipe->chain = chain;
+    while (pipe->num < SPP_PIPE_STAGE_MAX && pipe_chains[chain].stage[pipe->num] != PIPE_END) {
+        pipe->stage[pipe->num] = pipe_chains[chain].stage[pipe->num];
+        pipe->num++;
+    }
+    portENTER_CRITICAL(&pipe_mux);
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (pipe_live[i] == NULL) {
+            pipe_live[i] = pipe;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pipe_mux);
+    return pipe;
+}
+
+// ================================================================================================
+// 段の実行(後段の処理時間を除いて集計する)
+// ================================================================================================
+static void pipe_run(struct _spp_pipe* pipe, int i, struct _spp_pipe_view v)
+{
+    int         prev = pipe->cur;
+    int64_t     start = esp_timer_get_time();
+    uint32_t    us;
+
+    pipe->cur           = i;
+    pipe->child_us[i]   = 0;
+    pipe->stat[i].calls++;
+    pipe->stat[i].bytes_in += v.len;
+    pipe_stages[pipe->stage[i]].process(pipe, pipe->state[i], v);
+
+    us = esp_timer_get_time() - start;
+    pipe->stat[i].us += us - pipe->child_us[i];
+    pipe->cur = prev;
+    if (i > 0) {
+        pipe->child_us[i - 1] += us;
+    }
+}
+
+// ================================================================================================
+// 受信したバッファを先頭の段に渡す(buf の参照を引き取る)
+// ================================================================================================
+void spp_pipe_push(struct _spp_pipe* pipe, struct _spp_buf* buf)
+{
+    struct _spp_pipe_view v = { buf, buf->off, buf->len };
+
+    if (pipe->num == 0) {
+        spp_buf_unref(buf);
+        return;
+    }
+    pipe_run(pipe, 0, v);
+}
+
+// ================================================================================================
+// 次の段に渡す(段の処理から呼ぶ、v の参照を引き渡す)
+// ================================================================================================
+void spp_pipe_emit(struct _spp_pipe* pipe, struct _spp_pipe_view v)
+{
+    int next = pipe->cur + 1;
+
+    pipe->stat[pipe->cur].bytes_out += v.len;
+    if (next >= pipe->num) {
+        // 終端の段がない chain
+        spp_buf_unref(v.buf);
+        return;
+    }
+    pipe_run(pipe, next, v);
+}
+
+// ================================================================================================
+// 捨てる(段の処理から呼ぶ)
+// ================================================================================================
+void spp_pipe_drop(struct _spp_pipe* pipe, struct _spp_pipe_view v)
+{
+    pipe->stat[pipe->cur].dropped++;
+    spp_buf_unref(v.buf);
+}
+
+// ================================================================================================
+// パイプラインの削除(データタスクの終了時、段が持っているバッファも返却する)
+// ================================================================================================
+void spp_pipe_destroy(struct _spp_pipe* pipe)
+{
+    if (pipe == NULL) {
+        return;
+    }
+    for (int i = 0; i < pipe->num; i++) {
+        if (pipe_stages[pipe->stage[i]].cleanup != NULL) {
+            pipe_stages[pipe->stage[i]].cleanup(pipe->state[i]);
+        }
+    }
+    portENTER_CRITICAL(&pipe_mux);
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (pipe_live[i] == pipe) {
+            pipe_live[i] = NULL;
+        }
+    }
+    for (int i = 0; i < pipe->num; i++) {
+        struct _spp_pipe_stat* t = &pipe_total[pipe->stage[i]];
+        t->calls        += pipe->stat[i].calls;
+        t->bytes_in     += pipe->stat[i].bytes_in;
+        t->bytes_out    += pipe->stat[i].bytes_out;
+        t->dropped      += pipe->stat[i].dropped;
+        t->us           += pipe->stat[i].us;
+    }
+    portEXIT_CRITICAL(&pipe_mux);
+    free(pipe);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+static void pipe_show_stat(const char* name, const struct _spp_pipe_stat* st)
+{
+    printf("      %-8s %8u %10u %10u %7u %8u\n", name, st->calls, st->bytes_in, st->bytes_out, st->dropped,
+            (st->calls > 0) ? (uint32_t)(st->us / st->calls) : 0);
+}
+
+void spp_pipe_show(void)
+{
+    struct _spp_pipe_stat   total[PIPE_STAGE_NUM];
+    struct _spp_pipe        live;
+
+    printf("    chains :");
+    for (int c = 0; c < PIPE_CHAIN_NUM; c++) {
+        printf("  %d:%s", c, pipe_chains[c].name);
+    }
+    printf("\n");
+    for (int i = 0; i < SPP_PIPE_PEER_MAX; i++) {
+        if (pipe_peer[i].use) {
+            printf("    peer %s : %s\n", bdaddr_to_str(pipe_peer[i].bda, NULL), pipe_chains[pipe_peer[i].chain].name);
+        }
+    }
+    printf("      stage       calls   in(byte)  out(byte) dropped  us/call\n");
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        bool found = false;
+        portENTER_CRITICAL(&pipe_mux);
+        if (pipe_live[i] != NULL) {
+            live    = *pipe_live[i];
+            found   = true;
+        }
+        portEXIT_CRITICAL(&pipe_mux);
+        if (found) {
+            printf("    fd %d (%s)\n", live.fd, pipe_chains[live.chain].name);
+            for (int s = 0; s < live.num; s++) {
+                pipe_show_stat(pipe_stages[live.stage[s]].name, &live.stat[s]);
+            }
+        }
+    }
+    portENTER_CRITICAL(&pipe_mux);
+    memcpy(total, pipe_total, sizeof(total));
+    portEXIT_CRITICAL(&pipe_mux);
+    printf("    closed connections\n");
+    for (int s = 0; s < PIPE_STAGE_NUM; s++) {
+        pipe_show_stat(pipe_stages[s].name, &total[s]);
+    }
+}
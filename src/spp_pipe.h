@@ -0,0 +1,85 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 受信データの処理パイプライン
+//     接続ごとに段(stage)の列(chain)を持ち、受信したバッファを先頭の段から順に渡す
+//     段の間はバッファの範囲(view)と参照の所有権を渡すだけで、データはコピーしない
+//         段は受け取った view を spp_pipe_emit() で次の段に渡すか、spp_buf_unref() で捨てる
+//         1つのバッファを複数の view に分けるときは spp_buf_ref() で参照を増やす
+//         view の範囲内のデータはその場で書き換えてよい(view どうしは重ならない)
+//     段ごとに呼び出し回数、入出力バイト数、処理時間(後段を除く)を集計する
+//     chain はサーバごとの既定値(spp_servers[].pipe_chain)を、接続先ごとの設定(spp_pipe_set_peer)で上書きできる
+
+#define SPP_PIPE_STAGE_MAX      6           // 1つの chain の段数
+#define SPP_PIPE_STATE_SIZE     16          // 段ごとの状態の大きさ
+#define SPP_PIPE_PEER_MAX       4           // 接続先ごとの設定数
+
+// 段
+#define PIPE_OUTBOX             0           // outboxのACKフレームを取り除く
+#define PIPE_LOG                1           // 受信データのログ表示
+#define PIPE_LINE               2           // 行(LF区切り)に分ける
+#define PIPE_CKSUM              3           // NMEA形式のチェックサム(*hh)を確認し、一致しない行を捨てる
+#define PIPE_UPPER              4           // 英小文字を大文字にする
+#define PIPE_ECHO               5           // 送信元に返す(終端)
+#define PIPE_HUB                6           // 配信ハブに渡す(終端)
+#define PIPE_STAGE_NUM          7
+#define PIPE_END                0xff
+
+// chain
+#define PIPE_CHAIN_ECHO         0           // エコーバック(従来の動作)
+#define PIPE_CHAIN_UPPER        1           // 行ごとに大文字にしてエコーバック
+#define PIPE_CHAIN_NMEA         2           // チェックサムの正しい行を配信ハブへ
+#define PIPE_CHAIN_NUM          3
+
+struct _spp_pipe_view {
+    struct _spp_buf*    buf;
+    uint16_t            off;
+    uint16_t            len;
+};
+
+// 段ごとの統計
+struct _spp_pipe_stat {
+    uint32_t        calls;
+    uint32_t        bytes_in;
+    uint32_t        bytes_out;      // 次の段に渡した/送信したバイト数
+    uint32_t        dropped;        // 捨てた view の数
+    uint64_t        us;             // 処理時間(後段を除く)
+};
+
+struct _spp_pipe;
+
+// 段の定義
+struct _spp_pipe_stage {
+    const char*     name;
+    void            (*process)(struct _spp_pipe* pipe, void* state, struct _spp_pipe_view v);
+    void            (*cleanup)(void* state);        // 接続終了時(NULL可)
+};
+
+// パイプライン(接続ごと)
+struct _spp_pipe {
+    int                     fd;
+    int                     conn;                           // パラメータテーブルの添字(メトリクスのラベル)
+    int                     chain;
+    int                     num;                            // 段数
+    int                     cur;                            // 実行中の段
+    uint8_t                 stage[SPP_PIPE_STAGE_MAX];
+    uint32_t                child_us[SPP_PIPE_STAGE_MAX];   // 後段で使った時間
+    struct _spp_pipe_stat   stat[SPP_PIPE_STAGE_MAX];
+    uint8_t                 state[SPP_PIPE_STAGE_MAX][SPP_PIPE_STATE_SIZE] __attribute__((aligned(4)));
+};
+
+// extern宣言
+extern esp_err_t spp_pipe_init(void);
+extern int spp_pipe_chain_for(esp_bd_addr_t bda, int chain);
+extern esp_err_t spp_pipe_set_peer(esp_bd_addr_t bda, int chain);
+extern struct _spp_pipe* spp_pipe_create(int fd, int conn, int chain);
+extern void spp_pipe_push(struct _spp_pipe* pipe, struct _spp_buf* buf);
+extern void spp_pipe_emit(struct _spp_pipe* pipe, struct _spp_pipe_view v);
+extern void spp_pipe_drop(struct _spp_pipe* pipe, struct _spp_pipe_view v);
+extern void spp_pipe_destroy(struct _spp_pipe* pipe);
+extern void spp_pipe_show(void);
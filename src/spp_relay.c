@@ -0,0 +1,367 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_relay.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// 中継の端点(接続ごと)
+struct _relay_ep {
+    bool                use;
+    volatile bool       closing;        // クローズイベント受信済み
+    int                 fd;
+    bool                inbound;        // true: 接続を受けた側  false: 接続した側
+    struct _relay_ep*   partner;        // ペアの相手
+    bool                unpaired;       // 相手側がペアを解除した(渡せなかった受信データは捨てる)
+    QueueHandle_t       txq;            // この接続に送信するバッファ
+    TaskHandle_t        task;
+    uint32_t            rx_bytes;
+    uint32_t            tx_bytes;
+    uint32_t            stalls;         // 相手側が詰まっていて受信を止めた回数(止めるたびに1回)
+    bool                stalled;        // 受信を止めている
+    uint32_t            dropped;        // 相手側が切断して渡せずに捨てた受信データ
+    struct _spp_buf*    tx_cur;         // 送信途中のバッファ(off/len は未送信の部分)
+    struct _spp_buf*    rbuf;           // 受信用のバッファ(len > 0 なら相手側に渡していないデータ)
+};
+
+bool                        spp_relay_enable = false;
+static struct _relay_ep     relay_ep[OPEN_HDR_NUM];         // パラメータテーブルと同じ添字
+static SemaphoreHandle_t    relay_mutex = NULL;
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_relay_init(void)
+{
+    esp_err_t   err = spp_buf_init();
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    relay_mutex = xSemaphoreCreateMutex();
+    if (relay_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        relay_ep[i].txq = xQueueCreate(SPP_RELAY_TXQ_DEPTH, sizeof(struct _spp_buf*));
+        if (relay_ep[i].txq == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// ペアになっていない逆方向の端点を探してペアにする(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void relay_try_pair(struct _relay_ep* ep)
+{
+    if (ep->partner != NULL) {
+        return;
+    }
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        struct _relay_ep* other = &relay_ep[i];
+        if (other->use && !other->closing && other->partner == NULL && other->inbound != ep->inbound) {
+            ep->partner     = other;
+            other->partner  = ep;
+            xTaskNotifyGive(other->task);
+            ESP_LOGI(TAG, "relay paired : fd %d <-> fd %d", ep->fd, other->fd);
+            return;
+        }
+    }
+}
+
+// ================================================================================================
+// 送信途中のバッファの送信(リンク品質に応じて分割して送信し、送りきったら返却する)
+//     輻輳で書けなければ残りを ep->tx_cur に持ったまま戻る
+//     その間は送信キューから取り出さないので、キューが一杯になって相手側の受信が止まる
+// return   true: 送りきった(クローズ済みなら残りは捨てる)  false: 輻輳中
+// ================================================================================================
+static bool relay_send(struct _relay_ep* ep, int fd)
+{
+    struct _spp_buf*    tbuf = ep->tx_cur;
+
+    while (tbuf->len > 0) {
+        int n = spp_link_chunk_size(fd, tbuf->len);
+        int w = write(fd, &tbuf->data[tbuf->off], n);
+        if (w < 0) {
+            break;
+        }
+        if (w == 0) {
+            return false;
+        }
+        tbuf->off       += w;
+        tbuf->len       -= w;
+        ep->tx_bytes    += w;
+        spp_link_traffic(fd, w);
+        spp_link_pace(fd);
+    }
+    ep->tx_cur = NULL;
+    spp_buf_unref(tbuf);
+    return true;
+}
+
+// ================================================================================================
+// 送信キューの送信(送信途中のバッファから順に)
+// return   true: 1つ以上送りきった
+// ================================================================================================
+static bool relay_send_queue(struct _relay_ep* ep, int fd)
+{
+    bool    sent = false;
+
+    while (ep->tx_cur != NULL || xQueueReceive(ep->txq, &ep->tx_cur, 0) == pdTRUE) {
+        if (!relay_send(ep, fd)) {
+            break;
+        }
+        sent = true;
+        // 送信キューが空いたことを相手側に通知
+        xSemaphoreTake(relay_mutex, portMAX_DELAY);
+        if (ep->partner != NULL) {
+            xTaskNotifyGive(ep->partner->task);
+        }
+        xSemaphoreGive(relay_mutex);
+    }
+    return sent;
+}
+
+// ================================================================================================
+// ペアの解除(ロック取得済みで呼ぶこと、以降は相手側から送信キューに入らない、新たにペアにもならない)
+// ================================================================================================
+static void relay_unpair(struct _relay_ep* ep)
+{
+    ep->closing = true;
+    if (ep->partner != NULL) {
+        ep->partner->partner    = NULL;
+        ep->partner->unpaired   = true;
+        xTaskNotifyGive(ep->partner->task);
+        ep->partner = NULL;
+    }
+}
+
+// ================================================================================================
+// 受信したデータを相手側の送信キューに渡す(ロック取得済みで呼ぶこと)
+//     相手側の送信キューが一杯なら ep->rbuf に持ったまま、空いてから次の受信より先に渡す
+//     受信した後に相手側がペアを解除したら、新しい相手に混ざらないように捨てる
+// return   true: 渡した
+// ================================================================================================
+static bool relay_pass(struct _relay_ep* ep)
+{
+    if (ep->unpaired) {
+        if (ep->rbuf != NULL && ep->rbuf->len > 0) {
+            ep->dropped     += ep->rbuf->len;
+            ep->rbuf->len   = 0;
+        }
+        ep->unpaired = false;
+    }
+    if (ep->rbuf == NULL || ep->rbuf->len == 0 || ep->partner == NULL
+     || xQueueSend(ep->partner->txq, &ep->rbuf, 0) != pdTRUE) {
+        return false;
+    }
+    // バッファの所有権を相手側に渡す
+    xTaskNotifyGive(ep->partner->task);
+    ep->rbuf = NULL;
+    return true;
+}
+
+// ================================================================================================
+// 強制終了したときの資源の返却(監視タスクから呼ばれる)
+// ================================================================================================
+static void relay_cleanup(void* arg)
+{
+    struct _relay_ep*   ep = arg;
+    struct _spp_buf*    buf;
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    relay_unpair(ep);
+    xSemaphoreGive(relay_mutex);
+    while (xQueueReceive(ep->txq, &buf, 0) == pdTRUE) {
+        spp_buf_unref(buf);
+    }
+    spp_buf_unref(ep->tx_cur);
+    spp_buf_unref(ep->rbuf);
+    ep->tx_cur  = NULL;
+    ep->rbuf    = NULL;
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    ep->use = false;
+    xSemaphoreGive(relay_mutex);
+}
+
+// ================================================================================================
+// 中継処理(接続ごとのデータタスク本体)
+// ================================================================================================
+static void relay_run(int conn, bool inbound)
+{
+    struct _relay_ep*   ep = &relay_ep[conn];
+    int                 fd = spp_conn_fd(conn);
+
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    ep->use         = true;
+    ep->closing     = false;
+    ep->fd          = fd;
+    ep->inbound     = inbound;
+    ep->partner     = NULL;
+    ep->unpaired    = false;
+    ep->task        = xTaskGetCurrentTaskHandle();
+    ep->rx_bytes    = 0;
+    ep->tx_bytes    = 0;
+    ep->stalls      = 0;
+    ep->stalled     = false;
+    ep->dropped     = 0;
+    ep->tx_cur      = NULL;
+    ep->rbuf        = NULL;
+    xSemaphoreGive(relay_mutex);
+    spp_conn_set_cleanup(conn, relay_cleanup, ep);
+
+    while (!ep->closing) {
+        bool    progressed = false;
+        bool    space;
+
+        // 渡していない受信データを先に渡し、相手側の送信キューに空きがあるときだけ受信する
+        xSemaphoreTake(relay_mutex, portMAX_DELAY);
+        relay_try_pair(ep);
+        progressed = relay_pass(ep);
+        space = (ep->partner != NULL && uxQueueSpacesAvailable(ep->partner->txq) > 0);
+        if (ep->partner != NULL && !space && !ep->stalled) {
+            ep->stalls++;
+        }
+        ep->stalled = (ep->partner != NULL && !space);
+        xSemaphoreGive(relay_mutex);
+
+        if (space) {
+            if (ep->rbuf == NULL) {
+                ep->rbuf = spp_buf_alloc(0);
+            }
+            if (ep->rbuf != NULL) {
+                int size_r = read(fd, ep->rbuf->data, SPP_BUF_SIZE);
+                if (size_r < 0) {
+                    break;
+                }
+                if (size_r > 0) {
+                    spp_link_traffic(fd, size_r);
+                    ep->rbuf->len   = size_r;
+                    ep->rx_bytes    += size_r;
+                    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+                    relay_pass(ep);
+                    xSemaphoreGive(relay_mutex);
+                    progressed      = true;
+                }
+            }
+        }
+
+        // 相手側から渡されたバッファを送信して返却(輻輳中は次の周回で続きから送る)
+        if (relay_send_queue(ep, fd)) {
+            progressed = true;
+        }
+
+        if (!progressed) {
+            ulTaskNotifyTake(pdTRUE, 10 / portTICK_PERIOD_MS);
+        }
+    }
+
+    // ペアを解除して資源を返却
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    relay_unpair(ep);
+    xSemaphoreGive(relay_mutex);
+    // こちらから切断するときは受け取り済みのデータを期限まで送る
+    while (ep->tx_cur != NULL || uxQueueMessagesWaiting(ep->txq) > 0) {
+        if (!spp_conn_draining(conn)) {
+            if (ep->tx_cur == NULL) {
+                xQueueReceive(ep->txq, &ep->tx_cur, 0);
+            }
+            spp_buf_unref(ep->tx_cur);
+            ep->tx_cur = NULL;
+        }
+        else if (!relay_send_queue(ep, fd)) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    if (ep->rbuf != NULL) {
+        ep->dropped += ep->rbuf->len;
+        spp_buf_unref(ep->rbuf);
+        ep->rbuf = NULL;
+    }
+    ESP_LOGI(TAG, "relay end : fd = %d  rx = %d  tx = %d  stalls = %d  dropped = %d", fd, ep->rx_bytes, ep->tx_bytes,
+            ep->stalls, ep->dropped);
+    // 送信キューが空になってから端点を空きにする
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    ep->use = false;
+    xSemaphoreGive(relay_mutex);
+}
+
+// ================================================================================================
+// 中継データタスク(接続を受けた側 / 接続した側)
+// ================================================================================================
+void spp_relay_in_task(void* param)
+{
+    relay_run((int)(intptr_t)param, true);
+    spp_conn_exit((int)(intptr_t)param);
+}
+
+void spp_relay_out_task(void* param)
+{
+    relay_run((int)(intptr_t)param, false);
+    spp_conn_exit((int)(intptr_t)param);
+}
+
+// ================================================================================================
+// クローズ通知(spp_close_handler から呼ぶ)
+// ================================================================================================
+void spp_relay_close(int conn)
+{
+    if (relay_mutex == NULL || conn < 0 || conn >= OPEN_HDR_NUM) {
+        return;
+    }
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    if (relay_ep[conn].use) {
+        relay_ep[conn].closing = true;
+        xTaskNotifyGive(relay_ep[conn].task);
+    }
+    xSemaphoreGive(relay_mutex);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_relay_show(void)
+{
+    printf("    relay mode : %s  free buffers : %d / %d\n", spp_relay_enable ? "on" : "off", spp_buf_free_num(), SPP_BUF_NUM);
+    if (relay_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(relay_mutex, portMAX_DELAY);
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        struct _relay_ep* ep = &relay_ep[i];
+        if (ep->use) {
+            printf("    fd %2d %-3s -> fd %2d  rx : %u  tx : %u  stalls : %u  dropped : %u\n", ep->fd,
+                    ep->inbound ? "in" : "out", (ep->partner != NULL) ? ep->partner->fd : -1, ep->rx_bytes, ep->tx_bytes,
+                    ep->stalls, ep->dropped);
+        }
+    }
+    xSemaphoreGive(relay_mutex);
+}
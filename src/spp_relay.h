@@ -0,0 +1,22 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 中継モード
+//     有効時は接続を受けた側(inbound)と接続した側(outbound)を1組ずつペアにして双方向に転送する
+//     受信したバッファはコピーせずに相手側の送信キューに渡す
+//     相手側の送信キューが一杯の間は受信しない(相手側の詰まりを送信元に伝える)
+
+#define SPP_RELAY_TXQ_DEPTH     4           // 1接続あたりの送信待ちバッファ数
+
+// extern宣言
+extern bool spp_relay_enable;
+extern esp_err_t spp_relay_init(void);
+extern void spp_relay_in_task(void* param);
+extern void spp_relay_out_task(void* param);
+extern void spp_relay_close(int conn);
+extern void spp_relay_show(void);
@@ -0,0 +1,579 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "sys/unistd.h"
+
+#include "spp_user_hdr.h"
+#include "spp_rpc.h"
+#include "spp_link.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+#define RPC_HDR_SIZE        (sizeof(struct _spp_rpc_hdr))
+
+// 要求スロットの状態
+#define SLOT_FREE           0
+#define SLOT_QUEUED         1           // ワーカ待ち
+#define SLOT_RUNNING        2           // ハンドラ実行中
+#define SLOT_ABANDONED      3           // タイムアウト/キャンセル済み(ワーカが処理を終えたら解放)
+#define SLOT_SENDING        4           // ワーカが応答を送信中
+
+struct _rpc_conn;
+
+// 要求スロット
+struct _rpc_slot {
+    struct _spp_rpc_req req;
+    struct _rpc_conn*   conn;
+    uint8_t             state;
+    bool                has_deadline;
+    TickType_t          deadline;
+    uint8_t             data[SPP_RPC_MAX_PAYLOAD];
+};
+
+// 送信する応答(ロック中に決めて、ロックを外してから送信する)
+struct _rpc_rsp {
+    uint16_t            id;
+    uint16_t            method;
+    uint8_t             status;
+};
+
+// 接続ごとの状態
+struct _rpc_conn {
+    int                 fd;
+    int                 idx;                        // パラメータテーブルの添字
+    volatile bool       orphan;                     // データタスクが強制終了された(最後のワーカが解放する)
+    SemaphoreHandle_t   mutex;                      // スロットの状態とワーカ数の排他
+    SemaphoreHandle_t   tx_mutex;                   // 送信の排他(フレームが混ざらないように)
+    QueueHandle_t       job_q;                      // ワーカに渡す要求スロット(NULL:ワーカ終了)
+    int                 workers;                    // 生成したワーカ数
+    int                 idle;                       // 要求待ちのワーカ数
+    struct _rpc_slot    slot[SPP_RPC_WINDOW];
+    uint32_t            rx_len;
+    uint8_t             rx[RPC_HDR_SIZE + SPP_RPC_MAX_PAYLOAD];
+    uint32_t            requests;
+    uint32_t            timeouts;
+    uint32_t            cancels;
+    uint32_t            busy;
+};
+
+// メソッド登録テーブル
+struct _rpc_method {
+    uint16_t            method;
+    spp_rpc_handler_t   handler;
+};
+
+static struct _rpc_method   rpc_methods[SPP_RPC_METHOD_MAX];
+static int                  rpc_method_num = 0;
+static bool                 rpc_ready = false;
+
+
+// ================================================================================================
+// 応答送信(conn->mutex を取得せずに呼ぶこと)
+//     ヘッダとペイロードをまとめて送り、輻輳で途中までしか書けなければ残りを書ききる
+// ================================================================================================
+static void rpc_send_rsp(struct _rpc_conn* conn, uint16_t id, uint16_t method, uint8_t status, const uint8_t* data, uint16_t len)
+{
+    uint8_t             buff[RPC_HDR_SIZE + SPP_RPC_MAX_PAYLOAD];
+    struct _spp_rpc_hdr hdr = { .type = RPC_RSP, .status = status, .len = len, .id = id, .method = method, .timeout_ms = 0 };
+    uint32_t            sent = 0;
+
+    memcpy(buff, &hdr, RPC_HDR_SIZE);
+    if (len > 0) {
+        memcpy(&buff[RPC_HDR_SIZE], data, len);
+    }
+    // データタスクが送信中に強制終了されたときは送信の排他が戻らないので、待つ間も確認する
+    while (xSemaphoreTake(conn->tx_mutex, 100 / portTICK_PERIOD_MS) != pdTRUE) {
+        if (conn->orphan) {
+            return;
+        }
+    }
+    while (!conn->orphan && sent < RPC_HDR_SIZE + len) {
+        int size_w = write(conn->fd, &buff[sent], RPC_HDR_SIZE + len - sent);
+        if (size_w < 0) {
+            break;
+        }
+        if (size_w == 0) {
+            if (spp_conn_stopping(conn->idx) && !spp_conn_draining(conn->idx)) {
+                break;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        spp_link_traffic(conn->fd, size_w);
+        sent += size_w;
+    }
+    xSemaphoreGive(conn->tx_mutex);
+}
+
+// ロック中に決めた応答をまとめて送信
+static void rpc_send_list(struct _rpc_conn* conn, const struct _rpc_rsp* list, int num)
+{
+    for (int i = 0; i < num; i++) {
+        rpc_send_rsp(conn, list[i].id, list[i].method, list[i].status, NULL, 0);
+    }
+}
+
+// ================================================================================================
+// メソッド検索
+// ================================================================================================
+static spp_rpc_handler_t rpc_find_handler(uint16_t method)
+{
+    for (int i = 0; i < rpc_method_num; i++) {
+        if (rpc_methods[i].method == method) {
+            return rpc_methods[i].handler;
+        }
+    }
+    return NULL;
+}
+
+// ================================================================================================
+// 接続ごとの状態の解放
+// ================================================================================================
+static void rpc_conn_free(struct _rpc_conn* conn)
+{
+    vQueueDelete(conn->job_q);
+    vSemaphoreDelete(conn->tx_mutex);
+    vSemaphoreDelete(conn->mutex);
+    free(conn);
+}
+
+// ================================================================================================
+// ワーカタスク(接続ごと、最大 SPP_RPC_WINDOW 個)
+//     複数のワーカで並行して処理するので、応答は処理が終わった順になる
+//     ハンドラが待っていても他の接続の要求や同じ接続の後続の要求は止まらない
+//     データタスクが強制終了されたときは処理中の要求を終えてから終了し、最後のワーカが状態を解放する
+// ================================================================================================
+static void rpc_worker_task(void* param)
+{
+    struct _rpc_conn*   conn = param;
+    struct _rpc_slot*   slot;
+    uint8_t             rsp[SPP_RPC_MAX_PAYLOAD];
+    bool                last;
+
+    while (!conn->orphan) {
+        xQueueReceive(conn->job_q, &slot, portMAX_DELAY);
+        if (slot == NULL) {
+            // 接続終了
+            break;
+        }
+
+        xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        conn->idle--;
+        if (slot->state == SLOT_ABANDONED) {
+            // 実行前にタイムアウト/キャンセルされた
+            slot->state = SLOT_FREE;
+            conn->idle++;
+            xSemaphoreGive(conn->mutex);
+            continue;
+        }
+        slot->state = SLOT_RUNNING;
+        xSemaphoreGive(conn->mutex);
+
+        spp_rpc_handler_t   handler = rpc_find_handler(slot->req.method);
+        uint16_t            rsp_len = 0;
+        uint8_t             status  = (handler != NULL) ? handler(&slot->req, rsp, &rsp_len) : RPC_ST_NO_METHOD;
+        if (rsp_len > SPP_RPC_MAX_PAYLOAD) {
+            rsp_len = 0;
+            status  = RPC_ST_ERROR;
+        }
+
+        // 応答するかどうかはロック中に決め、送信はロックを外してから行う
+        xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        if (slot->state == SLOT_RUNNING) {
+            slot->state = SLOT_SENDING;
+            xSemaphoreGive(conn->mutex);
+            rpc_send_rsp(conn, slot->req.id, slot->req.method, status, rsp, rsp_len);
+            xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        }
+        slot->state = SLOT_FREE;
+        conn->idle++;
+        xSemaphoreGive(conn->mutex);
+    }
+
+    xSemaphoreTake(conn->mutex, portMAX_DELAY);
+    conn->workers--;
+    conn->idle--;
+    last = (conn->orphan && conn->workers == 0);
+    xSemaphoreGive(conn->mutex);
+    if (last) {
+        rpc_conn_free(conn);
+    }
+    vTaskDelete(NULL);
+}
+
+// ================================================================================================
+// 強制終了されたときの後始末(監視タスクから呼ばれる)
+//     要求を打ち切り、待っているワーカを終了させる(ワーカがいなければここで解放する)
+// ================================================================================================
+static void rpc_cleanup(void* arg)
+{
+    struct _rpc_conn*   conn = arg;
+    struct _rpc_slot*   stop = NULL;
+    bool                last;
+
+    xSemaphoreTake(conn->mutex, portMAX_DELAY);
+    conn->orphan = true;
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        if (conn->slot[i].state == SLOT_QUEUED || conn->slot[i].state == SLOT_RUNNING) {
+            conn->slot[i].state         = SLOT_ABANDONED;
+            conn->slot[i].req.cancelled = true;
+        }
+    }
+    for (int i = 0; i < conn->idle; i++) {
+        xQueueSend(conn->job_q, &stop, 0);
+    }
+    last = (conn->workers == 0);
+    xSemaphoreGive(conn->mutex);
+    if (last) {
+        rpc_conn_free(conn);
+    }
+}
+
+// ================================================================================================
+// 待っている要求の数だけワーカがいなければ追加する(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void rpc_add_worker(struct _rpc_conn* conn)
+{
+    int queued = 0;
+
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        if (conn->slot[i].state == SLOT_QUEUED) {
+            queued++;
+        }
+    }
+    if (queued <= conn->idle || conn->workers >= SPP_RPC_WINDOW) {
+        return;
+    }
+    if (xTaskCreate(rpc_worker_task, "rpc_worker", SPP_RPC_WORKER_STACK, conn, 5, NULL) != pdPASS) {
+        // 既存のワーカで順に処理する
+        ESP_LOGW(TAG, "RPC worker create error (workers = %d)", conn->workers);
+        return;
+    }
+    conn->workers++;
+    conn->idle++;
+}
+
+// ================================================================================================
+// 要求を打ち切る(ロック取得済みで呼ぶこと、応答はロックを外してから送信する)
+// ================================================================================================
+static void rpc_abandon(struct _rpc_slot* slot, uint8_t status, struct _rpc_rsp* rsp)
+{
+    slot->state         = SLOT_ABANDONED;
+    slot->req.cancelled = true;
+    rsp->id             = slot->req.id;
+    rsp->method         = slot->req.method;
+    rsp->status         = status;
+}
+
+// ================================================================================================
+// 受信フレームの処理
+// ================================================================================================
+static void rpc_handle_frame(struct _rpc_conn* conn, const struct _spp_rpc_hdr* hdr, const uint8_t* payload)
+{
+    struct _rpc_slot*   free_slot = NULL;
+    struct _rpc_slot*   same_id = NULL;
+    struct _rpc_rsp     rsp = { .id = hdr->id, .method = hdr->method };
+    int                 rsp_num = 0;
+
+    xSemaphoreTake(conn->mutex, portMAX_DELAY);
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        struct _rpc_slot* slot = &conn->slot[i];
+        if (slot->state == SLOT_FREE) {
+            if (free_slot == NULL) {
+                free_slot = slot;
+            }
+        }
+        else if (slot->state != SLOT_ABANDONED && slot->req.id == hdr->id) {
+            same_id = slot;
+        }
+    }
+
+    switch (hdr->type) {
+      case RPC_REQ :
+        conn->requests++;
+        if (same_id != NULL) {
+            // 処理中の id と重複
+            rsp.status  = RPC_ST_BAD_REQ;
+            rsp_num     = 1;
+        }
+        else if (free_slot == NULL) {
+            conn->busy++;
+            rsp.status  = RPC_ST_BUSY;
+            rsp_num     = 1;
+        }
+        else {
+            memcpy(free_slot->data, payload, hdr->len);
+            free_slot->req.id           = hdr->id;
+            free_slot->req.method       = hdr->method;
+            free_slot->req.data         = free_slot->data;
+            free_slot->req.len          = hdr->len;
+            free_slot->req.cancelled    = false;
+            free_slot->conn             = conn;
+            free_slot->has_deadline     = (hdr->timeout_ms != 0);
+            free_slot->deadline         = xTaskGetTickCount() + (hdr->timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+            free_slot->state            = SLOT_QUEUED;
+            xQueueSend(conn->job_q, &free_slot, 0);     // スロット数と同じ長さなので一杯にはならない
+            rpc_add_worker(conn);
+        }
+        break;
+      case RPC_CANCEL :
+        if (same_id != NULL && same_id->state != SLOT_SENDING) {
+            conn->cancels++;
+            rpc_abandon(same_id, RPC_ST_CANCELLED, &rsp);
+            rsp_num = 1;
+        }
+        break;
+      default :
+        break;
+    }
+    xSemaphoreGive(conn->mutex);
+    rpc_send_list(conn, &rsp, rsp_num);
+}
+
+// ================================================================================================
+// タイムアウトの確認
+// ================================================================================================
+static void rpc_check_timeout(struct _rpc_conn* conn)
+{
+    TickType_t      now = xTaskGetTickCount();
+    struct _rpc_rsp rsp[SPP_RPC_WINDOW];
+    int             rsp_num = 0;
+
+    xSemaphoreTake(conn->mutex, portMAX_DELAY);
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        struct _rpc_slot* slot = &conn->slot[i];
+        if ((slot->state == SLOT_QUEUED || slot->state == SLOT_RUNNING)
+          && slot->has_deadline && (int32_t)(now - slot->deadline) >= 0) {
+            conn->timeouts++;
+            rpc_abandon(slot, RPC_ST_TIMEOUT, &rsp[rsp_num++]);
+        }
+    }
+    xSemaphoreGive(conn->mutex);
+    rpc_send_list(conn, rsp, rsp_num);
+}
+
+// ================================================================================================
+// RPCデータタスク(SPP_RPC_SERVER_NAME の接続ごとに生成)
+// ================================================================================================
+void spp_rpc_task(void* param)
+{
+    struct _rpc_conn*   conn = malloc(sizeof(struct _rpc_conn));
+    bool                busy;
+
+    if (conn == NULL || !rpc_ready) {
+        ESP_LOGE(TAG, "RPC not available");
+        free(conn);
+        spp_conn_exit((int)(intptr_t)param);
+        return;
+    }
+    memset(conn, 0, sizeof(*conn));
+    conn->idx       = (int)(intptr_t)param;
+    conn->fd        = spp_conn_fd(conn->idx);
+    conn->mutex     = xSemaphoreCreateMutex();
+    conn->tx_mutex  = xSemaphoreCreateMutex();
+    conn->job_q     = xQueueCreate(SPP_RPC_WINDOW, sizeof(struct _rpc_slot*));
+    if (conn->mutex == NULL || conn->tx_mutex == NULL || conn->job_q == NULL) {
+        if (conn->mutex != NULL) {
+            vSemaphoreDelete(conn->mutex);
+        }
+        if (conn->tx_mutex != NULL) {
+            vSemaphoreDelete(conn->tx_mutex);
+        }
+        if (conn->job_q != NULL) {
+            vQueueDelete(conn->job_q);
+        }
+        free(conn);
+        spp_conn_exit((int)(intptr_t)param);
+        return;
+    }
+    spp_conn_set_cleanup(conn->idx, rpc_cleanup, conn);
+
+    while (!spp_conn_stopping(conn->idx)) {
+        int size_r = read(conn->fd, &conn->rx[conn->rx_len], sizeof(conn->rx) - conn->rx_len);
+        if (size_r < 0) {
+            // クローズされた
+            break;
+        }
+        conn->rx_len += size_r;
+        spp_link_traffic(conn->fd, size_r);
+
+        // 受信済みのフレームをすべて処理
+        uint32_t pos = 0;
+        while (conn->rx_len - pos >= RPC_HDR_SIZE) {
+            struct _spp_rpc_hdr hdr;
+            memcpy(&hdr, &conn->rx[pos], RPC_HDR_SIZE);
+            if (hdr.len > SPP_RPC_MAX_PAYLOAD) {
+                // フレーム境界がわからなくなったので受信済みデータは捨てる
+                ESP_LOGW(TAG, "invalid frame length %d", hdr.len);
+                pos = conn->rx_len;
+                break;
+            }
+            if (conn->rx_len - pos < RPC_HDR_SIZE + hdr.len) {
+                break;
+            }
+            rpc_handle_frame(conn, &hdr, &conn->rx[pos + RPC_HDR_SIZE]);
+            pos += RPC_HDR_SIZE + hdr.len;
+        }
+        memmove(conn->rx, &conn->rx[pos], conn->rx_len - pos);
+        conn->rx_len -= pos;
+
+        rpc_check_timeout(conn);
+        if (size_r == 0) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    }
+
+    // こちらから切断するときは処理中の要求の応答を期限まで待つ
+    do {
+        busy = false;
+        xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+            if (conn->slot[i].state == SLOT_QUEUED || conn->slot[i].state == SLOT_RUNNING) {
+                busy = true;
+            }
+        }
+        xSemaphoreGive(conn->mutex);
+        if (busy) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    } while (busy && spp_conn_draining(conn->idx));
+
+    // 処理中の要求を打ち切り、ワーカが手放すのを待ってから解放する
+    spp_conn_set_cleanup(conn->idx, NULL, NULL);
+    ESP_LOGI(TAG, "RPC closed : fd = %d  requests = %d  timeouts = %d  cancels = %d  busy = %d  workers = %d",
+            conn->fd, conn->requests, conn->timeouts, conn->cancels, conn->busy, conn->workers);
+    do {
+        busy = false;
+        xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+            if (conn->slot[i].state == SLOT_QUEUED || conn->slot[i].state == SLOT_RUNNING) {
+                conn->slot[i].state         = SLOT_ABANDONED;
+                conn->slot[i].req.cancelled = true;
+            }
+            if (conn->slot[i].state != SLOT_FREE) {
+                busy = true;
+            }
+        }
+        xSemaphoreGive(conn->mutex);
+        if (busy) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    } while (busy);
+
+    // ワーカを終了させる
+    struct _rpc_slot*   stop = NULL;
+    int                 workers;
+    xSemaphoreTake(conn->mutex, portMAX_DELAY);
+    workers = conn->workers;
+    xSemaphoreGive(conn->mutex);
+    for (int i = 0; i < workers; i++) {
+        xQueueSend(conn->job_q, &stop, portMAX_DELAY);
+    }
+    do {
+        xSemaphoreTake(conn->mutex, portMAX_DELAY);
+        workers = conn->workers;
+        xSemaphoreGive(conn->mutex);
+        if (workers > 0) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+    } while (workers > 0);
+
+    int idx = conn->idx;
+    rpc_conn_free(conn);
+    spp_conn_exit(idx);
+}
+
+// ================================================================================================
+// 組み込みメソッド
+// ================================================================================================
+static uint8_t rpc_m_echo(const struct _spp_rpc_req* req, uint8_t* rsp, uint16_t* rsp_len)
+{
+    memcpy(rsp, req->data, req->len);
+    *rsp_len = req->len;
+    return RPC_ST_OK;
+}
+
+static uint8_t rpc_m_sleep(const struct _spp_rpc_req* req, uint8_t* rsp, uint16_t* rsp_len)
+{
+    uint32_t    ms;
+
+    if (req->len != sizeof(ms)) {
+        return RPC_ST_BAD_REQ;
+    }
+    memcpy(&ms, req->data, sizeof(ms));
+    for (uint32_t t = 0; t < ms && !req->cancelled; t += 10) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+    return RPC_ST_OK;
+}
+
+static uint8_t rpc_m_conn_list(const struct _spp_rpc_req* req, uint8_t* rsp, uint16_t* rsp_len)
+{
+    uint16_t    len = 0;
+
+    for (int idx = 0; idx < OPEN_HDR_NUM && len + 12 <= SPP_RPC_MAX_PAYLOAD; idx++) {
+        if (open_hdr_params[idx].use) {
+            uint16_t    fd = (uint16_t)open_hdr_params[idx].fd;
+            memcpy(&rsp[len],      open_hdr_params[idx].bda,        sizeof(esp_bd_addr_t));
+            memcpy(&rsp[len + 6],  &open_hdr_params[idx].bd_handle, sizeof(uint32_t));
+            memcpy(&rsp[len + 10], &fd,                             sizeof(uint16_t));
+            len += 12;
+        }
+    }
+    *rsp_len = len;
+    return RPC_ST_OK;
+}
+
+// ================================================================================================
+// メソッド登録
+// ================================================================================================
+esp_err_t spp_rpc_register(uint16_t method, spp_rpc_handler_t handler)
+{
+    for (int i = 0; i < rpc_method_num; i++) {
+        if (rpc_methods[i].method == method) {
+            // 登録済みなら置き換え
+            rpc_methods[i].handler = handler;
+            return ESP_OK;
+        }
+    }
+    if (rpc_method_num >= SPP_RPC_METHOD_MAX) {
+        ESP_LOGE(TAG, "RPC method table full");
+        return ESP_ERR_NO_MEM;
+    }
+    rpc_methods[rpc_method_num].method  = method;
+    rpc_methods[rpc_method_num].handler = handler;
+    rpc_method_num++;
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 初期化(組み込みメソッドの登録)
+//     ワーカは接続ごとに要求が来たときに生成する
+// ================================================================================================
+esp_err_t spp_rpc_init(void)
+{
+    spp_rpc_register(SPP_RPC_M_ECHO,      rpc_m_echo);
+    spp_rpc_register(SPP_RPC_M_SLEEP,     rpc_m_sleep);
+    spp_rpc_register(SPP_RPC_M_CONN_LIST, rpc_m_conn_list);
+    rpc_ready = true;
+    return ESP_OK;
+}
@@ -0,0 +1,68 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP上のRPC(要求のパイプライン処理)
+//     フレーム形式(リトルエンディアン、要求/応答/キャンセル共通)
+//         type(1) status(1) len(2) id(2) method(2) timeout_ms(4) + payload(len)
+//     要求元は応答を待たずに SPP_RPC_WINDOW 個まで要求を送信できる
+//     応答は処理が終わった順に返る(id で対応をとる)
+//     timeout_ms(0:なし)を過ぎても処理が終わらない要求には RPC_ST_TIMEOUT を返す
+//     RPC_CANCEL を受信すると同じ id の要求に RPC_ST_CANCELLED を返す(ハンドラには cancelled で通知)
+//     timeout_ms は tick に切り上げる(1tick未満のタイムアウトでも処理する機会がある)
+
+#define SPP_RPC_WINDOW          8           // 1接続あたりの同時処理要求数(ワーカタスクも接続ごとに最大この数まで生成する)
+#define SPP_RPC_WORKER_STACK    3072        // ワーカタスクのスタックサイズ
+#define SPP_RPC_MAX_PAYLOAD     256         // 要求/応答の最大ペイロード長
+#define SPP_RPC_METHOD_MAX      16          // 登録できるメソッド数
+
+// フレーム種別
+#define RPC_REQ                 0x01
+#define RPC_RSP                 0x02
+#define RPC_CANCEL              0x03
+
+// 応答ステータス
+#define RPC_ST_OK               0
+#define RPC_ST_NO_METHOD        1           // 未登録のメソッド
+#define RPC_ST_TIMEOUT          2           // タイムアウト
+#define RPC_ST_CANCELLED        3           // キャンセルされた
+#define RPC_ST_BUSY             4           // 同時処理数の上限
+#define RPC_ST_BAD_REQ          5           // 不正な要求
+#define RPC_ST_ERROR            6           // ハンドラでのエラー
+
+// 組み込みメソッド
+#define SPP_RPC_M_ECHO          0x0000      // ペイロードをそのまま返す
+#define SPP_RPC_M_SLEEP         0x0001      // 指定時間(payload : ms(4))待ってから応答する
+#define SPP_RPC_M_CONN_LIST     0x0002      // 接続一覧(1接続あたり bda(6) handle(4) fd(2))
+
+struct _spp_rpc_hdr {
+    uint8_t         type;
+    uint8_t         status;
+    uint16_t        len;
+    uint16_t        id;
+    uint16_t        method;
+    uint32_t        timeout_ms;
+};
+
+// ハンドラに渡す要求
+struct _spp_rpc_req {
+    uint16_t        id;
+    uint16_t        method;
+    const uint8_t*  data;
+    uint16_t        len;
+    volatile bool   cancelled;      // キャンセル/タイムアウト済み(ハンドラは途中で打ち切ってよい)
+};
+
+// ハンドラ
+//     rsp に応答ペイロード(最大 SPP_RPC_MAX_PAYLOAD)を格納して rsp_len に長さを設定する
+//     戻り値は応答ステータス
+typedef uint8_t (*spp_rpc_handler_t)(const struct _spp_rpc_req* req, uint8_t* rsp, uint16_t* rsp_len);
+
+// extern宣言
+extern esp_err_t spp_rpc_init(void);
+extern esp_err_t spp_rpc_register(uint16_t method, spp_rpc_handler_t handler);
+extern void spp_rpc_task(void* param);
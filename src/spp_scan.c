@@ -0,0 +1,209 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+
+#include "spp_scan.h"
+#include "spp_bond.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+static const char* const    scan_prof_name[SCAN_PROF_NUM + 1] = { "fast", "balanced", "low", "auto" };
+
+static portMUX_TYPE         scan_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t         scan_task_handle = NULL;
+static int                  scan_select     = SCAN_PROF_AUTO;   // 選択されたプロファイル
+static int                  scan_prof       = -1;               // 現在のプロファイル
+static int                  scan_disc       = -1;               // 設定中の発見可能(-1:未設定)
+static int64_t              scan_enter_ms;                      // 現在のプロファイルに入った時刻
+static int64_t              scan_wait_ms;                       // 受付待ちの開始時刻
+static int64_t              scan_fast_until_ms;                 // 切断後のFASTの期限
+static uint32_t             scan_switches   = 0;
+static struct _spp_scan_stat scan_stat[SCAN_PROF_NUM];
+
+
+// ================================================================================================
+// 現在時刻(ms)
+// ================================================================================================
+static int64_t scan_now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+// ================================================================================================
+// プロファイルの決定と設定の反映
+// ================================================================================================
+static esp_err_t scan_update(void)
+{
+    int64_t     now = scan_now_ms();
+    int         prof;
+    bool        disc;
+    esp_err_t   err = ESP_OK;
+
+    portENTER_CRITICAL(&scan_mux);
+    if (scan_select != SCAN_PROF_AUTO) {
+        prof = scan_select;
+    }
+    else if (now < scan_fast_until_ms) {
+        prof = SCAN_PROF_FAST;
+    }
+    else if (spp_bond_num() > 0) {
+        prof = SCAN_PROF_LOW;
+    }
+    else {
+        prof = SCAN_PROF_BALANCED;
+    }
+    if (prof != scan_prof) {
+        if (scan_prof >= 0) {
+            scan_stat[scan_prof].dwell_ms += now - scan_enter_ms;
+            scan_switches++;
+        }
+        scan_prof       = prof;
+        scan_enter_ms   = now;
+        scan_wait_ms    = now;
+        scan_stat[prof].enter++;
+    }
+    switch (prof) {
+      case SCAN_PROF_FAST :
+        disc = true;
+        break;
+      case SCAN_PROF_BALANCED :
+        disc = ((now - scan_enter_ms) % SPP_SCAN_DISC_PERIOD_MS) < SPP_SCAN_DISC_ON_MS;
+        break;
+      default :
+        disc = false;
+        break;
+    }
+    portEXIT_CRITICAL(&scan_mux);
+
+    if ((int)disc != scan_disc) {
+        ESP_LOGI(TAG, "profile %s : %s", scan_prof_name[prof], disc ? "discoverable" : "non discoverable");
+        err = esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, disc ? ESP_BT_GENERAL_DISCOVERABLE : ESP_BT_NON_DISCOVERABLE);
+        if (err == ESP_OK) {
+            scan_disc = disc;
+        }
+    }
+    return err;
+}
+
+// ================================================================================================
+// 制御タスク
+// ================================================================================================
+static void scan_task(void* param)
+{
+    TickType_t  last = xTaskGetTickCount();
+
+    while (1) {
+        vTaskDelayUntil(&last, SPP_SCAN_TICK_MS / portTICK_PERIOD_MS);
+        scan_update();
+    }
+}
+
+// ================================================================================================
+// 開始(spp_init からBluedroid有効化後に呼ぶ)
+// ================================================================================================
+esp_err_t spp_scan_start(void)
+{
+    esp_err_t err = scan_update();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (scan_task_handle == NULL) {
+        if (xTaskCreate(scan_task, "scan_task", 2048, NULL, 3, &scan_task_handle) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// プロファイルの選択(SCAN_PROF_AUTO で自動切り替え)
+// ================================================================================================
+void spp_scan_select(int prof)
+{
+    if (prof < 0 || prof > SCAN_PROF_AUTO) {
+        return;
+    }
+    portENTER_CRITICAL(&scan_mux);
+    scan_select = prof;
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+// ================================================================================================
+// ESP_SPP_SRV_OPEN_EVT
+//     プロファイルに入ってから(または前回の受付から)の時間を記録する
+// ================================================================================================
+void spp_scan_accepted(void)
+{
+    int64_t now = scan_now_ms();
+
+    portENTER_CRITICAL(&scan_mux);
+    if (scan_prof >= 0) {
+        struct _spp_scan_stat*  st = &scan_stat[scan_prof];
+        uint32_t                ms = now - scan_wait_ms;
+        if (st->accept == 0 || ms < st->accept_ms_min) {
+            st->accept_ms_min = ms;
+        }
+        if (ms > st->accept_ms_max) {
+            st->accept_ms_max = ms;
+        }
+        st->accept_ms_sum += ms;
+        st->accept++;
+        scan_wait_ms = now;
+    }
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+// ================================================================================================
+// ESP_SPP_CLOSE_EVT
+//     しばらくFASTにして再接続を待つ
+// ================================================================================================
+void spp_scan_disconnected(void)
+{
+    portENTER_CRITICAL(&scan_mux);
+    scan_fast_until_ms = scan_now_ms() + SPP_SCAN_FAST_MS;
+    portEXIT_CRITICAL(&scan_mux);
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_scan_show(void)
+{
+    struct _spp_scan_stat   stat[SCAN_PROF_NUM];
+    int64_t                 now = scan_now_ms();
+    int                     prof;
+
+    portENTER_CRITICAL(&scan_mux);
+    memcpy(stat, scan_stat, sizeof(stat));
+    prof = scan_prof;
+    if (prof >= 0) {
+        stat[prof].dwell_ms += now - scan_enter_ms;
+    }
+    portEXIT_CRITICAL(&scan_mux);
+
+    printf("    select %s  current %s  %s  bonded %d  switches %u\n",
+            scan_prof_name[scan_select], (prof >= 0) ? scan_prof_name[prof] : "-",
+            (scan_disc == 1) ? "discoverable" : "non discoverable", spp_bond_num(), scan_switches);
+    printf("    profile   enter  dwell(s)  accept  accept time(ms) min/avg/max\n");
+    for (int i = 0; i < SCAN_PROF_NUM; i++) {
+        printf("    %-8s %6u  %8u  %6u  %u / %u / %u\n", scan_prof_name[i], stat[i].enter, stat[i].dwell_ms / 1000,
+                stat[i].accept, stat[i].accept_ms_min,
+                (stat[i].accept > 0) ? stat[i].accept_ms_sum / stat[i].accept : 0, stat[i].accept_ms_max);
+    }
+}
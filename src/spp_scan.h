@@ -0,0 +1,49 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// スキャンモード(接続受付/発見可能)のプロファイル
+//     SCAN_PROF_FAST     : 接続可能 + 常に発見可能(従来の動作)
+//     SCAN_PROF_BALANCED : 接続可能 + SPP_SCAN_DISC_PERIOD_MS 周期のうち SPP_SCAN_DISC_ON_MS だけ発見可能
+//     SCAN_PROF_LOW      : 接続可能のみ(発見不可)
+//     自動切り替え(SCAN_PROF_AUTO)
+//         切断後 SPP_SCAN_FAST_MS の間 → FAST(接続先がすぐに再接続できるように)
+//         ペアリング済みデバイスあり  → LOW
+//         ペアリング済みデバイスなし  → BALANCED
+//     プロファイルごとに滞在時間と、プロファイルに入ってから接続を受け付けるまでの時間を集計する
+//     ペアリング済みデバイスの数は spp_bond のミラーから得る
+//     (IDF 4.3 にはページ/inquiryスキャンのウィンドウと間隔を設定するAPIがないので、
+//      esp_bt_gap_set_scan_mode() の発見可能の有無とその時間の割合で消費電力を調整する)
+
+#define SPP_SCAN_TICK_MS        100         // 制御周期
+#define SPP_SCAN_FAST_MS        10000       // 切断後にFASTにしておく時間
+#define SPP_SCAN_DISC_PERIOD_MS 10000       // BALANCEDの発見可能の周期
+#define SPP_SCAN_DISC_ON_MS     2560        // BALANCEDの発見可能の時間(inquiryの標準の長さ 10.24s の1/4)
+
+// プロファイル
+#define SCAN_PROF_FAST          0
+#define SCAN_PROF_BALANCED      1
+#define SCAN_PROF_LOW           2
+#define SCAN_PROF_NUM           3
+#define SCAN_PROF_AUTO          SCAN_PROF_NUM
+
+// プロファイルごとの統計
+struct _spp_scan_stat {
+    uint32_t        enter;          // プロファイルに入った回数
+    uint32_t        dwell_ms;       // 滞在時間の合計
+    uint32_t        accept;         // 接続を受け付けた回数
+    uint32_t        accept_ms_sum;  // プロファイルに入ってから受け付けるまでの時間
+    uint32_t        accept_ms_min;
+    uint32_t        accept_ms_max;
+};
+
+// extern宣言
+extern esp_err_t spp_scan_start(void);
+extern void spp_scan_select(int prof);
+extern void spp_scan_accepted(void);
+extern void spp_scan_disconnected(void);
+extern void spp_scan_show(void);
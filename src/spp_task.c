@@ -0,0 +1,303 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_bt.h"
+#include "esp_gap_bt_api.h"
+#include "esp_spp_api.h"
+
+#include "spp_user_hdr.h"
+#include "spp_task.h"
+
+// LOG表示用TAG(関数名にしておく)
+#define TAG                 __func__
+
+// 接続の種類ごとの配置
+struct _spp_task_class  spp_task_class[SPP_TASK_CLASS_NUM] = {
+    // name     priority    core                    stack                   slots
+    { "data",   5,          SPP_TASK_CORE_AUTO,     SPP_TASK_STACK_DATA,    SPP_TASK_SLOTS_DATA },
+    { "bulk",   4,          SPP_TASK_CORE_AUTO,     SPP_TASK_STACK_BULK,    SPP_TASK_SLOTS_BULK },
+    { "ctrl",   6,          SPP_TASK_CORE_AUTO,     SPP_TASK_STACK_CTRL,    SPP_TASK_SLOTS_CTRL },
+};
+
+#ifdef  SPP_TASK_STATIC
+// 静的割り当てのスロット
+struct _task_slot {
+    bool            use;
+    uint8_t         cls;
+    TaskHandle_t    handle;
+    StackType_t*    stack;
+    StaticTask_t    tcb;
+};
+static struct _task_slot    task_slot[SPP_TASK_SLOT_NUM];
+static StackType_t          task_stack_arena[SPP_TASK_ARENA_SIZE];
+static portMUX_TYPE         task_slot_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t             task_slot_full = 0;         // プールが一杯で生成できなかった回数
+#endif  // SPP_TASK_STATIC
+
+static uint32_t             task_util[portNUM_PROCESSORS];      // コアごとの使用率(%)
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t             task_prev_idle[portNUM_PROCESSORS];
+static uint32_t             task_prev_total = 0;
+static TickType_t           task_sample_tick = 0;
+static TaskStatus_t         task_stat[SPP_TASK_STAT_MAX];
+#endif
+static SemaphoreHandle_t    task_mutex = NULL;
+
+
+// ================================================================================================
+// 初期化
+// ================================================================================================
+esp_err_t spp_task_init(void)
+{
+#ifdef  SPP_TASK_STATIC
+    // スタック領域を種類ごとのスロットに分ける
+    StackType_t*    p = task_stack_arena;
+    int             n = 0;
+    for (int c = 0; c < SPP_TASK_CLASS_NUM; c++) {
+        for (int i = 0; i < spp_task_class[c].slots; i++, n++) {
+            task_slot[n].cls    = c;
+            task_slot[n].stack  = p;
+            p += spp_task_class[c].stack;
+        }
+    }
+#endif  // SPP_TASK_STATIC
+    task_mutex = xSemaphoreCreateMutex();
+    return (task_mutex != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// ================================================================================================
+// コアの選択(FreeRTOSに依存しない計算部分)
+// param    util    : コアごとの使用率(%)
+//          assigned: コアごとの割り当て済みデータタスク数
+//          bt_core : BTのタスクがいるコア(-1:なし)
+// return   選択したコア
+// ================================================================================================
+int spp_task_pick_core(const uint32_t util[], const int assigned[], int core_num, int bt_core)
+{
+    int         best = 0;
+    uint32_t    best_cost = UINT32_MAX;
+
+    for (int i = 0; i < core_num; i++) {
+        uint32_t cost = util[i] + assigned[i] * SPP_TASK_WEIGHT;
+        if (i == bt_core) {
+            cost += SPP_TASK_BT_BIAS;
+        }
+        if (cost < best_cost) {
+            best        = i;
+            best_cost   = cost;
+        }
+    }
+    return best;
+}
+
+// ================================================================================================
+// コアごとの使用率の更新(前回からのIDLEタスクの実行時間から計算する)
+// ================================================================================================
+static void task_update_util(void)
+{
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    uint32_t    total;
+    uint32_t    idle[portNUM_PROCESSORS] = {0};
+    UBaseType_t num;
+
+    if (task_prev_total != 0 && xTaskGetTickCount() - task_sample_tick < SPP_TASK_SAMPLE_MS / portTICK_PERIOD_MS) {
+        // 前回の値を使う
+        return;
+    }
+    num = uxTaskGetSystemState(task_stat, SPP_TASK_STAT_MAX, &total);
+    if (num == 0) {
+        return;
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        TaskHandle_t idle_handle = xTaskGetIdleTaskHandleForCPU(c);
+        for (int i = 0; i < num; i++) {
+            if (task_stat[i].xHandle == idle_handle) {
+                idle[c] = task_stat[i].ulRunTimeCounter;
+                break;
+            }
+        }
+    }
+    if (task_prev_total != 0 && total != task_prev_total) {
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            uint32_t idle_pct = (uint64_t)(idle[c] - task_prev_idle[c]) * 100 / (total - task_prev_total);
+            task_util[c] = (idle_pct < 100) ? 100 - idle_pct : 0;
+        }
+    }
+    memcpy(task_prev_idle, idle, sizeof(task_prev_idle));
+    task_prev_total     = total;
+    task_sample_tick    = xTaskGetTickCount();
+#endif // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+}
+
+// ================================================================================================
+// コアごとの割り当て済みデータタスク数
+// ================================================================================================
+static void task_count_assigned(int assigned[])
+{
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        assigned[c] = 0;
+    }
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        if (open_hdr_params[i].use && open_hdr_params[i].core >= 0 && open_hdr_params[i].core < portNUM_PROCESSORS) {
+            assigned[open_hdr_params[i].core]++;
+        }
+    }
+}
+
+// ================================================================================================
+// データタスクの生成
+// param    cls     : 接続の種類(SPP_TASK_CLASS_xxx)
+//          core    : 配置したコア
+// ================================================================================================
+BaseType_t spp_task_create(TaskFunction_t func, const char* name, void* param, int cls,
+                           TaskHandle_t* handle, int* core)
+{
+    const struct _spp_task_class*   tc = &spp_task_class[(cls >= 0 && cls < SPP_TASK_CLASS_NUM) ? cls : SPP_TASK_CLASS_DATA];
+    int                             assigned[portNUM_PROCESSORS];
+    int                             c = tc->core;
+
+    if (c == SPP_TASK_CORE_AUTO) {
+        xSemaphoreTake(task_mutex, portMAX_DELAY);
+        task_update_util();
+        task_count_assigned(assigned);
+        c = spp_task_pick_core(task_util, assigned, portNUM_PROCESSORS, SPP_TASK_BT_CORE);
+        xSemaphoreGive(task_mutex);
+    }
+    *core = c;
+    ESP_LOGI(TAG, "%s : class %s  core %d  priority %d", name, tc->name, c, tc->priority);
+#ifdef  SPP_TASK_STATIC
+    struct _task_slot*  slot = NULL;
+    // 終了したデータタスクのスロットは IDLEタスクが後始末するまで返却されないので、少し待つ
+    for (int wait = 0; slot == NULL && wait <= SPP_TASK_SLOT_WAIT_MS / portTICK_PERIOD_MS; wait++) {
+        if (wait > 0) {
+            vTaskDelay(1);
+        }
+        portENTER_CRITICAL(&task_slot_mux);
+        for (int i = 0; i < SPP_TASK_SLOT_NUM; i++) {
+            if (!task_slot[i].use && &spp_task_class[task_slot[i].cls] == tc) {
+                slot        = &task_slot[i];
+                slot->use   = true;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&task_slot_mux);
+    }
+    if (slot != NULL) {
+        slot->handle = xTaskCreateStaticPinnedToCore(func, name, tc->stack, param, tc->priority, slot->stack, &slot->tcb, c);
+        *handle = slot->handle;
+        return pdPASS;
+    }
+    // 種類ごとのスロット数を同時接続数の上限にする(ヒープからは割り当てない)
+    task_slot_full++;
+    ESP_LOGW(TAG, "no free %s slot", tc->name);
+    return pdFAIL;
+#else   // SPP_TASK_STATIC
+    return xTaskCreatePinnedToCore(func, name, tc->stack, param, tc->priority, handle, c);
+#endif  // SPP_TASK_STATIC
+}
+
+// ================================================================================================
+// スタックの使用量(スタック領域の未使用パターン(0xa5)が残っていない部分)
+// ================================================================================================
+static uint32_t task_stack_used(const StackType_t* stack, uint32_t size)
+{
+    const uint8_t*  p = (const uint8_t*)stack;
+    uint32_t        free = 0;
+
+    // スタックは上位アドレスから使われるので、下位アドレスから未使用パターンを数える
+    while (free < size && p[free] == 0xa5) {
+        free++;
+    }
+    return size - free;
+}
+
+static void task_record_used(int cls, uint32_t used)
+{
+    if (used > spp_task_class[cls].max_used) {
+        spp_task_class[cls].max_used = used;
+    }
+}
+
+#ifdef  SPP_TASK_STATIC
+// ================================================================================================
+// 静的タスク削除後の後始末(IDLEタスクから呼ばれる)
+//     スタックの使用量を記録してスロットを返却する
+// ================================================================================================
+void vPortCleanUpTCB(void* pxTCB)
+{
+    for (int i = 0; i < SPP_TASK_SLOT_NUM; i++) {
+        struct _task_slot* slot = &task_slot[i];
+        if (slot->use && (void*)&slot->tcb == pxTCB) {
+            task_record_used(slot->cls, task_stack_used(slot->stack, spp_task_class[slot->cls].stack));
+            portENTER_CRITICAL(&task_slot_mux);
+            slot->handle    = NULL;
+            slot->use       = false;
+            portEXIT_CRITICAL(&task_slot_mux);
+            return;
+        }
+    }
+}
+#endif  // SPP_TASK_STATIC
+
+// ================================================================================================
+// スタック使用量と推奨サイズの表示
+//     実行中のデータタスクは現在の最小空き量(HWM)も反映する
+// ================================================================================================
+void spp_task_show_stack(void)
+{
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        UBaseType_t hwm;
+        if (spp_conn_stack_hwm(i, &hwm)) {
+            int c = open_hdr_params[i].task_class;
+            task_record_used(c, spp_task_class[c].stack - hwm);
+        }
+    }
+    for (int c = 0; c < SPP_TASK_CLASS_NUM; c++) {
+        const struct _spp_task_class* tc = &spp_task_class[c];
+        uint32_t recommended = (tc->max_used + SPP_TASK_STACK_MARGIN + 255) & ~255;
+        printf("    class %-4s : stack %5u  max used %5u  recommended %5u%s\n", tc->name, tc->stack, tc->max_used,
+                recommended, (tc->max_used == 0) ? "  (no data)" : "");
+    }
+#ifdef  SPP_TASK_STATIC
+    int free_slots = 0;
+    for (int i = 0; i < SPP_TASK_SLOT_NUM; i++) {
+        if (!task_slot[i].use) {
+            free_slots++;
+        }
+    }
+    printf("    static slots : %d / %d free  slot full : %u\n", free_slots, SPP_TASK_SLOT_NUM, task_slot_full);
+#endif  // SPP_TASK_STATIC
+}
+
+// ================================================================================================
+// 状態表示
+// ================================================================================================
+void spp_task_show(void)
+{
+    int assigned[portNUM_PROCESSORS];
+
+    xSemaphoreTake(task_mutex, portMAX_DELAY);
+    task_update_util();
+    task_count_assigned(assigned);
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        printf("    core %d : %3u %%  data tasks : %d%s\n", c, task_util[c], assigned[c], (c == SPP_TASK_BT_CORE) ? "  (BT)" : "");
+    }
+    xSemaphoreGive(task_mutex);
+    for (int i = 0; i < SPP_TASK_CLASS_NUM; i++) {
+        printf("    class %-4s : priority %d  core %s\n", spp_task_class[i].name, spp_task_class[i].priority,
+                (spp_task_class[i].core == SPP_TASK_CORE_AUTO) ? "auto" : (spp_task_class[i].core == 0) ? "0" : "1");
+    }
+}
@@ -0,0 +1,75 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// データタスクの配置(コア/優先度)
+//     接続の種類ごとに優先度と配置するコアを spp_task_class[] で指定する
+//     コアを SPP_TASK_CORE_AUTO にした種類は、コアごとの使用率(run-time stats)と
+//     割り当て済みのデータタスク数から負荷の低いコアを選ぶ
+//     BluetoothコントローラとBluedroidのタスクがいるコアには SPP_TASK_BT_BIAS を加算して避けやすくする
+
+#define SPP_TASK_CORE_AUTO      -1
+#define SPP_TASK_BT_CORE        CONFIG_BT_BLUEDROID_PINNED_TO_CORE
+#define SPP_TASK_BT_BIAS        20          // BTのコアの使用率に加算する値(%)
+#define SPP_TASK_WEIGHT         10          // 割り当て済みデータタスク1つあたりに加算する値(%)
+#define SPP_TASK_SAMPLE_MS      200         // 使用率を計算し直す最小間隔
+#define SPP_TASK_STAT_MAX       48          // 使用率の計算で扱うタスク数の上限
+
+// 静的割り当てモード
+//     データタスクのTCBとスタックを種類ごとのプールから割り当てる(xTaskCreateStaticPinnedToCore)
+//     初期化後にヒープを使わないので、ヒープが断片化しても接続を受け付けられる
+//     プールが一杯のときはデータタスクを生成せずに接続を切断する(種類ごとのスロット数が同時接続数の上限)
+//     タスク終了後のスロットの返却は vPortCleanUpTCB()(CONFIG_FREERTOS_ENABLE_STATIC_TASK_CLEAN_UP)で行う
+#define SPP_TASK_STATIC         1
+#define SPP_TASK_SLOT_WAIT_MS   100         // スロットが返却されるのを待つ期限
+
+// スタック使用量の計測用ビルド
+//     スタックを SPP_TASK_PROFILE_STACK にして、種類ごとの最大使用量から推奨サイズを表示する('P')
+//#define SPP_TASK_PROFILE        1
+#define SPP_TASK_PROFILE_STACK  8192
+#define SPP_TASK_STACK_MARGIN   512         // 推奨サイズの余裕
+
+// 種類ごとのスタックサイズとスロット数
+#ifdef  SPP_TASK_PROFILE
+#define SPP_TASK_STACK_DATA     SPP_TASK_PROFILE_STACK
+#define SPP_TASK_STACK_BULK     SPP_TASK_PROFILE_STACK
+#define SPP_TASK_STACK_CTRL     SPP_TASK_PROFILE_STACK
+#else   // SPP_TASK_PROFILE
+#define SPP_TASK_STACK_DATA     3072
+#define SPP_TASK_STACK_BULK     4096
+#define SPP_TASK_STACK_CTRL     3072
+#endif  // SPP_TASK_PROFILE
+#define SPP_TASK_SLOTS_DATA     8           // パラメータテーブル数(OPEN_HDR_NUM)と同じ
+#define SPP_TASK_SLOTS_BULK     2
+#define SPP_TASK_SLOTS_CTRL     2
+#define SPP_TASK_SLOT_NUM       (SPP_TASK_SLOTS_DATA + SPP_TASK_SLOTS_BULK + SPP_TASK_SLOTS_CTRL)
+#define SPP_TASK_ARENA_SIZE     (SPP_TASK_STACK_DATA * SPP_TASK_SLOTS_DATA + SPP_TASK_STACK_BULK * SPP_TASK_SLOTS_BULK + \
+                                 SPP_TASK_STACK_CTRL * SPP_TASK_SLOTS_CTRL)
+
+// 接続の種類
+#define SPP_TASK_CLASS_DATA     0           // エコーバック/中継/配信/集約
+#define SPP_TASK_CLASS_BULK     1           // OTA/ファイル転送
+#define SPP_TASK_CLASS_CTRL     2           // RPC
+#define SPP_TASK_CLASS_NUM      3
+
+struct _spp_task_class {
+    const char*     name;
+    UBaseType_t     priority;       // 優先度
+    int             core;           // 配置するコア(SPP_TASK_CORE_AUTO:自動)
+    uint32_t        stack;          // スタックサイズ
+    int             slots;          // 静的割り当てのスロット数
+    uint32_t        max_used;       // スタックの最大使用量(計測値)
+};
+
+// extern宣言
+extern struct _spp_task_class spp_task_class[SPP_TASK_CLASS_NUM];
+extern esp_err_t spp_task_init(void);
+extern int spp_task_pick_core(const uint32_t util[], const int assigned[], int core_num, int bt_core);
+extern BaseType_t spp_task_create(TaskFunction_t func, const char* name, void* param, int cls,
+                                  TaskHandle_t* handle, int* core);
+extern void spp_task_show(void);
+extern void spp_task_show_stack(void);
@@ -6,20 +6,28 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 
-// HOST or CLIENT モード
-// HOSTモード時は以下をコメントアウトする
+// 起動時のモード
+//     サーバ(接続受付)とクライアント(接続要求)は同時に動作できる
+//     CLIENT モード時は起動時にサーバを開始しない(コンソールの 'S' で後から開始できる)
+//     HOSTモード時は以下をコメントアウトする
 #define SPP_CLIENT_MODE 1
 
 // デバイス名等
 #define BT_DEVICE_NAME      "ESP32"
 #define SPP_SERVER_NAME     "SPP_SERVER"
+#define SPP_OTA_SERVER_NAME "SPP_OTA"       // OTAアップデート用サーバ名
+#define SPP_FT_SERVER_NAME  "SPP_FILE"      // ファイル転送用サーバ名
+#define SPP_RPC_SERVER_NAME "SPP_RPC"       // RPC用サーバ名
+#define SPP_HUB_SERVER_NAME "SPP_HUB"       // 配信ハブ用サーバ名
+#define SPP_AGG_SERVER_NAME "SPP_AGG"       // 集約用サーバ名
+#define SPP_BRIDGE_SERVER_NAME "SPP_UART"   // UARTブリッジ用サーバ名
+#define SPP_METRICS_SERVER_NAME "SPP_METRICS" // メトリクス用サーバ名
 
-// 接続先デバイス名(CLIENT モード時のみ使用)
+// 接続先デバイス名
 #define REMOTE_DEVICE_NAME  "NCC-1701F"  // デバイス名
 
 
 // extern宣言
-#ifdef  SPP_CLIENT_MODE         // SPP クライアントモード
 extern const char remote_device_name[];  // デバイス名
 extern esp_bd_addr_t    host_bd_address;
 extern uint8_t          host_service_channel1;
@@ -27,4 +35,3 @@ extern uint8_t          host_service_channel2;
 extern bool             found_bd_addr;
 extern bool             found_scn1;
 extern bool             found_scn2;
-#endif  // SPP_CLIENT_MODE
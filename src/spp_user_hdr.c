@@ -7,6 +7,7 @@
 */
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -27,6 +28,23 @@
 #include "spp_test.h"
 #include "spp_init.h"
 #include "spp_user_hdr.h"
+#include "spp_outbox.h"
+#include "spp_ota.h"
+#include "spp_ft.h"
+#include "spp_rpc.h"
+#include "spp_relay.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_hub.h"
+#include "spp_agg.h"
+#include "spp_bridge.h"
+#include "spp_metrics.h"
+#include "spp_mem.h"
+#include "spp_task.h"
+#include "spp_boot.h"
+#include "spp_link.h"
+#include "spp_cap.h"
+#include "spp_bond.h"
 #include "bt_utils.h"
 #include "uart_console.h"
 
@@ -34,116 +52,414 @@
 #define TAG                 __func__
 
 
-#define SPP_DATA_LEN    100        // 受信バッファ長
+// SPPデータタスクの資源(強制終了したときに監視タスクが返却する)
+struct _data_res {
+    struct _spp_pipe*   pipe;
+    struct _spp_buf*    buf;            // 受信中のバッファ
+};
+static struct _data_res     data_res[OPEN_HDR_NUM];
+
+static void data_task_cleanup(void* arg)
+{
+    struct _data_res*   res = arg;
+
+    spp_buf_unref(res->buf);
+    spp_pipe_destroy(res->pipe);
+    res->buf    = NULL;
+    res->pipe   = NULL;
+}
 
 // ================================================================================================
-// SPPデータタスク(エコーバックを行う)
+// SPPデータタスク(受信データを接続ごとの処理パイプラインに渡す、既定ではエコーバックを行う)
+//     受信は共通バッファプールのバッファに直接読み込み、そのバッファをパイプラインに渡す
 // ================================================================================================
 void spp_data_task(void* param)
 {
-    static uint8_t spp_data[SPP_DATA_LEN];
-
-    int size_r = 0;
-    int size_w = 0;
-    int fd = (int)param;
+    int                 conn = (int)(intptr_t)param;
+    int                 fd = spp_conn_fd(conn);
+    struct _data_res*   res = &data_res[conn];
+    struct _spp_buf*    buf;
+    int                 size_r = 0;
 
-    do {
-        /* controll the log frequency, retry after 1s */
-        // vTaskDelay(1000 / portTICK_PERIOD_MS);
+    res->buf    = NULL;
+    res->pipe   = spp_pipe_create(fd, conn, open_hdr_params[conn].pipe_chain);
+    if (res->pipe == NULL) {
+        ESP_LOGE(TAG, "failed to create pipeline");
+        spp_conn_exit(conn);
+        return;
+    }
+    spp_conn_set_cleanup(conn, data_task_cleanup, res);
 
-        size_r = read(fd, spp_data, SPP_DATA_LEN);
+    while (!spp_conn_stopping(conn)) {
+        // キャプチャの書き出し要求(書き出し中は受信しない)
+        spp_cap_export_poll(conn);
+        buf = spp_buf_alloc(100 / portTICK_PERIOD_MS);
+        if (buf == NULL) {
+            // バッファが空くまで受信しない(フロー制御)
+            continue;
+        }
+        res->buf = buf;
+        size_r = read(fd, buf->data, SPP_BUF_SIZE);
+        res->buf = NULL;
+        spp_link_traffic(fd, size_r);
+        if (size_r >= 0) {
+            spp_metrics_add((size_r > 0) ? MET_RX_BYTES : MET_READ_ZERO, conn, (size_r > 0) ? size_r : 1);
+        }
+        if (size_r > 0) {
+            spp_metrics_observe(MET_READ_SIZE, conn, size_r);
+        }
         if (size_r == -1) {
             // クローズされたなど
             ESP_LOGI(TAG, "read : fd = %d data_len = %d", fd, size_r);
+            spp_buf_unref(buf);
             break;
         }
         else if (size_r == 0) {
             // 受信データなし
-            // ESP_LOGI(TAG, "read : fd = %d data_len = %d", fd, size_r);
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            spp_buf_unref(buf);
+            vTaskDelay(100 / portTICK_PERIOD_MS);
         }
         else {
-            // 受信データ表示
-            ESP_LOGI(TAG, "read : fd = %d data_len = %d", fd, size_r);
-            esp_log_buffer_hex(TAG, spp_data, size_r);
-            // エコーバック
-            size_w = write(fd, spp_data, size_r);
-            ESP_LOGI(TAG, "write : fd = %d data_len = %d", fd, size_w);
+            spp_cap_record(CAP_RX, 0, fd, buf->data, size_r);
+            buf->off    = 0;
+            buf->len    = size_r;
+            spp_pipe_push(res->pipe, buf);
         }
-    } while (1);
+    }
 
     // タスク終了
-    vTaskDelete(NULL);
+    spp_conn_set_cleanup(conn, NULL, NULL);
+    spp_pipe_destroy(res->pipe);
+    res->pipe = NULL;
+    spp_conn_exit(conn);
 }
 
+// メトリクスのサービスのラベル(クライアント接続は spp_server_num)
+#define CONN_SVC_LABEL(server)  (((server) >= 0) ? (server) : spp_server_num)
+
 // パラメータテーブル
 struct _open_hdr_params     open_hdr_params[OPEN_HDR_NUM] = {0};
+static portMUX_TYPE         conn_mux = portMUX_INITIALIZER_UNLOCKED;
+static struct _spp_conn_stat conn_stat;
+
+// SPPサーバテーブル
+struct _spp_server          spp_servers[] = {
+    // name                     task_func           task_class              pipe_chain          sec_mask                                        max_conn
+    { SPP_SERVER_NAME,          spp_data_task,      SPP_TASK_CLASS_DATA,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       0   },  // エコーバック
+    { SPP_OTA_SERVER_NAME,      spp_ota_task,       SPP_TASK_CLASS_BULK,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE | ESP_SPP_SEC_ENCRYPT, 1   },  // OTAアップデート
+    { SPP_FT_SERVER_NAME,       spp_ft_task,        SPP_TASK_CLASS_BULK,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE | ESP_SPP_SEC_ENCRYPT, 2   },  // ファイル転送
+    { SPP_RPC_SERVER_NAME,      spp_rpc_task,       SPP_TASK_CLASS_CTRL,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       2   },  // RPC
+    { SPP_HUB_SERVER_NAME,      spp_hub_task,       SPP_TASK_CLASS_DATA,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       0   },  // 配信ハブ
+    { SPP_AGG_SERVER_NAME,      spp_agg_task,       SPP_TASK_CLASS_DATA,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       0   },  // 集約
+    { SPP_BRIDGE_SERVER_NAME,   spp_bridge_task,    SPP_TASK_CLASS_BULK,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       1   },  // UARTブリッジ
+    { SPP_METRICS_SERVER_NAME,  spp_metrics_task,   SPP_TASK_CLASS_CTRL,    PIPE_CHAIN_ECHO,    ESP_SPP_SEC_AUTHENTICATE,                       2   },  // メトリクス
+};
+const int                   spp_server_num = sizeof(spp_servers) / sizeof(spp_servers[0]);
+static bool                 spp_server_requested = false;
+
+
+// ================================================================================================
+// サーバの開始(起動時または実行中に1回だけ)
+//     クライアントとして接続中でも開始できる
+// return   true: 開始要求した     false: 開始要求済み
+// ================================================================================================
+bool spp_server_start_all(void)
+{
+    if (spp_server_requested) {
+        return false;
+    }
+    spp_server_requested = true;
+    spp_server_start_next();
+    return true;
+}
+
 
+// ================================================================================================
+// 未開始のサーバを1つ開始する
+// return   true: 開始要求した     false: すべて開始済み
+// ================================================================================================
+bool spp_server_start_next(void)
+{
+    for (int i = 0; i < spp_server_num; i++) {
+        if (!spp_servers[i].started) {
+            spp_boot_begin(BOOT_SRV_START);
+            esp_spp_start_srv(spp_servers[i].sec_mask, ESP_SPP_ROLE_SLAVE, 0, spp_servers[i].name);
+            /*
+                第1パラメータ
+                    ESP_SPP_SEC_NONE
+                    ESP_SPP_SEC_AUTHORIZE
+                    ESP_SPP_SEC_AUTHENTICATE 
+                第2パラメータ
+                    ESP_SPP_ROLE_MASTER         initiatorのとき
+                    ESP_SPP_ROLE_SLAVE          Accepterのとき
+                第3パラメータ
+                    取得するチャネル
+                    0: 任意のチャネル
+                第4パラメータ
+                    サーバ名
+            */
+            return true;
+        }
+    }
+    return false;
+}
+
+// ================================================================================================
+// サーバ開始完了(ESP_SPP_START_EVT)
+//     開始要求は1つずつ行っているので、未開始の先頭のサーバが対象
+//     失敗したサーバも開始済みにして(接続は受け付けない)次のサーバに進む
+// ================================================================================================
+void spp_server_started(bool success, uint32_t listen_handle, uint8_t scn)
+{
+    for (int i = 0; i < spp_server_num; i++) {
+        if (!spp_servers[i].started) {
+            spp_servers[i].started = true;
+            if (success) {
+                spp_servers[i].listen_handle    = listen_handle;
+                spp_servers[i].scn              = scn;
+                ESP_LOGI(TAG, "server '%s' started : scn = %d", spp_servers[i].name, scn);
+            }
+            else {
+                spp_servers[i].listen_handle    = 0;
+                ESP_LOGE(TAG, "server '%s' start failed", spp_servers[i].name);
+            }
+            return;
+        }
+    }
+}
+
+// ================================================================================================
+// 接続を受け付けたサーバの検索(ESP_SPP_SRV_OPEN_EVT)
+//     接続したハンドルは直前の listen handle なので、それでサーバを特定し
+//     以降の接続待ちは new_listen_handle に更新する
+// ================================================================================================
+struct _spp_server* spp_server_accept(uint32_t handle, uint32_t new_listen_handle)
+{
+    for (int i = 0; i < spp_server_num; i++) {
+        if (spp_servers[i].started && spp_servers[i].listen_handle != 0 && spp_servers[i].listen_handle == handle) {
+            spp_servers[i].listen_handle = new_listen_handle;
+            return &spp_servers[i];
+        }
+    }
+    ESP_LOGW(TAG, "server for handle %d not found", handle);
+    return NULL;
+}
 
 // ================================================================================================
 // SPP open event handler(オープンイベント時の処理)
+//     server : 接続を受け付けたサーバ(NULLのときはクライアント接続 → エコーバック)
 // ================================================================================================
-void spp_open_handler(uint32_t bd_handle, int fd, esp_bd_addr_t bda)
+void spp_open_handler(uint32_t bd_handle, int fd, esp_bd_addr_t bda, const struct _spp_server* server)
 {
+    TaskFunction_t  task_func = (server != NULL) ? server->task_func : spp_data_task;
+    const char*     task_desc = (server != NULL) ? server->name : "echo back";
+    int             task_class = (server != NULL) ? server->task_class : SPP_TASK_CLASS_DATA;
+    int             pipe_chain = spp_pipe_chain_for(bda, (server != NULL) ? server->pipe_chain : PIPE_CHAIN_ECHO);
+    int             srv_idx = (server != NULL) ? server - spp_servers : -1;
+    bool            limited = false;
+    int             core;
+
     TaskHandle_t    task_handle;
     int             idx;
     
-    for (idx = 0; idx < OPEN_HDR_NUM; idx++) {
+    if (spp_relay_enable && task_func == spp_data_task) {
+        // 中継モード時はエコーバックの代わりに中継する(接続を受けた側と接続した側をペアにする)
+        task_func = (server != NULL) ? spp_relay_in_task : spp_relay_out_task;
+        task_desc = "relay";
+    }
+
+    // パラメータテーブルはデータタスクの生成前に確保する(データタスクがすぐに終了しても見つかるように)
+    portENTER_CRITICAL(&conn_mux);
+    if (srv_idx >= 0 && spp_servers[srv_idx].max_conn > 0 && spp_servers[srv_idx].stat.active >= spp_servers[srv_idx].max_conn) {
+        // サーバごとの同時接続数の上限
+        spp_servers[srv_idx].stat.rejected++;
+        limited = true;
+    }
+    for (idx = 0; !limited && idx < OPEN_HDR_NUM; idx++) {
         if (!open_hdr_params[idx].use) {
             // 未使用のパラメータテーブルが見つかった
+            memset(&open_hdr_params[idx], 0, sizeof(open_hdr_params[idx]));
+            open_hdr_params[idx].use            = true;
+            memcpy(open_hdr_params[idx].bda, bda, sizeof(esp_bd_addr_t)) ;
+            open_hdr_params[idx].bd_handle      = bd_handle;
+            open_hdr_params[idx].fd             = fd;
+            open_hdr_params[idx].task_func      = task_func;
+            open_hdr_params[idx].task_class     = task_class;
+            open_hdr_params[idx].pipe_chain     = pipe_chain;
+            open_hdr_params[idx].server         = srv_idx;
+            open_hdr_params[idx].open_tick      = xTaskGetTickCount();
+            open_hdr_params[idx].core           = -1;           // 生成するまで割り当て済みに数えない
+            if (srv_idx >= 0) {
+                struct _spp_server_stat* st = &spp_servers[srv_idx].stat;
+                st->accepted++;
+                st->active++;
+                if (st->active > st->peak) {
+                    st->peak = st->active;
+                }
+            }
             break;
         }
     }
+    portEXIT_CRITICAL(&conn_mux);
+    if (limited) {
+        spp_metrics_add(MET_CONN_REJECT, srv_idx, 1);
+        ESP_LOGW(TAG, "server '%s' reached the connection limit (%d)", server->name, server->max_conn);
+        esp_spp_disconnect(bd_handle);
+        return;
+    }
     if (idx >= OPEN_HDR_NUM) {
         ESP_LOGE(TAG, "Tasks reached the upper limit");
+        esp_spp_disconnect(bd_handle);
         return;
     }
     ESP_LOGV(TAG, "Parameter table index : %d", idx);
+    spp_metrics_conn_reset(idx);
+    spp_metrics_add(MET_CONN_OPEN, CONN_SVC_LABEL(srv_idx), 1);
+    spp_metrics_add(MET_CONN_ACTIVE, CONN_SVC_LABEL(srv_idx), 1);
+    spp_mem_conn_open(idx);
 
-    // データタスクの生成
+    // データタスクの生成(接続の種類に応じた優先度で、負荷の低いコアに配置する)
     BaseType_t ret;
-    ret = xTaskCreate(spp_data_task, "spp_data_task", 4096, (void *)fd, 5, &task_handle);
+    spp_mem_conn_task(idx, false);
+    ret = spp_task_create(task_func, "spp_data_task", (void *)(intptr_t)idx, task_class, &task_handle, &core);
+    spp_mem_conn_task(idx, true);
     if (ret == pdPASS) {
-        open_hdr_params[idx].use            = true;
-        memcpy(open_hdr_params[idx].bda, bda, sizeof(esp_bd_addr_t)) ;
-        open_hdr_params[idx].bd_handle      = bd_handle;
-        open_hdr_params[idx].fd             = fd;
+        portENTER_CRITICAL(&conn_mux);
         open_hdr_params[idx].task_handle    = task_handle;
-        ESP_LOGI(TAG, "echo back task created");
+        open_hdr_params[idx].core           = core;
+        conn_stat.opened++;
+        portEXIT_CRITICAL(&conn_mux);
+        ESP_LOGI(TAG, "%s task created", task_desc);
+        if (task_func == spp_data_task) {
+            // outboxの未確認データ送信開始
+            spp_outbox_link_up(fd);
+        }
     }
     else {
         ESP_LOGE(TAG, "echo back task create error %d", ret);
+        // データタスクなしで終了した扱いにする(ESP_SPP_CLOSE_EVT で解放)
+        portENTER_CRITICAL(&conn_mux);
+        open_hdr_params[idx].worker_done    = true;
+        open_hdr_params[idx].stop           = true;
+        open_hdr_params[idx].stop_tick      = xTaskGetTickCount();
+        portEXIT_CRITICAL(&conn_mux);
+        esp_spp_disconnect(bd_handle);
     }
 
     return;
 }
 
+// ================================================================================================
+// 停止要求(ロック取得済みで呼ぶこと)
+// return   データタスクへの停止要求を新たに出したら true
+// ================================================================================================
+static bool conn_request_stop(struct _open_hdr_params* p, bool local)
+{
+    if (p->stop) {
+        return false;
+    }
+    p->stop         = true;
+    p->local_close  = local;
+    p->stop_tick    = xTaskGetTickCount();
+    if (local) {
+        conn_stat.local++;
+    }
+    return true;
+}
+
+// ================================================================================================
+// データタスクの終了と ESP_SPP_CLOSE_EVT の両方が揃ったらパラメータテーブルを解放する(ロック取得済みで呼ぶこと)
+// ================================================================================================
+static void conn_release_if_done(struct _open_hdr_params* p)
+{
+    if (p->use && p->closed && p->worker_done) {
+        p->use = false;
+        conn_stat.released++;
+        uint32_t conn_ms = (xTaskGetTickCount() - p->open_tick) * portTICK_PERIOD_MS;
+        if (p->server >= 0) {
+            struct _spp_server_stat* st = &spp_servers[p->server].stat;
+            st->active--;
+            st->closed++;
+            st->conn_ms += conn_ms;
+        }
+        spp_metrics_add(MET_CONN_CLOSE, CONN_SVC_LABEL(p->server), 1);
+        spp_metrics_add(MET_CONN_ACTIVE, CONN_SVC_LABEL(p->server), -1);
+        spp_metrics_observe(MET_CONN_TIME, CONN_SVC_LABEL(p->server), conn_ms);
+        spp_mem_conn_close(p - open_hdr_params);
+    }
+}
+
+// ================================================================================================
+// 停止要求を出したときの後始末(他のモジュールへの通知)
+// ================================================================================================
+static void conn_notify_stop(int idx, int fd)
+{
+    spp_outbox_link_down(fd);
+    spp_relay_close(idx);
+    spp_agg_close(idx);
+    spp_cap_close(idx);
+}
+
 // ================================================================================================
 // SPP close event handler(クローズイベント時の処理)
+//     データタスクは削除せず、停止要求を出して自分で終了させる
 // ================================================================================================
 void spp_close_handler(uint32_t bd_handle)
 {
-    int             idx;
-    
+    struct _open_hdr_params*    p = NULL;
+    bool                        notify = false;
+    int                         fd = -1;
+    int                         idx;
+
+    portENTER_CRITICAL(&conn_mux);
     for (idx = 0; idx < OPEN_HDR_NUM; idx++) {
-        if (open_hdr_params[idx].use && open_hdr_params[idx].bd_handle == bd_handle) {
+        if (open_hdr_params[idx].use && !open_hdr_params[idx].closed && open_hdr_params[idx].bd_handle == bd_handle) {
             // 対象のパラメータテーブルが見つかった
+            p = &open_hdr_params[idx];
+            p->closed   = true;
+            notify      = conn_request_stop(p, false);
+            fd          = p->fd;
+            conn_release_if_done(p);
             break;
         }
     }
-    if (idx >= OPEN_HDR_NUM) {
-        ESP_LOGE(TAG, "Tasks reached the upper limit");
+    portEXIT_CRITICAL(&conn_mux);
+    if (p == NULL) {
+        ESP_LOGW(TAG, "handle %d not found", bd_handle);
         return;
     }
-    ESP_LOGV(TAG, "Parameter table index : %d", idx);
-    
-    ESP_LOGI(TAG, "echo back task tarminate");
-    vTaskDelete(open_hdr_params[idx].task_handle);
-    open_hdr_params[idx].use = false;
 
+    ESP_LOGI(TAG, "connection closed : handle = %d  fd = %d", bd_handle, fd);
+    if (notify) {
+        conn_notify_stop(idx, fd);
+    }
     return;
 }
 
+// ================================================================================================
+// こちらから切断する(データタスクが未送信データを送り切ってから切断する)
+// ================================================================================================
+void spp_close_handle(uint32_t bd_handle)
+{
+    bool    notify = false;
+    int     fd = -1;
+    int     idx;
+
+    portENTER_CRITICAL(&conn_mux);
+    for (idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        if (open_hdr_params[idx].use && open_hdr_params[idx].bd_handle == bd_handle) {
+            notify  = conn_request_stop(&open_hdr_params[idx], true);
+            fd      = open_hdr_params[idx].fd;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&conn_mux);
+    if (notify) {
+        ESP_LOGI(TAG, "close handle %d", bd_handle);
+        conn_notify_stop(idx, fd);
+    }
+}
+
 // ================================================================================================
 // Close all BD handle
 // ================================================================================================
@@ -153,11 +469,262 @@ void spp_close_all_handle(void)
     
     for (idx = 0; idx < OPEN_HDR_NUM; idx++) {
         if (open_hdr_params[idx].use ) {
-            ESP_LOGI(TAG, "close handle %d", open_hdr_params[idx].bd_handle);
             // 切断処理
-            esp_spp_disconnect(open_hdr_params[idx].bd_handle);
-            open_hdr_params[idx].use = false;
+            spp_close_handle(open_hdr_params[idx].bd_handle);
         }
     }
     return;
 }
+
+// ================================================================================================
+// 接続の fd(データタスクから呼ぶ)
+//     データタスクが終了するまでパラメータテーブルは解放されないので、添字で参照してよい
+// ================================================================================================
+int spp_conn_fd(int conn)
+{
+    return (conn >= 0 && conn < OPEN_HDR_NUM) ? open_hdr_params[conn].fd : -1;
+}
+
+// ================================================================================================
+// 停止要求が出ているか(データタスクから呼ぶ)
+// ================================================================================================
+bool spp_conn_stopping(int conn)
+{
+    return (conn >= 0 && conn < OPEN_HDR_NUM) && open_hdr_params[conn].stop;
+}
+
+// ================================================================================================
+// 未送信データを送ってよいか(こちらから切断中で、期限内)
+// ================================================================================================
+bool spp_conn_draining(int conn)
+{
+    struct _open_hdr_params*    p;
+    bool                        drain;
+
+    if (conn < 0 || conn >= OPEN_HDR_NUM) {
+        return false;
+    }
+    p = &open_hdr_params[conn];
+    portENTER_CRITICAL(&conn_mux);
+    drain = p->stop && p->local_close && !p->closed
+         && xTaskGetTickCount() - p->stop_tick < SPP_CONN_DRAIN_MS / portTICK_PERIOD_MS;
+    portEXIT_CRITICAL(&conn_mux);
+    return drain;
+}
+
+// ================================================================================================
+// 強制終了したときの資源の返却関数の登録(データタスクから呼ぶ、NULL:解除)
+//     監視タスクがデータタスクを削除した後に呼ぶので、引数はデータタスクのスタック以外に置くこと
+// ================================================================================================
+void spp_conn_set_cleanup(int conn, void (*cleanup)(void* arg), void* arg)
+{
+    if (conn < 0 || conn >= OPEN_HDR_NUM) {
+        return;
+    }
+    portENTER_CRITICAL(&conn_mux);
+    open_hdr_params[conn].cleanup       = cleanup;
+    open_hdr_params[conn].cleanup_arg   = arg;
+    portEXIT_CRITICAL(&conn_mux);
+}
+
+// ================================================================================================
+// データタスクの終了(データタスクの最後に呼ぶ、戻らない)
+//     資源はすべて返却してから呼ぶこと
+//     監視タスクが削除中なら自分では削除せずに止まって待つ(削除済みのタスクを削除させない)
+// ================================================================================================
+void spp_conn_exit(int conn)
+{
+    struct _open_hdr_params*    p;
+    uint32_t                    bd_handle = 0;
+    bool                        disconnect = false;
+    bool                        killing = false;
+
+    if (conn < 0 || conn >= OPEN_HDR_NUM) {
+        vTaskDelete(NULL);
+        return;
+    }
+    p = &open_hdr_params[conn];
+    portENTER_CRITICAL(&conn_mux);
+    p->cleanup = NULL;
+    if (p->killing) {
+        killing = true;
+    }
+    else if (p->use && !p->worker_done) {
+        p->worker_done = true;
+        if (p->stop && p->local_close) {
+            conn_stat.drained++;
+        }
+        // 自分から終了したときや、こちらから切断するときはここで切断する
+        disconnect  = !p->closed;
+        bd_handle   = p->bd_handle;
+        conn_release_if_done(p);
+    }
+    portEXIT_CRITICAL(&conn_mux);
+
+    if (killing) {
+        while (1) {
+            vTaskSuspend(NULL);
+        }
+    }
+    if (disconnect) {
+        esp_spp_disconnect(bd_handle);
+    }
+    vTaskDelete(NULL);
+}
+
+// ================================================================================================
+// 実行中のデータタスクのスタックの最小空き量
+//     ロック中はデータタスクが終了できず、監視タスクも削除を始めないので、削除済みのタスクを参照することはない
+// return   データタスクが実行中なら true
+// ================================================================================================
+bool spp_conn_stack_hwm(int idx, UBaseType_t* hwm)
+{
+    bool    running;
+
+    portENTER_CRITICAL(&conn_mux);
+    running = open_hdr_params[idx].use && !open_hdr_params[idx].worker_done && !open_hdr_params[idx].killing
+           && open_hdr_params[idx].task_handle != NULL;
+    if (running) {
+        *hwm = uxTaskGetStackHighWaterMark(open_hdr_params[idx].task_handle);
+    }
+    portEXIT_CRITICAL(&conn_mux);
+    return running;
+}
+
+// ================================================================================================
+// データタスクの強制終了
+//     削除中の印(killing)を付けてから削除するので、データタスクが自分を削除したタスクを削除することはない
+//     削除後に登録された関数で資源を返却してから、終了したことにする
+// ================================================================================================
+static void conn_kill(struct _open_hdr_params* p, TaskHandle_t task)
+{
+    void    (*cleanup)(void* arg);
+    void*   arg;
+
+    vTaskDelete(task);
+
+    portENTER_CRITICAL(&conn_mux);
+    cleanup         = p->cleanup;
+    arg             = p->cleanup_arg;
+    p->cleanup      = NULL;
+    portEXIT_CRITICAL(&conn_mux);
+    if (cleanup != NULL) {
+        cleanup(arg);
+    }
+
+    portENTER_CRITICAL(&conn_mux);
+    p->killing      = false;
+    p->worker_done  = true;
+    conn_stat.forced++;
+    conn_release_if_done(p);
+    portEXIT_CRITICAL(&conn_mux);
+}
+
+// ================================================================================================
+// 監視タスク
+//     期限内に終了しないデータタスクを削除し、切断されないままの接続を切断する
+// ================================================================================================
+static void conn_watch_task(void* param)
+{
+    while (1) {
+        vTaskDelay(SPP_CONN_WATCH_MS / portTICK_PERIOD_MS);
+        for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+            struct _open_hdr_params*    p = &open_hdr_params[idx];
+            TaskHandle_t                kill = NULL;
+            bool                        disconnect = false;
+            uint32_t                    bd_handle;
+
+            portENTER_CRITICAL(&conn_mux);
+            if (p->use && p->stop && xTaskGetTickCount() - p->stop_tick >= SPP_CONN_STOP_MS / portTICK_PERIOD_MS) {
+                if (!p->worker_done && p->task_handle != NULL) {
+                    kill            = p->task_handle;
+                    p->killing      = true;
+                }
+                // 切断要求への応答がないときは再度要求する(応答がないままなら切断済みとみなす)
+                if (!p->closed && p->disc_retry++ >= SPP_CONN_DISC_RETRY) {
+                    p->closed = true;
+                }
+                disconnect      = !p->closed;
+                bd_handle       = p->bd_handle;
+                p->stop_tick    = xTaskGetTickCount();
+                conn_release_if_done(p);
+            }
+            portEXIT_CRITICAL(&conn_mux);
+
+            if (kill != NULL) {
+                ESP_LOGW(TAG, "data task for handle %d did not stop, deleted", bd_handle);
+                conn_kill(p, kill);
+            }
+            if (disconnect) {
+                esp_spp_disconnect(bd_handle);
+            }
+        }
+        // 接続/解放後のメモリ使用量の確定
+        spp_mem_poll();
+        // ペアリング済みデバイスの使用順の保存
+        spp_bond_poll(false);
+    }
+}
+
+// ================================================================================================
+// 初期化(監視タスクの生成)
+// ================================================================================================
+esp_err_t spp_conn_init(void)
+{
+    if (xTaskCreate(conn_watch_task, "conn_watch", 2048, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+// ================================================================================================
+// 接続の終了の統計を取得する
+// ================================================================================================
+void spp_conn_get_stat(struct _spp_conn_stat* stat)
+{
+    portENTER_CRITICAL(&conn_mux);
+    *stat = conn_stat;
+    portEXIT_CRITICAL(&conn_mux);
+}
+
+// ================================================================================================
+// 接続の状態表示
+// ================================================================================================
+void spp_conn_show(void)
+{
+    struct _spp_conn_stat   st;
+
+    spp_conn_get_stat(&st);
+
+    printf("    opened %u  released %u  local close %u (drained %u)  forced %u\n",
+            st.opened, st.released, st.local, st.drained, st.forced);
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        struct _open_hdr_params* p = &open_hdr_params[idx];
+        if (p->use) {
+            printf("    [%d] %s  handle %d  fd %d  %s  %s%s%s\n", idx, bdaddr_to_str(p->bda, NULL), p->bd_handle, p->fd,
+                    (p->server >= 0) ? spp_servers[p->server].name : "client",
+                    p->stop ? (p->local_close ? "stopping(local) " : "stopping ") : "open ",
+                    p->closed ? "closed " : "", p->worker_done ? "task done" : "");
+        }
+    }
+    spp_server_show();
+}
+
+// ================================================================================================
+// サーバごとの状態表示
+// ================================================================================================
+void spp_server_show(void)
+{
+    printf("    server       scn  sec   max  active/peak  accepted  rejected  closed  avg ms\n");
+    for (int i = 0; i < spp_server_num; i++) {
+        struct _spp_server*     srv = &spp_servers[i];
+        struct _spp_server_stat st;
+
+        portENTER_CRITICAL(&conn_mux);
+        st = srv->stat;
+        portEXIT_CRITICAL(&conn_mux);
+        printf("    %-12s %3d  0x%02x  %3d  %6d/%-4d  %8u  %8u  %6u  %6" PRIu64 "\n", srv->name,
+                (srv->listen_handle != 0) ? srv->scn : 0, srv->sec_mask, srv->max_conn, st.active, st.peak,
+                st.accepted, st.rejected, st.closed, (st.closed > 0) ? st.conn_ms / st.closed : 0);
+    }
+}
@@ -8,6 +8,23 @@
 
 
 #define OPEN_HDR_NUM    8           // パラメータテーブル数
+#define SPP_CONN_DRAIN_MS   1000    // こちらから切断するときに未送信データを送り切るまでの期限
+#define SPP_CONN_STOP_MS    3000    // 停止要求からデータタスクの終了を待つ期限(過ぎたら強制終了)
+#define SPP_CONN_WATCH_MS   100     // 監視周期
+#define SPP_CONN_DISC_RETRY 3       // 切断の再要求回数(超えたら切断済みとみなす)
+
+// 接続の終了手順
+//     0. データタスクのパラメータはパラメータテーブルの添字(conn)で、fd は spp_conn_fd() で得る
+//        (fd は切断後の次の接続で再利用されるので、データタスクの識別には使わない)
+//     1. 停止要求 : ESP_SPP_CLOSE_EVT(相手から切断)または spp_close_handle()(こちらから切断)
+//     2. データタスクは spp_conn_stopping() で停止要求を知り、こちらから切断するときは未送信データを
+//        spp_conn_draining() の間だけ送り切り、資源を返却して spp_conn_exit() で終了する
+//     3. データタスクが終了したときにまだ接続中なら esp_spp_disconnect() で切断する
+//     4. データタスクの終了と ESP_SPP_CLOSE_EVT の両方が揃ったらパラメータテーブルを解放する
+//     SPP_CONN_STOP_MS 以内に終了しないデータタスクは監視タスクが削除する(強制終了)
+//         削除中(killing)はデータタスクが spp_conn_exit() に来ても自分を削除せずに監視タスクを待つ
+//         削除後に spp_conn_set_cleanup() で登録された関数で資源を返却してからパラメータテーブルを解放する
+//         データタスクは自分で資源を返却する前に登録を解除(NULL)すること
 
 // パラメータテーブル
 struct _open_hdr_params {
@@ -16,10 +33,79 @@ struct _open_hdr_params {
     uint32_t        bd_handle;
     int             fd;
     TaskHandle_t    task_handle;
+    TaskFunction_t  task_func;      // データタスクの処理関数
+    int             core;           // データタスクを配置したコア(-1:未生成)
+    int             task_class;     // 接続の種類(SPP_TASK_CLASS_xxx)
+    int             pipe_chain;     // 処理パイプラインの chain(spp_data_task のみ)
+    int             server;         // 接続を受け付けたサーバ(spp_servers[] の添字、-1:クライアント接続)
+    TickType_t      open_tick;      // 接続した時刻
+    volatile bool   stop;           // 停止要求
+    bool            local_close;    // こちらから切断
+    bool            closed;         // ESP_SPP_CLOSE_EVT 受信済み
+    bool            worker_done;    // データタスク終了済み
+    bool            killing;        // 監視タスクがデータタスクを削除中
+    void            (*cleanup)(void* arg);  // 強制終了したときの資源の返却(データタスクが登録)
+    void*           cleanup_arg;
+    TickType_t      stop_tick;      // 停止要求の時刻
+    uint8_t         disc_retry;     // 切断の再要求回数
+};
+
+// 接続の終了の統計
+struct _spp_conn_stat {
+    uint32_t        opened;
+    uint32_t        released;       // パラメータテーブルを解放した数
+    uint32_t        local;          // こちらから切断した数
+    uint32_t        drained;        // 期限内に終了した数(こちらから切断)
+    uint32_t        forced;         // 強制終了した数
+};
+
+// サーバごとの統計
+struct _spp_server_stat {
+    uint32_t        accepted;       // 受け付けた接続数
+    uint32_t        rejected;       // 同時接続数の上限で切断した数
+    uint32_t        closed;         // 解放した接続数
+    uint16_t        active;         // 接続中の数
+    uint16_t        peak;           // 接続中の数の最大
+    uint64_t        conn_ms;        // 解放した接続の接続時間の合計
+};
+
+// SPPサーバテーブル
+//     spp_server_start_all() で先頭のサーバを開始し、ESP_SPP_START_EVT ごとに次のサーバを開始する
+//     接続時(ESP_SPP_SRV_OPEN_EVT)は listen handle でサーバを特定してデータタスクを切り替える
+//     セキュリティと同時接続数の上限はサーバごとに設定し、統計もサーバごとに集計する
+struct _spp_server {
+    const char*     name;           // サーバ名
+    TaskFunction_t  task_func;      // データタスクの処理関数
+    int             task_class;     // 接続の種類(SPP_TASK_CLASS_xxx)
+    int             pipe_chain;     // 処理パイプラインの chain の既定値(PIPE_CHAIN_xxx、spp_data_task のみ)
+    esp_spp_sec_t   sec_mask;       // セキュリティ(ESP_SPP_SEC_xxx)
+    int             max_conn;       // 同時接続数の上限(0:制限なし、OPEN_HDR_NUM が全体の上限)
+    bool            started;        // 開始済み
+    uint32_t        listen_handle;  // 接続待ちハンドル
+    uint8_t         scn;            // サーバチャネル
+    struct _spp_server_stat stat;
 };
 
 extern struct _open_hdr_params   open_hdr_params[];
-extern void spp_open_handler(uint32_t handle, int fd, esp_bd_addr_t bda);
+extern struct _spp_server        spp_servers[];
+extern const int                 spp_server_num;
+extern void spp_data_task(void* param);
+extern void spp_open_handler(uint32_t handle, int fd, esp_bd_addr_t bda, const struct _spp_server* server);
+extern bool spp_server_start_all(void);
+extern bool spp_server_start_next(void);
+extern void spp_server_started(bool success, uint32_t listen_handle, uint8_t scn);
+extern struct _spp_server* spp_server_accept(uint32_t handle, uint32_t new_listen_handle);
 extern void spp_close_handler(uint32_t bd_handle);
+extern void spp_close_handle(uint32_t bd_handle);
 extern void spp_close_all_handle(void);
+extern esp_err_t spp_conn_init(void);
+extern int spp_conn_fd(int conn);
+extern bool spp_conn_stopping(int conn);
+extern bool spp_conn_draining(int conn);
+extern void spp_conn_set_cleanup(int conn, void (*cleanup)(void* arg), void* arg);
+extern void spp_conn_exit(int conn);
+extern bool spp_conn_stack_hwm(int idx, UBaseType_t* hwm);
+extern void spp_conn_get_stat(struct _spp_conn_stat* stat);
+extern void spp_conn_show(void);
+extern void spp_server_show(void);
 
@@ -0,0 +1,184 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 接続と切断の繰り返しのベンチマーク
+//     CONC_NUM 接続を保ちながら、最も古い接続を切断して新しい接続を開始することを繰り返す
+//     サービス(エコーバック、RPC、配信ハブ、集約)は順に切り替え、fd は切断のたびに再利用される
+//     hang_every 接続に1回はデータタスクが read()/write() から戻らず、監視タスクが強制終了する
+//     最後にヒープ、プールのバッファ、タスク数、パラメータテーブルが最初の状態に戻ることを確認する
+//     ヒープは BLOCK_NUM 接続ごとに記録し、どの区間も同じ(増え続けない)ことを確認する
+//     ./bench_conn [-n 接続数] [-h 強制終了の間隔]
+
+#include <getopt.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_rpc.h"
+#include "spp_hub.h"
+#include "spp_agg.h"
+#include "host_conn.h"
+
+#define CONC_NUM        4
+#define STEP_MS         20
+#define WARMUP_NUM      500     // ヒープの基準を取る前の接続数(初回だけの割り当てを除く)
+#define BLOCK_NUM       500     // ヒープを記録する間隔(接続数)
+#define HEAP_SLACK      1024    // 基準との差の許容(ホストのmallocの管理領域の揺らぎ)
+
+static uint32_t     cycles      = 2000;
+static uint32_t     hang_every  = 25;
+
+struct _peer {
+    struct _test_link   link;           // 先頭に置く(test_link_* の ctx)
+    bool                hang;           // read()/write() から戻らない
+    int                 conn;
+};
+
+static const TaskFunction_t service[] = { spp_data_task, spp_rpc_task, spp_hub_task, spp_agg_task };
+#define SERVICE_NUM     (sizeof(service) / sizeof(service[0]))
+
+static void peer_hang(struct _peer* peer)
+{
+    while (peer->hang) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+    }
+}
+
+static int peer_read(void* ctx, int fd, void* buf, size_t len)
+{
+    peer_hang(ctx);
+    return test_link_read(ctx, fd, buf, len);
+}
+
+static int peer_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    peer_hang(ctx);
+    return test_link_write(ctx, fd, buf, len);
+}
+
+static const struct _host_vfs_ops peer_ops = {
+    .read   = peer_read,
+    .write  = peer_write,
+};
+
+static void peer_open(struct _peer* peer, uint32_t n)
+{
+    static const uint8_t    hello[] = "hello";
+    struct _spp_rpc_hdr     req = { .type = RPC_REQ, .len = sizeof(hello), .id = n, .method = SPP_RPC_M_ECHO };
+    TaskFunction_t          func = service[n % SERVICE_NUM];
+
+    memset(peer, 0, sizeof(*peer));
+    peer->hang      = (hang_every > 0 && n % hang_every == hang_every - 1);
+    peer->link.fd   = host_vfs_open(&peer_ops, peer);
+    CHECK(peer->link.fd >= 0);
+    if (func == spp_rpc_task) {
+        test_link_push(&peer->link, &req, sizeof(req));
+    }
+    test_link_push(&peer->link, hello, sizeof(hello));
+    peer->conn = test_conn_open(peer->link.fd, func);
+    CHECK(peer->conn >= 0);
+}
+
+// 切断 : 半分はリンクが切れてから(read() が -1)、残りは ESP_SPP_CLOSE_EVT だけで終了させる
+static void peer_close(struct _peer* peer, uint32_t n)
+{
+    if (n % 2 == 0) {
+        peer->link.closed = true;
+    }
+    test_conn_close(peer->conn);
+    peer->hang = false;
+    test_link_close(&peer->link);
+}
+
+// ================================================================================================
+// 接続 first から num 個の接続と切断を繰り返し、すべて切断して終わる
+// return   強制終了した数
+// ================================================================================================
+static uint32_t churn(uint32_t first, uint32_t num)
+{
+    static struct _peer peer[CONC_NUM];
+    uint32_t            hung = 0;
+
+    for (uint32_t n = first; n < first + num + CONC_NUM; n++) {
+        struct _peer* p = &peer[n % CONC_NUM];
+
+        if (n >= first + CONC_NUM) {
+            hung += p->hang;
+            peer_close(p, n - CONC_NUM);
+        }
+        if (n < first + num) {
+            peer_open(p, n);
+        }
+        vTaskDelay(pdMS_TO_TICKS(STEP_MS));
+    }
+    vTaskDelay(pdMS_TO_TICKS(500));
+    return hung;
+}
+
+int main(int argc, char** argv)
+{
+    struct _spp_conn_stat   st;
+    size_t                  heap_base;
+    size_t                  heap[64];
+    int                     heap_num = 0;
+    int                     tasks;
+    uint32_t                hung;
+    uint64_t                start;
+    int                     opt;
+
+    while ((opt = getopt(argc, argv, "n:h:")) != -1) {
+        switch (opt) {
+          case 'n' : cycles     = atoi(optarg); break;
+          case 'h' : hang_every = atoi(optarg); break;
+          default  :
+            fprintf(stderr, "usage: %s [-n connections] [-h hang_every]\n", argv[0]);
+            return 1;
+        }
+    }
+    CHECK(cycles >= BLOCK_NUM * 2 && cycles <= BLOCK_NUM * sizeof(heap) / sizeof(heap[0]));
+    printf("%u connections (%u services, %d at a time)  hang every %u\n", cycles, (unsigned)SERVICE_NUM, CONC_NUM, hang_every);
+    CHECK(spp_pipe_init() == ESP_OK);
+    CHECK(spp_rpc_init() == ESP_OK);
+    CHECK(spp_hub_init() == ESP_OK);
+    CHECK(spp_agg_init() == ESP_OK);
+    CHECK(spp_conn_init() == ESP_OK);
+    tasks = host_task_count();
+
+    hung        = churn(0, WARMUP_NUM);
+    heap_base   = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    start       = host_now_us();
+    for (uint32_t n = 0; n < cycles; n += BLOCK_NUM) {
+        hung += churn(WARMUP_NUM + n, (cycles - n < BLOCK_NUM) ? cycles - n : BLOCK_NUM);
+        heap[heap_num++] = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    }
+
+    spp_conn_get_stat(&st);
+    printf("%u hung  %u s (virtual)\n", hung, (unsigned)((host_now_us() - start) / 1000000));
+    printf("opened %u  released %u  forced %u\n", st.opened, st.released, st.forced);
+    printf("heap free : after warm-up %u", (unsigned)heap_base);
+    for (int i = 0; i < heap_num; i++) {
+        printf("  %u", (unsigned)heap[i]);
+    }
+    printf("\nbuffers free : %d / %d  tasks : %d / %d\n", spp_buf_free_num(), SPP_BUF_NUM, host_task_count(), tasks);
+    spp_conn_show();
+
+    CHECK(st.opened == WARMUP_NUM + cycles && st.released == st.opened && st.forced == hung);
+    for (int i = 0; i < OPEN_HDR_NUM; i++) {
+        CHECK(!open_hdr_params[i].use);
+    }
+    CHECK(spp_buf_free_num() == SPP_BUF_NUM);
+    CHECK(host_task_count() == tasks);
+    CHECK(heap[0] + HEAP_SLACK >= heap_base);
+    for (int i = 1; i < heap_num; i++) {
+        CHECK(heap[i] == heap[0]);
+    }
+    return 0;
+}
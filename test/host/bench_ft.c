@@ -0,0 +1,131 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ファイル転送のベンチマーク(ウィンドウ数 × 片方向遅延)
+//     spp_ft_task を遅延と帯域のあるリンクで動かし、ウィンドウ数1(stop-and-wait)と比べる
+//     受信側はフレームごとにACKを返し、受信データがファイルと一致することを確認する
+//     ./bench_ft [-s KB] [-b byte/s] [-w link_window]
+
+#include <getopt.h>
+#include <sys/stat.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_ft.h"
+#include "host_conn.h"
+
+#define FILE_NAME       "bench.bin"
+
+static uint8_t*     file_data;
+static uint32_t     file_size   = 128 * 1024;
+static uint32_t     link_bps    = 100 * 1024;
+static uint32_t     link_window = 16 * 1024;
+
+// ================================================================================================
+// 1回の転送
+// return   所要時間(us)
+// ================================================================================================
+static uint64_t run(uint32_t latency_ms, uint32_t window)
+{
+    struct _delay_link* link = delay_link_open(latency_ms, link_bps, link_window);
+    struct _spp_ft_hdr  hdr = { .type = FT_OPEN, .param = window, .len = strlen(FILE_NAME), .arg = 0 };
+    static uint8_t      rx[8192];
+    uint32_t            rx_len = 0;
+    uint32_t            expected = 0;
+    uint64_t            start;
+    bool                opened = false;
+    int                 conn = test_conn_open(link->fd, spp_ft_task);
+
+    CHECK(conn >= 0);
+    start = host_now_us();
+    delay_link_peer_write(link, &hdr, sizeof(hdr));
+    delay_link_peer_write(link, FILE_NAME, hdr.len);
+
+    while (expected < file_size) {
+        int n = delay_link_peer_read(link, &rx[rx_len], sizeof(rx) - rx_len, 10 * 1000000);
+        CHECK(n > 0);
+        rx_len += n;
+
+        uint32_t pos = 0;
+        while (rx_len - pos >= sizeof(hdr)) {
+            memcpy(&hdr, &rx[pos], sizeof(hdr));
+            if (rx_len - pos < sizeof(hdr) + hdr.len) {
+                break;
+            }
+            if (hdr.type == FT_RSP_OPEN) {
+                CHECK(hdr.param == FT_ST_OK && hdr.arg == file_size);
+                opened = true;
+            }
+            else {
+                // フレーム境界がずれていれば type/データが合わない
+                CHECK(opened && hdr.type == FT_DATA);
+                if (hdr.arg == expected) {
+                    CHECK(memcmp(&rx[pos + sizeof(hdr)], &file_data[expected], hdr.len) == 0);
+                    expected += hdr.len;
+                    struct _spp_ft_hdr ack = { .type = FT_ACK, .arg = expected };
+                    delay_link_peer_write(link, &ack, sizeof(ack));
+                }
+            }
+            pos += sizeof(hdr) + hdr.len;
+        }
+        memmove(rx, &rx[pos], rx_len - pos);
+        rx_len -= pos;
+    }
+    uint64_t elapsed = host_now_us() - start;
+
+    hdr.type = FT_CLOSE;
+    hdr.len  = 0;
+    delay_link_peer_write(link, &hdr, sizeof(hdr));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    link->closed = true;
+    test_conn_close(conn);
+    delay_link_close(link);
+    return elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    static const uint32_t   latency[] = { 10, 50, 150 };
+    static const uint32_t   window[]  = { 1, 2, 4, 8, 16, 32 };
+    int                     opt;
+    FILE*                   fp;
+
+    while ((opt = getopt(argc, argv, "s:b:w:")) != -1) {
+        switch (opt) {
+          case 's' : file_size   = atoi(optarg) * 1024; break;
+          case 'b' : link_bps    = atoi(optarg); break;
+          case 'w' : link_window = atoi(optarg); break;
+          default  :
+            fprintf(stderr, "usage: %s [-s KB] [-b byte/s] [-w link_window]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    file_data = malloc(file_size);
+    for (uint32_t i = 0; i < file_size; i++) {
+        file_data[i] = (uint8_t)((i * 2654435761u) >> 11);
+    }
+    mkdir(SPP_FT_BASE_PATH, 0755);
+    fp = fopen(SPP_FT_BASE_PATH "/" FILE_NAME, "wb");
+    CHECK(fp != NULL && fwrite(file_data, 1, file_size, fp) == file_size);
+    fclose(fp);
+
+    printf("file %u byte  link %u byte/s  credit window %u byte\n", file_size, link_bps, link_window);
+    printf("latency  window      time   throughput\n");
+    for (int l = 0; l < sizeof(latency) / sizeof(latency[0]); l++) {
+        for (int w = 0; w < sizeof(window) / sizeof(window[0]); w++) {
+            uint64_t us = run(latency[l], window[w]);
+            printf("%5u ms  %6u  %6u ms  %6u byte/s%s\n", latency[l], window[w], (unsigned)(us / 1000),
+                   (unsigned)((uint64_t)file_size * 1000000 / us), (window[w] == 1) ? "  (stop-and-wait)" : "");
+        }
+    }
+    unlink(SPP_FT_BASE_PATH "/" FILE_NAME);
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 配信ハブのベンチマーク(SPP_HUB_SUB_MAX 接続)
+//     一定間隔でレコードを登録し、帯域の違う接続ごとに受信したレコード数と読み飛ばし数、バッファの使用数を表示する
+//     購読者がいない間と全員が切断したあとは、リングがプールのバッファを保持しないことを確認する
+//     ./bench_hub [-t 登録時間ms] [-i 登録間隔ms] [-l 片方向遅延ms]
+
+#include <getopt.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_hub.h"
+#include "host_conn.h"
+
+#define REC_LEN         256
+
+static uint32_t     run_ms      = 5000;
+static uint32_t     interval_ms = 10;
+static uint32_t     latency_ms  = 20;
+
+struct _client {
+    struct _delay_link* link;
+    int                 conn;
+    uint32_t            bps;
+    uint32_t            recs;           // 受信したレコード数
+    uint32_t            gaps;           // 読み飛ばされたレコード数
+    uint32_t            next;           // 次に期待するシーケンス番号
+    bool                first;
+    uint8_t             rx[REC_LEN];
+    uint32_t            rx_len;
+};
+
+static struct _client   clients[SPP_HUB_SUB_MAX];
+static volatile bool    running;
+
+// ================================================================================================
+// 相手側の受信(レコードのシーケンス番号と内容を確認する)
+// ================================================================================================
+static void client_task(void* param)
+{
+    struct _client* c = param;
+
+    while (running) {
+        int n = delay_link_peer_read(c->link, &c->rx[c->rx_len], REC_LEN - c->rx_len, 100 * 1000);
+        c->rx_len += n;
+        if (c->rx_len < REC_LEN) {
+            continue;
+        }
+        uint32_t seq;
+        memcpy(&seq, c->rx, sizeof(seq));
+        for (int i = sizeof(seq); i < REC_LEN; i++) {
+            CHECK(c->rx[i] == (uint8_t)(seq + i));
+        }
+        if (c->first) {
+            CHECK(seq >= c->next);
+            c->gaps += seq - c->next;
+        }
+        c->first    = true;
+        c->next     = seq + 1;
+        c->recs++;
+        c->rx_len   = 0;
+    }
+    vTaskDelete(NULL);
+}
+
+static void publish(uint32_t seq)
+{
+    uint8_t rec[REC_LEN];
+
+    memcpy(rec, &seq, sizeof(seq));
+    for (int i = sizeof(seq); i < REC_LEN; i++) {
+        rec[i] = (uint8_t)(seq + i);
+    }
+    CHECK(spp_hub_publish(rec, sizeof(rec)) == ESP_OK);
+}
+
+int main(int argc, char** argv)
+{
+    int         opt;
+    int         tasks;
+    int         min_free = SPP_BUF_NUM;
+    uint32_t    seq = 0;
+
+    while ((opt = getopt(argc, argv, "t:i:l:")) != -1) {
+        switch (opt) {
+          case 't' : run_ms      = atoi(optarg); break;
+          case 'i' : interval_ms = atoi(optarg); break;
+          case 'l' : latency_ms  = atoi(optarg); break;
+          default  :
+            fprintf(stderr, "usage: %s [-t run_ms] [-i interval_ms] [-l latency_ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    CHECK(spp_hub_init() == ESP_OK);
+    tasks = host_task_count();
+
+    // 購読者がいない間はバッファを保持しない
+    for (int i = 0; i < SPP_HUB_RING * 2; i++) {
+        publish(seq++);
+    }
+    CHECK(spp_buf_free_num() == SPP_BUF_NUM);
+
+    // 帯域の違う接続 : 半分は登録レートより十分速く、残りは 1/2, 1/4, 1/8 ...
+    running = true;
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        struct _client* c = &clients[i];
+        uint32_t        rate = REC_LEN * 1000 / interval_ms;
+        c->bps  = (i < SPP_HUB_SUB_MAX / 2) ? rate * 4 : rate >> (i - SPP_HUB_SUB_MAX / 2 + 1);
+        c->link = delay_link_open(latency_ms, c->bps, 2048);
+        c->conn = test_conn_open(c->link->fd, spp_hub_task);
+        CHECK(c->conn >= 0);
+        CHECK(xTaskCreate(client_task, "client", 4096, c, 4, NULL) == pdPASS);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    for (uint32_t t = 0; t < run_ms; t += interval_ms) {
+        publish(seq++);
+        if (spp_buf_free_num() < min_free) {
+            min_free = spp_buf_free_num();
+        }
+        vTaskDelay(pdMS_TO_TICKS(interval_ms));
+    }
+    vTaskDelay(pdMS_TO_TICKS(latency_ms * 2 + 500));
+
+    printf("%u clients  %u records of %u byte every %u ms  one-way latency %u ms\n",
+           SPP_HUB_SUB_MAX, run_ms / interval_ms, REC_LEN, interval_ms, latency_ms);
+    printf("client   link byte/s   received    skipped\n");
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        printf("%6d  %12u  %9u  %9u\n", i, clients[i].bps, clients[i].recs, clients[i].gaps);
+    }
+    printf("buffers in use : max %d / %d (ring %d)\n", SPP_BUF_NUM - min_free, SPP_BUF_NUM, SPP_HUB_RING);
+    spp_hub_show();
+
+    // 全員切断 → リングのバッファも返却される
+    running = false;
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        clients[i].link->closed = true;
+    }
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        test_conn_close(clients[i].conn);
+    }
+    vTaskDelay(pdMS_TO_TICKS(500));
+    CHECK(host_task_count() == tasks);
+    CHECK(spp_buf_free_num() == SPP_BUF_NUM);
+    for (int i = 0; i < SPP_HUB_SUB_MAX; i++) {
+        delay_link_close(clients[i].link);
+    }
+    return 0;
+}
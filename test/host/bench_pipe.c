@@ -0,0 +1,218 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 処理パイプライン(spp_pipe.c)の段ごとのオーバーヘッドのベンチマーク
+//     リンクの速さで1秒分の NMEA形式の行(一部はチェックサム不一致)を read() の大きさごとにバッファに入れて流す
+//     chain ごとに先頭の k 段だけのパイプラインで流したときのCPU時間の差を、k 段目のオーバーヘッドとする
+//     (k = 0 は段なし : バッファの受け渡しと返却だけ)
+//     仮想時刻ではなくこのスレッドのCPU時間で計り、リンクの速さで流したときのCPUの使用率(1コア)も表示する
+//     ./bench_pipe [-r リンクの速さbyte/s] [-s read()の大きさ] [-n 繰り返し回数]
+
+#include <getopt.h>
+#include <time.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_pipe.h"
+#include "spp_hub.h"
+
+#define INPUT_MAX       (4 * 1024 * 1024)
+#define BAD_EVERY       10              // チェックサムを壊す行の間隔
+
+static uint32_t     link_bps    = 200 * 1024;
+static uint32_t     read_size   = SPP_BUF_SIZE;
+static uint32_t     reps        = 5;
+
+static uint8_t      input[INPUT_MAX];
+static uint32_t     input_len;
+static uint32_t     good_lines, bad_lines;
+static uint32_t     good_bytes;
+static uint64_t     sink_bytes;         // echo が書いたバイト数
+
+static const char*  chain_name[PIPE_CHAIN_NUM] = { "echo", "upper", "nmea" };
+static const char*  stage_name[PIPE_STAGE_NUM] = { "outbox", "log", "line", "cksum", "upper", "echo", "hub" };
+
+// echo の書き込み先(受け付けて捨てる)
+static int sink_read(void* ctx, int fd, void* buf, size_t len)
+{
+    return 0;
+}
+
+static int sink_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    sink_bytes += len;
+    return len;
+}
+
+static const struct _host_vfs_ops sink_ops = {
+    .read   = sink_read,
+    .write  = sink_write,
+};
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 入力 : 英小文字を含む NMEA形式の行を link_bps バイト分
+static void make_input(void)
+{
+    char        line[96];
+
+    input_len = good_lines = bad_lines = good_bytes = 0;
+    for (uint32_t n = 0; ; n++) {
+        uint8_t sum = 0;
+        int     len = snprintf(line, sizeof(line), "$gpgga,%06u.00,3539.%04u,n,13945.%04u,e,1,08,0.9,%u.%u,m,,",
+                               n % 240000, n % 10000, (n * 7) % 10000, 20 + n % 30, n % 10);
+        for (int i = 1; i < len; i++) {
+            sum ^= line[i];
+        }
+        if (n % BAD_EVERY == BAD_EVERY - 1) {
+            sum ^= 0x5a;
+        }
+        len += snprintf(&line[len], sizeof(line) - len, "*%02X\r\n", sum);
+        if (input_len + len > link_bps) {
+            break;
+        }
+        memcpy(&input[input_len], line, len);
+        input_len += len;
+        if (n % BAD_EVERY == BAD_EVERY - 1) {
+            bad_lines++;
+        }
+        else {
+            good_lines++;
+            good_bytes += len;
+        }
+    }
+}
+
+// ================================================================================================
+// chain の先頭の num 段だけで入力を流す
+// return   spp_pipe_push() のCPU時間の合計(ns)
+// ================================================================================================
+static uint64_t run(int fd, int chain, int num, struct _spp_pipe_stat stat[])
+{
+    struct _spp_pipe*   pipe = spp_pipe_create(fd, 0, chain);
+    uint64_t            ns = 0;
+
+    CHECK(pipe != NULL);
+    pipe->num = num;            // 後ろの段を外す(最後の段が渡したバッファは返却される)
+    sink_bytes = 0;
+    for (uint32_t pos = 0; pos < input_len; pos += read_size) {
+        struct _spp_buf*    buf = spp_buf_alloc(0);
+        uint32_t            n = (input_len - pos < read_size) ? input_len - pos : read_size;
+        uint64_t            t;
+
+        CHECK(buf != NULL);
+        memcpy(buf->data, &input[pos], n);
+        buf->off    = 0;
+        buf->len    = n;
+        t = cpu_ns();
+        spp_pipe_push(pipe, buf);
+        ns += cpu_ns() - t;
+    }
+    memcpy(stat, pipe->stat, sizeof(pipe->stat));
+    spp_pipe_destroy(pipe);
+    CHECK(spp_buf_free_num() == SPP_BUF_NUM);
+    return ns;
+}
+
+// ================================================================================================
+// 1つの chain の段ごとのオーバーヘッド
+// ================================================================================================
+static void bench_chain(int fd, int chain)
+{
+    struct _spp_pipe*       pipe = spp_pipe_create(fd, 0, chain);
+    struct _spp_pipe_stat   stat[SPP_PIPE_STAGE_MAX];
+    uint8_t                 stage[SPP_PIPE_STAGE_MAX];
+    uint64_t                best[SPP_PIPE_STAGE_MAX + 1];
+    uint64_t                link_ns = (uint64_t)input_len * 1000000000 / link_bps;
+    int                     num;
+
+    CHECK(pipe != NULL);
+    num = pipe->num;
+    memcpy(stage, pipe->stage, sizeof(stage));
+    spp_pipe_destroy(pipe);
+
+    for (int k = 0; k <= num; k++) {
+        best[k] = UINT64_MAX;
+        for (uint32_t r = 0; r < reps; r++) {
+            uint64_t ns = run(fd, chain, k, stat);
+            if (ns < best[k]) {
+                best[k] = ns;
+            }
+        }
+    }
+
+    // 全段で流したときの結果
+    printf("chain %s\n", chain_name[chain]);
+    printf("  stage       calls   in(byte)  out(byte) dropped   ns/call  ns/byte  cpu at link rate\n");
+    printf("  (none)   %8u %10u %10s %7s %9u %8.2f  %6.3f %%\n", (input_len + read_size - 1) / read_size, input_len, "-", "-",
+           (unsigned)(best[0] / ((input_len + read_size - 1) / read_size)), (double)best[0] / input_len, (double)best[0] * 100 / link_ns);
+    for (int k = 1; k <= num; k++) {
+        const struct _spp_pipe_stat*    st = &stat[k - 1];
+        uint64_t                        ns = (best[k] > best[k - 1]) ? best[k] - best[k - 1] : 0;
+
+        printf("  %-8s %8u %10u %10u %7u %9u %8.2f  %6.3f %%\n", stage_name[stage[k - 1]], st->calls, st->bytes_in,
+               st->bytes_out, st->dropped, (st->calls > 0) ? (unsigned)(ns / st->calls) : 0,
+               (st->bytes_in > 0) ? (double)ns / st->bytes_in : 0, (double)ns * 100 / link_ns);
+    }
+    printf("  total    %57.2f  %6.3f %%\n", (double)best[num] / input_len, (double)best[num] * 100 / link_ns);
+
+    // 出力の確認
+    CHECK(stat[0].bytes_in == input_len);
+    switch (chain) {
+      case PIPE_CHAIN_ECHO :
+      case PIPE_CHAIN_UPPER :
+        CHECK(sink_bytes == input_len);
+        CHECK(stat[num - 1].bytes_out == input_len);
+        break;
+      case PIPE_CHAIN_NMEA :
+        CHECK(stat[0].bytes_out == input_len && stat[0].calls == (input_len + read_size - 1) / read_size);
+        CHECK(stat[1].calls == good_lines + bad_lines && stat[1].dropped == bad_lines);
+        CHECK(stat[2].calls == good_lines && stat[2].bytes_out == good_bytes);
+        break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int     fd;
+    int     opt;
+
+    while ((opt = getopt(argc, argv, "r:s:n:")) != -1) {
+        switch (opt) {
+          case 'r' : link_bps   = atoi(optarg); break;
+          case 's' : read_size  = atoi(optarg); break;
+          case 'n' : reps       = atoi(optarg); break;
+          default  :
+            fprintf(stderr, "usage: %s [-r link_byte_per_sec] [-s read_size] [-n repeat]\n", argv[0]);
+            return 1;
+        }
+    }
+    CHECK(link_bps <= INPUT_MAX && read_size > 0 && read_size <= SPP_BUF_SIZE && reps > 0);
+    CHECK(spp_pipe_init() == ESP_OK);
+    CHECK(spp_hub_init() == ESP_OK);
+    fd = host_vfs_open(&sink_ops, NULL);
+    CHECK(fd >= 0);
+    make_input();
+
+    printf("input %u byte (%u lines, %u bad checksum)  read %u byte  link %u byte/s  best of %u\n",
+           input_len, good_lines + bad_lines, bad_lines, read_size, link_bps, reps);
+    for (int c = 0; c < PIPE_CHAIN_NUM; c++) {
+        bench_chain(fd, c);
+    }
+    host_vfs_close(fd);
+    return 0;
+}
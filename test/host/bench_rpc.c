@@ -0,0 +1,172 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// RPCのベンチマーク
+//     1. 要求元のウィンドウ数(1～SPP_RPC_WINDOW)ごとに、sleep要求を連続して処理したときの処理数と応答時間
+//     2. 別の接続が待ちの長い要求でウィンドウを使い切っているときの echo の応答時間
+//     ./bench_rpc [-n 要求数] [-l 片方向遅延ms] [-t sleep ms]
+
+#include <getopt.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_rpc.h"
+#include "host_conn.h"
+
+static uint32_t     req_num     = 64;
+static uint32_t     latency_ms  = 20;
+static uint32_t     sleep_ms    = 50;
+
+struct _client {
+    struct _delay_link* link;
+    int                 conn;
+    uint8_t             rx[4096];
+    uint32_t            rx_len;
+};
+
+static void client_open(struct _client* c)
+{
+    memset(c, 0, sizeof(*c));
+    c->link = delay_link_open(latency_ms, 100 * 1024, 8192);
+    c->conn = test_conn_open(c->link->fd, spp_rpc_task);
+    CHECK(c->conn >= 0);
+}
+
+static void client_close(struct _client* c)
+{
+    c->link->closed = true;
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    test_conn_close(c->conn);
+    delay_link_close(c->link);
+}
+
+static void client_req(struct _client* c, uint16_t id, uint16_t method, uint32_t timeout_ms, const void* data, uint16_t len)
+{
+    struct _spp_rpc_hdr hdr = { .type = RPC_REQ, .len = len, .id = id, .method = method, .timeout_ms = timeout_ms };
+
+    delay_link_peer_write(c->link, &hdr, sizeof(hdr));
+    delay_link_peer_write(c->link, data, len);
+}
+
+// 応答を1つ受信
+static struct _spp_rpc_hdr client_rsp(struct _client* c)
+{
+    struct _spp_rpc_hdr hdr;
+
+    while (1) {
+        if (c->rx_len >= sizeof(hdr)) {
+            memcpy(&hdr, c->rx, sizeof(hdr));
+            if (c->rx_len >= sizeof(hdr) + hdr.len) {
+                CHECK(hdr.type == RPC_RSP);
+                c->rx_len -= sizeof(hdr) + hdr.len;
+                memmove(c->rx, &c->rx[sizeof(hdr) + hdr.len], c->rx_len);
+                return hdr;
+            }
+        }
+        int n = delay_link_peer_read(c->link, &c->rx[c->rx_len], sizeof(c->rx) - c->rx_len, 30 * 1000000);
+        CHECK(n > 0);
+        c->rx_len += n;
+    }
+}
+
+// ================================================================================================
+// 1. ウィンドウ数ごとの処理数
+// ================================================================================================
+static void bench_window(uint32_t window)
+{
+    struct _client  c;
+    static uint64_t sent_us[65536];
+    uint64_t        start, total_lat = 0, max_lat = 0;
+    uint32_t        sent = 0, done = 0;
+
+    client_open(&c);
+    start = host_now_us();
+    while (done < req_num) {
+        while (sent < req_num && sent - done < window) {
+            sent_us[sent] = host_now_us();
+            client_req(&c, sent, SPP_RPC_M_SLEEP, 0, &sleep_ms, sizeof(sleep_ms));
+            sent++;
+        }
+        struct _spp_rpc_hdr hdr = client_rsp(&c);
+        CHECK(hdr.status == RPC_ST_OK && hdr.id < sent);
+        uint64_t lat = host_now_us() - sent_us[hdr.id];
+        total_lat += lat;
+        if (lat > max_lat) {
+            max_lat = lat;
+        }
+        done++;
+    }
+    uint64_t elapsed = host_now_us() - start;
+    printf("%6u  %8u ms  %8.1f req/s  %8u ms  %8u ms\n", window, (unsigned)(elapsed / 1000),
+           (double)req_num * 1000000 / elapsed, (unsigned)(total_lat / req_num / 1000), (unsigned)(max_lat / 1000));
+    client_close(&c);
+}
+
+// ================================================================================================
+// 2. 他の接続がウィンドウを使い切っているときの応答時間
+// ================================================================================================
+static void bench_cross(void)
+{
+    struct _client  busy, probe;
+    uint32_t        long_ms = 2000;
+    uint64_t        total = 0, max_lat = 0;
+
+    client_open(&busy);
+    client_open(&probe);
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        client_req(&busy, i, SPP_RPC_M_SLEEP, 0, &long_ms, sizeof(long_ms));
+    }
+    vTaskDelay(pdMS_TO_TICKS(latency_ms * 2));
+    for (int i = 0; i < 16; i++) {
+        uint64_t t = host_now_us();
+        client_req(&probe, i, SPP_RPC_M_ECHO, 0, "ping", 4);
+        struct _spp_rpc_hdr hdr = client_rsp(&probe);
+        CHECK(hdr.status == RPC_ST_OK && hdr.id == i);
+        t = host_now_us() - t;
+        total += t;
+        if (t > max_lat) {
+            max_lat = t;
+        }
+    }
+    printf("echo while another connection runs %d x sleep(%u ms) : avg %u ms  max %u ms  (round trip %u ms)\n",
+           SPP_RPC_WINDOW, long_ms, (unsigned)(total / 16 / 1000), (unsigned)(max_lat / 1000), latency_ms * 2);
+    for (int i = 0; i < SPP_RPC_WINDOW; i++) {
+        CHECK(client_rsp(&busy).status == RPC_ST_OK);
+    }
+    client_close(&busy);
+    client_close(&probe);
+}
+
+int main(int argc, char** argv)
+{
+    int     opt;
+
+    while ((opt = getopt(argc, argv, "n:l:t:")) != -1) {
+        switch (opt) {
+          case 'n' : req_num    = atoi(optarg); break;
+          case 'l' : latency_ms = atoi(optarg); break;
+          case 't' : sleep_ms   = atoi(optarg); break;
+          default  :
+            fprintf(stderr, "usage: %s [-n requests] [-l latency_ms] [-t sleep_ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    CHECK(req_num <= 65536);
+    spp_rpc_init();
+
+    printf("%u x sleep(%u ms)  one-way latency %u ms\n", req_num, sleep_ms, latency_ms);
+    printf("window      time      throughput   avg latency  max latency\n");
+    for (uint32_t w = 1; w <= SPP_RPC_WINDOW; w *= 2) {
+        bench_window(w);
+    }
+    bench_cross();
+    printf("tasks left : %d\n", host_task_count());
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ホスト試験の接続の開始と終了(host_test.h, spp_user_hdr.h の後に include する)
+//     ESP_SPP_SRV_OPEN_EVT / ESP_SPP_CLOSE_EVT の代わりに spp_open_handler() / spp_close_handler() を呼ぶ
+//     データタスクは実機と同じくパラメータテーブルの添字を受け取る
+//     test_conn_open()  : task_func のサーバへの接続を開始し、パラメータテーブルの添字を返す(NULL:クライアント接続)
+//     test_conn_close() : 接続を終了し、パラメータテーブルが解放されるまで待つ
+
+#include "spp_task.h"
+
+#define TEST_CONN_WAIT_MS   10000   // 解放を待つ期限(強制終了の分も含む)
+
+static uint32_t test_conn_handle = 0x100;
+
+static int test_conn_open(int fd, TaskFunction_t task_func)
+{
+    static bool                 task_ready = false;
+    const struct _spp_server*   server = NULL;
+    uint32_t                    handle = ++test_conn_handle;
+    esp_bd_addr_t               bda = { 0x24, 0x0a, 0xc4, 0x00, (uint8_t)(handle >> 8), (uint8_t)handle };
+
+    if (!task_ready) {
+        CHECK(spp_task_init() == ESP_OK);
+        task_ready = true;
+    }
+    for (int i = 0; task_func != NULL && i < spp_server_num; i++) {
+        if (spp_servers[i].task_func == task_func) {
+            server = &spp_servers[i];
+            break;
+        }
+    }
+    CHECK(task_func == NULL || server != NULL);
+    spp_open_handler(handle, fd, bda, server);
+    for (int idx = 0; idx < OPEN_HDR_NUM; idx++) {
+        if (open_hdr_params[idx].use && open_hdr_params[idx].bd_handle == handle) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+static void test_conn_close(int conn)
+{
+    uint32_t    handle = open_hdr_params[conn].bd_handle;
+
+    spp_close_handler(handle);
+    for (int ms = 0; open_hdr_params[conn].use && open_hdr_params[conn].bd_handle == handle; ms += 10) {
+        CHECK(ms < TEST_CONN_WAIT_MS);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
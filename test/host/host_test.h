@@ -0,0 +1,339 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ホスト試験の共通部分
+//     CHECK()     : 条件が成り立たなければ場所を表示して終了する
+//     test_link_* : host_vfs_open() で作る単純なリンク(1回の write() で受け付けるバイト数を指定できる)
+//     delay_link_*: 遅延と帯域のあるリンク(ベンチマーク用)
+//     test_trace_*: 区間の並び(トレース)を順に与えて、区間ごとの最後の状態と切り替え回数を確認する
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define CHECK(cond)     do { if (!(cond)) { \
+                            printf("CHECK failed: %s at %s:%d\n", #cond, __FILE__, __LINE__); exit(1); } } while (0)
+
+// 試験用リンク
+//     tx : 端末からの送信データ(write())をためる
+//     rx : 端末への受信データ(read()で返す)
+//     write_size : write() 1回で受け付けるバイト数を順に使う(0:輻輳、末尾まで来たら先頭に戻る、空なら制限なし)
+struct _test_link {
+    int         fd;
+    bool        closed;
+    uint8_t*    tx;
+    size_t      tx_len;
+    size_t      tx_cap;
+    uint8_t     rx[8192];
+    size_t      rx_head;
+    size_t      rx_len;
+    const int*  write_size;
+    int         write_size_num;
+    int         write_idx;
+    uint32_t    writes;
+    uint32_t    short_writes;
+};
+
+static inline int test_link_read(void* ctx, int fd, void* buf, size_t len)
+{
+    struct _test_link*  link = ctx;
+
+    if (link->closed) {
+        return -1;
+    }
+    if (len > link->rx_len - link->rx_head) {
+        len = link->rx_len - link->rx_head;
+    }
+    memcpy(buf, &link->rx[link->rx_head], len);
+    link->rx_head += len;
+    if (link->rx_head == link->rx_len) {
+        link->rx_head = link->rx_len = 0;
+    }
+    return len;
+}
+
+static inline int test_link_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    struct _test_link*  link = ctx;
+
+    if (link->closed) {
+        return -1;
+    }
+    link->writes++;
+    if (link->write_size_num > 0) {
+        size_t  n = link->write_size[link->write_idx++ % link->write_size_num];
+        if (n < len) {
+            len = n;
+            link->short_writes++;
+        }
+    }
+    if (link->tx_len + len > link->tx_cap) {
+        link->tx_cap = (link->tx_len + len) * 2;
+        link->tx     = realloc(link->tx, link->tx_cap);
+    }
+    memcpy(&link->tx[link->tx_len], buf, len);
+    link->tx_len += len;
+    return len;
+}
+
+static const struct _host_vfs_ops test_link_ops = {
+    .read   = test_link_read,
+    .write  = test_link_write,
+};
+
+static inline void test_link_open(struct _test_link* link, const int* write_size, int write_size_num)
+{
+    memset(link, 0, sizeof(*link));
+    link->write_size     = write_size;
+    link->write_size_num = write_size_num;
+    link->fd             = host_vfs_open(&test_link_ops, link);
+    CHECK(link->fd >= 0);
+}
+
+static inline void test_link_close(struct _test_link* link)
+{
+    link->closed = true;
+    host_vfs_close(link->fd);
+    free(link->tx);
+    link->tx = NULL;
+}
+
+static inline void test_link_push(struct _test_link* link, const void* data, size_t len)
+{
+    if (link->rx_head > 0) {
+        memmove(link->rx, &link->rx[link->rx_head], link->rx_len - link->rx_head);
+        link->rx_len  -= link->rx_head;
+        link->rx_head = 0;
+    }
+    CHECK(link->rx_len + len <= sizeof(link->rx));
+    memcpy(&link->rx[link->rx_len], data, len);
+    link->rx_len += len;
+}
+
+// 端末が読むのを待ちながら送る(1tickごとに空いた分を入れる)
+static inline void test_link_send(struct _test_link* link, const void* data, size_t len)
+{
+    const uint8_t*  p = data;
+
+    while (len > 0) {
+        size_t  room = sizeof(link->rx) - (link->rx_len - link->rx_head);
+        size_t  n = (len < room) ? len : room;
+        if (n == 0) {
+            vTaskDelay(1);
+            continue;
+        }
+        test_link_push(link, p, n);
+        p   += n;
+        len -= n;
+    }
+}
+
+// 遅延と帯域のあるリンク
+//     片方向ごとに、送信路が空く時刻 + 送信時間(帯域) + 遅延 で相手に届く
+//     相手が読んでいないデータが window バイトになると write() は書ける分だけ受け付ける(RFCOMMのクレジットと同じ)
+//     デバイス側は fd の read()/write()、相手側は delay_link_peer_*() を使う
+#define DELAY_LINK_BUF      65536
+#define DELAY_LINK_MARKS    1024
+
+struct _delay_dir {
+    uint8_t     data[DELAY_LINK_BUF];
+    uint32_t    head;                   // 読んだ位置(累積)
+    uint32_t    tail;                   // 書いた位置(累積)
+    uint32_t    mark_end[DELAY_LINK_MARKS];
+    uint64_t    mark_us[DELAY_LINK_MARKS];  // mark_end までのデータが届く時刻
+    uint32_t    mark_head;
+    uint32_t    mark_tail;
+    uint64_t    busy_until_us;          // 送信路が空く時刻
+};
+
+struct _delay_link {
+    int                 fd;
+    bool                closed;
+    uint32_t            latency_us;
+    uint32_t            bytes_per_sec;
+    uint32_t            window;
+    struct _delay_dir   to_peer;
+    struct _delay_dir   to_dev;
+};
+
+static inline int delay_dir_write(struct _delay_link* link, struct _delay_dir* d, const void* buf, size_t len)
+{
+    uint32_t    room = link->window - (d->tail - d->head);
+    uint32_t    n = (len < room) ? len : room;
+    uint64_t    now = host_now_us();
+    uint32_t    m;
+
+    if (n == 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        d->data[(d->tail + i) % DELAY_LINK_BUF] = ((const uint8_t*)buf)[i];
+    }
+    d->tail += n;
+    if (d->busy_until_us < now) {
+        d->busy_until_us = now;
+    }
+    d->busy_until_us += (uint64_t)n * 1000000 / link->bytes_per_sec;
+    if (d->mark_tail - d->mark_head < DELAY_LINK_MARKS) {
+        m = d->mark_tail++ % DELAY_LINK_MARKS;
+    }
+    else {
+        m = (d->mark_tail - 1) % DELAY_LINK_MARKS;       // 一杯なら最後の区切りを延ばす
+    }
+    d->mark_end[m]  = d->tail;
+    d->mark_us[m]   = d->busy_until_us + link->latency_us;
+    host_wake(d);
+    return n;
+}
+
+// 届いているバイト数
+static inline uint32_t delay_dir_avail(struct _delay_dir* d)
+{
+    uint64_t    now = host_now_us();
+    uint32_t    end = d->head;
+
+    for (uint32_t i = d->mark_head; i != d->mark_tail && d->mark_us[i % DELAY_LINK_MARKS] <= now; i++) {
+        end = d->mark_end[i % DELAY_LINK_MARKS];
+    }
+    return end - d->head;
+}
+
+static inline int delay_dir_read(struct _delay_dir* d, void* buf, size_t len)
+{
+    uint32_t    n = delay_dir_avail(d);
+
+    if (n > len) {
+        n = len;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        ((uint8_t*)buf)[i] = d->data[(d->head + i) % DELAY_LINK_BUF];
+    }
+    d->head += n;
+    while (d->mark_head != d->mark_tail && (int32_t)(d->mark_end[d->mark_head % DELAY_LINK_MARKS] - d->head) <= 0) {
+        // 読み終わった区切り
+        d->mark_head++;
+    }
+    return n;
+}
+
+static inline int delay_link_dev_read(void* ctx, int fd, void* buf, size_t len)
+{
+    struct _delay_link* link = ctx;
+    return link->closed ? -1 : delay_dir_read(&link->to_dev, buf, len);
+}
+
+static inline int delay_link_dev_write(void* ctx, int fd, const void* buf, size_t len)
+{
+    struct _delay_link* link = ctx;
+    return link->closed ? -1 : delay_dir_write(link, &link->to_peer, buf, len);
+}
+
+static const struct _host_vfs_ops delay_link_ops = {
+    .read   = delay_link_dev_read,
+    .write  = delay_link_dev_write,
+};
+
+static inline struct _delay_link* delay_link_open(uint32_t latency_ms, uint32_t bytes_per_sec, uint32_t window)
+{
+    struct _delay_link* link = calloc(1, sizeof(*link));
+
+    CHECK(link != NULL && window <= DELAY_LINK_BUF);
+    link->latency_us    = latency_ms * 1000;
+    link->bytes_per_sec = bytes_per_sec;
+    link->window        = window;
+    link->fd            = host_vfs_open(&delay_link_ops, link);
+    CHECK(link->fd >= 0);
+    return link;
+}
+
+static inline void delay_link_close(struct _delay_link* link)
+{
+    link->closed = true;
+    host_vfs_close(link->fd);
+    free(link);
+}
+
+// 相手側の送信(書ききるまで待つ)
+static inline void delay_link_peer_write(struct _delay_link* link, const void* buf, size_t len)
+{
+    while (len > 0) {
+        int n = delay_dir_write(link, &link->to_dev, buf, len);
+        if (n == 0) {
+            vTaskDelay(1);
+            continue;
+        }
+        buf = (const uint8_t*)buf + n;
+        len -= n;
+    }
+}
+
+// 相手側の受信(届くか timeout_us まで待つ)
+static inline int delay_link_peer_read(struct _delay_link* link, void* buf, size_t len, uint32_t timeout_us)
+{
+    struct _delay_dir*  d = &link->to_peer;
+    uint64_t            until = host_now_us() + timeout_us;
+
+    while (delay_dir_avail(d) == 0) {
+        uint64_t    wake = until;
+        if (d->mark_head != d->mark_tail && d->mark_us[d->mark_head % DELAY_LINK_MARKS] < wake) {
+            wake = d->mark_us[d->mark_head % DELAY_LINK_MARKS];
+        }
+        if (!host_wait_us(d, wake) && host_now_us() >= until) {
+            return 0;
+        }
+    }
+    return delay_dir_read(d, buf, len);
+}
+
+// トレース(区間の並び)を順に与える試験
+//     区間ごとに step() を ticks 回呼び、戻り値(状態)が変わった回数を数える
+//     step() の中では tr->state が直前の状態、tr->tick が先頭の区間からの通しの周期番号
+//     区間の最後の状態と区間内の切り替え回数がどちらも期待どおりであることを確認する
+struct _test_phase {
+    const char* name;
+    uint32_t    ticks;
+    int         state;                  // 区間の最後の状態
+    int         switches;               // 区間内の切り替え回数
+};
+
+struct _test_trace {
+    const char* const*  state_name;
+    int                 state;
+    uint32_t            tick;
+};
+
+typedef int (*test_trace_step_t)(struct _test_trace* tr, const struct _test_phase* ph, uint32_t t);
+
+static inline void test_trace_start(struct _test_trace* tr, const char* const* state_name, int state)
+{
+    tr->state_name  = state_name;
+    tr->state       = state;
+    tr->tick        = 0;
+    printf("phase                         ticks  state   switches\n");
+}
+
+static inline void test_trace_phase(struct _test_trace* tr, const struct _test_phase* ph, test_trace_step_t step)
+{
+    int switches = 0;
+
+    for (uint32_t t = 0; t < ph->ticks; t++, tr->tick++) {
+        int state = step(tr, ph, t);
+        if (state != tr->state) {
+            switches++;
+            tr->state = state;
+        }
+    }
+    printf("%-28s  %5u  %-6s  %d\n", ph->name, ph->ticks, tr->state_name[tr->state], switches);
+    CHECK(tr->state == ph->state);
+    CHECK(switches == ph->switches);
+}
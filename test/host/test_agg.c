@@ -0,0 +1,187 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 集約の試験
+//     1. 切断した接続のキューに残ったレコードがあっても、接続中でキューが空の接続を待つ(遅着にしない)
+//        出力先の接続の write() が短い書き込みと輻輳(0)を繰り返しても、レコードは欠けずに出力される
+//     2. 到着時刻が揺らぐ(SPP_AGG_WINDOW_MS 未満)複数の接続のレコードが、欠けずに時刻順に出力される
+//     3. 出力先の接続が切断されたら UART に戻り、同じ fd を割り当てられた次の接続には出力しない
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_agg.h"
+#include "spp_buf.h"
+#include "host_conn.h"
+
+#define SRC_NUM         4
+#define REC_NUM         200             // 接続ごとのレコード数
+#define REC_INTERVAL_MS 20              // 接続ごとのレコードの間隔
+#define JITTER_MS       120             // 到着の揺らぎの最大
+
+static struct _test_link    out;
+static size_t               out_pos;
+static const int            out_write_size[] = { 5, 0, 11, 0, 0, 64, 3 };
+
+// 送信元(相手側)
+struct _source {
+    struct _test_link   link;
+    int                 conn;
+    uint32_t            base_ms;        // 最初のレコードの時刻
+    uint32_t            offset_ms;
+    volatile bool       done;
+};
+
+static void send_rec(struct _test_link* link, uint32_t ts_ms)
+{
+    uint8_t             frame[sizeof(struct _spp_agg_hdr) + 9];
+    struct _spp_agg_hdr hdr = { .magic = SPP_AGG_MAGIC, .type = SPP_AGG_TYPE, .len = 8, .ts_ms = ts_ms };
+
+    memcpy(frame, &hdr, sizeof(hdr));
+    snprintf((char*)&frame[sizeof(hdr)], 9, "%08u", ts_ms);
+    test_link_send(link, frame, sizeof(hdr) + hdr.len);
+}
+
+// 出力されたレコードを読む(時刻が古い順で内容が崩れていないこと)
+static int read_output(uint32_t* ts, int max)
+{
+    int n = 0;
+
+    while (out.tx_len - out_pos >= sizeof(struct _spp_agg_hdr)) {
+        struct _spp_agg_hdr hdr;
+        char                text[9];
+        memcpy(&hdr, &out.tx[out_pos], sizeof(hdr));
+        CHECK(hdr.magic == SPP_AGG_MAGIC && hdr.len == 8 && out.tx_len - out_pos >= sizeof(hdr) + hdr.len);
+        snprintf(text, sizeof(text), "%08u", hdr.ts_ms);
+        CHECK(memcmp(&out.tx[out_pos + sizeof(hdr)], text, 8) == 0);
+        CHECK(n < max);
+        ts[n++] = hdr.ts_ms;
+        out_pos += sizeof(hdr) + hdr.len;
+    }
+    return n;
+}
+
+// ================================================================================================
+// 揺らぎのある送信元 : 時刻 ts のレコードが base + ts + 揺らぎ で届く(接続内の順序は保つ)
+// ================================================================================================
+static void source_task(void* param)
+{
+    struct _source* s = param;
+    uint64_t        start = host_now_us();
+    uint64_t        arrive = 0;
+
+    for (int i = 0; i < REC_NUM; i++) {
+        uint32_t    ts = i * REC_INTERVAL_MS + s->offset_ms;
+        uint64_t    t = (uint64_t)(ts + rand() % JITTER_MS) * 1000;
+        if (t > arrive) {
+            arrive = t;
+        }
+        while (host_now_us() - start < arrive) {
+            vTaskDelay(1);
+        }
+        send_rec(&s->link, s->base_ms + ts);
+    }
+    s->done = true;
+    vTaskDelete(NULL);
+}
+
+int main(void)
+{
+    static struct _source   src[SRC_NUM];
+    static uint32_t         ts[SRC_NUM * REC_NUM + 16];
+    struct _test_link       a, b;
+    int                     conn_a, conn_b, conn_out;
+    int                     n;
+
+    srand(1);
+    CHECK(spp_agg_init() == ESP_OK);
+    CHECK(spp_buf_init() == ESP_OK);
+    test_link_open(&out, out_write_size, sizeof(out_write_size) / sizeof(out_write_size[0]));
+    conn_out = test_conn_open(out.fd, NULL);
+    CHECK(conn_out >= 0);
+    CHECK(spp_agg_set_output(conn_out) == out.fd);
+
+    // 1. A は 100, 200 を送って切断、接続中の B はまだ空 → B の 50 を待ってから出力する
+    test_link_open(&a, NULL, 0);
+    test_link_open(&b, NULL, 0);
+    conn_a = test_conn_open(a.fd, spp_agg_task);
+    conn_b = test_conn_open(b.fd, spp_agg_task);
+    CHECK(conn_a >= 0 && conn_b >= 0);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    send_rec(&a, 100);
+    send_rec(&a, 200);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    a.closed = true;
+    vTaskDelay(pdMS_TO_TICKS(50));
+    send_rec(&b, 50);
+    vTaskDelay(pdMS_TO_TICKS(SPP_AGG_WINDOW_MS * 2));
+    n = read_output(ts, 16);
+    CHECK(n == 3 && ts[0] == 50 && ts[1] == 100 && ts[2] == 200);
+    CHECK(out.short_writes > 0);
+    out.write_size_num = 0;
+    b.closed = true;
+    test_conn_close(conn_a);
+    test_conn_close(conn_b);
+    test_link_close(&a);
+    test_link_close(&b);
+
+    // 2. 揺らぎのある SRC_NUM 接続
+    for (int i = 0; i < SRC_NUM; i++) {
+        test_link_open(&src[i].link, NULL, 0);
+        src[i].base_ms      = 1000;
+        src[i].offset_ms    = i * REC_INTERVAL_MS / SRC_NUM;
+        src[i].conn         = test_conn_open(src[i].link.fd, spp_agg_task);
+        CHECK(src[i].conn >= 0);
+    }
+    for (int i = 0; i < SRC_NUM; i++) {
+        CHECK(xTaskCreate(source_task, "source", 4096, &src[i], 4, NULL) == pdPASS);
+    }
+    for (int i = 0; i < SRC_NUM; i++) {
+        while (!src[i].done) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(SPP_AGG_WINDOW_MS * 2));
+    spp_agg_show();
+    n = read_output(ts, SRC_NUM * REC_NUM);
+    printf("%d sources x %d records, jitter < %d ms : output %d\n", SRC_NUM, REC_NUM, JITTER_MS, n);
+    CHECK(n == SRC_NUM * REC_NUM);
+    for (int i = 1; i < n; i++) {
+        CHECK(ts[i - 1] <= ts[i]);
+    }
+
+    // 3. 出力先を切断 → 同じ fd の新しい接続 C には出力しない
+    n = out.fd;
+    out.closed = true;
+    test_conn_close(conn_out);
+    test_link_close(&out);
+    test_link_open(&out, NULL, 0);
+    CHECK(out.fd == n);
+    conn_out = test_conn_open(out.fd, NULL);
+    CHECK(conn_out >= 0);
+    send_rec(&src[0].link, 5000);
+    vTaskDelay(pdMS_TO_TICKS(SPP_AGG_WINDOW_MS * 2));
+    spp_agg_show();
+    CHECK(out.tx_len == 0);
+    for (int i = 0; i < SRC_NUM; i++) {
+        src[i].link.closed = true;
+    }
+    for (int i = 0; i < SRC_NUM; i++) {
+        test_conn_close(src[i].conn);
+    }
+    for (int i = 0; i < SRC_NUM; i++) {
+        test_link_close(&src[i].link);
+    }
+    out.closed = true;
+    test_conn_close(conn_out);
+    test_link_close(&out);
+    printf("test_agg : OK\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ペアリング済みデバイスの管理の試験(再起動をまたぐLRU)
+//     1. 使用した順と使用回数はNVSに保存され、再起動後も同じ順で(Bluedroidの一覧の順ではなく)解除する
+//     2. 固定したデバイスは解除しない
+//     3. 保存していないデバイスは最も古い側として扱う
+//     4. 接続による使用順の変更は接続ごとには書き込まず、SPP_BOND_FLUSH_MS 後の spp_bond_poll() でまとめて書き込む
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+
+#include "spp_bond.h"
+
+#define NVS_FILE        "test_bond_nvs.bin"
+
+static uint8_t* dev(int n)
+{
+    static esp_bd_addr_t    bda[32];
+
+    memcpy(bda[n], (uint8_t[]){ 0x24, 0x0a, 0xc4, 0x00, 0x10, (uint8_t)n }, ESP_BD_ADDR_LEN);
+    return bda[n];
+}
+
+// 新しくペアリング(ESP_BT_GAP_AUTH_CMPL_EVT)
+static void pair(int n)
+{
+    host_bt_bond_add(dev(n));
+    spp_bond_added(dev(n));
+}
+
+// NVSに保存した使用順の先頭(最近使った)のデバイス
+static bool lru_head_is(int n)
+{
+    uint8_t         rec[SPP_BOND_MAX * 12];         // struct _bond_rec(BDアドレスが先頭)
+    size_t          len = sizeof(rec);
+    nvs_handle_t    handle;
+
+    CHECK(nvs_open(SPP_BOND_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK);
+    CHECK(nvs_get_blob(handle, "lru", rec, &len) == ESP_OK);
+    nvs_close(handle);
+    return len > 0 && memcmp(rec, dev(n), ESP_BD_ADDR_LEN) == 0;
+}
+
+static void reboot(void)
+{
+    host_nvs_file(NVS_FILE);
+    CHECK(nvs_flash_init() == ESP_OK);
+    CHECK(spp_bond_load() == ESP_OK);
+}
+
+int main(void)
+{
+    unlink(NVS_FILE);
+    reboot();
+
+    // Bluedroidの一覧は 0, 1, ... の順、使用は 14 → 1 の順で最後に 0 を3回
+    for (int n = 0; n < SPP_BOND_CAPACITY; n++) {
+        pair(n);
+    }
+    for (int n = SPP_BOND_CAPACITY - 1; n >= 1; n--) {
+        spp_bond_used(dev(n));
+    }
+    for (int i = 0; i < 3; i++) {
+        spp_bond_used(dev(0));
+    }
+
+    // 4. 接続では書き込まず、最初の変更から SPP_BOND_FLUSH_MS 経ってからまとめて書き込む
+    CHECK(lru_head_is(SPP_BOND_CAPACITY - 1));
+    vTaskDelay((SPP_BOND_FLUSH_MS - 1000) / portTICK_PERIOD_MS);
+    spp_bond_poll(false);
+    CHECK(lru_head_is(SPP_BOND_CAPACITY - 1));
+    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    spp_bond_poll(false);
+    CHECK(lru_head_is(0));
+    CHECK(spp_bond_pin(dev(SPP_BOND_CAPACITY - 2), true) == ESP_OK);
+    CHECK(spp_bond_num() == SPP_BOND_CAPACITY);
+
+    // 1. 再起動後の追加 → 最も長く使っていない 14 を解除(一覧の順なら 0 になる)
+    reboot();
+    spp_bond_show();
+    CHECK(spp_bond_num() == SPP_BOND_CAPACITY);
+    pair(20);
+    CHECK(!host_bt_bonded(dev(SPP_BOND_CAPACITY - 1)));
+    CHECK(host_bt_bonded(dev(0)) && host_bt_bonded(dev(20)));
+
+    // 2. 次に古い 13 は固定しているので 12 を解除
+    pair(21);
+    CHECK(host_bt_bonded(dev(SPP_BOND_CAPACITY - 2)));
+    CHECK(!host_bt_bonded(dev(SPP_BOND_CAPACITY - 3)));
+    CHECK(spp_bond_num() == SPP_BOND_CAPACITY);
+
+    // 3. 保存していないデバイス(以前のファームウェアでペアリング)は最も古い側 → 起動時に解除
+    host_bt_bond_add(dev(22));
+    reboot();
+    spp_bond_show();
+    CHECK(!host_bt_bonded(dev(22)));
+    CHECK(spp_bond_num() == SPP_BOND_CAPACITY);
+    CHECK(host_bt_bonded(dev(0)) && host_bt_bonded(dev(20)) && host_bt_bonded(dev(21)));
+
+    unlink(NVS_FILE);
+    printf("test_bond : OK\n");
+    return 0;
+}
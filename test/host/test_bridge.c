@@ -0,0 +1,150 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// UARTブリッジ(spp_bridge.c)の試験
+//     UART1 を pty のスレーブにつなぎ、マスタ側を UART の相手の機器として読み書きする
+//     1. UART → SPP : SPP が輻輳して書ききれなくても、ブロックの続きから書いて1バイトも失わない
+//        (転送量の統計は実際に書けたバイト数と一致する)
+//     2. SPP → UART : 受信したデータがそのまま UART に出る
+//     3. 輻輳中に切断 : 書けなかった分は捨てたバイト数に数え、転送量には数えない
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_bridge.h"
+#include "host_conn.h"
+
+#define TO_SPP_LEN      (16 * 1024)
+#define TO_UART_LEN     6000
+#define DISCARD_LEN     3000            // 2ブロックに収まる
+#define WAIT_MS         30000
+
+static uint8_t  to_spp_data[TO_SPP_LEN];
+static uint8_t  to_uart_data[TO_UART_LEN];
+static uint8_t  uart_rx[TO_UART_LEN];
+
+// SPP の write() 1回で受け付けるバイト数(0:輻輳)
+static const int    cong_sizes[] = { 0, 0, 0, 100, 0, 500, 0, 0, 1000 };
+static const int    cong_all[] = { 0 };
+
+// pty を開き、スレーブを UART1 につなぐ
+static int pty_open(void)
+{
+    struct termios  tio;
+    int             master = posix_openpt(O_RDWR | O_NOCTTY);
+    int             slave;
+
+    CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    CHECK(slave >= 0);
+    CHECK(tcgetattr(slave, &tio) == 0);
+    cfmakeraw(&tio);
+    CHECK(tcsetattr(slave, TCSANOW, &tio) == 0);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    host_uart_attach(SPP_BRIDGE_UART, slave);
+    return master;
+}
+
+// UART の相手の機器から送る(pty に入るだけ入れる)
+static void uart_send(int master, const uint8_t* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(master, data, len);
+        if (n > 0) {
+            data    += n;
+            len     -= n;
+        }
+        else {
+            vTaskDelay(1);
+        }
+    }
+}
+
+static void wait_tx(struct _test_link* link, size_t len)
+{
+    for (int ms = 0; link->tx_len < len; ms += 10) {
+        CHECK(ms < WAIT_MS);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+int main(void)
+{
+    struct _test_link       link;
+    struct _spp_bridge_stat to_spp, to_uart;
+    uint64_t                sent;
+    size_t                  got = 0;
+    int                     master;
+    int                     conn;
+
+    for (int i = 0; i < TO_SPP_LEN; i++) {
+        to_spp_data[i] = (uint8_t)(i * 7 + i / 251);
+    }
+    for (int i = 0; i < TO_UART_LEN; i++) {
+        to_uart_data[i] = (uint8_t)(i * 13 + 5);
+    }
+    master = pty_open();
+    CHECK(spp_bridge_init() == ESP_OK);
+    test_link_open(&link, cong_sizes, sizeof(cong_sizes) / sizeof(cong_sizes[0]));
+    conn = test_conn_open(link.fd, spp_bridge_task);
+    CHECK(conn >= 0);
+
+    // 1. UART → SPP(輻輳あり)
+    uart_send(master, to_spp_data, TO_SPP_LEN);
+    wait_tx(&link, TO_SPP_LEN);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    spp_bridge_get_stat(&to_spp, &to_uart);
+    spp_bridge_show();
+    printf("to spp : %u byte  writes %u (short %u)  cong %u\n", (unsigned)link.tx_len, link.writes, link.short_writes, to_spp.cong);
+    CHECK(link.tx_len == TO_SPP_LEN && memcmp(link.tx, to_spp_data, TO_SPP_LEN) == 0);
+    CHECK(to_spp.bytes == TO_SPP_LEN && to_spp.discarded == 0);
+    CHECK(to_spp.cong > 0);
+
+    // 2. SPP → UART
+    test_link_send(&link, to_uart_data, TO_UART_LEN);
+    for (int ms = 0; got < TO_UART_LEN; ms += 10) {
+        ssize_t n = read(master, &uart_rx[got], TO_UART_LEN - got);
+        if (n > 0) {
+            got += n;
+            continue;
+        }
+        CHECK(ms < WAIT_MS);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+    spp_bridge_get_stat(&to_spp, &to_uart);
+    printf("to uart : %u byte\n", (unsigned)got);
+    CHECK(memcmp(uart_rx, to_uart_data, TO_UART_LEN) == 0);
+    CHECK(to_uart.bytes == TO_UART_LEN);
+
+    // 3. 輻輳が続いたまま切断
+    link.write_size     = cong_all;
+    link.write_size_num = 1;
+    link.write_idx      = 0;
+    sent = to_spp.bytes;
+    uart_send(master, to_spp_data, DISCARD_LEN);
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    CHECK(link.tx_len == TO_SPP_LEN);
+    test_conn_close(conn);
+    spp_bridge_get_stat(&to_spp, &to_uart);
+    spp_bridge_show();
+    CHECK(to_spp.bytes == sent && to_spp.discarded == DISCARD_LEN);
+
+    test_link_close(&link);
+    host_uart_attach(SPP_BRIDGE_UART, -1);
+    close(master);
+    printf("test_bridge : OK\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// キャプチャ(spp_cap.c)と再生(host/spp_replay.c)の試験
+//     エコーバックのデータタスクに NMEA形式の行(一部はチェックサム不一致)を1行ずつ送り、受信と送信をキャプチャする
+//     SPP経由(バイナリ)とUARTのログ("CAP:" の行)の両方に書き出し、spp_replay で再生する
+//     1. どちらの形式でも全レコードを読み込み、fd ごとの送受信バイト数がリンクの実際と一致する
+//     2. -c pipe -p nmea : 受信データを実際の処理パイプラインに通し、cksum 段が不一致の行だけを捨てる
+//     3. -c pipe -p echo : エコーバックした量が受信量と一致する
+//     4. -s 1 : 記録時のタイミング(仮想時刻)で再生する
+//     5. SPP への書き出しはエコーバックの接続のデータタスクが行い、輻輳(write() が 0)でも途中で切らずに書ききる
+//        エコーバック以外の接続と使用していない接続には書き出さない
+
+#include <unistd.h>
+#include <fcntl.h>
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_pipe.h"
+#include "spp_cap.h"
+#include "spp_agg.h"
+#include "host_conn.h"
+
+#define LINE_NUM        40
+#define BAD_EVERY       5               // チェックサムを壊す行の間隔
+#define LINE_GAP_MS     200             // データタスクが1行ずつ読む間隔
+#define CAP_BIN         "test_cap.bin"
+#define CAP_LOG         "test_cap.log"
+#define REPLAY_OUT      "test_cap.out"
+
+static uint32_t     rx_bytes;
+static uint32_t     bad_lines;
+
+// 書き出し先の接続の write() 1回で受け付けるバイト数(0:輻輳)
+static const int    bin_write_size[] = { 0, 0, 0, 100, 0, 7, 512, 0, 0, 1 };
+
+// 行の長さは SPP_CAP_SNAP 未満(データを切り詰めずに記録する)
+static int make_line(char* line, size_t size, uint32_t n)
+{
+    uint8_t sum = 0;
+    int     len = snprintf(line, size, "$GPGGA,%06u.00,3539.%04u,N,13945.%04u,E", n, n % 10000, (n * 7) % 10000);
+
+    for (int i = 1; i < len; i++) {
+        sum ^= line[i];
+    }
+    if (n % BAD_EVERY == BAD_EVERY - 1) {
+        sum ^= 0x5a;
+    }
+    len += snprintf(&line[len], size - len, "*%02X\r\n", sum);
+    CHECK(len < SPP_CAP_SNAP);
+    return len;
+}
+
+// spp_replay を実行し、出力の中で prefix で始まる行を返す
+static int replay(const char* args, const char* prefix, char* out, size_t size)
+{
+    char    cmd[256];
+    char    line[256];
+    FILE*   fp;
+    int     rc;
+
+    snprintf(cmd, sizeof(cmd), "./spp_replay %s > %s", args, REPLAY_OUT);
+    rc = system(cmd);
+    fp = fopen(REPLAY_OUT, "r");
+    CHECK(fp != NULL);
+    out[0] = '\0';
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (prefix != NULL && out[0] == '\0' && strncmp(line, prefix, strlen(prefix)) == 0) {
+            snprintf(out, size, "%s", line);
+        }
+    }
+    fclose(fp);
+    return WIFEXITED(rc) ? WEXITSTATUS(rc) : -1;
+}
+
+// UARTのログへの書き出し(標準出力をファイルに向ける)
+static void export_log(void)
+{
+    int     fd = open(CAP_LOG, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int     out;
+
+    CHECK(fd >= 0);
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    printf("I (1234) boot: log before the capture\n");
+    CHECK(spp_cap_export(-1) > 0);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+}
+
+int main(void)
+{
+    struct _test_link   link;
+    struct _test_link   bin;
+    struct _test_link   agg;
+    char                line[96];
+    char                out[256];
+    char                prefix[32];
+    char                args[128];
+    unsigned            calls, in, bytes_out, dropped;
+    unsigned            rx, tx;
+    unsigned long long  cap_ms, replay_ms;
+    int                 fd;
+    int                 conn;
+    int                 conn_bin;
+    int                 conn_agg;
+    int                 size;
+    FILE*               fp;
+
+    CHECK(spp_pipe_init() == ESP_OK);
+    CHECK(spp_agg_init() == ESP_OK);
+    test_link_open(&link, NULL, 0);
+    spp_cap_start();
+    conn = test_conn_open(link.fd, spp_data_task);
+    CHECK(conn >= 0);
+    for (uint32_t n = 0; n < LINE_NUM; n++) {
+        int len = make_line(line, sizeof(line), n);
+        test_link_push(&link, line, len);
+        rx_bytes  += len;
+        bad_lines += (n % BAD_EVERY == BAD_EVERY - 1);
+        vTaskDelay(pdMS_TO_TICKS(LINE_GAP_MS));
+    }
+    spp_cap_stop();
+    fd = link.fd;
+    CHECK(link.tx_len == rx_bytes);
+
+    // SPP経由(バイナリ)とUARTのログに書き出す
+    test_link_open(&agg, NULL, 0);
+    conn_agg = test_conn_open(agg.fd, spp_agg_task);
+    CHECK(spp_cap_export_request(conn_agg) == ESP_ERR_NOT_SUPPORTED);
+    CHECK(spp_cap_export_request(OPEN_HDR_NUM - 1) == ESP_ERR_NOT_FOUND);
+    test_link_open(&bin, bin_write_size, sizeof(bin_write_size) / sizeof(bin_write_size[0]));
+    conn_bin = test_conn_open(bin.fd, spp_data_task);
+    CHECK(spp_cap_export_request(conn_bin) == ESP_OK);
+    CHECK(spp_cap_export_request(conn_bin) == ESP_ERR_INVALID_STATE);
+    while (spp_cap_export_busy(&size)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    printf("export : %d byte  writes %u (short %u)\n", size, bin.writes, bin.short_writes);
+    CHECK(size > 0 && bin.tx_len == size && bin.short_writes > 0);
+    CHECK(agg.tx_len == 0);
+    test_conn_close(conn_bin);
+    test_conn_close(conn_agg);
+    test_link_close(&agg);
+    fp = fopen(CAP_BIN, "wb");
+    CHECK(fp != NULL && fwrite(bin.tx, 1, bin.tx_len, fp) == bin.tx_len);
+    fclose(fp);
+    test_link_close(&bin);
+    export_log();
+    test_conn_close(conn);
+    test_link_close(&link);
+
+    // 1. 全レコードの読み込みと送受信バイト数
+    snprintf(prefix, sizeof(prefix), "fd %2d : ", fd);
+    CHECK(replay("-f -c stat " CAP_BIN, prefix, out, sizeof(out)) == 0);
+    printf("binary : %s", out);
+    CHECK(sscanf(out, "fd %*d : rx %u byte  tx %u byte", &rx, &tx) == 2);
+    CHECK(rx == rx_bytes && tx == rx_bytes);
+    CHECK(replay("-f -c stat " CAP_LOG, prefix, out, sizeof(out)) == 0);
+    printf("log    : %s", out);
+    CHECK(sscanf(out, "fd %*d : rx %u byte  tx %u byte", &rx, &tx) == 2);
+    CHECK(rx == rx_bytes && tx == rx_bytes);
+
+    // 2. 処理パイプライン(nmea) : チェックサム不一致の行だけを捨てる
+    CHECK(replay("-f -c pipe -p nmea " CAP_BIN, "      cksum", out, sizeof(out)) == 0);
+    printf("nmea   : %s", out);
+    CHECK(sscanf(out, " cksum %u %u %u %u", &calls, &in, &bytes_out, &dropped) == 4);
+    CHECK(calls == LINE_NUM && in == rx_bytes && dropped == bad_lines);
+
+    // 3. 処理パイプライン(echo) : 受信した分をすべてエコーバックする
+    CHECK(replay("-f -c pipe -p echo " CAP_BIN, "fd ", out, sizeof(out)) == 0);
+    printf("echo   : %s", out);
+    CHECK(sscanf(out, "fd %*d : rx %u byte  echo %u byte", &rx, &tx) == 2);
+    CHECK(rx == rx_bytes && tx == rx_bytes);
+
+    // 4. 記録時のタイミングで再生する(仮想時刻なので記録と同じ長さ)
+    snprintf(args, sizeof(args), "-s 1 -c pipe -p nmea %s", CAP_BIN);
+    CHECK(replay(args, "captured : ", out, sizeof(out)) == 0);
+    printf("timing : %s", out);
+    CHECK(sscanf(out, "captured : %llu ms  replayed : %llu ms", &cap_ms, &replay_ms) == 2);
+    CHECK(cap_ms >= (LINE_NUM - 1) * LINE_GAP_MS && replay_ms >= cap_ms && replay_ms <= cap_ms + 1);
+
+    unlink(CAP_BIN);
+    unlink(CAP_LOG);
+    unlink(REPLAY_OUT);
+    printf("test_cap : OK\n");
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// イベント配送(spp_disp.c)の試験
+//     BTCタスクの代わりのタスクがイベントの記録(トレース)を順に発生させ、ハンドラは処理時間の分だけ待つ
+//     同じトレースをコールバックの中で直接ハンドラを呼んだ場合(従来)と配送タスク経由で比べる
+//     1. 配送タスク経由ではコールバックでかかる時間はハンドラの処理時間によらず小さい
+//     2. 続けて来た inquiry結果は SPP_DISP_BATCH_MAX 個ずつまとめて処理する
+//     3. イベントは発生した順に、パラメータが指す先の内容も保ったまま配送される
+//     4. 空きがないときは inquiry結果だけ捨て、それ以外は空くまで待って配送する
+//     5. 配送タスクよりも優先度の低いタスクから呼ばれ、キューに入れた時点で配送タスクに切り替わっても
+//        ハンドラから見たキューの深さは負(0xffffffff)にならない
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_disp.h"
+
+#define BTC_PRIO        19              // BluedroidのBTCタスクの優先度
+#define LOW_PRIO        (SPP_DISP_TASK_PRIO - 1)    // 配送タスクよりも低い優先度
+#define CALLBACK_MAX_US 100             // 配送タスク経由のときにコールバックでかかってよい時間
+#define LOG_MAX         128
+
+// トレースの区間 : 同じイベントを num 個続けて発生させ(BTCタスクの1回の実行)、gap_ms 待つ
+struct _step {
+    const char* name;
+    uint8_t     src;                    // DISP_SRC_xxx
+    int         event;
+    int         num;
+    uint32_t    gap_ms;
+};
+
+static const struct _step trace[] = {
+    { "connect (SRV_OPEN)",         DISP_SRC_SPP, ESP_SPP_SRV_OPEN_EVT,     1,  20 },
+    { "data",                       DISP_SRC_SPP, ESP_SPP_DATA_IND_EVT,     4,  50 },
+    { "inquiry burst",              DISP_SRC_GAP, ESP_BT_GAP_DISC_RES_EVT,  12, 50 },
+    { "inquiry done",               DISP_SRC_GAP, ESP_BT_GAP_DISC_STATE_CHANGED_EVT, 1, 20 },
+    { "disconnect (CLOSE)",         DISP_SRC_SPP, ESP_SPP_CLOSE_EVT,        1,  50 },
+};
+#define BURST_STEP      2
+
+// ハンドラの処理時間(従来はBTCタスクで行っていた処理の代わり)
+static uint32_t handler_us(uint8_t src, int event)
+{
+    if (src == DISP_SRC_SPP) {
+        switch (event) {
+          case ESP_SPP_SRV_OPEN_EVT :   return 30000;       // VFS登録、データタスクの生成
+          case ESP_SPP_CLOSE_EVT :      return 10000;       // 接続の終了
+          default :                     return 0;
+        }
+    }
+    return (event == ESP_BT_GAP_DISC_RES_EVT) ? 2000 : 0;   // EIRの解析
+}
+
+// 配送されたイベント
+struct _log {
+    uint8_t     src;
+    int         event;
+    uint8_t     seq;                    // パラメータが指す先の内容
+};
+
+static struct _log      log_buf[LOG_MAX];
+static int              log_num;
+static uint32_t         cb_max_us;      // コールバックでかかった時間の最大
+static uint32_t         depth_max;      // ハンドラから見たキューの深さの最大
+static volatile bool    btc_done;
+static bool             use_disp;
+static const struct _step* btc_trace;
+static int              btc_trace_num;
+
+static void log_event(uint8_t src, int event, uint8_t seq)
+{
+    struct _spp_disp_stat   st;
+
+    spp_disp_get_stat(&st);
+    if (st.depth > depth_max) {
+        depth_max = st.depth;
+    }
+    CHECK(log_num < LOG_MAX);
+    log_buf[log_num].src    = src;
+    log_buf[log_num].event  = event;
+    log_buf[log_num].seq    = seq;
+    log_num++;
+    host_sleep_until_us(host_now_us() + handler_us(src, event));
+}
+
+// ================================================================================================
+// ハンドラ
+// ================================================================================================
+static void gap_handler(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t* param)
+{
+    uint8_t seq = 0;
+
+    if (event == ESP_BT_GAP_DISC_RES_EVT) {
+        CHECK(param->disc_res.num_prop == 1 && param->disc_res.prop[0].type == ESP_BT_GAP_DEV_PROP_EIR);
+        seq = ((uint8_t*)param->disc_res.prop[0].val)[0];
+        CHECK(param->disc_res.bda[5] == seq);
+    }
+    log_event(DISP_SRC_GAP, event, seq);
+}
+
+static void spp_handler(esp_spp_cb_event_t event, esp_spp_cb_param_t* param)
+{
+    uint8_t seq = 0;
+
+    if (event == ESP_SPP_DATA_IND_EVT) {
+        CHECK(param->data_ind.len == 16);
+        seq = param->data_ind.data[0];
+        for (int i = 1; i < param->data_ind.len; i++) {
+            CHECK(param->data_ind.data[i] == seq);
+        }
+    }
+    log_event(DISP_SRC_SPP, event, seq);
+}
+
+// ================================================================================================
+// BTCタスクの代わり
+//     パラメータが指す先はコールバックから戻ったら上書きする(Bluedroidのバッファと同じ)
+// ================================================================================================
+static void btc_post(uint8_t src, int event, uint8_t seq)
+{
+    static uint8_t          data[ESP_BT_GAP_EIR_DATA_LEN];
+    esp_bt_gap_dev_prop_t   prop = { .type = ESP_BT_GAP_DEV_PROP_EIR, .len = sizeof(data), .val = data };
+    esp_bt_gap_cb_param_t   gap;
+    esp_spp_cb_param_t      spp;
+    uint64_t                start = host_now_us();
+
+    memset(data, seq, sizeof(data));
+    memset(&gap, 0, sizeof(gap));
+    memset(&spp, 0, sizeof(spp));
+    gap.disc_res.bda[5]     = seq;
+    gap.disc_res.num_prop   = 1;
+    gap.disc_res.prop       = &prop;
+    spp.data_ind.len        = 16;
+    spp.data_ind.data       = data;
+
+    if (src == DISP_SRC_GAP) {
+        use_disp ? spp_disp_gap_cb(event, &gap) : gap_handler(event, &gap);
+    }
+    else {
+        use_disp ? spp_disp_spp_cb(event, &spp) : spp_handler(event, &spp);
+    }
+    memset(data, 0xee, sizeof(data));
+    if (host_now_us() - start > cb_max_us) {
+        cb_max_us = host_now_us() - start;
+    }
+}
+
+static void btc_task(void* param)
+{
+    uint8_t seq = 0;
+
+    for (int i = 0; i < btc_trace_num; i++) {
+        for (int n = 0; n < btc_trace[i].num; n++) {
+            btc_post(btc_trace[i].src, btc_trace[i].event, ++seq);
+        }
+        vTaskDelay(pdMS_TO_TICKS(btc_trace[i].gap_ms));
+    }
+    btc_done = true;
+    vTaskDelete(NULL);
+}
+
+static void run(const struct _step* steps, int num, bool disp, UBaseType_t prio)
+{
+    log_num         = 0;
+    cb_max_us       = 0;
+    depth_max       = 0;
+    btc_done        = false;
+    use_disp        = disp;
+    btc_trace       = steps;
+    btc_trace_num   = num;
+    CHECK(xTaskCreate(btc_task, "btc", 4096, NULL, prio, NULL) == pdPASS);
+    while (!btc_done) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+}
+
+// 配送されたイベントが発生した順になっていること
+static void check_order(const struct _step* steps, int num)
+{
+    int     i = 0;
+    uint8_t seq = 0;
+
+    for (int s = 0; s < num; s++) {
+        for (int n = 0; n < steps[s].num; n++) {
+            seq++;
+            CHECK(i < log_num);
+            CHECK(log_buf[i].src == steps[s].src && log_buf[i].event == steps[s].event);
+            CHECK(steps[s].event != ESP_BT_GAP_DISC_RES_EVT || log_buf[i].seq == seq);
+            CHECK(steps[s].event != ESP_SPP_DATA_IND_EVT || log_buf[i].seq == seq);
+            i++;
+        }
+    }
+    CHECK(i == log_num);
+}
+
+int main(void)
+{
+    static const struct _step   overflow[] = {
+        { "inquiry overflow",       DISP_SRC_GAP, ESP_BT_GAP_DISC_RES_EVT,  SPP_DISP_QUEUE_LEN + 14, 0 },
+        { "disconnect (CLOSE)",     DISP_SRC_SPP, ESP_SPP_CLOSE_EVT,        1,  200 },
+    };
+    const int                   trace_num = sizeof(trace) / sizeof(trace[0]);
+    struct _spp_disp_stat       st;
+    uint32_t                    inline_max_us;
+    uint32_t                    batches;
+
+    // 従来 : コールバックの中でハンドラを呼ぶ
+    run(trace, trace_num, false, BTC_PRIO);
+    check_order(trace, trace_num);
+    inline_max_us = cb_max_us;
+
+    // 配送タスク経由
+    CHECK(spp_disp_init() == ESP_OK);
+    CHECK(spp_disp_register_gap(gap_handler) == ESP_OK);
+    CHECK(spp_disp_register_spp(spp_handler) == ESP_OK);
+    run(trace, BURST_STEP, true, BTC_PRIO);
+    check_order(trace, BURST_STEP);
+    spp_disp_get_stat(&st);
+    batches = st.batches;
+    run(&trace[BURST_STEP], trace_num - BURST_STEP, true, BTC_PRIO);
+    spp_disp_get_stat(&st);
+    batches = st.batches - batches;
+    check_order(&trace[BURST_STEP], trace_num - BURST_STEP);
+
+    printf("mode      callback max(us)  dispatch latency min/avg/max(us)  batches(max)\n");
+    printf("inline    %16u  %32s  %s\n", inline_max_us, "-", "-");
+    printf("dispatch  %16u  %10u / %8u / %8u  %u(%u)\n", cb_max_us,
+            st.lat_us_min, (uint32_t)(st.lat_us_sum / st.dispatched), st.lat_us_max, st.batches, st.batch_max);
+    spp_disp_show();
+
+    // 1. コールバックでかかる時間
+    CHECK(inline_max_us == handler_us(DISP_SRC_SPP, ESP_SPP_SRV_OPEN_EVT));
+    CHECK(cb_max_us <= CALLBACK_MAX_US);
+    // 2. inquiry結果の連続は SPP_DISP_BATCH_MAX 個ずつ(残りの2区間は1個ずつ)
+    CHECK(batches == (trace[BURST_STEP].num + SPP_DISP_BATCH_MAX - 1) / SPP_DISP_BATCH_MAX + 2);
+    CHECK(st.batch_max == SPP_DISP_BATCH_MAX);
+    CHECK(st.dropped == 0 && st.stalled == 0 && st.truncated == 0 && st.depth == 0);
+
+    // 4. 空きがない : inquiry結果は捨て、CLOSE は空くまで待って配送する
+    run(overflow, 2, true, BTC_PRIO);
+    spp_disp_get_stat(&st);
+    spp_disp_show();
+    CHECK(st.dropped == 14 && st.stalled == 1 && st.depth == 0);
+    CHECK(log_num == SPP_DISP_QUEUE_LEN + 1);
+    for (int i = 0; i < SPP_DISP_QUEUE_LEN; i++) {
+        CHECK(log_buf[i].event == ESP_BT_GAP_DISC_RES_EVT && log_buf[i].seq == i + 1);
+    }
+    CHECK(log_buf[SPP_DISP_QUEUE_LEN].src == DISP_SRC_SPP && log_buf[SPP_DISP_QUEUE_LEN].event == ESP_SPP_CLOSE_EVT);
+
+    // 5. 配送タスクよりも優先度の低いタスクから(キューに入れるとすぐに配送タスクに切り替わる)
+    run(trace, trace_num, true, LOW_PRIO);
+    check_order(trace, trace_num);
+    spp_disp_get_stat(&st);
+    printf("low priority caller : handler saw depth max %u\n", depth_max);
+    CHECK(depth_max <= SPP_DISP_QUEUE_LEN);
+    CHECK(st.depth == 0);
+    printf("test_disp : OK\n");
+    return 0;
+}
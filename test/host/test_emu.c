@@ -0,0 +1,83 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP接続の模擬(host/spp_emu.c)とエコーバックの計測(host/spp_emu_bench.c)の試験
+//     遅延、ゆらぎ、損失、輻輳、切断と再接続のあるリンクで spp_emu_bench を実行する
+//     1. 同じ seed なら出力は毎回同じ、seed を変えると変わる
+//     2. 時刻を指定した切断のたびに ESP_SPP_CLOSE_EVT → 次の listen handle への再接続で
+//        サーバが接続を受け付け直し、切断した接続はすべて解放されてバッファも返却される
+//     3. 障害のないリンクではエコーバックしたデータは失われない
+
+#include "host_test.h"
+
+#define BENCH_OUT       "test_emu.out"
+#define BENCH_LINK      "-l 15 -j 5 -b 700 -p 0.05 -c 2000:200 -d 4000 -R 300 -t 10"
+#define OUT_MAX         4096
+
+// spp_emu_bench を実行し、出力を out に返す
+static void bench(const char* args, char* out, size_t size)
+{
+    char    cmd[256];
+    FILE*   fp;
+    size_t  len;
+
+    snprintf(cmd, sizeof(cmd), "./spp_emu_bench %s > %s", args, BENCH_OUT);
+    CHECK(system(cmd) == 0);
+    fp = fopen(BENCH_OUT, "r");
+    CHECK(fp != NULL);
+    len = fread(out, 1, size - 1, fp);
+    out[len] = '\0';
+    fclose(fp);
+}
+
+// prefix で始まる行
+static const char* line_of(const char* out, const char* prefix)
+{
+    const char* p = strstr(out, prefix);
+
+    CHECK(p != NULL);
+    return p;
+}
+
+int main(void)
+{
+    static char     out1[OUT_MAX], out2[OUT_MAX], out3[OUT_MAX];
+    unsigned        opens, closes, local, cong;
+    unsigned        accepted, closed, active, released, free_num, buf_num;
+    unsigned long long  sent, echoed, lost;
+
+    // 1. 同じ seed なら同じ
+    bench(BENCH_LINK " -S 7", out1, sizeof(out1));
+    bench(BENCH_LINK " -S 7", out2, sizeof(out2));
+    bench(BENCH_LINK " -S 8", out3, sizeof(out3));
+    printf("%s", out1);
+    CHECK(strcmp(out1, out2) == 0);
+    CHECK(strcmp(strchr(out1, '\n'), strchr(out3, '\n')) != 0);
+    CHECK(sscanf(line_of(out1, "events"), "events : open %u  close %u (local %u)  congestion %u", &opens, &closes, &local, &cong) == 4);
+    CHECK(cong > 0);
+
+    // 2. 時刻を指定した切断と再接続
+    bench("-l 10 -D 2000,5000,8000 -R 300 -t 10", out1, sizeof(out1));
+    printf("%s", out1);
+    CHECK(sscanf(line_of(out1, "events"), "events : open %u  close %u (local %u)", &opens, &closes, &local) == 3);
+    CHECK(opens == 4 && closes == 3 && local == 0);
+    CHECK(sscanf(line_of(out1, "device"), "device : accepted %u  closed %u  active %u  released %u  buffers free %u / %u",
+                 &accepted, &closed, &active, &released, &free_num, &buf_num) == 6);
+    CHECK(accepted == 4 && closed == 3 && active == 1 && released == 3);
+    CHECK(free_num == buf_num);
+
+    // 3. 障害のないリンク
+    bench("-l 10 -t 5", out1, sizeof(out1));
+    printf("%s", out1);
+    CHECK(sscanf(line_of(out1, "sent"), "sent %llu byte  echoed %llu byte  lost %llu byte", &sent, &echoed, &lost) == 3);
+    CHECK(echoed > 0 && lost == 0 && sent - echoed <= 4096);
+
+    unlink(BENCH_OUT);
+    printf("test_emu : OK\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// ポーリング間隔の制御(spp_link_policy_step)の試験
+//     SPP_LINK_TICK_MS ごとの転送量の記録(トレース)を順に与えて、区間ごとの状態と切り替え回数を確認する
+//     休止中にするのは、転送量が SPP_LINK_IDLE_RATE 未満になってからちょうど SPP_LINK_IDLE_MS 後
+
+#include "host_test.h"
+
+#include "spp_user_hdr.h"
+#include "spp_link.h"
+
+// トレースの区間 : ticks 周期の間、every 周期ごとに bytes を転送する
+struct _phase {
+    struct _test_phase  ph;             // 先頭に置く(test_trace_phase() に渡す)
+    uint32_t            bytes;
+    uint32_t            every;
+};
+
+static const struct _phase trace[] = {
+    { { "idle after connect",           20,     LINK_ST_IDLE,   0 },    0,                      1 },
+    { { "keystrokes (< burst)",         50,     LINK_ST_IDLE,   0 },    20,                     5 },
+    { { "file transfer",                30,     LINK_ST_ACTIVE, 1 },    4000,                   1 },
+    { { "echo session 400 byte/s",      60,     LINK_ST_ACTIVE, 0 },    40,                     1 },
+    { { "trickle 100 byte/s",           60,     LINK_ST_IDLE,   1 },    10,                     1 },
+    { { "echo while idle (< burst)",    30,     LINK_ST_IDLE,   0 },    40,                     1 },
+    { { "burst every 1 s",              100,    LINK_ST_ACTIVE, 1 },    100,                    10 },
+    { { "quiet",                        50,     LINK_ST_IDLE,   1 },    0,                      1 },
+    { { "single burst",                 1,      LINK_ST_ACTIVE, 1 },    SPP_LINK_BURST_BYTES,   1 },
+    { { "quiet again",                  50,     LINK_ST_IDLE,   1 },    0,                      1 },
+};
+
+static const char* const        state_name[] = { [LINK_ST_IDLE] = "idle", [LINK_ST_ACTIVE] = "active" };
+static struct _spp_link_policy  policy;
+static uint32_t                 busy_tick = 0;      // 最後に休止候補でなかった周期
+
+static int policy_step(struct _test_trace* tr, const struct _test_phase* ph, uint32_t t)
+{
+    const struct _phase*    phase = (const struct _phase*)ph;
+    uint32_t                bytes = (t % phase->every == 0) ? phase->bytes : 0;
+    uint32_t                poll = spp_link_policy_step(&policy, bytes, SPP_LINK_TICK_MS);
+
+    CHECK(poll == ((policy.state == LINK_ST_ACTIVE) ? SPP_LINK_POLL_ACTIVE : SPP_LINK_POLL_IDLE));
+    if (bytes >= SPP_LINK_BURST_BYTES || policy.rate >= SPP_LINK_IDLE_RATE) {
+        busy_tick = tr->tick;
+    }
+    if (policy.state != tr->state && policy.state == LINK_ST_IDLE) {
+        CHECK((tr->tick - busy_tick) * SPP_LINK_TICK_MS == SPP_LINK_IDLE_MS);
+    }
+    return policy.state;
+}
+
+int main(void)
+{
+    struct _test_trace  tr;
+
+    memset(&policy, 0, sizeof(policy));
+    test_trace_start(&tr, state_name, policy.state);
+    for (int i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+        test_trace_phase(&tr, &trace[i].ph, policy_step);
+    }
+    printf("test_link_policy : OK\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// リンク品質の判定(spp_link_quality_step)の試験
+//     SPP_LINK_RSSI_MS ごとの RSSI delta の記録(トレース)を順に与えて、区間ごとの品質と切り替え回数を確認する
+//     - 1回だけの落ち込みでは品質を下げない(平滑化)
+//     - 閾値付近で揺れても上がる方向はヒステリシス分必要なので、ばたつかない
+
+#include "host_test.h"
+
+#include "spp_user_hdr.h"
+#include "spp_link.h"
+
+// トレースの区間 : from から to まで1サンプルごとに step ずつ変える(step = 0 なら from/to を交互に ticks 回)
+struct _phase {
+    struct _test_phase  ph;             // 先頭に置く(test_trace_phase() に渡す)
+    int8_t              from;
+    int8_t              to;
+    int8_t              step;
+};
+
+static const struct _phase trace[] = {
+    { { "in range",                     10, LINK_Q_GOOD, 0 },   0,   0,   0 },
+    { { "single dip -12 dB",            1,  LINK_Q_GOOD, 0 },   -12, 0,   0 },
+    { { "back in range",                10, LINK_Q_GOOD, 0 },   0,   0,   0 },
+    { { "walk away to -20 dB",          20, LINK_Q_POOR, 2 },   -1,  -20, -1 },
+    { { "hold -20 dB",                  10, LINK_Q_POOR, 0 },   -20, -20, 0 },
+    { { "hover -14/-16 dB",             20, LINK_Q_POOR, 0 },   -14, -16, 0 },
+    { { "step up to -8 dB",             10, LINK_Q_FAIR, 1 },   -8,  -8,  0 },
+    { { "hover -4/-6 dB",               20, LINK_Q_FAIR, 0 },   -4,  -6,  0 },
+    { { "recover to 0 dB",              10, LINK_Q_GOOD, 1 },   0,   0,   0 },
+    { { "hover -4/-7 dB from good",     20, LINK_Q_GOOD, 0 },   -4,  -7,  0 },
+    { { "drop to -30 dB",               10, LINK_Q_POOR, 2 },   -30, -30, 0 },
+};
+
+static const char* const        level_name[LINK_Q_NUM] = { [LINK_Q_GOOD] = "good", [LINK_Q_FAIR] = "fair", [LINK_Q_POOR] = "poor" };
+static struct _spp_link_quality quality;
+
+static int quality_step(struct _test_trace* tr, const struct _test_phase* ph, uint32_t t)
+{
+    const struct _phase*    phase = (const struct _phase*)ph;
+    int8_t                  rssi = (phase->step != 0) ? phase->from + phase->step * (int)t : (t % 2 == 0) ? phase->from : phase->to;
+    uint8_t                 level = spp_link_quality_step(&quality, rssi);
+
+    CHECK(level == quality.level && quality.valid);
+    // 下がるのは平滑値が閾値を下回ったとき、上がるのはヒステリシス分上回ったとき
+    if (level > tr->state) {
+        CHECK(quality.avg_x16 / 16 < ((level == LINK_Q_POOR) ? LINK_Q_POOR_DB : LINK_Q_FAIR_DB));
+    }
+    else if (level < tr->state) {
+        CHECK(quality.avg_x16 / 16 >= ((level == LINK_Q_GOOD) ? LINK_Q_FAIR_DB : LINK_Q_POOR_DB) + SPP_LINK_RSSI_HYST);
+    }
+    return level;
+}
+
+int main(void)
+{
+    struct _test_trace  tr;
+
+    memset(&quality, 0, sizeof(quality));
+    test_trace_start(&tr, level_name, quality.level);
+    for (int i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+        test_trace_phase(&tr, &trace[i].ph, quality_step);
+    }
+    printf("test_link_quality : OK\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// メトリクスのデータタスク(spp_metrics_task)の試験
+//     輻輳と短い write() が続くリンクで 'D' 'S' 'S' を要求する
+//     1. 応答は途中で切れずに要求の順に届き、各応答の先頭の長さ(len)は応答全体の長さと一致する
+//     2. 'D' の応答は spp_metrics_describe() の結果と同じ
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_metrics.h"
+#include "host_conn.h"
+
+#define WAIT_MS         10000
+
+// write() 1回で受け付けるバイト数(0:輻輳)
+static const int    write_sizes[] = { 0, 7, 0, 0, 100, 3, 0, 64 };
+
+static uint32_t get32(const uint8_t* p)
+{
+    uint32_t    v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+int main(void)
+{
+    static const char   req[] = "DSS";
+    struct _test_link   link;
+    uint8_t             desc[SPP_METRICS_SNAP_MAX];
+    int                 desc_len;
+    size_t              pos;
+    size_t              last = 0;
+    int                 conn;
+
+    CHECK(spp_metrics_init() == ESP_OK);
+    desc_len = spp_metrics_describe(desc, sizeof(desc));
+    CHECK(desc_len > 0 && get32(desc) == desc_len);
+
+    test_link_open(&link, write_sizes, sizeof(write_sizes) / sizeof(write_sizes[0]));
+    test_link_push(&link, req, strlen(req));
+    conn = test_conn_open(link.fd, spp_metrics_task);
+    CHECK(conn >= 0);
+    // 送信が止まるまで待つ
+    for (int ms = 0; ms == 0 || link.tx_len != last; ms += 500) {
+        CHECK(ms < WAIT_MS);
+        last = link.tx_len;
+        vTaskDelay(pdMS_TO_TICKS(500));
+    }
+    printf("%u byte  writes %u (short %u)\n", (unsigned)link.tx_len, link.writes, link.short_writes);
+    CHECK(link.short_writes > 0);
+
+    // 1. 'D'
+    CHECK(link.tx_len >= 4 && get32(link.tx) == desc_len);
+    CHECK(memcmp(link.tx, desc, desc_len) == 0);
+    pos = desc_len;
+    // 1. 'S' x 2
+    for (int i = 0; i < 2; i++) {
+        const uint8_t*  p = &link.tx[pos];
+        uint32_t        len;
+
+        CHECK(pos + 8 <= link.tx_len);
+        CHECK(p[0] == 'M' && p[1] == 'T' && p[2] == 2 && p[3] == MET_NUM);
+        len = get32(&p[4]);
+        printf("snapshot %d : %u byte\n", i, len);
+        CHECK(len > 8 && pos + len <= link.tx_len);
+        pos += len;
+    }
+    CHECK(pos == link.tx_len);
+
+    test_conn_close(conn);
+    test_link_close(&link);
+    printf("test_metrics : OK\n");
+    return 0;
+}
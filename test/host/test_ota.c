@@ -0,0 +1,238 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// SPP経由のOTAの再開の試験(ファイル上のパーティションとNVS)
+//     1. 途中で切断 → 切断時に保存した位置(セクタ境界)から再開する
+//     2. 電源断(切断時の保存がない) → 64KBごとに保存した位置から再開する
+//     3. 続きを送って OTA_END → ハッシュが一致してブートパーティションが切り替わる
+//     別のイメージで OTA_BEGIN したら先頭から、オフセットがずれた OTA_DATA には NAK を返す
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "nvs_flash.h"
+#include "mbedtls/sha256.h"
+
+#include "spp_user_hdr.h"
+#include "spp_ota.h"
+#include "host_conn.h"
+
+#define IMAGE_SIZE      (300 * 1024 + 123)
+#define PART_SIZE       (320 * 1024)
+#define FRAME_LEN       1000
+#define NVS_FILE        "test_ota_nvs.bin"
+#define NVS_LOST_FILE   "test_ota_nvs_lost.bin"
+
+static uint8_t                  image[IMAGE_SIZE];
+static uint8_t                  image_sha[32];
+static const esp_partition_t*   part_ota0;
+
+struct _peer {
+    struct _test_link   link;
+    int                 conn;
+    size_t              rsp_pos;        // 読んだ応答の位置
+    uint32_t            acked;          // 最後のACK
+};
+
+// ================================================================================================
+// 接続(OTAデータタスクを生成)
+// ================================================================================================
+static void peer_open(struct _peer* peer)
+{
+    memset(peer, 0, sizeof(*peer));
+    test_link_open(&peer->link, NULL, 0);
+    peer->conn = test_conn_open(peer->link.fd, spp_ota_task);
+    CHECK(peer->conn >= 0);
+}
+
+// 切断してOTAデータタスクの終了を待つ
+static void peer_close(struct _peer* peer)
+{
+    peer->link.closed = true;
+    test_conn_close(peer->conn);
+    test_link_close(&peer->link);
+}
+
+static void peer_req(struct _peer* peer, uint8_t type, uint8_t flags, uint32_t offset, const void* payload, uint16_t len)
+{
+    struct _spp_ota_req_hdr hdr = { .type = type, .flags = flags, .len = len, .offset = offset };
+
+    test_link_send(&peer->link, &hdr, sizeof(hdr));
+    test_link_send(&peer->link, payload, len);
+}
+
+// ================================================================================================
+// 届いている応答を1つ読む(ACKは記録する)
+// ================================================================================================
+static bool peer_rsp(struct _peer* peer, struct _spp_ota_rsp* rsp)
+{
+    if (peer->link.tx_len < peer->rsp_pos + sizeof(*rsp)) {
+        return false;
+    }
+    memcpy(rsp, &peer->link.tx[peer->rsp_pos], sizeof(*rsp));
+    peer->rsp_pos += sizeof(*rsp);
+    if (rsp->type == OTA_RSP_ACK) {
+        CHECK(rsp->offset >= peer->acked);
+        peer->acked = rsp->offset;
+    }
+    return true;
+}
+
+// type の応答を待つ(途中の応答は読み飛ばす)
+static struct _spp_ota_rsp peer_wait(struct _peer* peer, uint8_t type)
+{
+    struct _spp_ota_rsp rsp;
+
+    for (int wait = 0; wait < 1000; ) {
+        if (!peer_rsp(peer, &rsp)) {
+            vTaskDelay(1);
+            wait++;
+        }
+        else if (rsp.type == type) {
+            return rsp;
+        }
+    }
+    printf("no response 0x%02x\n", type);
+    exit(1);
+}
+
+static uint32_t peer_begin(struct _peer* peer, const uint8_t* sha)
+{
+    uint8_t             payload[sizeof(uint32_t) + 32];
+    uint32_t            size = IMAGE_SIZE;
+    struct _spp_ota_rsp rsp;
+
+    memcpy(payload, &size, sizeof(size));
+    memcpy(&payload[sizeof(size)], sha, 32);
+    peer_req(peer, OTA_BEGIN, 0, 0, payload, sizeof(payload));
+    rsp = peer_wait(peer, OTA_RSP_BEGIN);
+    CHECK(rsp.status == OTA_ST_OK);
+    return rsp.offset;
+}
+
+// from から to まで送る
+static void peer_data(struct _peer* peer, uint32_t from, uint32_t to)
+{
+    for (uint32_t off = from; off < to; off += FRAME_LEN) {
+        uint32_t len = (to - off < FRAME_LEN) ? to - off : FRAME_LEN;
+        peer_req(peer, OTA_DATA, 0, off, &image[off], len);
+    }
+}
+
+// ================================================================================================
+// NVSの再読み込み(再起動)
+// ================================================================================================
+static void reboot_nvs(const char* path)
+{
+    host_nvs_file(path);
+    CHECK(nvs_flash_init() == ESP_OK);
+}
+
+static void copy_file(const char* from, const char* to)
+{
+    uint8_t buf[4096];
+    size_t  n;
+    FILE*   in  = fopen(from, "rb");
+    FILE*   out = fopen(to, "wb");
+
+    CHECK(in != NULL && out != NULL);
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, n, out);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+int main(void)
+{
+    struct _peer            peer;
+    struct _spp_ota_rsp     rsp;
+    mbedtls_sha256_context  sha;
+    uint8_t                 other_sha[32];
+    uint8_t                 buf[4096];
+    uint32_t                resume;
+
+    unlink(NVS_FILE);
+    unlink(NVS_LOST_FILE);
+    unlink("test_ota_0.bin");
+    unlink("test_ota_1.bin");
+    CHECK(host_partition_file("factory", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, "test_ota_factory.bin", 64 * 1024) != NULL);
+    part_ota0 = host_partition_file("ota_0", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, "test_ota_0.bin", PART_SIZE);
+    CHECK(part_ota0 != NULL);
+    CHECK(host_partition_file("ota_1", ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, "test_ota_1.bin", PART_SIZE) != NULL);
+    reboot_nvs(NVS_FILE);
+
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = (uint8_t)((i * 2654435761u) >> 13);
+    }
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    mbedtls_sha256_update_ret(&sha, image, IMAGE_SIZE);
+    mbedtls_sha256_finish_ret(&sha, image_sha);
+    memcpy(other_sha, image_sha, sizeof(other_sha));
+    other_sha[0] ^= 1;
+
+    // 1. 150000byte まで送って切断
+    peer_open(&peer);
+    CHECK(peer_begin(&peer, image_sha) == 0);
+    peer_data(&peer, 0, 150000);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    while (peer_rsp(&peer, &rsp)) {
+        CHECK(rsp.type == OTA_RSP_ACK);
+    }
+    CHECK(peer.acked >= 131072);
+    copy_file(NVS_FILE, NVS_LOST_FILE);         // 切断前の状態(電源断の場合)
+    peer_close(&peer);
+
+    reboot_nvs(NVS_FILE);
+    peer_open(&peer);
+    resume = peer_begin(&peer, image_sha);
+    printf("resume after disconnect : %u\n", resume);
+    CHECK(resume == (150000 & ~4095));
+    peer_close(&peer);
+
+    // 2. 電源断 → 64KBごとの保存位置から
+    reboot_nvs(NVS_LOST_FILE);
+    peer_open(&peer);
+    resume = peer_begin(&peer, image_sha);
+    printf("resume after power loss : %u\n", resume);
+    CHECK(resume == 131072);
+
+    // オフセットがずれたフレームは NAK(期待する位置)
+    peer_req(&peer, OTA_DATA, 0, resume + FRAME_LEN, &image[resume + FRAME_LEN], FRAME_LEN);
+    rsp = peer_wait(&peer, OTA_RSP_NAK);
+    CHECK(rsp.status == OTA_ST_OFFSET && rsp.offset == resume);
+
+    // 3. 続きを送って完了
+    peer_data(&peer, resume, IMAGE_SIZE);
+    peer_req(&peer, OTA_END, 0, 0, NULL, 0);
+    rsp = peer_wait(&peer, OTA_RSP_END);
+    CHECK(rsp.status == OTA_ST_OK && rsp.offset == IMAGE_SIZE);
+    CHECK(esp_ota_get_boot_partition() == part_ota0);
+    for (uint32_t off = 0; off < IMAGE_SIZE; off += sizeof(buf)) {
+        uint32_t n = (IMAGE_SIZE - off < sizeof(buf)) ? IMAGE_SIZE - off : sizeof(buf);
+        CHECK(esp_partition_read(part_ota0, off, buf, n) == ESP_OK);
+        CHECK(memcmp(buf, &image[off], n) == 0);
+    }
+
+    // 完了後は再開しない、別のイメージも先頭から
+    CHECK(peer_begin(&peer, image_sha) == 0);
+    CHECK(peer_begin(&peer, other_sha) == 0);
+    peer_req(&peer, OTA_ABORT, 0, 0, NULL, 0);
+    peer_close(&peer);
+
+    unlink(NVS_FILE);
+    unlink(NVS_LOST_FILE);
+    unlink("test_ota_factory.bin");
+    unlink("test_ota_0.bin");
+    unlink("test_ota_1.bin");
+    printf("test_ota : OK\n");
+    return 0;
+}
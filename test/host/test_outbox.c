@@ -0,0 +1,297 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// outbox の試験(ファイル上のパーティション)
+//     - write() が途中までしか書けなくてもレコードの区切りが崩れないこと
+//     - ACKフレームが分割/連結/データに挟まれていても取り出せること、エスケープした 0xA5 がデータに戻ること
+//     - 再起動(同じファイルで初期化しなおし)後は確認済みのレコードを再送しないこと
+//     - 一杯になったら古いセクタを捨て、残りは欠けずに送ること
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+
+#include "spp_outbox.h"
+
+#define PART_FILE       "test_outbox.bin"
+#define PART_SIZE       (OUTBOX_SECTOR_SIZE * 4)
+
+// 受信側で切り出したレコード
+struct _rx_rec {
+    uint32_t    seq;
+    uint32_t    idx;
+};
+
+// ================================================================================================
+// 試験データ(idx番目)
+// ================================================================================================
+static uint32_t rec_make(uint32_t idx, uint8_t* buf)
+{
+    uint32_t    len = 8 + (idx * 37) % 200;
+
+    memcpy(buf, &idx, sizeof(idx));
+    for (uint32_t i = sizeof(idx); i < len; i++) {
+        buf[i] = (uint8_t)(idx * 7 + i);
+    }
+    return len;
+}
+
+// ================================================================================================
+// 受信側のレコード切り出し(区切りやチェックサムが崩れていたら失敗)
+// ================================================================================================
+static int rx_parse(const uint8_t* data, size_t len, struct _rx_rec* rec, int max)
+{
+    size_t  pos = 0;
+    int     num = 0;
+
+    while (pos < len) {
+        struct _outbox_rec_hdr  hdr;
+        uint8_t                 expect[OUTBOX_BATCH_SIZE];
+        uint8_t                 sum = 0;
+
+        CHECK(pos + sizeof(hdr) <= len);
+        memcpy(&hdr, &data[pos], sizeof(hdr));
+        CHECK(hdr.magic == OUTBOX_REC_MAGIC);
+        CHECK(hdr.type == OUTBOX_REC_DATA);
+        CHECK(pos + sizeof(hdr) + hdr.len <= len);
+        for (int i = 0; i < hdr.len; i++) {
+            sum += data[pos + sizeof(hdr) + i];
+        }
+        CHECK(sum == hdr.sum);
+        CHECK(num < max);
+        memcpy(&rec[num].idx, &data[pos + sizeof(hdr)], sizeof(uint32_t));
+        rec[num].seq = hdr.seq;
+        CHECK(rec_make(rec[num].idx, expect) == hdr.len);
+        CHECK(memcmp(expect, &data[pos + sizeof(hdr)], hdr.len) == 0);
+        CHECK(num == 0 || (rec[num].seq > rec[num - 1].seq && rec[num].idx == rec[num - 1].idx + 1));
+        num++;
+        pos += (sizeof(hdr) + hdr.len + 3) & ~3;
+    }
+    CHECK(pos == len);
+    return num;
+}
+
+static void put_records(uint32_t from, uint32_t num)
+{
+    uint8_t     buf[OUTBOX_BATCH_SIZE];
+
+    for (uint32_t i = from; i < from + num; i++) {
+        CHECK(spp_outbox_put(buf, rec_make(i, buf)) == ESP_OK);
+    }
+}
+
+static void boot(void)
+{
+    CHECK(host_partition_file(OUTBOX_PARTITION_LABEL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PART_FILE, PART_SIZE) != NULL);
+    CHECK(spp_outbox_init() == ESP_OK);
+}
+
+// ================================================================================================
+// 短い write() でも区切りが崩れない
+// ================================================================================================
+static void test_short_write(void)
+{
+    static const int    sizes[] = { 0, 7, 50, 0, 300, 1, 13 };
+    struct _test_link   link;
+    struct _rx_rec      rec[64];
+    struct _outbox_stat stat;
+
+    unlink(PART_FILE);
+    boot();
+    put_records(0, 40);
+
+    test_link_open(&link, sizes, sizeof(sizes) / sizeof(sizes[0]));
+    spp_outbox_link_up(link.fd);
+    vTaskDelay(pdMS_TO_TICKS(10000));
+
+    CHECK(link.short_writes > 0);
+    CHECK(rx_parse(link.tx, link.tx_len, rec, 64) == 40);
+    CHECK(rec[0].idx == 0);
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.sent_seq == rec[39].seq);
+
+    spp_outbox_link_down(link.fd);
+    test_link_close(&link);
+    printf("short write : %u writes (%u short) %u bytes\n", link.writes, link.short_writes, (unsigned)link.tx_len);
+}
+
+// ================================================================================================
+// ACKフレームの取り出し
+// ================================================================================================
+static void test_ack_stream(void)
+{
+    struct _test_link   link;
+    struct _rx_rec      rec[64];
+    struct _outbox_stat stat;
+    uint8_t             in[64];
+    uint8_t             out[64];
+    int                 out_len = 0;
+    int                 n = 0;
+    uint32_t            seq5, seq10;
+
+    unlink(PART_FILE);
+    boot();
+    put_records(0, 20);
+    test_link_open(&link, NULL, 0);
+    spp_outbox_link_up(link.fd);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(rx_parse(link.tx, link.tx_len, rec, 64) == 20);
+    seq5  = rec[4].seq;
+    seq10 = rec[9].seq;
+
+    // "ab" ACK(seq5)の前半 | 後半 "c" エスケープした0xA5 | 0xA5だけ | 'K'...(seq10) "d"
+    in[n++] = 'a';
+    in[n++] = 'b';
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    in[n++] = OUTBOX_ACK_MAGIC1;
+    in[n++] = seq5 & 0xff;
+    out_len += spp_outbox_rx(link.fd, in, n);
+    memcpy(&out[0], in, out_len);
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.acked_seq == 0);
+
+    n = 0;
+    in[n++] = (seq5 >> 8) & 0xff;
+    in[n++] = (seq5 >> 16) & 0xff;
+    in[n++] = (seq5 >> 24) & 0xff;
+    in[n++] = 'c';
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    n = spp_outbox_rx(link.fd, in, n);
+    memcpy(&out[out_len], in, n);
+    out_len += n;
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.acked_seq == seq5);
+
+    n = 0;
+    in[n++] = OUTBOX_ACK_MAGIC1;
+    memcpy(&in[n], &seq10, sizeof(seq10));
+    n += sizeof(seq10);
+    in[n++] = 'd';
+    n = spp_outbox_rx(link.fd, in, n);
+    memcpy(&out[out_len], in, n);
+    out_len += n;
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.acked_seq == seq10);
+
+    // データとしての "0xA5 'K' ..." はエスケープされていればACKにならない
+    n = 0;
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    in[n++] = OUTBOX_ACK_MAGIC0;
+    in[n++] = OUTBOX_ACK_MAGIC1;
+    memset(&in[n], 0xff, 4);
+    n += 4;
+    n = spp_outbox_rx(link.fd, in, n);
+    memcpy(&out[out_len], in, n);
+    out_len += n;
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.acked_seq == seq10);
+
+    static const uint8_t expect[] = { 'a', 'b', 'c', OUTBOX_ACK_MAGIC0, 'd', OUTBOX_ACK_MAGIC0, OUTBOX_ACK_MAGIC1, 0xff, 0xff, 0xff, 0xff };
+    CHECK(out_len == sizeof(expect));
+    CHECK(memcmp(out, expect, sizeof(expect)) == 0);
+    CHECK(stat.rx_errors == 0);
+
+    // ACKフレームだけなら0を返す(2つ連結)
+    n = 0;
+    for (int i = 10; i < 12; i++) {
+        in[n++] = OUTBOX_ACK_MAGIC0;
+        in[n++] = OUTBOX_ACK_MAGIC1;
+        memcpy(&in[n], &rec[i].seq, sizeof(uint32_t));
+        n += sizeof(uint32_t);
+    }
+    CHECK(spp_outbox_rx(link.fd, in, n) == 0);
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.acked_seq == rec[11].seq);
+
+    // 別の fd のデータはそのまま
+    in[0] = OUTBOX_ACK_MAGIC0;
+    CHECK(spp_outbox_rx(link.fd + 100, in, 1) == 1);
+
+    spp_outbox_link_down(link.fd);
+    test_link_close(&link);
+}
+
+// ================================================================================================
+// 再起動後は確認済みの次から送る
+// ================================================================================================
+static void test_reboot(void)
+{
+    struct _test_link   link;
+    struct _rx_rec      rec[64];
+    uint8_t             ack[OUTBOX_ACK_LEN];
+    uint32_t            acked;
+
+    unlink(PART_FILE);
+    boot();
+    put_records(0, 30);
+    test_link_open(&link, NULL, 0);
+    spp_outbox_link_up(link.fd);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(rx_parse(link.tx, link.tx_len, rec, 64) == 30);
+    acked = rec[17].seq;
+    ack[0] = OUTBOX_ACK_MAGIC0;
+    ack[1] = OUTBOX_ACK_MAGIC1;
+    memcpy(&ack[2], &acked, sizeof(acked));
+    CHECK(spp_outbox_rx(link.fd, ack, sizeof(ack)) == 0);
+    CHECK(spp_outbox_flush() == ESP_OK);
+    spp_outbox_link_down(link.fd);
+    test_link_close(&link);
+
+    // 再起動
+    boot();
+    test_link_open(&link, NULL, 0);
+    spp_outbox_link_up(link.fd);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(rx_parse(link.tx, link.tx_len, rec, 64) == 12);
+    CHECK(rec[0].idx == 18);
+    CHECK(rec[0].seq > acked);
+    spp_outbox_link_down(link.fd);
+    test_link_close(&link);
+}
+
+// ================================================================================================
+// 一杯になったら古いセクタを捨てる
+// ================================================================================================
+static void test_wrap(void)
+{
+    static const int    sizes[] = { 100, 0, 333 };
+    struct _test_link   link;
+    struct _rx_rec      rec[256];
+    struct _outbox_stat stat;
+    int                 num;
+
+    unlink(PART_FILE);
+    boot();
+    put_records(0, 200);            // 約25KB(4セクタには入らない)
+    spp_outbox_get_stat(&stat);
+    CHECK(stat.dropped > 0);
+
+    test_link_open(&link, sizes, sizeof(sizes) / sizeof(sizes[0]));
+    spp_outbox_link_up(link.fd);
+    vTaskDelay(pdMS_TO_TICKS(10000));
+    num = rx_parse(link.tx, link.tx_len, rec, 256);
+    CHECK(num > 0 && num < 200);
+    CHECK(rec[num - 1].idx == 199);
+    printf("wrap : %u sectors dropped, %d records sent\n", stat.dropped, num);
+    spp_outbox_link_down(link.fd);
+    test_link_close(&link);
+}
+
+int main(void)
+{
+    test_short_write();
+    test_ack_stream();
+    test_reboot();
+    test_wrap();
+    unlink(PART_FILE);
+    printf("test_outbox : OK\n");
+    return 0;
+}
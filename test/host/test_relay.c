@@ -0,0 +1,157 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// 中継の試験(遅延と帯域のあるリンク2本で端から端まで)
+//     1. 受信側が遅くて write() が輻輳しても、双方向のデータが欠けずに順番どおり届く
+//     2. 片側が切断したら残った側は新しい接続とペアになり、前の接続のデータは混ざらない
+//     3. すべて切断するとデータタスクが終了し、バッファがすべてプールに戻る
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "spp_relay.h"
+#include "host_conn.h"
+
+#define STREAM_A_TO_B   (96 * 1024)
+#define STREAM_B_TO_A   (24 * 1024)
+#define STREAM_C_TO_B   (16 * 1024)
+
+// 相手側の送受信(片方向のストリーム)
+struct _stream {
+    struct _delay_link* link;
+    uint8_t             seed;
+    uint32_t            len;
+    uint32_t            pos;            // 送った/受け取ったバイト数
+    uint32_t            read_size;      // 受信側の1回の読み込みサイズ
+    uint32_t            read_ms;        // 受信側の読み込み間隔
+    volatile bool       done;
+};
+
+static uint8_t stream_byte(uint8_t seed, uint32_t i)
+{
+    return (uint8_t)(i * 7 + (i >> 8) + seed);
+}
+
+static void writer_task(void* param)
+{
+    struct _stream* s = param;
+    uint8_t         buf[700];
+
+    while (s->pos < s->len) {
+        uint32_t n = (s->len - s->pos < sizeof(buf)) ? s->len - s->pos : sizeof(buf);
+        for (uint32_t i = 0; i < n; i++) {
+            buf[i] = stream_byte(s->seed, s->pos + i);
+        }
+        delay_link_peer_write(s->link, buf, n);
+        s->pos += n;
+    }
+    s->done = true;
+    vTaskDelete(NULL);
+}
+
+static void reader_task(void* param)
+{
+    struct _stream* s = param;
+    uint8_t         buf[1024];
+
+    while (s->pos < s->len) {
+        int n = delay_link_peer_read(s->link, buf, s->read_size, 10 * 1000000);
+        CHECK(n > 0 && s->pos + n <= s->len);
+        for (int i = 0; i < n; i++) {
+            CHECK(buf[i] == stream_byte(s->seed, s->pos + i));
+        }
+        s->pos += n;
+        if (s->read_ms > 0) {
+            vTaskDelay(pdMS_TO_TICKS(s->read_ms));
+        }
+    }
+    s->done = true;
+    vTaskDelete(NULL);
+}
+
+static void stream_start(struct _stream* tx, struct _stream* rx, struct _delay_link* from, struct _delay_link* to,
+                         uint8_t seed, uint32_t len, uint32_t read_size, uint32_t read_ms)
+{
+    memset(tx, 0, sizeof(*tx));
+    memset(rx, 0, sizeof(*rx));
+    tx->link        = from;
+    rx->link        = to;
+    tx->seed        = rx->seed = seed;
+    tx->len         = rx->len  = len;
+    rx->read_size   = read_size;
+    rx->read_ms     = read_ms;
+    CHECK(xTaskCreate(writer_task, "writer", 4096, tx, 4, NULL) == pdPASS);
+    CHECK(xTaskCreate(reader_task, "reader", 4096, rx, 4, NULL) == pdPASS);
+}
+
+static void stream_wait(struct _stream* tx, struct _stream* rx, uint32_t timeout_ms)
+{
+    for (uint32_t ms = 0; !(tx->done && rx->done); ms += 10) {
+        CHECK(ms < timeout_ms);
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+int main(void)
+{
+    struct _delay_link* a;
+    struct _delay_link* b;
+    struct _delay_link* c;
+    struct _stream      ab_tx, ab_rx, ba_tx, ba_rx;
+    uint64_t            start;
+    int                 tasks;
+    int                 conn_a, conn_b, conn_c;
+
+    CHECK(spp_relay_init() == ESP_OK);
+    spp_relay_enable = true;
+    tasks = host_task_count();
+
+    // A(接続を受けた側) : 速いリンク、B(接続した側) : 受信側が遅くクレジットも少ない
+    a = delay_link_open(10, 200 * 1024, 4096);
+    b = delay_link_open(20, 100 * 1024, 1024);
+    conn_a = test_conn_open(a->fd, spp_data_task);
+    conn_b = test_conn_open(b->fd, NULL);
+    CHECK(conn_a >= 0 && conn_b >= 0);
+
+    // 1. 双方向(A→B は B の受信側が 256byte/20ms でしか読まない)
+    start = host_now_us();
+    stream_start(&ab_tx, &ab_rx, a, b, 0x11, STREAM_A_TO_B, 256, 20);
+    stream_start(&ba_tx, &ba_rx, b, a, 0x22, STREAM_B_TO_A, 1024, 0);
+    stream_wait(&ab_tx, &ab_rx, 60 * 1000);
+    stream_wait(&ba_tx, &ba_rx, 60 * 1000);
+    printf("A -> B %u byte  B -> A %u byte  %u ms\n", STREAM_A_TO_B, STREAM_B_TO_A, (unsigned)((host_now_us() - start) / 1000));
+    spp_relay_show();
+
+    // 2. A を切断 → B は新しい接続 C とペアになる
+    a->closed = true;
+    vTaskDelay(pdMS_TO_TICKS(100));
+    CHECK(host_task_count() == tasks + 1);
+    test_conn_close(conn_a);
+    c = delay_link_open(10, 200 * 1024, 4096);
+    conn_c = test_conn_open(c->fd, spp_data_task);
+    CHECK(conn_c >= 0);
+    stream_start(&ab_tx, &ab_rx, c, b, 0x33, STREAM_C_TO_B, 512, 5);
+    stream_wait(&ab_tx, &ab_rx, 30 * 1000);
+    spp_relay_show();
+
+    // 3. すべて切断(クローズイベント) → データタスクが終了してバッファが戻る
+    c->closed = true;
+    b->closed = true;
+    test_conn_close(conn_c);
+    test_conn_close(conn_b);
+    CHECK(host_task_count() == tasks);
+    CHECK(spp_buf_free_num() == SPP_BUF_NUM);
+    delay_link_close(a);
+    delay_link_close(b);
+    delay_link_close(c);
+    printf("test_relay : OK\n");
+    return 0;
+}
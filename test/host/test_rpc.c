@@ -0,0 +1,114 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// RPCの試験
+//     - 1tick未満のタイムアウトを指定した要求も処理される(切り上げ)
+//     - 期限を過ぎた要求には RPC_ST_TIMEOUT、キャンセルした要求には RPC_ST_CANCELLED を1回だけ返す
+//     - write() が途中までしか書けなくても応答フレームが崩れない
+//     - 接続を閉じるとワーカも終了する
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_rpc.h"
+#include "host_conn.h"
+
+static size_t   rsp_pos;
+
+static void req(struct _test_link* link, uint8_t type, uint16_t id, uint16_t method, uint32_t timeout_ms, const void* data, uint16_t len)
+{
+    struct _spp_rpc_hdr hdr = { .type = type, .len = len, .id = id, .method = method, .timeout_ms = timeout_ms };
+
+    test_link_send(link, &hdr, sizeof(hdr));
+    test_link_send(link, data, len);
+}
+
+// 応答を1つ取り出す(なければ false)
+static bool rsp(struct _test_link* link, struct _spp_rpc_hdr* hdr, uint8_t* payload)
+{
+    if (link->tx_len < rsp_pos + sizeof(*hdr)) {
+        return false;
+    }
+    memcpy(hdr, &link->tx[rsp_pos], sizeof(*hdr));
+    CHECK(hdr->type == RPC_RSP && hdr->len <= SPP_RPC_MAX_PAYLOAD);
+    if (link->tx_len < rsp_pos + sizeof(*hdr) + hdr->len) {
+        return false;
+    }
+    memcpy(payload, &link->tx[rsp_pos + sizeof(*hdr)], hdr->len);
+    rsp_pos += sizeof(*hdr) + hdr->len;
+    return true;
+}
+
+int main(void)
+{
+    static const int    sizes[] = { 3, 0, 5, 0, 0, 40 };
+    struct _test_link   link;
+    struct _spp_rpc_hdr hdr;
+    uint8_t             payload[SPP_RPC_MAX_PAYLOAD];
+    uint8_t             echo[200];
+    uint32_t            ms;
+    int                 tasks;
+    int                 conn;
+    bool                got[8] = { false };
+
+    spp_rpc_init();
+    tasks = host_task_count();
+    test_link_open(&link, sizes, sizeof(sizes) / sizeof(sizes[0]));
+    conn = test_conn_open(link.fd, spp_rpc_task);
+    CHECK(conn >= 0);
+
+    // 0 : 1tick未満のタイムアウトの echo → 処理される
+    for (int i = 0; i < sizeof(echo); i++) {
+        echo[i] = i;
+    }
+    req(&link, RPC_REQ, 0, SPP_RPC_M_ECHO, 5, echo, sizeof(echo));
+    // 1 : 100ms の sleep に 30ms のタイムアウト → RPC_ST_TIMEOUT
+    ms = 100;
+    req(&link, RPC_REQ, 1, SPP_RPC_M_SLEEP, 30, &ms, sizeof(ms));
+    // 2 : 500ms の sleep をキャンセル → RPC_ST_CANCELLED
+    ms = 500;
+    req(&link, RPC_REQ, 2, SPP_RPC_M_SLEEP, 0, &ms, sizeof(ms));
+    // 3 : 未登録のメソッド
+    req(&link, RPC_REQ, 3, 0x7fff, 0, NULL, 0);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    req(&link, RPC_CANCEL, 2, SPP_RPC_M_SLEEP, 0, NULL, 0);
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    while (rsp(&link, &hdr, payload)) {
+        CHECK(hdr.id < 4 && !got[hdr.id]);
+        got[hdr.id] = true;
+        switch (hdr.id) {
+          case 0 :
+            CHECK(hdr.status == RPC_ST_OK && hdr.len == sizeof(echo) && memcmp(payload, echo, sizeof(echo)) == 0);
+            break;
+          case 1 :
+            CHECK(hdr.status == RPC_ST_TIMEOUT);
+            break;
+          case 2 :
+            CHECK(hdr.status == RPC_ST_CANCELLED);
+            break;
+          case 3 :
+            CHECK(hdr.status == RPC_ST_NO_METHOD);
+            break;
+        }
+    }
+    CHECK(got[0] && got[1] && got[2] && got[3]);
+    CHECK(rsp_pos == link.tx_len);
+    CHECK(link.short_writes > 0);
+
+    // 切断 → データタスクとワーカが終了する
+    link.closed = true;
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    test_conn_close(conn);
+    CHECK(host_task_count() == tasks);
+    test_link_close(&link);
+    printf("test_rpc : OK\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+// データタスクの配置の試験
+//     1. spp_task_pick_core() : 使用率、割り当て済みタスク数、BTのコアの加算から最も負荷の低いコアを選ぶ
+//     2. 接続を順に追加したときの配置(BTのコアは SPP_TASK_BT_BIAS 分だけ少なく割り当てられる)
+//     3. spp_task_create() : パラメータテーブルの割り当て済みタスク数を使って同じ配置になる
+//        種類ごとのスロットが一杯になったら生成しない(ヒープから割り当てない)
+//     4. spp_open_handler() : データタスクの生成前に確保したパラメータテーブルは割り当て済みに数えず、同じ配置になる
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "spp_user_hdr.h"
+#include "spp_buf.h"
+#include "host_conn.h"
+
+#define CONN_NUM        SPP_TASK_SLOTS_DATA
+
+static volatile bool    release;
+
+static void idle_task(void* param)
+{
+    while (!release) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    vTaskDelete(NULL);
+}
+
+// 接続を順に追加したときの配置
+static void place(const uint32_t util[], int bt_core, int n, int cores[], int assigned[])
+{
+    assigned[0] = assigned[1] = 0;
+    for (int i = 0; i < n; i++) {
+        cores[i] = spp_task_pick_core(util, assigned, 2, bt_core);
+        assigned[cores[i]]++;
+    }
+}
+
+int main(void)
+{
+    static const uint32_t   idle[2] = { 0, 0 };
+    static const uint32_t   busy0[2] = { 60, 10 };
+    int                     assigned[2];
+    int                     cores[16];
+    int                     expected[CONN_NUM];
+
+    // 1. 1回の選択
+    {
+        const uint32_t  util[2] = { 10, 10 };
+        const int       none[2] = { 0, 0 };
+        const int       two0[2] = { 2, 0 };
+        const uint32_t  light0[2] = { 10, 50 };
+        const uint32_t  near0[2] = { 10, 25 };
+
+        CHECK(spp_task_pick_core(util, none, 2, -1) == 0);          // 同じ負荷なら若い番号
+        CHECK(spp_task_pick_core(util, none, 2, 0) == 1);           // BTのコアを避ける
+        CHECK(spp_task_pick_core(util, none, 2, 1) == 0);
+        CHECK(spp_task_pick_core(util, two0, 2, -1) == 1);          // 割り当て済みの少ないコア
+        CHECK(spp_task_pick_core(light0, none, 2, 0) == 0);         // 10+20 < 50 : BTのコアでも空いていれば選ぶ
+        CHECK(spp_task_pick_core(near0, none, 2, 0) == 1);          // 10+20 > 25
+        CHECK(spp_task_pick_core(util, none, 1, 0) == 0);           // シングルコア
+    }
+
+    // 2. 順に追加 : 使用率が同じなら BTのコアは SPP_TASK_BT_BIAS / SPP_TASK_WEIGHT 個少なくなる
+    place(idle, 0, 10, cores, assigned);
+    CHECK(cores[0] == 1 && cores[1] == 1);
+    CHECK(assigned[1] - assigned[0] == SPP_TASK_BT_BIAS / SPP_TASK_WEIGHT);
+    place(idle, -1, 10, cores, assigned);
+    for (int i = 0; i < 10; i++) {
+        CHECK(cores[i] == i % 2);                                   // BTの加算がなければ交互
+    }
+    // 使用率の高いコアには差が埋まるまで割り当てない
+    place(busy0, 0, 9, cores, assigned);
+    for (int i = 0; i < 7; i++) {
+        CHECK(cores[i] == 1);
+    }
+    CHECK(assigned[0] == 1 && assigned[1] == 8);
+
+    // 3. spp_task_create() (ホストでは使用率は 0)
+    CHECK(spp_task_init() == ESP_OK);
+    place(idle, SPP_TASK_BT_CORE, CONN_NUM, expected, assigned);
+    for (int i = 0; i < CONN_NUM; i++) {
+        TaskHandle_t    handle;
+        int             core = -1;
+        CHECK(spp_task_create(idle_task, "place", NULL, SPP_TASK_CLASS_DATA, &handle, &core) == pdPASS);
+        printf("connection %d : core %d\n", i, core);
+        CHECK(core == expected[i]);
+        // 接続時と同じくパラメータテーブルに記録する
+        open_hdr_params[i].use  = true;
+        open_hdr_params[i].core = core;
+    }
+    {
+        TaskHandle_t    handle = NULL;
+        int             core = -1;
+        CHECK(spp_task_create(idle_task, "place", NULL, SPP_TASK_CLASS_DATA, &handle, &core) == pdFAIL);
+    }
+    spp_task_show();
+    spp_task_show_stack();
+    release = true;
+    vTaskDelay(pdMS_TO_TICKS(100));
+    for (int i = 0; i < CONN_NUM; i++) {
+        open_hdr_params[i].use = false;
+    }
+
+    // 4. 接続(spp_open_handler)を順に追加する
+    {
+        static struct _test_link    link[CONN_NUM];
+        int                         conn[CONN_NUM];
+
+        CHECK(spp_buf_init() == ESP_OK);
+        for (int i = 0; i < CONN_NUM; i++) {
+            test_link_open(&link[i], NULL, 0);
+            conn[i] = test_conn_open(link[i].fd, NULL);
+            CHECK(conn[i] >= 0 && open_hdr_params[conn[i]].task_handle != NULL);
+            printf("connection %d (open handler) : core %d\n", i, open_hdr_params[conn[i]].core);
+            CHECK(open_hdr_params[conn[i]].core == expected[i]);
+        }
+        spp_task_show();
+        for (int i = 0; i < CONN_NUM; i++) {
+            test_conn_close(conn[i]);
+            test_link_close(&link[i]);
+        }
+    }
+    printf("test_task_place : OK\n");
+    return 0;
+}